@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "rhxglobals.h"
+#include "pipelinebenchmark.h"
+#include "synthdatablockgenerator.h"
+
+// Headless benchmark of the acquisition pipeline.  With no --run option, every combination of the sweep options is
+// run in a separate child process (so that peak memory is measured per configuration), and the results are written
+// as a JSON array.  With --run, a single configuration is run in this process.
+//
+// Example: IntanRHXBenchmark --sample-rates 20000,30000 --channels max --readers display+disk --output results.json
+
+static QStringList splitList(const QString& value)
+{
+    QStringList items = value.split(',', Qt::SkipEmptyParts);
+    for (QString& item : items) item = item.trimmed();
+    return items;
+}
+
+static bool writeJson(const QJsonDocument& document, const QString& fileName)
+{
+    QByteArray json = document.toJson(QJsonDocument::Indented);
+    if (fileName.isEmpty()) {
+        std::cout << json.toStdString();
+        return true;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Error: could not open " << fileName.toStdString() << " for writing\n";
+        return false;
+    }
+    file.write(json);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // No windows are created, but some engine code paths (e.g., error dialogs) need a QApplication.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    // Keep benchmark settings (e.g., synthMaxChannels) separate from those of the GUI application.
+    QCoreApplication::setOrganizationName(OrganizationName);
+    QCoreApplication::setOrganizationDomain(OrganizationDomain);
+    QCoreApplication::setApplicationName(ApplicationName + "Benchmark");
+
+    QCommandLineParser commandLine;
+    commandLine.setApplicationDescription("Headless throughput and latency benchmark of the Intan RHX acquisition pipeline.");
+    commandLine.addHelpOption();
+    QCommandLineOption controllersOption("controllers", "Controller types: usb2, usb3, stim.", "list", "usb3");
+    QCommandLineOption sampleRatesOption("sample-rates", "Per-channel sample rates in Hz.", "list", "30000");
+    QCommandLineOption channelsOption("channels", "Synthetic headstage set: default, max.", "list", "default,max");
+    QCommandLineOption filterOrdersOption("filter-orders", "Software lowpass and highpass filter orders (1-8).", "list", "2,8");
+    QCommandLineOption fileFormatsOption("file-formats", "Traditional, OneFilePerSignalType, OneFilePerChannel.", "list", "Traditional");
+    QCommandLineOption readersOption("readers", "Reader sets, each a '+'-separated subset of display, disk, audio, tcp.",
+                                     "list", "display,display+disk,display+disk+tcp");
+    QCommandLineOption xpusOption("xpus", "Waveform processors: cpu, opencl.", "list", "cpu");
+    QCommandLineOption layoutsOption("layouts", "WaveformFifo amplifier buffer layouts: TimeMajor, ChannelTiled.", "list",
+                                     "TimeMajor,ChannelTiled");
+    QCommandLineOption warmupOption("warmup", "Seconds to run before measuring.", "seconds", "2");
+    QCommandLineOption secondsOption("seconds", "Seconds to measure each configuration.", "seconds", "10");
+    QCommandLineOption speedsOption("speeds", "Synthetic data rates as multiples of real time; 0 generates data as fast "
+                                    "as the pipeline consumes it.", "list", "1");
+    QCommandLineOption seedOption("seed", "Seed for synthetic unit activity.", "seed", QString::number(DefaultSynthSeed));
+    QCommandLineOption impedanceOption("impedance", "After each run, time a full impedance check and an impedance spectrum "
+                                       "measurement, and compare them with the synthetic electrode impedances.");
+    QCommandLineOption savePathOption("save-path", "Directory for recorded data (default: a temporary directory).", "path");
+    QCommandLineOption outputOption("output", "Write JSON results to this file instead of standard output.", "file");
+    QCommandLineOption runOption("run", "Run a single configuration, as written in the 'configuration' field of the results.", "spec");
+    commandLine.addOptions({ controllersOption, sampleRatesOption, channelsOption, filterOrdersOption, fileFormatsOption,
+                             readersOption, xpusOption, layoutsOption, warmupOption, secondsOption, speedsOption, seedOption,
+                             impedanceOption, savePathOption, outputOption, runOption });
+    commandLine.process(app);
+
+    QTemporaryDir temporaryDir;
+    bool temporarySavePath = !commandLine.isSet(savePathOption);
+    QString savePath = temporarySavePath ? QDir(temporaryDir.path()).filePath("recordings") : commandLine.value(savePathOption);
+    QDir().mkpath(savePath);
+
+    if (commandLine.isSet(runOption)) {
+        BenchmarkConfiguration config;
+        config.controllerType = ControllerRecordUSB3;
+        config.sampleRate = SampleRate30000Hz;
+        config.maxChannels = false;
+        config.filterOrder = 2;
+        config.fileFormat = "Traditional";
+        config.useOpenCL = false;
+        config.layout = "TimeMajor";
+        config.warmupSeconds = 2.0;
+        config.measureSeconds = 10.0;
+        config.synthSpeed = 1.0;
+        config.seed = DefaultSynthSeed;
+        config.measureImpedance = false;
+        config.saveDirectory = QDir(savePath).absolutePath();
+
+        QString errorMessage;
+        if (!BenchmarkConfiguration::fromString(commandLine.value(runOption), config, errorMessage)) {
+            std::cerr << "Error: " << errorMessage.toStdString() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        QJsonObject result;
+        {
+            PipelineBenchmark benchmark(config);
+            result = benchmark.run();
+        }
+        if (!writeJson(QJsonDocument(result), commandLine.value(outputOption))) return EXIT_FAILURE;
+        return result["errors"].toArray().isEmpty() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Build the sweep.  File format only matters when recording, so runs without the disk reader use just the first one.
+    QStringList fileFormats = splitList(commandLine.value(fileFormatsOption));
+    QStringList specs;
+    for (const QString& controller : splitList(commandLine.value(controllersOption))) {
+        for (const QString& rate : splitList(commandLine.value(sampleRatesOption))) {
+            for (const QString& channels : splitList(commandLine.value(channelsOption))) {
+                for (const QString& order : splitList(commandLine.value(filterOrdersOption))) {
+                    for (const QString& readers : splitList(commandLine.value(readersOption))) {
+                        for (const QString& xpu : splitList(commandLine.value(xpusOption))) {
+                            for (const QString& layout : splitList(commandLine.value(layoutsOption))) {
+                                for (const QString& speed : splitList(commandLine.value(speedsOption))) {
+                                    bool recordToDisk = readers.split('+').contains("disk", Qt::CaseInsensitive);
+                                    for (int i = 0; i < (recordToDisk ? fileFormats.size() : std::min(1, (int) fileFormats.size())); ++i) {
+                                        specs.append("controller=" + controller + ";rate=" + rate + ";channels=" + channels +
+                                                     ";order=" + order + ";format=" + fileFormats[i] + ";readers=" + readers +
+                                                     ";xpu=" + xpu + ";layout=" + layout + ";warmup=" + commandLine.value(warmupOption) +
+                                                     ";seconds=" + commandLine.value(secondsOption) + ";speed=" + speed +
+                                                     ";seed=" + commandLine.value(seedOption) +
+                                                     ";impedance=" + (commandLine.isSet(impedanceOption) ? "on" : "off"));
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    double timeoutSeconds = commandLine.value(warmupOption).toDouble() + commandLine.value(secondsOption).toDouble() + 60.0;
+    QJsonArray results;
+    for (int i = 0; i < specs.size(); ++i) {
+        std::cerr << "[" << i + 1 << "/" << specs.size() << "] " << specs[i].toStdString() << '\n';
+
+        QString resultFileName = QDir(temporaryDir.path()).filePath("result" + QString::number(i) + ".json");
+        QProcess child;
+        child.setStandardOutputFile(QProcess::nullDevice());
+        child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        child.start(QCoreApplication::applicationFilePath(),
+                    { "--run", specs[i], "--save-path", savePath, "--output", resultFileName });
+        bool finished = child.waitForFinished((int) round(1000.0 * timeoutSeconds));
+        if (!finished) child.kill();
+
+        QJsonObject result;
+        QFile resultFile(resultFileName);
+        if (resultFile.open(QIODevice::ReadOnly)) {
+            result = QJsonDocument::fromJson(resultFile.readAll()).object();
+        }
+        if (result.isEmpty()) {
+            result["configuration"] = specs[i];
+            result["errors"] = QJsonArray({ finished ? "Benchmark process exited with code " + QString::number(child.exitCode()) :
+                                                       QString("Benchmark process timed out") });
+        }
+        results.append(result);
+
+        // Recordings from long sweeps at high channel counts can be large; discard them as we go.
+        if (temporarySavePath) {
+            QDir(savePath).removeRecursively();
+            QDir().mkpath(savePath);
+        }
+    }
+
+    return writeJson(QJsonDocument(results), commandLine.value(outputOption)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
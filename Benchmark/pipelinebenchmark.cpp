@@ -0,0 +1,478 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QTimer>
+#include <QTcpSocket>
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "syntheticrhxcontroller.h"
+#include "rhxdatablock.h"
+#include "systemstate.h"
+#include "controllerinterface.h"
+#include "commandparser.h"
+#include "abstractxpuinterface.h"
+#include "pipelinebenchmark.h"
+
+QString BenchmarkConfiguration::toString() const
+{
+    QString controllerName = "usb3";
+    if (controllerType == ControllerRecordUSB2) controllerName = "usb2";
+    else if (controllerType == ControllerStimRecord) controllerName = "stim";
+
+    return "controller=" + controllerName +
+            ";rate=" + QString::number(AbstractRHXController::getSampleRate(sampleRate)) +
+            ";channels=" + (maxChannels ? "max" : "default") +
+            ";order=" + QString::number(filterOrder) +
+            ";format=" + fileFormat +
+            ";readers=" + readers.join('+') +
+            ";xpu=" + (useOpenCL ? "opencl" : "cpu") +
+            ";layout=" + layout +
+            ";warmup=" + QString::number(warmupSeconds) +
+            ";seconds=" + QString::number(measureSeconds) +
+            ";speed=" + QString::number(synthSpeed) +
+            ";seed=" + QString::number(seed) +
+            ";impedance=" + (measureImpedance ? "on" : "off");
+}
+
+// Parse a configuration written by toString().  Keys that are not present keep their current values.
+bool BenchmarkConfiguration::fromString(const QString& spec, BenchmarkConfiguration& config, QString& errorMessage)
+{
+    const QStringList fields = spec.split(';', Qt::SkipEmptyParts);
+    for (const QString& field : fields) {
+        int equalsIndex = field.indexOf('=');
+        if (equalsIndex < 1) {
+            errorMessage = "Malformed field: " + field;
+            return false;
+        }
+        QString key = field.left(equalsIndex).trimmed().toLower();
+        QString value = field.mid(equalsIndex + 1).trimmed();
+        QString valueLower = value.toLower();
+        bool ok = true;
+
+        if (key == "controller") {
+            if (valueLower == "usb2") config.controllerType = ControllerRecordUSB2;
+            else if (valueLower == "usb3") config.controllerType = ControllerRecordUSB3;
+            else if (valueLower == "stim") config.controllerType = ControllerStimRecord;
+            else ok = false;
+        } else if (key == "rate") {
+            double rate = value.toDouble(&ok);
+            if (ok) {
+                config.sampleRate = AbstractRHXController::nearestSampleRate(rate);
+                ok = (int) config.sampleRate >= 0;
+            }
+        } else if (key == "channels") {
+            if (valueLower == "max") config.maxChannels = true;
+            else if (valueLower == "default") config.maxChannels = false;
+            else ok = false;
+        } else if (key == "order") {
+            config.filterOrder = value.toInt(&ok);
+            ok = ok && config.filterOrder >= 1 && config.filterOrder <= 8;
+        } else if (key == "format") {
+            config.fileFormat = value;
+            ok = valueLower == "traditional" || valueLower == "onefilepersignaltype" || valueLower == "onefileperchannel";
+        } else if (key == "readers") {
+            config.readers = valueLower.split('+', Qt::SkipEmptyParts);
+            for (const QString& reader : config.readers) {
+                if (reader != "display" && reader != "disk" && reader != "audio" && reader != "tcp") ok = false;
+            }
+        } else if (key == "xpu") {
+            if (valueLower == "cpu") config.useOpenCL = false;
+            else if (valueLower == "opencl") config.useOpenCL = true;
+            else ok = false;
+        } else if (key == "layout") {
+            config.layout = value;
+            ok = valueLower == "timemajor" || valueLower == "channeltiled";
+        } else if (key == "warmup") {
+            config.warmupSeconds = value.toDouble(&ok);
+            ok = ok && config.warmupSeconds >= 0.0;
+        } else if (key == "seconds") {
+            config.measureSeconds = value.toDouble(&ok);
+            ok = ok && config.measureSeconds > 0.0;
+        } else if (key == "speed") {
+            config.synthSpeed = value.toDouble(&ok);
+            ok = ok && config.synthSpeed >= 0.0;
+        } else if (key == "seed") {
+            config.seed = value.toUInt(&ok);
+        } else if (key == "impedance") {
+            if (valueLower == "on") config.measureImpedance = true;
+            else if (valueLower == "off") config.measureImpedance = false;
+            else ok = false;
+        } else {
+            errorMessage = "Unknown key: " + key;
+            return false;
+        }
+
+        if (!ok) {
+            errorMessage = "Invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+PipelineBenchmark::PipelineBenchmark(const BenchmarkConfiguration& config_, QObject *parent) :
+    QObject(parent),
+    config(config_),
+    rhxController(nullptr),
+    state(nullptr),
+    controllerInterface(nullptr),
+    parser(nullptr),
+    waveformSink(nullptr),
+    spikeSink(nullptr),
+    firstBlock(0),
+    lastBlock(0),
+    measuredSeconds(0.0),
+    peakBufferPercentFull(0.0),
+    cpuLoadTotal(0.0),
+    cpuLoadSamples(0),
+    tcpBytesReceived(0),
+    measuring(false)
+{
+}
+
+PipelineBenchmark::~PipelineBenchmark()
+{
+    delete waveformSink;
+    delete spikeSink;
+    delete parser;
+    delete controllerInterface;
+    delete state;
+    delete rhxController;
+}
+
+QJsonObject PipelineBenchmark::run()
+{
+    // SyntheticRHXController::findConnectedChips() creates either its default set of headstages or the maximum number
+    // of channels the controller supports, depending on this setting.
+    QSettings settings;
+    settings.setValue("synthMaxChannels", config.maxChannels);
+
+    rhxController = new SyntheticRHXController(config.controllerType, config.sampleRate, config.seed);
+    rhxController->setSynthSpeed(config.synthSpeed);
+    state = new SystemState(rhxController, StimStepSize500nA, (config.controllerType == ControllerRecordUSB3) ? 8 : 4, true);
+    controllerInterface = new ControllerInterface(state, rhxController, "N/A", config.useOpenCL, nullptr, this);
+    parser = new CommandParser(state, controllerInterface, this);
+    connect(parser, SIGNAL(TCPErrorSignal(QString)), this, SLOT(recordError(QString)));
+    connect(controllerInterface, SIGNAL(TCPErrorMessage(QString)), parser, SLOT(TCPErrorSlot(QString)));
+
+    parser->setCommandSlot("PipelineProfiling", "True");
+    parser->setCommandSlot("HighpassFilterOrder", QString::number(config.filterOrder));
+    parser->setCommandSlot("LowpassFilterOrder", QString::number(config.filterOrder));
+    parser->setCommandSlot("WaveformBufferLayout", config.layout);
+
+    bool recordToDisk = config.readers.contains("disk");
+    if (recordToDisk) {
+        parser->setCommandSlot("FileFormat", config.fileFormat);
+        parser->setCommandSlot("Filename.Path", config.saveDirectory);
+        parser->setCommandSlot("Filename.BaseFilename", "benchmark");
+    }
+    if (config.readers.contains("audio")) {
+        parser->setCommandSlot("AudioEnabled", "True");
+    }
+    bool outputToTcp = config.readers.contains("tcp");
+    if (outputToTcp) {
+        std::vector<std::string> ampChannels = state->signalSources->amplifierChannelsNameList();
+        for (const std::string& name : ampChannels) {
+            Channel* channel = state->signalSources->channelByName(name);
+            if (channel) {
+                channel->setOutputToTcp(true);
+                channel->setOutputToTcpSpike(true);
+            }
+        }
+        if (!connectTcpSink()) {
+            recordError("Could not connect to TCP data output ports");
+        }
+    }
+
+    QTimer bufferTimer;
+    connect(&bufferTimer, SIGNAL(timeout()), this, SLOT(sampleBufferLevel()));
+    bufferTimer.start(100);
+    QTimer::singleShot((int) round(1000.0 * config.warmupSeconds), this, SLOT(startMeasurement()));
+    QTimer::singleShot((int) round(1000.0 * (config.warmupSeconds + config.measureSeconds)), this, SLOT(stopMeasurement()));
+
+    // RunMode returns only after stopMeasurement() stops the controller.
+    QJsonObject result;
+    if (errors.isEmpty()) {
+        parser->setCommandSlot("RunMode", recordToDisk ? "Record" : "Run");
+    }
+    bufferTimer.stop();
+    if (measuredSeconds <= 0.0) {
+        recordError("Pipeline stopped before measurement completed");
+    }
+
+    int samplesPerDataBlock = RHXDataBlock::samplesPerDataBlock(config.controllerType);
+    double sampleRate = AbstractRHXController::getSampleRate(config.sampleRate);
+    double expectedBlocksPerSecond = sampleRate / samplesPerDataBlock;
+    double blocksPerSecond = measuredSeconds > 0.0 ? (double)(lastBlock - firstBlock) / measuredSeconds : 0.0;
+
+    result["configuration"] = config.toString();
+    result["controller"] = QString::fromStdString(AbstractRHXController::getBoardTypeString(config.controllerType));
+    result["sampleRateHz"] = sampleRate;
+    result["amplifierChannels"] = state->signalSources->numAmplifierChannels();
+    result["dataStreams"] = rhxController->getNumEnabledDataStreams();
+    result["filterOrder"] = config.filterOrder;
+    if (recordToDisk) result["fileFormat"] = config.fileFormat;
+    result["readers"] = QJsonArray::fromStringList(config.readers);
+    result["xpu"] = config.useOpenCL ? "OpenCL" : "CPU";
+    result["xpuDiagnostic"] = xpuDiagnosticReport();
+    result["waveformBufferLayout"] = config.layout;
+    result["measuredSeconds"] = measuredSeconds;
+    result["blocksPerSecond"] = blocksPerSecond;
+    result["expectedBlocksPerSecond"] = expectedBlocksPerSecond;
+    result["realTimeRatio"] = blocksPerSecond / expectedBlocksPerSecond;
+    result["waveformProcessorCpuLoadPercent"] = cpuLoadSamples > 0 ? cpuLoadTotal / cpuLoadSamples : 0.0;
+    result["peakSoftwareBufferPercentFull"] = peakBufferPercentFull;
+    if (outputToTcp) {
+        result["tcpMegabytesPerSecond"] = measuredSeconds > 0.0 ? tcpBytesReceived / 1048576.0 / measuredSeconds : 0.0;
+    }
+    if (config.readers.contains("audio")) {
+        result["audioPerformance"] = controllerInterface->getAudioPerformanceReport();
+    }
+    result["peakResidentMB"] = peakResidentMegabytes();
+
+    QJsonObject stages;
+    for (int s = 0; s < NumPipelineStages; ++s) {
+        PipelineStage stage = (PipelineStage) s;
+        PipelineStageSummary summary = state->pipelineProfiler->summary(stage);
+        QJsonObject stageObject;
+        stageObject["blocks"] = (qint64) summary.blocks;
+        stageObject["meanLatencyUs"] = (qint64) summary.meanLatencyUs;
+        stageObject["p50LatencyUs"] = (qint64) summary.p50LatencyUs;
+        stageObject["p99LatencyUs"] = (qint64) summary.p99LatencyUs;
+        stageObject["maxLatencyUs"] = (qint64) summary.maxLatencyUs;
+        stageObject["maxQueueDepth"] = (qint64) summary.maxQueueDepth;
+        stages[PipelineProfiler::stageName(stage)] = stageObject;
+    }
+    result["stages"] = stages;
+    if (config.measureImpedance && errors.isEmpty()) {
+        result["impedance"] = impedanceReport();
+    }
+    result["errors"] = QJsonArray::fromStringList(errors);
+    return result;
+}
+
+// Time a full impedance check of every amplifier channel, then an impedance spectrum measurement, and compare each
+// measurement with the electrode impedance the synthetic controller emulated for that channel.
+QJsonObject PipelineBenchmark::impedanceReport()
+{
+    QJsonObject report;
+    QElapsedTimer impedanceTimer;
+    impedanceTimer.start();
+    if (!controllerInterface->measureImpedances()) {
+        recordError("Impedance measurement failed");
+        return report;
+    }
+    report["seconds"] = impedanceTimer.nsecsElapsed() / 1.0e9;
+
+    int channelsPerStream = RHXDataBlock::channelsPerStream(config.controllerType);
+    int numChannels = 0;
+    double maxMagnitudeErrorPercent = 0.0;
+    double maxPhaseErrorDegrees = 0.0;
+    auto compare = [&](int stream, int chipChannel, double frequency, double magnitude, double phase) {
+        double expectedMagnitude = rhxController->electrodeImpedanceMagnitude(stream, chipChannel, frequency);
+        double expectedPhase = rhxController->electrodeImpedancePhase(stream, chipChannel);
+        maxMagnitudeErrorPercent = std::max(maxMagnitudeErrorPercent,
+                                            100.0 * std::abs(magnitude - expectedMagnitude) / expectedMagnitude);
+        maxPhaseErrorDegrees = std::max(maxPhaseErrorDegrees, std::abs(std::remainder(phase - expectedPhase, 360.0)));
+    };
+
+    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+        for (int chipChannel = 0; chipChannel < channelsPerStream; ++chipChannel) {
+            Channel* channel = state->signalSources->getAmplifierChannel(stream, chipChannel);
+            if (!channel) continue;
+            compare(stream, chipChannel, state->actualImpedanceFreq->getValue(), channel->getImpedanceMagnitude(),
+                    channel->getImpedancePhase());
+            ++numChannels;
+        }
+    }
+    report["channels"] = numChannels;
+    report["maxMagnitudeErrorPercent"] = maxMagnitudeErrorPercent;
+    report["maxPhaseErrorDegrees"] = maxPhaseErrorDegrees;
+
+    impedanceTimer.restart();
+    if (!controllerInterface->measureImpedanceSpectra()) {
+        recordError("Impedance spectrum measurement failed");
+        return report;
+    }
+    QJsonObject spectrum;
+    spectrum["seconds"] = impedanceTimer.nsecsElapsed() / 1.0e9;
+
+    QJsonArray frequencyArray;
+    std::vector<double> frequencies;
+    for (const QString& field : state->actualImpedanceSpectrumFreqs->getValueString().split(',', Qt::SkipEmptyParts)) {
+        frequencies.push_back(field.toDouble());
+        frequencyArray.append(frequencies.back());
+    }
+    maxMagnitudeErrorPercent = 0.0;
+    maxPhaseErrorDegrees = 0.0;
+    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+        for (int chipChannel = 0; chipChannel < channelsPerStream; ++chipChannel) {
+            Channel* channel = state->signalSources->getAmplifierChannel(stream, chipChannel);
+            if (!channel) continue;
+            const std::vector<double>& magnitudes = channel->getImpedanceSpectrumMagnitudes();
+            const std::vector<double>& phases = channel->getImpedanceSpectrumPhases();
+            for (int i = 0; i < (int) std::min(frequencies.size(), magnitudes.size()); ++i) {
+                compare(stream, chipChannel, frequencies[i], magnitudes[i], phases[i]);
+            }
+        }
+    }
+    spectrum["frequenciesHz"] = frequencyArray;
+    spectrum["maxMagnitudeErrorPercent"] = maxMagnitudeErrorPercent;
+    spectrum["maxPhaseErrorDegrees"] = maxPhaseErrorDegrees;
+    report["spectrum"] = spectrum;
+    return report;
+}
+
+// Blocks per second each XPU achieved in the startup diagnostic, with OpenCL devices also given relative to the CPU.
+QJsonArray PipelineBenchmark::xpuDiagnosticReport() const
+{
+    QJsonArray report;
+    double cpuBlocksPerSecond = AbstractXPUInterface::diagnosticBlocksPerSecond(state->cpuInfo.diagnosticTime);
+    QJsonObject cpuObject;
+    cpuObject["name"] = state->cpuInfo.name;
+    cpuObject["blocksPerSecond"] = cpuBlocksPerSecond;
+    report.append(cpuObject);
+    for (const GPUInfo& gpu : state->gpuList) {
+        double gpuBlocksPerSecond = AbstractXPUInterface::diagnosticBlocksPerSecond(gpu.diagnosticTime);
+        QJsonObject gpuObject;
+        gpuObject["name"] = gpu.name;
+        gpuObject["blocksPerSecond"] = gpuBlocksPerSecond;
+        gpuObject["relativeToCpu"] = cpuBlocksPerSecond > 0.0 ? gpuBlocksPerSecond / cpuBlocksPerSecond : 0.0;
+        gpuObject["used"] = gpu.used;
+        report.append(gpuObject);
+    }
+    return report;
+}
+
+// Peak resident memory of this process, in megabytes.
+double PipelineBenchmark::peakResidentMegabytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+    return counters.PeakWorkingSetSize / 1048576.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss / 1048576.0;  // macOS reports bytes.
+#else
+    return usage.ru_maxrss / 1024.0;  // Linux reports kilobytes.
+#endif
+#endif
+}
+
+void PipelineBenchmark::recordError(QString errorMessage)
+{
+    std::cerr << "Benchmark error: " << errorMessage.toStdString() << '\n';
+    errors.append(errorMessage);
+}
+
+// Discard start-up transients: measure blocks and latencies only from the end of the warm-up period.
+void PipelineBenchmark::startMeasurement()
+{
+    firstBlock = state->pipelineProfiler->summary(StageWaveformCommit).blocks;
+    state->pipelineProfiler->resetStatistics();
+    peakBufferPercentFull = 0.0;
+    cpuLoadTotal = 0.0;
+    cpuLoadSamples = 0;
+    tcpBytesReceived = 0;
+    measureTimer.start();
+    measuring = true;
+}
+
+void PipelineBenchmark::stopMeasurement()
+{
+    if (!measuring) return;
+    lastBlock = state->pipelineProfiler->summary(StageWaveformCommit).blocks;
+    measuredSeconds = measureTimer.nsecsElapsed() / 1.0e9;
+    measuring = false;
+    if (state->running) {
+        parser->setCommandSlot("RunMode", "Stop");
+    }
+}
+
+void PipelineBenchmark::sampleBufferLevel()
+{
+    if (!measuring) return;
+    peakBufferPercentFull = std::max(peakBufferPercentFull, controllerInterface->swBufferPercentFull());
+    cpuLoadTotal += controllerInterface->latestWaveformProcessorCpuLoad();
+    ++cpuLoadSamples;
+}
+
+void PipelineBenchmark::discardTcpData()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) return;
+    qint64 numBytes = socket->readAll().size();
+    if (measuring) tcpBytesReceived += numBytes;
+}
+
+// Open the waveform and spike data output ports, as a TCP client would, and connect a local socket to each one that
+// reads and discards everything the TCPDataOutputThread sends.
+bool PipelineBenchmark::connectTcpSink()
+{
+    TCPCommunicator* waveformCommunicator = state->tcpWaveformDataCommunicator;
+    TCPCommunicator* spikeCommunicator = state->tcpSpikeDataCommunicator;
+    connect(waveformCommunicator, SIGNAL(newConnection()), waveformCommunicator, SLOT(establishConnection()));
+    connect(spikeCommunicator, SIGNAL(newConnection()), spikeCommunicator, SLOT(establishConnection()));
+    parser->executeCommandSlot("ConnectTCPWaveformDataOutput");
+    parser->executeCommandSlot("ConnectTCPSpikeDataOutput");
+
+    waveformSink = new QTcpSocket;
+    spikeSink = new QTcpSocket;
+    connect(waveformSink, SIGNAL(readyRead()), this, SLOT(discardTcpData()));
+    connect(spikeSink, SIGNAL(readyRead()), this, SLOT(discardTcpData()));
+    waveformSink->connectToHost(waveformCommunicator->address, waveformCommunicator->port);
+    spikeSink->connectToHost(spikeCommunicator->address, spikeCommunicator->port);
+
+    QElapsedTimer timeout;
+    timeout.start();
+    while (timeout.elapsed() < 2000) {
+        if (waveformCommunicator->status == TCPCommunicator::Connected &&
+                spikeCommunicator->status == TCPCommunicator::Connected) {
+            return true;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return false;
+}
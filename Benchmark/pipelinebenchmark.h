@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef PIPELINEBENCHMARK_H
+#define PIPELINEBENCHMARK_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <cstdint>
+
+#include "rhxglobals.h"
+
+class SyntheticRHXController;
+class SystemState;
+class ControllerInterface;
+class CommandParser;
+class QTcpSocket;
+
+// One point in the benchmark sweep.  Readers may include "disk" (record to saveDirectory in fileFormat),
+// "audio", and "tcp" (waveform and spike output to a local socket that discards everything it receives).
+// The display reader is always drained by the main thread, as it is when the GUI is running.
+struct BenchmarkConfiguration {
+    ControllerType controllerType;
+    AmplifierSampleRate sampleRate;
+    bool maxChannels;
+    int filterOrder;
+    QString fileFormat;
+    QStringList readers;
+    bool useOpenCL;
+    QString layout;
+    double warmupSeconds;
+    double measureSeconds;
+    double synthSpeed;          // Multiple of real time at which synthetic data is generated; 0 = as fast as it is consumed
+    unsigned int seed;          // Seed for synthetic unit activity
+    bool measureImpedance;      // After the run, measure impedances and spectra and compare with synthetic values
+    QString saveDirectory;
+
+    QString toString() const;
+    static bool fromString(const QString& spec, BenchmarkConfiguration& config, QString& errorMessage);
+};
+
+// Runs the complete acquisition pipeline (SyntheticRHXController -> USBDataThread -> WaveformProcessorThread ->
+// WaveformFifo readers) headless for a single configuration, and returns sustained throughput, per-stage latency,
+// and peak memory as a JSON object.  Peak memory is a process-wide high-water mark, so each configuration should be
+// run in a fresh process.  Optionally, a full impedance check and an impedance spectrum measurement are then timed and
+// checked against the electrode impedances emulated by the synthetic controller.
+class PipelineBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PipelineBenchmark(const BenchmarkConfiguration& config_, QObject *parent = nullptr);
+    ~PipelineBenchmark();
+
+    QJsonObject run();
+
+    static double peakResidentMegabytes();
+
+private slots:
+    void recordError(QString errorMessage);
+    void startMeasurement();
+    void stopMeasurement();
+    void sampleBufferLevel();
+    void discardTcpData();
+
+private:
+    bool connectTcpSink();
+    QJsonArray xpuDiagnosticReport() const;
+    QJsonObject impedanceReport();
+
+    BenchmarkConfiguration config;
+
+    SyntheticRHXController* rhxController;
+    SystemState* state;
+    ControllerInterface* controllerInterface;
+    CommandParser* parser;
+    QTcpSocket* waveformSink;
+    QTcpSocket* spikeSink;
+
+    QStringList errors;
+    QElapsedTimer measureTimer;
+    int64_t firstBlock;
+    int64_t lastBlock;
+    double measuredSeconds;
+    double peakBufferPercentFull;
+    double cpuLoadTotal;
+    int cpuLoadSamples;
+    int64_t tcpBytesReceived;
+    bool measuring;
+};
+
+#endif // PIPELINEBENCHMARK_H
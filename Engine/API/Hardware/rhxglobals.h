@@ -214,6 +214,7 @@ const uint32_t DataFileMagicNumberRHD = 0xc6912702;
 const uint32_t DataFileMagicNumberRHS = 0xd69127ac;
 const uint32_t SpikeFileMagicNumberAllChannels = 0x18f8474b;
 const uint32_t SpikeFileMagicNumberSingleChannel = 0x18f88c00;
+const uint32_t ImpedanceSpectrumFileMagicNumber = 0x5a7e0c15;
 
 // TCP Waveform Output magic number
 const uint32_t TCPWaveformMagicNumber = 0x2ef07a08;
@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <queue>
@@ -1893,6 +1894,61 @@ int RHXRegisters::createCommandListZcheckDac(std::vector<unsigned int> &commandL
     return (int)commandList.size();
 }
 
+// Create a list of 'period' commands to generate one period of a multi-tone waveform using the on-chip impedance
+// testing voltage DAC: a sum of equal-amplitude sine waves at the given harmonics of (sampleRate / period), with
+// Schroeder phases to keep the peak low, scaled so that its peak is amplitude (in DAC steps, 0-128).  With a single
+// harmonic of 1, this is a sine wave of frequency (sampleRate / period).
+// Return the length of the command list.
+int RHXRegisters::createCommandListZcheckDac(std::vector<unsigned int> &commandList, int period,
+                                             const std::vector<int> &harmonics, double amplitude)
+{
+    commandList.clear();    // if command list already exists, erase it and start a new one
+
+    if ((amplitude < 0.0) || (amplitude > 128.0)) {
+        std::cerr << "Error in RHXRegisters::createCommandListZcheckDac: Amplitude out of range.\n";
+        return -1;
+    }
+    if (period > maxCommandLength()) {
+        std::cerr << "Error in RHXRegisters::createCommandListZcheckDac: Period too long.\n";
+        return -1;
+    }
+    if (harmonics.empty()) {
+        std::cerr << "Error in RHXRegisters::createCommandListZcheckDac: No harmonics.\n";
+        return -1;
+    }
+    for (int harmonic : harmonics) {
+        if (harmonic < 1 || 4 * harmonic > period) {
+            std::cerr << "Error in RHXRegisters::createCommandListZcheckDac: " <<
+                "Harmonic too high relative to sampling rate.\n";
+            return -1;
+        }
+    }
+
+    int numTones = (int) harmonics.size();
+    std::vector<double> waveform(period, 0.0);
+    double peak = 0.0;
+    for (int i = 0; i < period; ++i) {
+        for (int tone = 0; tone < numTones; ++tone) {
+            double schroederPhase = -Pi * tone * (tone + 1) / numTones;
+            waveform[i] += sin(TwoPi * harmonics[tone] * i / period + schroederPhase);
+        }
+        peak = std::max(peak, std::abs(waveform[i]));
+    }
+
+    unsigned int dacRegister = (type == ControllerStimRecord) ? 3 : 6;
+    for (int i = 0; i < period; ++i) {
+        int value = (int)floor(amplitude * waveform[i] / peak + 128.0 + 0.5);
+        if (value < 0) {
+            value = 0;
+        } else if (value > 255) {
+            value = 255;
+        }
+        commandList.push_back(createRHXCommand(RHXCommandRegWrite, dacRegister, value));
+    }
+
+    return (int)commandList.size();
+}
+
 // Create a list of RHD commands to sample auxiliary ADC inputs 1-3 at 1/4 the amplifier sampling
 // rate.  The reading of a ROM register is interleaved to allow for data frame alignment.
 // Return the length of the command list.  numCommands should be evenly divisible by four.
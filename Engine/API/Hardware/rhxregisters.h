@@ -130,6 +130,8 @@ public:
                                               double targetVoltage);
 
     int createCommandListZcheckDac(std::vector<unsigned int> &commandList, double frequency, double amplitude);
+    int createCommandListZcheckDac(std::vector<unsigned int> &commandList, int period, const std::vector<int> &harmonics,
+                                   double amplitude);
     int createCommandListDummy(std::vector <unsigned int> &commandList, int n, unsigned int cmd);
 
     enum RHXCommandType {
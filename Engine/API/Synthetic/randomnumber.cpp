@@ -28,18 +28,14 @@
 //
 //------------------------------------------------------------------------------
 
-#include <QTime>
 #include <QRandomGenerator>
 #include <cmath>
 #include "randomnumber.h"
 
 // Generate random numbers from both uniform and Gaussian distrubtions.
-RandomNumber::RandomNumber()
+RandomNumber::RandomNumber(unsigned int seed)
 {
-    // Seed random number generator.
-    // unsigned int seed = QTime::currentTime().msec();
-    unsigned int seed = 4;
-
+    // Seed random number generator.  A fixed seed makes synthetic data reproducible from run to run.
     generator = new QRandomGenerator(seed);
 
     // Initialize parameters for Gaussian distribution approximator.
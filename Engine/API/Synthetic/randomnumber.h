@@ -36,7 +36,7 @@ class QRandomGenerator;
 class RandomNumber
 {
 public:
-    RandomNumber();
+    explicit RandomNumber(unsigned int seed = 4);
     ~RandomNumber();
     double randomUniform();
     double randomUniform(double min, double max);
@@ -28,8 +28,17 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <complex>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SYNTH_USE_SSE2
+#endif
+
 #include "rhxglobals.h"
 #include "abstractrhxcontroller.h"
 #include "synthdatablockgenerator.h"
@@ -47,132 +56,6 @@ AbstractSynthSource::~AbstractSynthSource()
 
 }
 
-uint16_t AbstractSynthSource::convertToAmpADCValue(double electrodeMicrovolts) const
-{
-    int result = round(electrodeMicrovolts / 0.195) + 32768;
-    if (result < 0) result = 0;
-    else if (result > 65535) result = 65535;
-    return (uint16_t) result;
-}
-
-
-NeuralSynthSource::NeuralSynthSource(RandomNumber* randomGenerator_, double sampleRate, int nUnits_) :
-    AbstractSynthSource(randomGenerator_, sampleRate),
-    nUnits(nUnits_)
-{
-    spikeAmplitude.resize(nUnits);
-    spikeDurationMsec.resize(nUnits);
-    spikeRateHz.resize(nUnits);
-    firing.resize(nUnits);
-    spikeTimeMsec.resize(nUnits);
-    for (int i = 0; i < nUnits; ++i) {
-        spikeAmplitude[i] = randomGenerator->randomUniform(-500.0, -200.0);
-        spikeDurationMsec[i] = randomGenerator->randomUniform(0.3, 1.7);
-        spikeRateHz[i] = randomGenerator->randomLogUniform(0.1, 50.0);
-    }
-
-    // Mimic virtual method reset() here in the constructor
-    tMsec = 0.0;
-    for (int i = 0; i < nUnits; ++i) {
-        firing[i] = false;
-        spikeTimeMsec[i] = 0.0;
-    }
-}
-
-void NeuralSynthSource::reset()
-{
-    tMsec = 0.0;
-    for (int i = 0; i < nUnits; ++i) {
-        firing[i] = false;
-        spikeTimeMsec[i] = 0.0;
-    }
-}
-
-double NeuralSynthSource::nextSpikeVoltage(int unit)
-{
-    double result = 0.0;
-    if (spikeTimeMsec[unit] < spikeDurationMsec[unit]) {
-        result = spikeAmplitude[unit] * exp(-2.0 * (spikeTimeMsec[unit])) *
-                sin(TwoPi * spikeTimeMsec[unit] / spikeDurationMsec[unit]);
-        spikeTimeMsec[unit] += tStepMsec;
-    } else if (spikeTimeMsec[unit] < spikeDurationMsec[unit] + SpikeRefractoryPeriodMsec) {
-        spikeTimeMsec[unit] += tStepMsec;
-    } else {
-        firing[unit] = false;
-        spikeTimeMsec[unit] = 0.0;
-    }
-    return result;
-}
-
-double NeuralSynthSource::LFPVoltage() const
-{
-    // double amplitude = 5000.0;
-    double amplitude = 100.0 + 80.0 * sin(TwoPi * (tMsec / 1000.0) * LFPModulationHz);
-    return amplitude * sin(TwoPi * (tMsec / 1000.0) * LFPFrequencyHz);
-}
-
-uint16_t NeuralSynthSource::nextSample()
-{
-    double result = NoiseRMSLevelMicroVolts * randomGenerator->randomGaussian();
-    for (int i = 0; i < nUnits; ++i) {
-        if (firing[i]) {
-            result += nextSpikeVoltage(i);
-        } else {
-            double spikeModulationFactor = (1000.0 - fmod(tMsec, 1000.0)) / 1000.0;
-            if (randomGenerator->randomUniform() < (spikeModulationFactor * spikeRateHz[i] * tStepMsec / 1000.0)) {
-                firing[i] = true;
-            }
-        }
-    }
-    //result = LFPVoltage();
-    result += LFPVoltage();
-    tMsec += tStepMsec;
-    return convertToAmpADCValue(result);
-}
-
-
-ECGSynthSource::ECGSynthSource(RandomNumber* randomGenerator_, double sampleRate) :
-    AbstractSynthSource(randomGenerator_, sampleRate)
-{
-    ecgAmplitude = randomGenerator->randomUniform(500.0, 3000.0);
-    // Mimic virtual method reset() here in the constructor
-    tMsec = 0.0;
-}
-
-void ECGSynthSource::reset()
-{
-    tMsec = 0.0;
-}
-
-uint16_t ECGSynthSource::nextSample()
-{
-    double ecgValue = 0.0;
-    // Piece together half sine waves to model QRS complex, P wave, and T wave.
-    if (tMsec < 80.0) {
-        ecgValue = 0.04 * sin(TwoPi * tMsec / 160.0); // P wave
-    } else if (tMsec > 100.0 && tMsec < 120.0) {
-        ecgValue = -0.25 * sin(TwoPi * (tMsec - 100.0) / 40.0); // Q
-    } else if (tMsec > 120.0 && tMsec < 180.0) {
-        ecgValue = 1.0 * sin(TwoPi * (tMsec - 120.0) / 120.0); // R
-    } else if (tMsec > 180.0 && tMsec < 260.0) {
-        ecgValue = -0.12 * sin(TwoPi * (tMsec - 180.0) / 160.0); // S
-    } else if (tMsec > 340.0 && tMsec < 400.0) {
-        ecgValue = 0.06 * sin(TwoPi * (tMsec - 340.0) / 120.0); // T wave
-    }
-
-    // Repeat ECG waveform with regular period.
-    tMsec += tStepMsec;
-    if (tMsec > 840.0) {
-        tMsec = 0.0;
-    }
-
-    // Multiply basic ECG waveform by channel-specific amplitude, and add 2.4 uVrms noise.
-    ecgValue = ecgAmplitude * ecgValue + 2.4 * randomGenerator->randomGaussian();
-
-    return convertToAmpADCValue(ecgValue);
-}
-
-
 ADCSynthSource::ADCSynthSource(RandomNumber* randomGenerator_, double sampleRate, double freqHz_, double amplitude_) :
     AbstractSynthSource(randomGenerator_, sampleRate),
     freqHz(freqHz_),
@@ -220,9 +103,42 @@ uint16_t DigitalSynthSource::nextSample()
 }
 
 
-SynthDataBlockGenerator::SynthDataBlockGenerator(ControllerType type_, double sampleRate_) :
+// Convert electrode voltages in microvolts to amplifier ADC words, saturating at the ends of the ADC range.
+static void convertToAmpADCValues(const float* microvolts, uint16_t* words, int numValues)
+{
+    int i = 0;
+#ifdef SYNTH_USE_SSE2
+    const __m128 scale = _mm_set1_ps((float) (1.0 / 0.195));
+    const __m128 maxValue = _mm_set1_ps(40000.0F);
+    const __m128 minValue = _mm_set1_ps(-40000.0F);
+    const __m128i signBit = _mm_set1_epi16((short) 0x8000);
+    for (; i + 8 <= numValues; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(microvolts + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(microvolts + i + 4), scale);
+        a = _mm_min_ps(_mm_max_ps(a, minValue), maxValue);
+        b = _mm_min_ps(_mm_max_ps(b, minValue), maxValue);
+        // Pack to signed 16 bits with saturation, then flip the sign bit to get offset binary.
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*) (words + i), _mm_xor_si128(packed, signBit));
+    }
+#endif
+    for (; i < numValues; ++i) {
+        int result = (int) round(microvolts[i] / 0.195) + 32768;
+        if (result < 0) result = 0;
+        else if (result > 65535) result = 65535;
+        words[i] = (uint16_t) result;
+    }
+}
+
+SynthDataBlockGenerator::SynthDataBlockGenerator(ControllerType type_, double sampleRate_, unsigned int seed) :
     type(type_),
-    sampleRate(sampleRate_)
+    sampleRate(sampleRate_),
+    speed(1.0),
+    sampleCount(0),
+    impedanceTestChannel(-1),
+    impedanceTestPeriod(1),
+    impedanceTestStart(0),
+    laneGainStreams(0)
 {
     int bufferSizeInWords = MaxNumBlocksToRead *
             RHXDataBlock::dataBlockSizeInWords(type, AbstractRHXController::maxNumDataStreams(type));
@@ -230,20 +146,11 @@ SynthDataBlockGenerator::SynthDataBlockGenerator(ControllerType type_, double sa
     usbWords = nullptr;
     usbWords = new uint16_t [bufferSizeInWords];
     dataBlockPeriodInNsec = 1.0e9 * ((double)RHXDataBlock::samplesPerDataBlock(type)) / sampleRate;
-    randomGenerator = new RandomNumber();
-
-    synthSources.resize(AbstractRHXController::maxNumDataStreams(type));
-    for (unsigned int stream = 0; stream < synthSources.size(); ++stream) {
-        synthSources[stream].resize(RHXDataBlock::channelsPerStream(type));
-        for (int channel = 0; channel < RHXDataBlock::channelsPerStream(type); ++channel) {
-            if (sampleRate > 4999.9) {
-                synthSources[stream][channel] = new NeuralSynthSource(randomGenerator, sampleRate, 2);
-            } else {
-                synthSources[stream][channel] = new ECGSynthSource(randomGenerator, sampleRate);
-            }
-            synthSources[stream][channel]->reset();
-        }
-    }
+    randomGenerator = new RandomNumber(seed);
+    randomGenerator->setGaussianAccuracy(6);
+
+    createTemplateTables(seed);
+
     adcSynthSources.resize(2);
     adcSynthSources[0] = new ADCSynthSource(randomGenerator, sampleRate, 10.0, 1.0);
     adcSynthSources[1] = new ADCSynthSource(randomGenerator, sampleRate, 100.0, 0.5);
@@ -268,10 +175,8 @@ SynthDataBlockGenerator::~SynthDataBlockGenerator()
     delete [] usbWords;
     delete randomGenerator;
 
-    for (unsigned int stream = 0; stream < synthSources.size(); ++stream) {
-        for (unsigned int channel = 0; channel < synthSources[stream].size(); ++channel) {
-            delete synthSources[stream][channel];
-        }
+    for (unsigned int stream = 0; stream < streamRandomGenerators.size(); ++stream) {
+        delete streamRandomGenerators[stream];
     }
 
     for (unsigned int i = 0; i < adcSynthSources.size(); ++i) {
@@ -290,27 +195,299 @@ void SynthDataBlockGenerator::reset()
     timer.start();
 }
 
+// Build the noise, background, and spike template tables that amplifier data blocks are assembled from.
+void SynthDataBlockGenerator::createTemplateTables(unsigned int seed)
+{
+    const int numStreams = AbstractRHXController::maxNumDataStreams(type);
+    const int channelsPerStream = RHXDataBlock::channelsPerStream(type);
+    const int maxLanes = numStreams * channelsPerStream;
+    const bool neural = sampleRate > 4999.9;
+    const double tStepMsec = 1.0e3 / sampleRate;
+
+    // Gaussian noise, read from a random offset for each sample.  The first maxLanes values are repeated at the end
+    // so a full sample of noise may be read from any offset without wrapping.
+    const double noiseRms = neural ? NoiseRMSLevelMicroVolts : ECGNoiseRMSLevelMicroVolts;
+    noiseTable.resize(NoiseTableSize + maxLanes);
+    for (int i = 0; i < NoiseTableSize; ++i) {
+        noiseTable[i] = (float) (noiseRms * randomGenerator->randomGaussian());
+    }
+    for (int i = 0; i < maxLanes; ++i) {
+        noiseTable[NoiseTableSize + i] = noiseTable[i % NoiseTableSize];
+    }
+
+    if (neural) {
+        // LFP: 2.3 Hz sine wave with amplitude modulated at 0.5 Hz; the sum repeats every 10 seconds.
+        int period = (int) round(10.0 * sampleRate);
+        backgroundTable.resize(period);
+        for (int i = 0; i < period; ++i) {
+            double t = i / sampleRate;
+            double amplitude = 100.0 + 80.0 * sin(TwoPi * t * LFPModulationHz);
+            backgroundTable[i] = (float) (amplitude * sin(TwoPi * t * LFPFrequencyHz));
+        }
+    } else {
+        // ECG: piece together half sine waves to model QRS complex, P wave, and T wave; repeats every 840 msec.
+        int period = (int) round(840.0 / tStepMsec);
+        backgroundTable.resize(period);
+        for (int i = 0; i < period; ++i) {
+            double tMsec = i * tStepMsec;
+            double ecgValue = 0.0;
+            if (tMsec < 80.0) {
+                ecgValue = 0.04 * sin(TwoPi * tMsec / 160.0); // P wave
+            } else if (tMsec > 100.0 && tMsec < 120.0) {
+                ecgValue = -0.25 * sin(TwoPi * (tMsec - 100.0) / 40.0); // Q
+            } else if (tMsec > 120.0 && tMsec < 180.0) {
+                ecgValue = 1.0 * sin(TwoPi * (tMsec - 120.0) / 120.0); // R
+            } else if (tMsec > 180.0 && tMsec < 260.0) {
+                ecgValue = -0.12 * sin(TwoPi * (tMsec - 180.0) / 160.0); // S
+            } else if (tMsec > 340.0 && tMsec < 400.0) {
+                ecgValue = 0.06 * sin(TwoPi * (tMsec - 340.0) / 120.0); // T wave
+            }
+            backgroundTable[i] = (float) ecgValue;
+        }
+    }
+
+    // Each stream gets its own generator, so its activity does not depend on how many other streams are enabled.
+    streamRandomGenerators.resize(numStreams);
+    backgroundPhase.resize(numStreams);
+    backgroundGain.resize(maxLanes);
+    units.clear();
+    for (int stream = 0; stream < numStreams; ++stream) {
+        RandomNumber* rng = new RandomNumber(seed * 1000003U + (unsigned int) stream + 1U);
+        rng->setGaussianAccuracy(6);
+        streamRandomGenerators[stream] = rng;
+        backgroundPhase[stream] = (int) (rng->randomUniform() * (backgroundTable.size() - 1));
+
+        for (int channel = 0; channel < channelsPerStream; ++channel) {
+            backgroundGain[stream * channelsPerStream + channel] = neural ? 1.0F : (float) rng->randomUniform(500.0, 3000.0);
+            if (!neural) continue;
+
+            for (int i = 0; i < UnitsPerChannel; ++i) {
+                SynthUnit unit;
+                unit.stream = stream;
+                unit.channel = channel;
+                double amplitude = rng->randomUniform(-500.0, -200.0);
+                double durationMsec = rng->randomUniform(0.3, 1.7);
+                double rateHz = rng->randomLogUniform(0.1, 50.0);
+                int templateLength = (int) ceil(durationMsec / tStepMsec);
+                unit.spikeTemplate.resize(templateLength);
+                for (int j = 0; j < templateLength; ++j) {
+                    double tMsec = j * tStepMsec;
+                    unit.spikeTemplate[j] = (float) (amplitude * exp(-2.0 * tMsec) * sin(TwoPi * tMsec / durationMsec));
+                }
+                unit.spikesPerSample = rateHz / sampleRate;
+                unit.refractorySamples = (int) round(SpikeRefractoryPeriodMsec / tStepMsec);
+                unit.templateIndex = -1;
+                scheduleNextSpike(unit, 0);
+                units.push_back(unit);
+            }
+        }
+    }
+
+    // Electrode impedances for impedance test emulation, from their own generator so the waveforms above are unchanged.
+    RandomNumber impedanceGenerator(seed * 7919U + 17U);
+    electrodeMagnitude.resize(maxLanes);
+    electrodePhase.resize(maxLanes);
+    for (int lane = 0; lane < maxLanes; ++lane) {
+        electrodeMagnitude[lane] = (float) impedanceGenerator.randomLogUniform(50.0e3, 2.0e6);
+        electrodePhase[lane] = (float) impedanceGenerator.randomUniform(-80.0, -60.0);
+    }
+}
+
+double SynthDataBlockGenerator::electrodeImpedanceMagnitude(int stream, int channel, double frequency) const
+{
+    int lane = stream * RHXDataBlock::channelsPerStream(type) + channel;
+    return electrodeMagnitude[lane] * pow(frequency / ElectrodeReferenceFrequency, electrodePhase[lane] / 90.0);
+}
+
+double SynthDataBlockGenerator::electrodeImpedancePhase(int stream, int channel) const
+{
+    return electrodePhase[stream * RHXDataBlock::channelsPerStream(type) + channel];
+}
+
+// Decompose one period of the DAC waveform into harmonics, ignoring those smaller than a DAC step (quantization error).
+// The test stays disabled until the next setImpedanceTest().
+void SynthDataBlockGenerator::setImpedanceTestDacWaveform(const std::vector<double>& dacWaveformVolts)
+{
+    disableImpedanceTest();
+    impedanceTestPeriod = std::max((int) dacWaveformVolts.size(), 1);
+    impedanceTestHarmonics.clear();
+    impedanceTestDacPhasors.clear();
+    for (int harmonic = 1; 2 * harmonic <= (int) dacWaveformVolts.size(); ++harmonic) {
+        std::complex<double> phasor(0.0, 0.0);
+        for (int t = 0; t < impedanceTestPeriod; ++t) {
+            phasor += dacWaveformVolts[t] * std::polar(1.0, -TwoPi * harmonic * t / impedanceTestPeriod);
+        }
+        phasor *= 2.0 / impedanceTestPeriod;
+        if (std::abs(phasor) >= ImpedanceTestDacStepVolts) {
+            impedanceTestHarmonics.push_back(harmonic);
+            impedanceTestDacPhasors.push_back(phasor);
+        }
+    }
+}
+
+void SynthDataBlockGenerator::setImpedanceTest(int chipChannel, double seriesCapacitance)
+{
+    if (chipChannel < 0 || impedanceTestHarmonics.empty()) {
+        disableImpedanceTest();
+        return;
+    }
+    const int numStreams = AbstractRHXController::maxNumDataStreams(type);
+    const int channelsPerStream = RHXDataBlock::channelsPerStream(type);
+    chipChannel %= channelsPerStream;   // RHD2164 channels 32-63 are read on their own (MISO B) streams.
+    const double parasiticCapacitance = (type == ControllerStimRecord) ? 12.0e-12 : 15.0e-12;
+
+    impedanceTestWaveform.assign(numStreams * impedanceTestPeriod, 0.0F);
+    for (int i = 0; i < (int) impedanceTestHarmonics.size(); ++i) {
+        const double relativeFreq = (double) impedanceTestHarmonics[i] / impedanceTestPeriod;
+        const double frequency = sampleRate * relativeFreq;
+
+        // The test current through the series capacitor leads the DAC voltage by 90 degrees.
+        std::complex<double> current = std::complex<double>(0.0, TwoPi * frequency * seriesCapacitance) *
+                impedanceTestDacPhasors[i];
+
+        // Undo ImpedanceReader's empirical amplitude corrections.
+        double gain = 1.0 / (18.0 * relativeFreq * relativeFreq + 1.0);
+        if (type == ControllerStimRecord) gain /= 1.1;
+
+        for (int stream = 0; stream < numStreams; ++stream) {
+            int lane = stream * channelsPerStream + chipChannel;
+            std::complex<double> electrode = std::polar(electrodeImpedanceMagnitude(stream, chipChannel, frequency),
+                                                        DegreesToRadians * electrodePhase[lane]);
+            std::complex<double> measured = electrode /
+                    (1.0 + std::complex<double>(0.0, TwoPi * frequency * parasiticCapacitance) * electrode);
+            std::complex<double> voltage = 1.0e6 * gain * current * measured *
+                    std::polar(1.0, -TwoPi * ImpedanceTestPipelineDelay * relativeFreq);
+
+            float* pWrite = &impedanceTestWaveform[stream * impedanceTestPeriod];
+            for (int t = 0; t < impedanceTestPeriod; ++t) {
+                pWrite[t] += (float) std::real(voltage * std::polar(1.0, TwoPi * relativeFreq * t));
+            }
+        }
+    }
+    impedanceTestChannel = chipChannel;
+}
+
+// Draw the start of the next spike at or after earliestSample.  Spikes follow a Poisson process whose rate falls
+// linearly from its peak to zero over each second; candidates from the peak-rate process are thinned to match.
+void SynthDataBlockGenerator::scheduleNextSpike(SynthUnit& unit, int64_t earliestSample)
+{
+    RandomNumber* rng = streamRandomGenerators[unit.stream];
+    int64_t t = earliestSample;
+    while (true) {
+        t += (int64_t) (-log(1.0 - rng->randomUniform()) / unit.spikesPerSample);
+        double modulationFactor = 1.0 - fmod(t / sampleRate, 1.0);
+        if (rng->randomUniform() < modulationFactor) break;
+    }
+    unit.spikeStartSample = t;
+}
+
+// Fill amplifierBlock with one data block of amplifier data, in microvolts.
+void SynthDataBlockGenerator::createAmplifierBlock(int numDataStreams)
+{
+    const int channelsPerStream = RHXDataBlock::channelsPerStream(type);
+    const int samplesPerBlock = RHXDataBlock::samplesPerDataBlock(type);
+    const int numLanes = channelsPerStream * numDataStreams;
+    const int64_t period = (int64_t) backgroundTable.size();
+
+    if (laneGainStreams != numDataStreams) {
+        laneGain.resize(numLanes);
+        for (int channel = 0; channel < channelsPerStream; ++channel) {
+            for (int stream = 0; stream < numDataStreams; ++stream) {
+                laneGain[channel * numDataStreams + stream] = backgroundGain[stream * channelsPerStream + channel];
+            }
+        }
+        laneBackground.resize(numDataStreams);
+        amplifierBlock.resize(samplesPerBlock * numLanes);
+        laneWords.resize(samplesPerBlock * numLanes);
+        laneGainStreams = numDataStreams;
+    }
+
+    // Noise plus background.
+    for (int sample = 0; sample < samplesPerBlock; ++sample) {
+        for (int stream = 0; stream < numDataStreams; ++stream) {
+            laneBackground[stream] = backgroundTable[(sampleCount + sample + backgroundPhase[stream]) % period];
+        }
+        const float* noise = &noiseTable[(int) (randomGenerator->randomUniform() * NoiseTableSize)];
+        float* row = &amplifierBlock[sample * numLanes];
+        for (int channel = 0; channel < channelsPerStream; ++channel) {
+            const float* gain = &laneGain[channel * numDataStreams];
+            const float* noiseLane = noise + channel * numDataStreams;
+            float* rowLane = row + channel * numDataStreams;
+            for (int stream = 0; stream < numDataStreams; ++stream) {
+                rowLane[stream] = noiseLane[stream] + gain[stream] * laneBackground[stream];
+            }
+        }
+    }
+
+    // Spikes, carried over block boundaries.
+    const int64_t blockStart = sampleCount;
+    const int64_t blockEnd = sampleCount + samplesPerBlock;
+    for (SynthUnit& unit : units) {
+        if (unit.stream >= numDataStreams) continue;
+        const int templateLength = (int) unit.spikeTemplate.size();
+        if (unit.templateIndex < 0 && unit.spikeStartSample < blockStart) {
+            // Stream was not enabled when this spike was due; resume from the present.
+            scheduleNextSpike(unit, blockStart);
+        }
+        int offset = 0;
+        while (true) {
+            if (unit.templateIndex < 0) {
+                if (unit.spikeStartSample >= blockEnd) break;
+                unit.templateIndex = 0;
+                offset = (int) (unit.spikeStartSample - blockStart);
+            }
+            int count = std::min(templateLength - unit.templateIndex, samplesPerBlock - offset);
+            float* pWrite = &amplifierBlock[offset * numLanes + unit.channel * numDataStreams + unit.stream];
+            const float* pRead = &unit.spikeTemplate[unit.templateIndex];
+            for (int i = 0; i < count; ++i) {
+                pWrite[i * numLanes] += pRead[i];
+            }
+            unit.templateIndex += count;
+            if (unit.templateIndex < templateLength) break;    // Spike continues into the next block
+            unit.templateIndex = -1;
+            scheduleNextSpike(unit, unit.spikeStartSample + templateLength + unit.refractorySamples);
+        }
+    }
+
+    // Impedance test waveform.
+    if (impedanceTestChannel >= 0) {
+        for (int stream = 0; stream < numDataStreams; ++stream) {
+            float* pWrite = &amplifierBlock[impedanceTestChannel * numDataStreams + stream];
+            const float* testWaveform = &impedanceTestWaveform[stream * impedanceTestPeriod];
+            for (int sample = 0; sample < samplesPerBlock; ++sample) {
+                int64_t t = (blockStart + sample - impedanceTestStart) % impedanceTestPeriod;
+                pWrite[sample * numLanes] += testWaveform[t];
+            }
+        }
+    }
+
+    sampleCount += samplesPerBlock;
+}
+
 // Synthesize a certain number of USB data blocks, if the appropriate time has elapsed, and writes the raw bytes
-// to a buffer.  Return total number of bytes read.
+// to a buffer.  Return total number of bytes read.  If speed is zero, blocks are synthesized without waiting.
 long SynthDataBlockGenerator::readSynthDataBlocksRaw(int numBlocks, uint8_t* buffer, int numDataStreams)
 {
-    double elapsedTime = (double)timer.nsecsElapsed();
-    double targetTime = (double)numBlocks * dataBlockPeriodInNsec;
-    double excessTime = elapsedTime - (targetTime - timeDeficitInNsec);
+    if (speed > 0.0) {
+        double elapsedTime = (double)timer.nsecsElapsed();
+        double targetTime = (double)numBlocks * dataBlockPeriodInNsec / speed;
+        double excessTime = elapsedTime - (targetTime - timeDeficitInNsec);
 
-    if (excessTime < 0.0) return 0; // Not enough time has passed; wait for the data to be ready
+        if (excessTime < 0.0) return 0; // Not enough time has passed; wait for the data to be ready
 
-    timer.start();
+        timer.start();
 
-    timeDeficitInNsec = excessTime; // Remember excess time and subtract it from next time meausurement;
-                                    // We need to do this to maintain the sample rate accurately.
-    if (timeDeficitInNsec > targetTime) {   // But don't let the deficit be too large in any one pass.
-        timeDeficitInNsec = targetTime;
+        timeDeficitInNsec = excessTime; // Remember excess time and subtract it from next time meausurement;
+                                        // We need to do this to maintain the sample rate accurately.
+        if (timeDeficitInNsec > targetTime) {   // But don't let the deficit be too large in any one pass.
+            timeDeficitInNsec = targetTime;
+        }
     }
 
     createSynthDataBlock(numBlocks, numDataStreams);
 
     long numWords = numBlocks * RHXDataBlock::dataBlockSizeInWords(type, numDataStreams);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
     uint16_t* pRead = usbWords;
     uint8_t* pWrite = buffer;
     for (long i = 0; i < numWords; ++i) {
@@ -320,15 +497,27 @@ long SynthDataBlockGenerator::readSynthDataBlocksRaw(int numBlocks, uint8_t* buf
         pWrite++;
         pRead++;
     }
+#else
+    std::memcpy(buffer, usbWords, BytesPerWord * numWords);
+#endif
 
     return BytesPerWord * numWords;
 }
 
 void SynthDataBlockGenerator::createSynthDataBlock(int numBlocks, int numDataStreams)
 {
+    const int channelsPerStream = RHXDataBlock::channelsPerStream(type);
+    const int samplesPerBlock = RHXDataBlock::samplesPerDataBlock(type);
+    const int numLanes = channelsPerStream * numDataStreams;
+
     uint16_t* pWrite = usbWords;
     for (int block = 0; block < numBlocks; ++block) {
-        for (int sample = 0; sample < RHXDataBlock::samplesPerDataBlock(type); ++sample) {
+        createAmplifierBlock(numDataStreams);
+        convertToAmpADCValues(amplifierBlock.data(), laneWords.data(), samplesPerBlock * numLanes);
+
+        for (int sample = 0; sample < samplesPerBlock; ++sample) {
+            const uint16_t* ampWords = &laneWords[sample * numLanes];
+
             // Write header magic number.
             uint64_t header = RHXDataBlock::headerMagicNumber(type);
             pWrite[0] = (uint16_t) ((header & 0x000000000000ffffUL) >> 0);
@@ -370,14 +559,9 @@ void SynthDataBlockGenerator::createSynthDataBlock(int numBlocks, int numDataStr
                         pWrite++;
                     }
                 }
-                // Write amplifier data (same for all streams to save CPU time).
-                for (int channel = 0; channel < RHXDataBlock::channelsPerStream(type); ++channel) {
-                    uint16_t value = synthSources[0][channel]->nextSample();
-                    for (int stream = 0; stream < numDataStreams; ++stream) {
-                        *pWrite = value;
-                        pWrite++;
-                    }
-                }
+                // Write amplifier data; already in [channel][stream] order.
+                std::memcpy(pWrite, ampWords, numLanes * sizeof(uint16_t));
+                pWrite += numLanes;
                 break;
             case ControllerStimRecord:
                 // Write auxiliary command 1-3 results.
@@ -388,14 +572,11 @@ void SynthDataBlockGenerator::createSynthDataBlock(int numBlocks, int numDataStr
                         pWrite += 2;
                     }
                 }
-                // Write amplifier data (same for all streams to save CPU time).
-                for (int channel = 0; channel < RHXDataBlock::channelsPerStream(type); ++channel) {
-                    uint16_t value = synthSources[0][channel]->nextSample();
-                    for (int stream = 0; stream < numDataStreams; ++stream) {
-                        pWrite[0] = (uint16_t) dcAmpSample;   // DC amplifier result; same on all channels here
-                        pWrite[1] = value; // AC amplifier result
-                        pWrite += 2;
-                    }
+                // Write amplifier data.
+                for (int lane = 0; lane < numLanes; ++lane) {
+                    pWrite[0] = (uint16_t) dcAmpSample;   // DC amplifier result; same on all channels here
+                    pWrite[1] = ampWords[lane]; // AC amplifier result
+                    pWrite += 2;
                 }
                 // Write auxiliary command 0 results.
                 for (int stream = 0; stream < numDataStreams; ++stream) {
@@ -418,31 +599,11 @@ void SynthDataBlockGenerator::createSynthDataBlock(int numBlocks, int numDataStr
                 pWrite++;
             }
 
-            // Write stimulation data (ControllerStimRecord only).
+            // Write stimulation data (ControllerStimRecord only): stimulation on/off, stimulation polarity, amplifier
+            // settle, and charge recovery, all zero.
             if (type == ControllerStimRecord) {
-                // Write stimulation on/off data.
-                for (int stream = 0; stream < numDataStreams; ++stream) {
-                    *pWrite = 0U;
-                    // *pWrite = (block == 0) ? 1U : 0U;   // TEMP
-                    pWrite++;
-                }
-                // Write stimulation polarity data.
-                for (int stream = 0; stream < numDataStreams; ++stream) {
-                    *pWrite = 0U;
-                    pWrite++;
-                }
-                // Write amplifier settle data.
-                for (int stream = 0; stream < numDataStreams; ++stream) {
-                    *pWrite = 0U;
-                    // *pWrite = (block == 1 || block == 2) ? 1U : 0U;   // TEMP
-                    pWrite++;
-                }
-                // Write charge recovery data.
-                for (int stream = 0; stream < numDataStreams; ++stream) {
-                    *pWrite = 0U;
-                    // *pWrite = (block == 2) ? 1U : 0U;   // TEMP
-                    pWrite++;
-                }
+                std::memset(pWrite, 0, 4 * numDataStreams * sizeof(uint16_t));
+                pWrite += 4 * numDataStreams;
             }
 
             // Write Analog Out data (ControllerStimRecord only).
@@ -35,9 +35,12 @@
 #include "randomnumber.h"
 #include "rhxdatablock.h"
 #include <QElapsedTimer>
+#include <complex>
 #include <cstdint>
 #include <vector>
 
+const unsigned int DefaultSynthSeed = 4;
+
 class AbstractSynthSource
 {
 public:
@@ -50,43 +53,6 @@ protected:
     double tStepMsec;
     double tMsec;
     RandomNumber* randomGenerator;
-
-    uint16_t convertToAmpADCValue(double electrodeMicrovolts) const;
-};
-
-class NeuralSynthSource : public AbstractSynthSource
-{
-public:
-    NeuralSynthSource(RandomNumber* randomGenerator_, double sampleRate, int nUnits_);
-    void reset() override;
-    uint16_t nextSample() override;
-
-private:
-    int nUnits;
-    std::vector<double> spikeAmplitude;
-    std::vector<double> spikeDurationMsec;
-    std::vector<double> spikeRateHz;
-    std::vector<bool> firing;
-    std::vector<double> spikeTimeMsec;
-
-    const double NoiseRMSLevelMicroVolts = 5.0;  // 5 uV rms typical cortical background noise
-    const double SpikeRefractoryPeriodMsec = 5.0;
-    const double LFPFrequencyHz = 2.3;
-    const double LFPModulationHz = 0.5;
-
-    double LFPVoltage() const;
-    double nextSpikeVoltage(int unit);
-};
-
-class ECGSynthSource : public AbstractSynthSource
-{
-public:
-    ECGSynthSource(RandomNumber* randomGenerator_, double sampleRate);
-    void reset() override;
-    uint16_t nextSample() override;
-
-private:
-    double ecgAmplitude;
 };
 
 class ADCSynthSource : public AbstractSynthSource
@@ -112,32 +78,102 @@ private:
     double periodMsec;
 };
 
+// One synthetic neuron recorded on one amplifier channel.
+struct SynthUnit
+{
+    int stream;
+    int channel;
+    std::vector<float> spikeTemplate;   // Spike waveform in microvolts, one value per sample
+    double spikesPerSample;             // Peak firing rate
+    int refractorySamples;
+    int64_t spikeStartSample;           // Start of the spike in progress, or of the next spike
+    int templateIndex;                  // Next template sample of the spike in progress, or -1 if none
+};
+
+// Generates USB data blocks for SyntheticRHXController.  Amplifier channels are built from precomputed tables: a
+// periodic background waveform (LFP, or ECG at low sample rates) with a per-channel gain and per-stream phase, Gaussian
+// noise read from a random offset in a noise table, and spike templates of two units per channel.  Every stream has its
+// own units and its own seeded random number generator, so activity is independent across streams and identical from
+// run to run for a given seed.
 class SynthDataBlockGenerator
 {
 public:
-    SynthDataBlockGenerator(ControllerType type_, double sampleRate_);
+    SynthDataBlockGenerator(ControllerType type_, double sampleRate_, unsigned int seed = DefaultSynthSeed);
     ~SynthDataBlockGenerator();
 
     long readSynthDataBlocksRaw(int numBlocks, uint8_t* buffer, int numDataStreams);
     void reset();
 
+    // Generate data at speed_ times real time, or as fast as it is read if speed_ is zero.
+    void setSpeed(double speed_) { speed = speed_ < 0.0 ? 0.0 : speed_; }
+    double getSpeed() const { return speed; }
+
+    // Impedance test emulation.  While enabled, chipChannel of every stream carries the voltage that the on-chip test
+    // current (the repeating Zcheck DAC waveform set by setImpedanceTestDacWaveform(), through seriesCapacitance)
+    // develops across that channel's synthetic electrode in parallel with the amplifier input capacitance, delayed by
+    // the 3-command SPI pipeline.  Amplitudes are scaled so that ImpedanceReader recovers the electrode impedance.
+    void setImpedanceTestDacWaveform(const std::vector<double>& dacWaveformVolts);  // One value per sample
+    void setImpedanceTest(int chipChannel, double seriesCapacitance);
+    void disableImpedanceTest() { impedanceTestChannel = -1; }
+    void restartImpedanceTest() { impedanceTestStart = sampleCount; }   // Test waveform restarts with the next block.
+
+    // Synthetic electrode impedance of an amplifier channel at frequency (in Hz): magnitude in ohms, phase in degrees.
+    // Electrodes are modeled as constant phase elements, so the phase does not depend on frequency.
+    double electrodeImpedanceMagnitude(int stream, int channel, double frequency) const;
+    double electrodeImpedancePhase(int stream, int channel) const;
+
 private:
+    static const int NoiseTableSize = 65536;
+    const double NoiseRMSLevelMicroVolts = 5.0;  // 5 uV rms typical cortical background noise
+    const double ECGNoiseRMSLevelMicroVolts = 2.4;
+    const double SpikeRefractoryPeriodMsec = 5.0;
+    const double LFPFrequencyHz = 2.3;
+    const double LFPModulationHz = 0.5;
+    const int UnitsPerChannel = 2;
+    const double ImpedanceTestPipelineDelay = 3.0;    // Samples
+    const double ImpedanceTestDacStepVolts = 1.225 / 256.0;
+    const double ElectrodeReferenceFrequency = 1000.0;  // Frequency at which electrodeMagnitude applies, in Hz
+
     ControllerType type;
     double sampleRate;
+    double speed;
     RandomNumber* randomGenerator;
+    std::vector<RandomNumber*> streamRandomGenerators;
     uint16_t* usbWords;
     uint32_t tIndex;
+    int64_t sampleCount;    // Samples generated since construction; unlike tIndex, not cleared by reset()
     QElapsedTimer timer;
     double dataBlockPeriodInNsec;
     double timeDeficitInNsec;
-    std::vector<std::vector<AbstractSynthSource*> > synthSources;
     std::vector<ADCSynthSource*> adcSynthSources;
     std::vector<DigitalSynthSource*> digitalSynthSources;
 
+    std::vector<float> noiseTable;          // NoiseTableSize values, followed by a copy of the first values for wraparound
+    std::vector<float> backgroundTable;     // One period of the background waveform
+    std::vector<int> backgroundPhase;       // Per stream
+    std::vector<float> backgroundGain;      // Per stream and channel: [stream * channelsPerStream + channel]
+    std::vector<SynthUnit> units;
+    std::vector<float> electrodeMagnitude;  // Per stream and channel, in ohms at ElectrodeReferenceFrequency
+    std::vector<float> electrodePhase;      // Per stream and channel, in degrees
+    int impedanceTestChannel;               // -1 if no impedance test is running
+    int impedanceTestPeriod;
+    int64_t impedanceTestStart;             // sampleCount at which the test waveform is at phase zero
+    std::vector<int> impedanceTestHarmonics;    // Harmonics of the DAC waveform that are at least one DAC step
+    std::vector<std::complex<double> > impedanceTestDacPhasors;  // Per harmonic, in volts
+    std::vector<float> impedanceTestWaveform;   // [stream][t]: one period of the test voltage, in microvolts
+    std::vector<float> amplifierBlock;      // One data block of amplifier data: [sample][channel][stream]
+    std::vector<float> laneGain;            // backgroundGain in [channel][stream] order for the current number of streams
+    std::vector<float> laneBackground;
+    std::vector<uint16_t> laneWords;
+    int laneGainStreams;
+
     uint16_t auxInSample;
     uint16_t vddSample;
     uint16_t dcAmpSample;
 
+    void createTemplateTables(unsigned int seed);
+    void scheduleNextSpike(SynthUnit& unit, int64_t earliestSample);
+    void createAmplifierBlock(int numDataStreams);
     void createSynthDataBlock(int numBlocks, int numDataStreams);
 };
 
@@ -28,14 +28,20 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
 #include <iostream>
 #include <QDebug>
 #include "syntheticrhxcontroller.h"
 
-SyntheticRHXController::SyntheticRHXController(ControllerType type_, AmplifierSampleRate sampleRate_) :
-    AbstractRHXController(type_, sampleRate_)
+SyntheticRHXController::SyntheticRHXController(ControllerType type_, AmplifierSampleRate sampleRate_, unsigned int seed) :
+    AbstractRHXController(type_, sampleRate_),
+    continuousRunMode(true),
+    zcheckDacPeriod(0),
+    zcheckEnabled(false),
+    zcheckChannel(0),
+    zcheckScale(0)
 {
-    dataGenerator = new SynthDataBlockGenerator(type, getSampleRate(sampleRate));
+    dataGenerator = new SynthDataBlockGenerator(type, getSampleRate(sampleRate), seed);
 }
 
 SyntheticRHXController::~SyntheticRHXController()
@@ -98,6 +104,97 @@ long SyntheticRHXController::readDataBlocksRaw(int numBlocks, uint8_t *buffer)
     return dataGenerator->readSynthDataBlocksRaw(numBlocks, buffer, numDataStreams);
 }
 
+void SyntheticRHXController::setContinuousRunMode(bool continuousMode)
+{
+    std::lock_guard<std::mutex> lockOk(okMutex);
+    continuousRunMode = continuousMode;
+    updateImpedanceTest();
+}
+
+// No chips are programmed, but the impedance test settings in the command list are decoded so that the synthetic data
+// can emulate an impedance measurement: the Zcheck DAC waveform in AuxCmd1, and the Zcheck enable, series capacitor,
+// and channel select registers in AuxCmd3.
+void SyntheticRHXController::uploadCommandList(const std::vector<unsigned int> &commandList, AuxCmdSlot auxCommandSlot,
+                                               int /* bank */)
+{
+    std::lock_guard<std::mutex> lockOk(okMutex);
+
+    const bool rhs = (type == ControllerStimRecord);
+    int reg, data;
+    if (auxCommandSlot == AuxCmd1) {
+        const int dacRegister = rhs ? 3 : 6;
+        std::vector<double> dacWaveformVolts;
+        int minValue = 255;
+        int maxValue = 0;
+        bool dacWaveform = !commandList.empty();
+        for (unsigned int command : commandList) {
+            if (!decodeRegisterWrite(command, reg, data) || reg != dacRegister) {
+                dacWaveform = false;
+                break;
+            }
+            minValue = std::min(minValue, data);
+            maxValue = std::max(maxValue, data);
+            dacWaveformVolts.push_back((data - 128) * (1.225 / 256.0));
+        }
+        dacWaveform = dacWaveform && maxValue > minValue;
+        zcheckDacPeriod = dacWaveform ? (int) commandList.size() : 0;
+        if (dacWaveform) {
+            dataGenerator->setImpedanceTestDacWaveform(dacWaveformVolts);
+        }
+    } else if (auxCommandSlot == AuxCmd3) {
+        for (unsigned int command : commandList) {
+            if (!decodeRegisterWrite(command, reg, data)) continue;
+            if (rhs && reg == 2) {
+                zcheckChannel = (data >> 8) & 0x3f;
+                zcheckScale = (data >> 3) & 0x03;
+                zcheckEnabled = (data & 0x01) != 0;
+            } else if (!rhs && reg == 5) {
+                zcheckScale = (data >> 3) & 0x03;
+                zcheckEnabled = (data & 0x01) != 0;
+            } else if (!rhs && reg == 7) {
+                zcheckChannel = data & 0x3f;
+            }
+        }
+    }
+    updateImpedanceTest();
+}
+
+// If command is an RHD or RHS register write, return true and its register address and data.
+bool SyntheticRHXController::decodeRegisterWrite(unsigned int command, int& reg, int& data) const
+{
+    if (type == ControllerStimRecord) {
+        if ((command & 0xc0000000U) != 0x80000000U) return false;
+        reg = (int) ((command >> 16) & 0xffU);
+        data = (int) (command & 0xffffU);
+    } else {
+        if ((command & 0xc000U) != 0x8000U) return false;
+        reg = (int) ((command >> 8) & 0x3fU);
+        data = (int) (command & 0xffU);
+    }
+    return true;
+}
+
+void SyntheticRHXController::updateImpedanceTest()
+{
+    if (continuousRunMode || !zcheckEnabled || zcheckDacPeriod == 0) {
+        dataGenerator->disableImpedanceTest();
+        return;
+    }
+    double seriesCapacitance;
+    switch (zcheckScale) {
+    case 0:
+        seriesCapacitance = 0.1e-12;
+        break;
+    case 1:
+        seriesCapacitance = 1.0e-12;
+        break;
+    default:
+        seriesCapacitance = 10.0e-12;
+        break;
+    }
+    dataGenerator->setImpedanceTest(zcheckChannel, seriesCapacitance);
+}
+
 // Set the delay for sampling the MISO line on a particular SPI port (PortA - PortH), in integer clock steps, where each
 // clock step is 1/2800 of a per-channel sampling period.  Note: Cable delay must be updated after sampleRate is changed,
 // since cable delay calculations are based on the clock frequency!
@@ -37,9 +37,19 @@
 class SyntheticRHXController : public AbstractRHXController
 {
 public:
-    SyntheticRHXController(ControllerType type_, AmplifierSampleRate sampleRate_);
+    SyntheticRHXController(ControllerType type_, AmplifierSampleRate sampleRate_, unsigned int seed = DefaultSynthSeed);
     ~SyntheticRHXController();
 
+    // Generate data at speed times real time, or as fast as it is read if speed is zero.
+    void setSynthSpeed(double speed) { dataGenerator->setSpeed(speed); }
+
+    // Impedance of the synthetic electrode on an amplifier channel at frequency (in Hz), which impedance measurements
+    // should recover.
+    double electrodeImpedanceMagnitude(int stream, int channel, double frequency) const
+        { return dataGenerator->electrodeImpedanceMagnitude(stream, channel, frequency); }
+    double electrodeImpedancePhase(int stream, int channel) const
+        { return dataGenerator->electrodeImpedancePhase(stream, channel); }
+
     bool isSynthetic() const override { return true; }
     bool isPlayback() const override { return false; }
     AcquisitionMode acquisitionMode() const override { return SyntheticMode; }
@@ -47,7 +57,7 @@ public:
     bool uploadFPGABitfile(const std::string& /* filename */) override { return true; }
     void resetBoard() override {}
 
-    void run() override {}
+    void run() override { dataGenerator->restartImpedanceTest(); }  // A run restarts the Zcheck DAC waveform.
     bool isRunning() override { return false; }
     void flush() override { dataGenerator->reset(); }
     void resetFpga() override {}
@@ -56,7 +66,7 @@ public:
     bool readDataBlocks(int numBlocks, std::deque<RHXDataBlock*> &dataQueue) override;
     long readDataBlocksRaw(int numBlocks, uint8_t *buffer) override;
 
-    void setContinuousRunMode(bool) override {}
+    void setContinuousRunMode(bool continuousMode) override;
     void setMaxTimeStep(unsigned int) override {}
     void setCableDelay(BoardPort port, int delay) override;
     void setDspSettle(bool) override {}
@@ -104,7 +114,7 @@ public:
     void clearTtlOut() override {}
     void resetSequencers() override {}
     void programStimReg(int, int, StimRegister, int) override {}
-    void uploadCommandList(const std::vector<unsigned int>&, AuxCmdSlot, int) override {}
+    void uploadCommandList(const std::vector<unsigned int> &commandList, AuxCmdSlot auxCommandSlot, int bank) override;
 
     int findConnectedChips(std::vector<ChipType> &chipType, std::vector<int> &portIndex, std::vector<int> &commandStream,
                            std::vector<int> &numChannelsOnPort, bool synthMaxChannels = false) override;
@@ -116,6 +126,17 @@ private:
     void forceAllDataStreamsOff() override {} // Used in FPGA initialization; no analog for synthetic.
 
     SynthDataBlockGenerator* dataGenerator;
+
+    // Impedance test settings decoded from uploaded command lists.  The test signal is generated only outside
+    // continuous run mode, as it is during ImpedanceReader::measureImpedances().
+    bool continuousRunMode;
+    int zcheckDacPeriod;        // Samples per period of the AuxCmd1 Zcheck DAC waveform, or 0 if there is none
+    bool zcheckEnabled;
+    int zcheckChannel;
+    int zcheckScale;
+
+    bool decodeRegisterWrite(unsigned int command, int& reg, int& data) const;
+    void updateImpedanceTest();
 };
 
 #endif // SYNTHETICRHXCONTROLLER_H
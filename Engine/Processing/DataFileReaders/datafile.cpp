@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 
 #include <iostream>
+#include <cstring>
 #include "datafile.h"
 
 
@@ -60,6 +61,18 @@ DataFile::~DataFile()
     close();
 }
 
+// Read numBytes raw (little endian) bytes with a single call, rather than one word at a time through the data
+// stream.  As with QDataStream, any bytes past the end of the file are returned as zero.
+int64_t DataFile::readBlock(char* dest, int64_t numBytes) const
+{
+    int64_t numBytesRead = file->read(dest, numBytes);
+    if (numBytesRead < 0) numBytesRead = 0;
+    if (numBytesRead < numBytes) {
+        memset(dest + numBytesRead, 0, numBytes - numBytesRead);
+    }
+    return numBytesRead;
+}
+
 void DataFile::close()
 {
     if (!file) return;
@@ -44,6 +44,7 @@ public:
     ~DataFile();
 
     QString getFileName() const { return QFileInfo(fileName).baseName(); }
+    QString getFilePath() const { return fileName; }
     int64_t fileSize() const { return file->size(); }
     int64_t pos() const { return file->pos(); }
     void seek(int64_t pos) { file->seek(pos); }
@@ -52,6 +53,7 @@ public:
     uint16_t readWord() const { uint16_t word; *dataStream >> word; return word; }
     int16_t readSignedWord() const { int16_t word; *dataStream >> word; return word; }
     int32_t readTimeStamp() const { int32_t timeStamp; *dataStream >> timeStamp; return timeStamp; }
+    int64_t readBlock(char* dest, int64_t numBytes) const;
     void close();
 
 private:
@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 
 #include <iostream>
+#include <cstring>
 #include "datafilereader.h"
 #include "datafilemanager.h"
 
@@ -187,20 +188,25 @@ long DataFileManager::readDataBlocksRaw(int numBlocks, uint8_t* buffer)
         return 0;
     }
 
+    // Header magic number and filler word count are the same for every frame, so compute them once.
+    uint8_t headerBytes[8];
+    uint64_t header = RHXDataBlock::headerMagicNumber(info->controllerType);
+    for (int i = 0; i < 8; ++i) {
+        headerBytes[i] = (header >> (8 * i)) & 0xffU;
+    }
+    int numFillerWords = 0;
+    if (type == ControllerRecordUSB2) {
+        numFillerWords = numDataStreams;
+    } else if (type == ControllerRecordUSB3) {
+        numFillerWords = numDataStreams % 4;
+    }
+
     uint16_t word;
     uint8_t* pWrite = buffer;
     for (int block = 0; block < numBlocks; ++block) {
         for (int sample = 0; sample < samplesPerDataBlock; ++sample) {
             // Write header magic number.
-            uint64_t header = RHXDataBlock::headerMagicNumber(info->controllerType);
-            pWrite[0] = (header & 0x00000000000000ffUL) >> 0;
-            pWrite[1] = (header & 0x000000000000ff00UL) >> 8;
-            pWrite[2] = (header & 0x0000000000ff0000UL) >> 16;
-            pWrite[3] = (header & 0x00000000ff000000UL) >> 24;
-            pWrite[4] = (header & 0x000000ff00000000UL) >> 32;
-            pWrite[5] = (header & 0x0000ff0000000000UL) >> 40;
-            pWrite[6] = (header & 0x00ff000000000000UL) >> 48;
-            pWrite[7] = (header & 0xff00000000000000UL) >> 56;
+            memcpy(pWrite, headerBytes, sizeof(headerBytes));
             pWrite += 8;
 
             // Load one-sample data frame.
@@ -304,17 +310,8 @@ long DataFileManager::readDataBlocksRaw(int numBlocks, uint8_t* buffer)
             }
 
             // Write filler words.
-            int numFillerWords = 0;
-            if (type == ControllerRecordUSB2) {
-                numFillerWords = numDataStreams;
-            } else if (type == ControllerRecordUSB3) {
-                numFillerWords = numDataStreams % 4;
-            }
-            for (int i = 0; i < numFillerWords; ++i) {
-                pWrite[0] = 0;
-                pWrite[1] = 0;
-                pWrite += 2;
-            }
+            memset(pWrite, 0, 2 * numFillerWords);
+            pWrite += 2 * numFillerWords;
 
             // Write stimulation data (ControllerStimRecord only).
             if (type == ControllerStimRecord) {
@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 
 #include <QFileInfo>
+#include <QtEndian>
 #include <iostream>
 #include "rhxglobals.h"
 #include "datafilereader.h"
@@ -51,6 +52,7 @@ TraditionalIntanFileManager::TraditionalIntanFileManager(const QString& fileName
 
     // Allocate buffers for reading entire data block at once.
     samplesPerDataBlock = info->samplesPerDataBlock;
+    dataBlockBuffer.resize(info->bytesPerDataBlock / sizeof(uint16_t));
     timeStampBuffer.resize(samplesPerDataBlock);
     amplifierDataBuffer.resize(samplesPerDataBlock * info->numEnabledAmplifierChannels);
     if (info->dcAmplifierDataSaved) {   // This parameter is accurate in traditional Intan format headers, even with old software.
@@ -155,41 +157,33 @@ QString TraditionalIntanFileManager::currentFileName() const
     return consecutiveFiles[consecutiveFileIndex].fileName;
 }
 
+// Copy one signal's section of the raw data block into its buffer (converting from little endian if necessary),
+// and advance pRead past it.
+template <typename T>
+static inline void unpackDataBlockSection(const uint16_t*& pRead, std::vector<T>& dest)
+{
+    if (dest.empty()) return;
+    qFromLittleEndian<T>(pRead, (qsizetype) dest.size(), dest.data());
+    pRead += dest.size() * sizeof(T) / sizeof(uint16_t);
+}
+
 void TraditionalIntanFileManager::loadNextDataBlock()
 {
-    for (int i = 0; i < (int) timeStampBuffer.size(); ++i) {
-        timeStampBuffer[i] = dataFile->readTimeStamp();
-    }
-    for (int i = 0; i < (int) amplifierDataBuffer.size(); ++i) {
-        amplifierDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) dcAmplifierDataBuffer.size(); ++i) {
-        dcAmplifierDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) stimDataBuffer.size(); ++i) {
-        stimDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) auxInputDataBuffer.size(); ++i) {
-        auxInputDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) supplyVoltageDataBuffer.size(); ++i) {
-        supplyVoltageDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) tempSensorBuffer.size(); ++i) {
-        tempSensorBuffer[i] = dataFile->readSignedWord();
-    }
-    for (int i = 0; i < (int) analogInDataBuffer.size(); ++i) {
-        analogInDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) analogOutDataBuffer.size(); ++i) {
-        analogOutDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) digitalInDataBuffer.size(); ++i) {
-        digitalInDataBuffer[i] = dataFile->readWord();
-    }
-    for (int i = 0; i < (int) digitalOutDataBuffer.size(); ++i) {
-        digitalOutDataBuffer[i] = dataFile->readWord();
-    }
+    dataFile->readBlock((char*) dataBlockBuffer.data(), dataBlockBuffer.size() * sizeof(uint16_t));
+
+    // Sections appear in the data block in this order.
+    const uint16_t* pRead = dataBlockBuffer.data();
+    unpackDataBlockSection(pRead, timeStampBuffer);
+    unpackDataBlockSection(pRead, amplifierDataBuffer);
+    unpackDataBlockSection(pRead, dcAmplifierDataBuffer);
+    unpackDataBlockSection(pRead, stimDataBuffer);
+    unpackDataBlockSection(pRead, auxInputDataBuffer);
+    unpackDataBlockSection(pRead, supplyVoltageDataBuffer);
+    unpackDataBlockSection(pRead, tempSensorBuffer);
+    unpackDataBlockSection(pRead, analogInDataBuffer);
+    unpackDataBlockSection(pRead, analogOutDataBuffer);
+    unpackDataBlockSection(pRead, digitalInDataBuffer);
+    unpackDataBlockSection(pRead, digitalOutDataBuffer);
 
     atEndOfCurrentFile = dataFile->atEnd();
 }
@@ -366,9 +360,12 @@ int64_t TraditionalIntanFileManager::jumpToTimeStamp(int64_t target)
     int64_t targetDataBlockInFile = (target - cumulativeSamples) / info->samplesPerDataBlock;
     if (targetDataBlockInFile < 0) targetDataBlockInFile = 0;
 
-    dataFile->close();
-    delete dataFile;
-    dataFile = new DataFile(consecutiveFiles[consecutiveFileIndex].fileName);
+    // Scrubbing within the current file only needs a seek; reopen only when the jump lands in another file.
+    if (dataFile->getFilePath() != consecutiveFiles[consecutiveFileIndex].fileName) {
+        dataFile->close();
+        delete dataFile;
+        dataFile = new DataFile(consecutiveFiles[consecutiveFileIndex].fileName);
+    }
     dataFile->seek(info->headerSizeInBytes + targetDataBlockInFile * info->bytesPerDataBlock);
 
     readIndex = target;
@@ -66,6 +66,9 @@ private:
     int samplesPerDataBlock;
     int positionInDataBlock;
 
+    // Raw little-endian data block, read from the file with a single call.
+    std::vector<uint16_t> dataBlockBuffer;
+
     //  Buffers for loading entire data block into memory.
     std::vector<int32_t> timeStampBuffer;
     std::vector<uint16_t> amplifierDataBuffer;
@@ -30,14 +30,23 @@
 
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 #include "fileperchannelsavemanager.h"
 
+namespace {
+
+const int ChannelBatch = 64;        // Amplifier channels copied out of WaveformFifo together (see writeAmplifierChannels()).
+const int ChannelGranularity = 8;   // Keep worker channel ranges aligned with WaveformFifo's eight-channel transposes.
+
+}
+
 // One file per signal type file format
 FilePerChannelSaveManager::FilePerChannelSaveManager(WaveformFifo* waveformFifo_, SystemState* state_) :
     SaveManager(waveformFifo_, state_),
     infoFile(nullptr),
-    timeStampFile(nullptr)
+    timeStampFile(nullptr),
+    workerPool(state_->saveThreads->getValue())
 {
     saveSpikeSnapshot = false;
     samplesPreDetect = 0;
@@ -78,6 +87,8 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
 {
     const QString DataFileExtension = ".dat";
     int bufferSize = calculateBufferSize(state);
+    FileWriterOptions writerOptions = fileWriterOptions();
+    workerPool.setNumThreads(state->saveThreads->getValue());
     //int bufferSize = 128;
 
     dateTimeStamp = getDateTimeStamp();
@@ -99,11 +110,12 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     state->saveGlobalSettings(subdirPath + "settings.xml");
 
     liveNotesFileName = subdirPath + "notes.txt";
-    infoFile = new SaveFile(subdirPath + "info" + intanFileExtension(), bufferSize);
+    noiseLogFileName = subdirPath + "noise.csv";
+    infoFile = new SaveFile(subdirPath + "info" + intanFileExtension(), bufferSize, writerOptions);
     if (!infoFile->isOpen()) {
         return false;
     }
-    timeStampFile = new SaveFile(subdirPath + "time" + DataFileExtension, bufferSize);
+    timeStampFile = new SaveFile(subdirPath + "time" + DataFileExtension, bufferSize, writerOptions);
     if (!timeStampFile->isOpen()) {
         return false;
     }
@@ -113,7 +125,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
         if (state->saveWidebandAmplifierWaveforms->getValue()) {
             amplifierFiles.push_back(new SaveFile(subdirPath + "amp-" + QString::fromStdString(saveList.amplifier[i]) +
-                                                  DataFileExtension, bufferSize));
+                                                  DataFileExtension, bufferSize, writerOptions));
             if (!amplifierFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -121,7 +133,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
         }
         if (state->saveLowpassAmplifierWaveforms->getValue()) {
             lowpassAmplifierFiles.push_back(new SaveFile(subdirPath + "low-" + QString::fromStdString(saveList.amplifier[i]) +
-                                                         DataFileExtension, bufferSize));
+                                                         DataFileExtension, bufferSize, writerOptions));
             if (!lowpassAmplifierFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -129,7 +141,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
         }
         if (state->saveHighpassAmplifierWaveforms->getValue()) {
             highpassAmplifierFiles.push_back(new SaveFile(subdirPath + "high-" + QString::fromStdString(saveList.amplifier[i]) +
-                                                          DataFileExtension, bufferSize));
+                                                          DataFileExtension, bufferSize, writerOptions));
             if (!highpassAmplifierFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -137,7 +149,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
         }
         if (state->saveSpikeData->getValue()) {
             spikeFiles.push_back(new SaveFile(subdirPath + "spike-" + QString::fromStdString(saveList.amplifier[i]) +
-                                              DataFileExtension, bufferSize));
+                                              DataFileExtension, bufferSize, writerOptions));
             if (!spikeFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -186,7 +198,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
         if (type == ControllerStimRecord) {
             if (saveList.stimEnabled[i]) {
                 stimFiles.push_back(new SaveFile(subdirPath + "stim-" + QString::fromStdString(saveList.amplifier[i]) +
-                                                 DataFileExtension, bufferSize));
+                                                 DataFileExtension, bufferSize, writerOptions));
                 if (!stimFiles.back()->isOpen()) {
                     closeAllSaveFiles();
                     return false;
@@ -194,7 +206,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
             }
             if (state->saveDCAmplifierWaveforms->getValue()) {
                 dcAmplifierFiles.push_back(new SaveFile(subdirPath + "dc-" + QString::fromStdString(saveList.amplifier[i]) +
-                                                        DataFileExtension, bufferSize));
+                                                        DataFileExtension, bufferSize, writerOptions));
                 if (!dcAmplifierFiles.back()->isOpen()) {
                     closeAllSaveFiles();
                     return false;
@@ -205,7 +217,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     if (type != ControllerStimRecord) {
         for (int i = 0; i < (int) saveList.auxInput.size(); ++i) {
             auxInputFiles.push_back(new SaveFile(subdirPath + "aux-" + QString::fromStdString(saveList.auxInput[i]) +
-                                                 DataFileExtension, bufferSize));
+                                                 DataFileExtension, bufferSize, writerOptions));
             if (!auxInputFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -213,7 +225,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
         }
         for (int i = 0; i < (int) saveList.supplyVoltage.size(); ++i) {
             supplyVoltageFiles.push_back(new SaveFile(subdirPath + "vdd-" + QString::fromStdString(saveList.supplyVoltage[i]) +
-                                                      DataFileExtension, bufferSize));
+                                                      DataFileExtension, bufferSize, writerOptions));
             if (!supplyVoltageFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -222,7 +234,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     }
     for (int i = 0; i < (int) saveList.boardAdc.size(); ++i) {
         analogInputFiles.push_back(new SaveFile(subdirPath + "board-" + QString::fromStdString(saveList.boardAdc[i]) +
-                                                DataFileExtension, bufferSize));
+                                                DataFileExtension, bufferSize, writerOptions));
         if (!analogInputFiles.back()->isOpen()) {
             closeAllSaveFiles();
             return false;
@@ -231,7 +243,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     if (type == ControllerStimRecord) {
         for (int i = 0; i < (int) saveList.boardDac.size(); ++i) {
             analogOutputFiles.push_back(new SaveFile(subdirPath + "board-" + QString::fromStdString(saveList.boardDac[i]) +
-                                                     DataFileExtension, bufferSize));
+                                                     DataFileExtension, bufferSize, writerOptions));
             if (!analogOutputFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -240,7 +252,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     }
     for (int i = 0; i < (int) saveList.boardDigitalIn.size(); ++i) {
         digitalInputFiles.push_back(new SaveFile(subdirPath + "board-" + QString::fromStdString(saveList.boardDigitalIn[i]) +
-                                                 DataFileExtension, bufferSize));
+                                                 DataFileExtension, bufferSize, writerOptions));
         if (!digitalInputFiles.back()->isOpen()) {
             closeAllSaveFiles();
             return false;
@@ -250,7 +262,7 @@ bool FilePerChannelSaveManager::openAllSaveFiles()
     if (!saveList.boardDigitalOut.empty()) {
         for (int i = 0; i < (int) saveList.boardDigitalOut.size(); ++i) {
             digitalOutputFiles.push_back(new SaveFile(subdirPath + "board-" + QString::fromStdString(saveList.boardDigitalOut[i]) +
-                                                      DataFileExtension, bufferSize));
+                                                      DataFileExtension, bufferSize, writerOptions));
             if (!digitalOutputFiles.back()->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -271,6 +283,9 @@ void FilePerChannelSaveManager::closeAllSaveFiles()
         delete liveNotesFile;
         liveNotesFile = nullptr;
     }
+    if (noiseLogFile) {
+        noiseLogFile->close();
+    }
 
     if (timeStampFile) {
         timeStampFile->close();
@@ -389,44 +404,56 @@ void FilePerChannelSaveManager::closeAllSaveFiles()
     digitalOutputFileIndices.clear();
 }
 
-int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeIndex)
+// Write amplifier (wideband, lowpass, highpass) and spike data for amplifier channels [firstChannel, lastChannel).
+// Every channel has its own files, so this may be called concurrently from several worker threads as long as the
+// channel ranges do not overlap.  Returns the sum of getNumBytesWritten() over the files written.
+int64_t FilePerChannelSaveManager::writeAmplifierChannels(int firstChannel, int lastChannel, int numSamples, int timeIndex,
+                                                          std::vector<uint16_t>& arena)
 {
-    float* vArray = new float [numSamples];
-    uint16_t* uint16Array = new uint16_t [numSamples];
     int64_t numBytesWritten = 0;
+    int downsampleFactor = (int) state->lowpassWaveformDownsampleRate->getNumericValue();
+    bool saveWideband = state->saveWidebandAmplifierWaveforms->getValue();
+    bool saveLowpass = state->saveLowpassAmplifierWaveforms->getValue();
+    bool saveHighpass = state->saveHighpassAmplifierWaveforms->getValue();
 
-    // Save timestamp data.
-    for (int t = 0; t < numSamples; ++t) {
-        timeStampFile->writeInt32((int) waveformFifo->getTimeStamp(WaveformFifo::ReaderDisk, timeIndex + t) - timeStampOffset);
-    }
-    numBytesWritten += timeStampFile->getNumBytesWritten();
+    if (arena.size() < (size_t) (ChannelBatch * numSamples)) arena.resize(ChannelBatch * numSamples);
+    uint16_t* channelData[ChannelBatch];
 
-    // Save amplifier data.
-    int downsampleFactor = (int) state->lowpassWaveformDownsampleRate->getNumericValue();
-    for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
-        if (state->saveWidebandAmplifierWaveforms->getValue()) {
-            waveformFifo->copyGpuAmplifierDataRaw(WaveformFifo::ReaderDisk, uint16Array, amplifierGPUWaveform[i], timeIndex,
-                                                  numSamples);
-            amplifierFiles[i]->writeUInt16AsSigned(uint16Array, numSamples);
-            numBytesWritten += amplifierFiles[i]->getNumBytesWritten();
+    for (int first = firstChannel; first < lastChannel; first += ChannelBatch) {
+        int batchSize = std::min(ChannelBatch, lastChannel - first);
+        for (int j = 0; j < batchSize; ++j) {
+            channelData[j] = &arena[j * numSamples];
         }
-        if (state->saveLowpassAmplifierWaveforms->getValue()) {
-            waveformFifo->copyGpuAmplifierDataRaw(WaveformFifo::ReaderDisk, uint16Array, amplifierLowpassGPUWaveform[i], timeIndex,
-                                                  numSamples, downsampleFactor);
-            lowpassAmplifierFiles[i]->writeUInt16AsSigned(uint16Array, numSamples / downsampleFactor);
-            numBytesWritten += lowpassAmplifierFiles[i]->getNumBytesWritten();
+
+        if (saveWideband) {
+            waveformFifo->copyGpuAmplifierChannelsRaw(WaveformFifo::ReaderDisk, channelData, &amplifierGPUWaveform[first],
+                                                      batchSize, timeIndex, numSamples);
+            for (int j = 0; j < batchSize; ++j) {
+                amplifierFiles[first + j]->writeUInt16AsSigned(channelData[j], numSamples);
+                numBytesWritten += amplifierFiles[first + j]->getNumBytesWritten();
+            }
         }
-        if (state->saveHighpassAmplifierWaveforms->getValue()) {
-            waveformFifo->copyGpuAmplifierDataRaw(WaveformFifo::ReaderDisk, uint16Array, amplifierHighpassGPUWaveform[i], timeIndex,
-                                                  numSamples);
-            highpassAmplifierFiles[i]->writeUInt16AsSigned(uint16Array, numSamples);
-            numBytesWritten += highpassAmplifierFiles[i]->getNumBytesWritten();
+        if (saveLowpass) {
+            waveformFifo->copyGpuAmplifierChannelsRaw(WaveformFifo::ReaderDisk, channelData, &amplifierLowpassGPUWaveform[first],
+                                                      batchSize, timeIndex, numSamples / downsampleFactor, downsampleFactor);
+            for (int j = 0; j < batchSize; ++j) {
+                lowpassAmplifierFiles[first + j]->writeUInt16AsSigned(channelData[j], numSamples / downsampleFactor);
+                numBytesWritten += lowpassAmplifierFiles[first + j]->getNumBytesWritten();
+            }
+        }
+        if (saveHighpass) {
+            waveformFifo->copyGpuAmplifierChannelsRaw(WaveformFifo::ReaderDisk, channelData, &amplifierHighpassGPUWaveform[first],
+                                                      batchSize, timeIndex, numSamples);
+            for (int j = 0; j < batchSize; ++j) {
+                highpassAmplifierFiles[first + j]->writeUInt16AsSigned(channelData[j], numSamples);
+                numBytesWritten += highpassAmplifierFiles[first + j]->getNumBytesWritten();
+            }
         }
     }
 
     // Save spike data.
     if (state->saveSpikeData->getValue()) {
-        for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
+        for (int i = firstChannel; i < lastChannel; ++i) {
             for (int t = timeIndex - samplesPostDetect; t < timeIndex + numSamples - samplesPostDetect; ++t) {
                 uint8_t spikeId = (uint8_t) waveformFifo->getDigitalData(WaveformFifo::ReaderDisk, spikeWaveform[i], t);
                 if (spikeId != SpikeIdNoSpike) {
@@ -446,7 +473,7 @@ int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeInde
         }
 
         // Force flush all channel files for which enough spikes have accumulated and the last forced flush was at least 0.1 s ago
-        for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
+        for (int i = firstChannel; i < lastChannel; ++i) {
             if ((spikeCounter[i] >= 1) && (mostRecentSpikeTimestamp[i] - lastForceFlushTimestamp[i] >= tenthOfSecondTimestamps)) {
                 spikeCounter[i] = 0;
                 lastForceFlushTimestamp[i] = mostRecentSpikeTimestamp[i];
@@ -454,14 +481,43 @@ int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeInde
             }
         }
     }
+    return numBytesWritten;
+}
+
+int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeIndex)
+{
+    if ((int) vArray.size() < numSamples) vArray.resize(numSamples);
+    if ((int) uint16Array.size() < numSamples) uint16Array.resize(numSamples);
+    int64_t numBytesWritten = 0;
+
+    // Save timestamp data.
+    for (int t = 0; t < numSamples; ++t) {
+        timeStampFile->writeInt32((int) waveformFifo->getTimeStamp(WaveformFifo::ReaderDisk, timeIndex + t) - timeStampOffset);
+    }
+    numBytesWritten += timeStampFile->getNumBytesWritten();
+
+    // Save amplifier and spike data, with the channels divided among the worker pool.
+    int numWorkers = workerPool.numThreads();
+    if ((int) workerArenas.size() < numWorkers) workerArenas.resize(numWorkers);
+    workerBytesWritten.assign(numWorkers, 0);
+    int numAmplifierChannels = (int) saveList.amplifier.size();
+    workerPool.run([&](int worker, int numWorkers_) {
+        int firstChannel, lastChannel;
+        WorkerPool::partition(numAmplifierChannels, ChannelGranularity, worker, numWorkers_, firstChannel, lastChannel);
+        if (firstChannel >= lastChannel) return;
+        workerBytesWritten[worker] = writeAmplifierChannels(firstChannel, lastChannel, numSamples, timeIndex, workerArenas[worker]);
+    });
+    for (int64_t bytes : workerBytesWritten) {
+        numBytesWritten += bytes;
+    }
 
     if (type == ControllerStimRecord) {
         // Save DC amplifier data.
         if (state->saveDCAmplifierWaveforms->getValue()) {
             for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
-                waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray, dcAmplifierWaveform[i], timeIndex, numSamples);
-                convertDcAmplifierValue(uint16Array, vArray, numSamples);
-                dcAmplifierFiles[i]->writeUInt16(uint16Array, numSamples);
+                waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray.data(), dcAmplifierWaveform[i], timeIndex, numSamples);
+                convertDcAmplifierValue(uint16Array.data(), vArray.data(), numSamples);
+                dcAmplifierFiles[i]->writeUInt16(uint16Array.data(), numSamples);
                 numBytesWritten += dcAmplifierFiles[i]->getNumBytesWritten();
             }
         }
@@ -471,8 +527,8 @@ int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeInde
                         // in some channels (as is usually the case).
         for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
             if (saveList.stimEnabled[i]) {
-                waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array, stimFlagsWaveform[i], timeIndex, numSamples);
-                stimFiles[iFile]->writeUInt16StimData(uint16Array, numSamples, posStimAmplitudes[i], negStimAmplitudes[i]);
+                waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array.data(), stimFlagsWaveform[i], timeIndex, numSamples);
+                stimFiles[iFile]->writeUInt16StimData(uint16Array.data(), numSamples, posStimAmplitudes[i], negStimAmplitudes[i]);
                 numBytesWritten += stimFiles[iFile]->getNumBytesWritten();
                 ++iFile;
             }
@@ -482,56 +538,54 @@ int64_t FilePerChannelSaveManager::writeToSaveFiles(int numSamples, int timeInde
     if (type != ControllerStimRecord) {
         // Save auxiliary input data.
         for (int i = 0; i < (int) saveList.auxInput.size(); ++i) {
-            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray, auxInputWaveform[i], timeIndex, numSamples);
-            convertAuxInputValue(uint16Array, vArray, numSamples);
-            auxInputFiles[i]->writeUInt16(uint16Array, numSamples);
+            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray.data(), auxInputWaveform[i], timeIndex, numSamples);
+            convertAuxInputValue(uint16Array.data(), vArray.data(), numSamples);
+            auxInputFiles[i]->writeUInt16(uint16Array.data(), numSamples);
             numBytesWritten += auxInputFiles[i]->getNumBytesWritten();
         }
 
         // Save supply voltage data.
         for (int i = 0; i < (int) saveList.supplyVoltage.size(); ++i) {
-            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray, supplyVoltageWaveform[i], timeIndex, numSamples);
-            convertSupplyVoltageValue(uint16Array, vArray, numSamples);
-            supplyVoltageFiles[i]->writeUInt16(uint16Array, numSamples);
+            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray.data(), supplyVoltageWaveform[i], timeIndex, numSamples);
+            convertSupplyVoltageValue(uint16Array.data(), vArray.data(), numSamples);
+            supplyVoltageFiles[i]->writeUInt16(uint16Array.data(), numSamples);
             numBytesWritten += supplyVoltageFiles[i]->getNumBytesWritten();
         }
     }
 
     // Save board ADC data.
     for (int i = 0; i < (int) saveList.boardAdc.size(); ++i) {
-        waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray, boardAdcWaveform[i], timeIndex, numSamples);
-        convertBoardAdcValue(uint16Array, vArray, numSamples);
-        analogInputFiles[i]->writeUInt16(uint16Array, numSamples);
+        waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray.data(), boardAdcWaveform[i], timeIndex, numSamples);
+        convertBoardAdcValue(uint16Array.data(), vArray.data(), numSamples);
+        analogInputFiles[i]->writeUInt16(uint16Array.data(), numSamples);
         numBytesWritten += analogInputFiles[i]->getNumBytesWritten();
     }
 
     if (type == ControllerStimRecord) {
         // Save board DAC data.
         for (int i = 0; i < (int) saveList.boardDac.size(); ++i) {
-            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray, boardDacWaveform[i], timeIndex, numSamples);
-            convertBoardDacValue(uint16Array, vArray, numSamples);
-            analogOutputFiles[i]->writeUInt16(uint16Array, numSamples);
+            waveformFifo->copyAnalogData(WaveformFifo::ReaderDisk, vArray.data(), boardDacWaveform[i], timeIndex, numSamples);
+            convertBoardDacValue(uint16Array.data(), vArray.data(), numSamples);
+            analogOutputFiles[i]->writeUInt16(uint16Array.data(), numSamples);
             numBytesWritten += analogOutputFiles[i]->getNumBytesWritten();
         }
     }
 
     // Save board digital input data.
     for (int i = 0; i < (int) saveList.boardDigitalIn.size(); ++i) {
-        waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array, boardDigitalInWaveform, timeIndex, numSamples);
-        digitalInputFiles[i]->writeBitAsUInt16(uint16Array, numSamples, digitalInputFileIndices[i]);
+        waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array.data(), boardDigitalInWaveform, timeIndex, numSamples);
+        digitalInputFiles[i]->writeBitAsUInt16(uint16Array.data(), numSamples, digitalInputFileIndices[i]);
         numBytesWritten += digitalInputFiles[i]->getNumBytesWritten();
     }
 
     // Save board digital output data, optionally.
     if (!saveList.boardDigitalOut.empty()) {
         for (int i = 0; i < (int) saveList.boardDigitalOut.size(); ++i) {
-            waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array, boardDigitalOutWaveform, timeIndex, numSamples);
-            digitalOutputFiles[i]->writeBitAsUInt16(uint16Array, numSamples, digitalOutputFileIndices[i]);
+            waveformFifo->copyDigitalData(WaveformFifo::ReaderDisk, uint16Array.data(), boardDigitalOutWaveform, timeIndex, numSamples);
+            digitalOutputFiles[i]->writeBitAsUInt16(uint16Array.data(), numSamples, digitalOutputFileIndices[i]);
             numBytesWritten += digitalOutputFiles[i]->getNumBytesWritten();
         }
     }
-    delete [] vArray;
-    delete [] uint16Array;
 
     return numBytesWritten;
 }
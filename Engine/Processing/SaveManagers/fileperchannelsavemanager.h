@@ -36,6 +36,7 @@
 #include "waveformfifo.h"
 #include "systemstate.h"
 #include "savemanager.h"
+#include "workerpool.h"
 
 // One file per channel file format
 class FilePerChannelSaveManager : public SaveManager
@@ -76,6 +77,16 @@ private:
     int *mostRecentSpikeTimestamp;
     int tenthOfSecondTimestamps;
     int *lastForceFlushTimestamp;
+
+    // Amplifier channels are divided among the workers; each worker has its own scratch arena (reused from one call
+    // to the next) holding one batch of channels, and its own count of bytes written.
+    WorkerPool workerPool;
+    std::vector<std::vector<uint16_t> > workerArenas;
+    std::vector<int64_t> workerBytesWritten;
+    std::vector<float> vArray;
+    std::vector<uint16_t> uint16Array;
+
+    int64_t writeAmplifierChannels(int firstChannel, int lastChannel, int numSamples, int timeIndex, std::vector<uint16_t>& arena);
 };
 
 #endif // FILEPERCHANNELSAVEMANAGER_H
@@ -73,6 +73,7 @@ bool FilePerSignalTypeSaveManager::openAllSaveFiles()
     const QString DataFileExtension = ".dat";
     dateTimeStamp = getDateTimeStamp();
     int bufferSize = calculateBufferSize(state);
+    FileWriterOptions writerOptions = fileWriterOptions();
 
     QString subdirName, subdirPath;
     if (state->createNewDirectory->getValue()) {
@@ -92,44 +93,45 @@ bool FilePerSignalTypeSaveManager::openAllSaveFiles()
     // Write settings file.
     state->saveGlobalSettings(subdirPath + "settings.xml");
 
-    infoFile = new SaveFile(subdirPath + "info" + intanFileExtension(), bufferSize);
+    infoFile = new SaveFile(subdirPath + "info" + intanFileExtension(), bufferSize, writerOptions);
     if (!infoFile->isOpen()) {
         closeAllSaveFiles();
         return false;
     }
-    timeStampFile = new SaveFile(subdirPath + "time" + DataFileExtension, bufferSize);
+    timeStampFile = new SaveFile(subdirPath + "time" + DataFileExtension, bufferSize, writerOptions);
     if (!timeStampFile->isOpen()) {
         closeAllSaveFiles();
         return false;
     }
     liveNotesFileName = subdirPath + "notes.txt";
+    noiseLogFileName = subdirPath + "noise.csv";
 
     getAllWaveformPointers();
 
     if (!saveList.amplifier.empty()) {
         if (state->saveWidebandAmplifierWaveforms->getValue()) {
-            amplifierFile = new SaveFile(subdirPath + "amplifier" + DataFileExtension, bufferSize);
+            amplifierFile = new SaveFile(subdirPath + "amplifier" + DataFileExtension, bufferSize, writerOptions);
             if (!amplifierFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
             }
         }
         if (state->saveLowpassAmplifierWaveforms->getValue()) {
-            lowpassAmplifierFile = new SaveFile(subdirPath + "lowpass" + DataFileExtension, bufferSize);
+            lowpassAmplifierFile = new SaveFile(subdirPath + "lowpass" + DataFileExtension, bufferSize, writerOptions);
             if (!lowpassAmplifierFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
             }
         }
         if (state->saveHighpassAmplifierWaveforms->getValue()) {
-            highpassAmplifierFile = new SaveFile(subdirPath + "highpass" + DataFileExtension, bufferSize);
+            highpassAmplifierFile = new SaveFile(subdirPath + "highpass" + DataFileExtension, bufferSize, writerOptions);
             if (!highpassAmplifierFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
             }
         }
         if (state->saveSpikeData->getValue()) {
-            spikeFile = new SaveFile(subdirPath + "spike" + DataFileExtension, bufferSize);
+            spikeFile = new SaveFile(subdirPath + "spike" + DataFileExtension, bufferSize, writerOptions);
             if (!spikeFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -185,13 +187,13 @@ bool FilePerSignalTypeSaveManager::openAllSaveFiles()
 
         }
         if (type == ControllerStimRecord) {
-            stimFile = new SaveFile(subdirPath + "stim" + DataFileExtension, bufferSize);
+            stimFile = new SaveFile(subdirPath + "stim" + DataFileExtension, bufferSize, writerOptions);
             if (!stimFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
             }
             if (state->saveDCAmplifierWaveforms->getValue()) {
-                dcAmplifierFile = new SaveFile(subdirPath + "dcamplifier" + DataFileExtension, bufferSize);
+                dcAmplifierFile = new SaveFile(subdirPath + "dcamplifier" + DataFileExtension, bufferSize, writerOptions);
                 if (!dcAmplifierFile->isOpen()) {
                     closeAllSaveFiles();
                     return false;
@@ -201,14 +203,14 @@ bool FilePerSignalTypeSaveManager::openAllSaveFiles()
     }
     if (type != ControllerStimRecord) {
         if (!saveList.auxInput.empty() && !saveAuxInsWithAmps) {
-            auxInputFile = new SaveFile(subdirPath + "auxiliary" + DataFileExtension, bufferSize);
+            auxInputFile = new SaveFile(subdirPath + "auxiliary" + DataFileExtension, bufferSize, writerOptions);
             if (!auxInputFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
             }
         }
         if (!saveList.supplyVoltage.empty()) {
-            supplyVoltageFile = new SaveFile(subdirPath + "supply" + DataFileExtension, bufferSize);
+            supplyVoltageFile = new SaveFile(subdirPath + "supply" + DataFileExtension, bufferSize, writerOptions);
             if (!supplyVoltageFile->isOpen()) {
                 closeAllSaveFiles();
                 return false;
@@ -216,28 +218,28 @@ bool FilePerSignalTypeSaveManager::openAllSaveFiles()
         }
     }
     if (!saveList.boardAdc.empty()) {
-        analogInputFile = new SaveFile(subdirPath + "analogin" + DataFileExtension, bufferSize);
+        analogInputFile = new SaveFile(subdirPath + "analogin" + DataFileExtension, bufferSize, writerOptions);
         if (!analogInputFile->isOpen()) {
             closeAllSaveFiles();
             return false;
         }
     }
     if (type == ControllerStimRecord && !saveList.boardDac.empty()) {
-        analogOutputFile = new SaveFile(subdirPath + "analogout" + DataFileExtension, bufferSize);
+        analogOutputFile = new SaveFile(subdirPath + "analogout" + DataFileExtension, bufferSize, writerOptions);
         if (!analogOutputFile->isOpen()) {
             closeAllSaveFiles();
             return false;
         }
     }
     if (!saveList.boardDigitalIn.empty()) {
-        digitalInputFile = new SaveFile(subdirPath + "digitalin" + DataFileExtension, bufferSize);
+        digitalInputFile = new SaveFile(subdirPath + "digitalin" + DataFileExtension, bufferSize, writerOptions);
         if (!digitalInputFile->isOpen()) {
             closeAllSaveFiles();
             return false;
         }
     }
     if (!saveList.boardDigitalOut.empty()) {
-        digitalOutputFile = new SaveFile(subdirPath + "digitalout" + DataFileExtension, bufferSize);
+        digitalOutputFile = new SaveFile(subdirPath + "digitalout" + DataFileExtension, bufferSize, writerOptions);
         if (!digitalOutputFile->isOpen()) {
             closeAllSaveFiles();
             return false;
@@ -256,6 +258,9 @@ void FilePerSignalTypeSaveManager::closeAllSaveFiles()
         delete liveNotesFile;
         liveNotesFile = nullptr;
     }
+    if (noiseLogFile) {
+        noiseLogFile->close();
+    }
 
     if (timeStampFile) {
         timeStampFile->close();
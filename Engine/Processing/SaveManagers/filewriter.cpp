@@ -0,0 +1,564 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "filewriter.h"
+
+namespace {
+
+const int64_t PageAlignment = 4096;  // Buffer, size, and offset alignment required by O_DIRECT on common filesystems
+
+std::atomic<int64_t> stallCount(0);
+std::atomic<int64_t> stallNsecs(0);
+std::atomic<int64_t> bytesPending(0);
+std::atomic<int64_t> maxBytesPending(0);
+std::atomic<int64_t> writeErrors(0);
+
+#ifndef _WIN32
+// Write all of data at offset, retrying after short writes and interrupted calls.  Returns bytes written or -errno.
+int64_t pwriteAll(int fd, const char* data, int64_t numBytes, int64_t offset)
+{
+    int64_t done = 0;
+    while (done < numBytes) {
+        ssize_t result = pwrite(fd, data + done, numBytes - done, offset + done);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (result == 0) return -EIO;
+        done += result;
+    }
+    return done;
+}
+
+// Shared service that performs writes submitted by every asynchronous FileWriter.
+class IoService
+{
+public:
+    virtual ~IoService() {}
+    virtual void submit(int fd, const char* data, int64_t numBytes, int64_t offset, FileWriter* writer, int page) = 0;
+};
+
+class ThreadPoolIoService : public IoService
+{
+public:
+    ThreadPoolIoService() : quit(false)
+    {
+        int numThreads = std::max(2, std::min(8, (int) std::thread::hardware_concurrency() / 2));
+        for (int i = 0; i < numThreads; ++i) {
+            threads.emplace_back(&ThreadPoolIoService::workerLoop, this);
+        }
+    }
+
+    ~ThreadPoolIoService()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    void submit(int fd, const char* data, int64_t numBytes, int64_t offset, FileWriter* writer, int page) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            requests.push_back({ fd, data, numBytes, offset, writer, page });
+        }
+        wake.notify_one();
+    }
+
+private:
+    struct Request {
+        int fd;
+        const char* data;
+        int64_t numBytes;
+        int64_t offset;
+        FileWriter* writer;
+        int page;
+    };
+
+    std::vector<std::thread> threads;
+    std::deque<Request> requests;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool quit;
+
+    void workerLoop()
+    {
+        while (true) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [this] { return quit || !requests.empty(); });
+                if (requests.empty()) return;
+                request = requests.front();
+                requests.pop_front();
+            }
+            int64_t result = pwriteAll(request.fd, request.data, request.numBytes, request.offset);
+            request.writer->completeWrite(request.page, result);
+        }
+    }
+};
+
+#ifdef HAVE_LIBURING
+class IoUringIoService : public IoService
+{
+public:
+    IoUringIoService() : initialized(false)
+    {
+        int result = io_uring_queue_init(QueueDepth, &ring, 0);
+        if (result < 0) {
+            std::cerr << "FileWriter: io_uring unavailable (" << strerror(-result) << "); using thread pool writes.\n";
+            return;
+        }
+        initialized = true;
+        reaper = std::thread(&IoUringIoService::reaperLoop, this);
+    }
+
+    ~IoUringIoService()
+    {
+        if (!initialized) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            io_uring_sqe* sqe = getSqe();
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, nullptr);  // Tells the reaper thread to exit.
+            io_uring_submit(&ring);
+        }
+        reaper.join();
+        io_uring_queue_exit(&ring);
+    }
+
+    bool isInitialized() const { return initialized; }
+
+    void submit(int fd, const char* data, int64_t numBytes, int64_t offset, FileWriter* writer, int page) override
+    {
+        Request* request = new Request { fd, data, numBytes, offset, writer, page };
+        std::lock_guard<std::mutex> lock(mtx);
+        io_uring_sqe* sqe = getSqe();
+        io_uring_prep_write(sqe, fd, data, (unsigned) numBytes, offset);
+        io_uring_sqe_set_data(sqe, request);
+        io_uring_submit(&ring);
+    }
+
+private:
+    static const unsigned QueueDepth = 256;
+
+    struct Request {
+        int fd;
+        const char* data;
+        int64_t numBytes;
+        int64_t offset;
+        FileWriter* writer;
+        int page;
+    };
+
+    io_uring ring;
+    bool initialized;
+    std::thread reaper;
+    std::mutex mtx;
+
+    // Call with mtx held.  If the submission queue is full, hand its entries to the kernel and try again.
+    io_uring_sqe* getSqe()
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        while (!sqe) {
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        return sqe;
+    }
+
+    void reaperLoop()
+    {
+        while (true) {
+            io_uring_cqe* cqe = nullptr;
+            int waitResult = io_uring_wait_cqe(&ring, &cqe);
+            if (waitResult == -EINTR) continue;
+            if (waitResult < 0) {
+                std::cerr << "FileWriter: io_uring_wait_cqe failed: " << strerror(-waitResult) << '\n';
+                return;
+            }
+            Request* request = (Request*) io_uring_cqe_get_data(cqe);
+            int64_t result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            if (!request) return;
+
+            // Finish short writes synchronously; they are rare (e.g., at the end of a full disk).
+            if (result >= 0 && result < request->numBytes) {
+                int64_t rest = pwriteAll(request->fd, request->data + result, request->numBytes - result,
+                                         request->offset + result);
+                result = rest < 0 ? rest : request->numBytes;
+            }
+            request->writer->completeWrite(request->page, result);
+            delete request;
+        }
+    }
+};
+#endif
+
+IoService* ioService(FileWriterBackend backend)
+{
+#ifdef HAVE_LIBURING
+    if (backend == FileWriterIoUring) {
+        static IoUringIoService ioUringService;
+        if (ioUringService.isInitialized()) return &ioUringService;
+    }
+#else
+    (void) backend;
+#endif
+    static ThreadPoolIoService threadPoolService;
+    return &threadPoolService;
+}
+#endif
+
+}
+
+FileWriter::FileWriter(const FileWriterOptions& options_, int bufferSize) :
+    options(options_),
+    asynchronous(false),
+    opened(false),
+    file(nullptr),
+    fd(-1),
+    directIOActive(false),
+    fileOffset(0),
+    currentPage(0),
+    numInFlight(0),
+    firstErrorNumber(0)
+{
+#ifndef _WIN32
+    asynchronous = options.backend != FileWriterSynchronous;
+#endif
+    options.numBuffers = std::max(2, options.numBuffers);
+    pageSize = ((std::max(bufferSize, 1) + PageAlignment - 1) / PageAlignment) * PageAlignment;
+}
+
+FileWriter::~FileWriter()
+{
+    close();
+    for (Page& page : pages) {
+        free(page.data);
+    }
+}
+
+bool FileWriter::open(const QString& fileName_, bool append)
+{
+    if (opened) return true;
+    fileName = fileName_;
+    error.clear();
+
+    if (!asynchronous) {
+        file = new QFile(fileName);
+        if (!file->open(append ? QIODevice::Append : QIODevice::WriteOnly)) {
+            error = file->errorString();
+            delete file;
+            file = nullptr;
+            return false;
+        }
+        opened = true;
+        return true;
+    }
+
+#ifndef _WIN32
+    QByteArray path = QFile::encodeName(fileName);
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC);
+    directIOActive = false;
+#ifdef O_DIRECT
+    if (options.directIO) {
+        fd = ::open(path.constData(), flags | O_DIRECT, 0644);
+        if (fd >= 0) {
+            directIOActive = true;
+        } else if (errno == EINVAL) {
+            std::cerr << "FileWriter: O_DIRECT not supported for " << fileName.toStdString() << "; using buffered writes.\n";
+        } else {
+            error = QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+    }
+#endif
+    if (fd < 0) {
+        fd = ::open(path.constData(), flags, 0644);
+        if (fd < 0) {
+            error = QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+    }
+
+    fileOffset = append ? (int64_t) lseek(fd, 0, SEEK_END) : 0;
+    if (directIOActive && fileOffset % PageAlignment != 0) {
+        // Appending at an unaligned offset; O_DIRECT writes would fail.
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        directIOActive = false;
+    }
+
+    if (pages.empty()) {
+        pages.push_back({ nullptr, 0, false });
+        if (posix_memalign((void**) &pages[0].data, PageAlignment, pageSize) != 0) {
+            pages.clear();
+            ::close(fd);
+            fd = -1;
+            error = "Out of memory";
+            return false;
+        }
+    }
+    currentPage = 0;
+    pages[currentPage].numBytes = 0;
+    firstErrorNumber.store(0);
+    opened = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FileWriter::write(const char* data, int64_t numBytes)
+{
+    if (!opened || numBytes <= 0) return;
+
+    if (!asynchronous) {
+        if (file->write(data, numBytes) != numBytes) {
+            std::cerr << "FileWriter: Error writing " << fileName.toStdString() << ": " << qPrintable(file->errorString()) << '\n';
+        }
+        return;
+    }
+
+    while (numBytes > 0) {
+        Page& page = pages[currentPage];
+        int64_t chunk = std::min(pageSize - page.numBytes, numBytes);
+        memcpy(page.data + page.numBytes, data, chunk);
+        page.numBytes += chunk;
+        data += chunk;
+        numBytes -= chunk;
+        if (page.numBytes == pageSize) submitCurrentPage();
+    }
+    if (firstErrorNumber != 0) reportError();
+}
+
+// For Windows 10, it appears that there's an internal buffer of 16 KB when writing to files, and even flushing will
+// not write less than that, so the synchronous backend forces data out by closing and reopening the file.
+void FileWriter::flushToDisk()
+{
+    if (!opened) return;
+
+    if (!asynchronous) {
+        file->close();
+        if (!file->open(QIODevice::Append)) {
+            std::cerr << "FileWriter: Cannot reopen file " << fileName.toStdString() << " for writing: " <<
+                         qPrintable(file->errorString()) << '\n';
+            delete file;
+            file = nullptr;
+            opened = false;
+        }
+        return;
+    }
+
+    // The partial page stays current: it is written again, whole, when it fills.
+    waitForAllWrites();
+    Page& page = pages[currentPage];
+    if (page.numBytes > 0) writeUnaligned(page.data, page.numBytes, fileOffset);
+    if (firstErrorNumber != 0) reportError();
+}
+
+void FileWriter::close()
+{
+    if (!opened) return;
+    opened = false;
+
+    if (!asynchronous) {
+        file->close();
+        delete file;
+        file = nullptr;
+        return;
+    }
+
+#ifndef _WIN32
+    Page& page = pages[currentPage];
+    if (page.numBytes > 0) {
+        if (directIOActive) {
+            waitForAllWrites();
+            writeUnaligned(page.data, page.numBytes, fileOffset);
+            fileOffset += page.numBytes;
+            page.numBytes = 0;
+        } else {
+            submitCurrentPage();
+        }
+    }
+    waitForAllWrites();
+    if (firstErrorNumber != 0) reportError();
+    ::close(fd);
+    fd = -1;
+#endif
+}
+
+FileWriterBackpressure FileWriter::backpressure()
+{
+    FileWriterBackpressure result;
+    result.stallCount = stallCount.load(std::memory_order_relaxed);
+    result.stallNsecs = stallNsecs.load(std::memory_order_relaxed);
+    result.maxBytesPending = maxBytesPending.load(std::memory_order_relaxed);
+    result.writeErrors = writeErrors.load(std::memory_order_relaxed);
+    return result;
+}
+
+void FileWriter::resetBackpressure()
+{
+    stallCount.store(0);
+    stallNsecs.store(0);
+    maxBytesPending.store(bytesPending.load());
+    writeErrors.store(0);
+}
+
+void FileWriter::completeWrite(int page, int64_t result)
+{
+    {
+        std::lock_guard<std::mutex> lock(pageMutex);
+        bytesPending.fetch_sub(pages[page].numBytes, std::memory_order_relaxed);
+        if (result < 0) recordError((int) -result);
+        pages[page].inFlight = false;
+        --numInFlight;
+    }
+    pageDone.notify_all();
+}
+
+void FileWriter::submitCurrentPage()
+{
+#ifndef _WIN32
+    Page& page = pages[currentPage];
+    {
+        std::lock_guard<std::mutex> lock(pageMutex);
+        page.inFlight = true;
+        ++numInFlight;
+    }
+    int64_t pending = bytesPending.fetch_add(page.numBytes, std::memory_order_relaxed) + page.numBytes;
+    int64_t maxPending = maxBytesPending.load(std::memory_order_relaxed);
+    while (pending > maxPending && !maxBytesPending.compare_exchange_weak(maxPending, pending)) {}
+
+    ioService(options.backend)->submit(fd, page.data, page.numBytes, fileOffset, this, currentPage);
+    fileOffset += page.numBytes;
+    currentPage = acquireFreePage();
+    pages[currentPage].numBytes = 0;
+#endif
+}
+
+// Return the index of a page that is not being written, allocating a new page if all are busy and numBuffers allows,
+// or else waiting for a write to complete.  The pages vector only grows here, with pageMutex held; in-flight data
+// never moves, since each Page only points to its buffer.
+int FileWriter::acquireFreePage()
+{
+    std::unique_lock<std::mutex> lock(pageMutex);
+    for (int i = 0; i < (int) pages.size(); ++i) {
+        if (!pages[i].inFlight) return i;
+    }
+    if ((int) pages.size() < options.numBuffers) {
+        char* data = nullptr;
+        if (posix_memalign((void**) &data, PageAlignment, pageSize) == 0) {
+            pages.push_back({ data, 0, false });
+            return (int) pages.size() - 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int freePage = -1;
+    pageDone.wait(lock, [&] {
+        for (int i = 0; i < (int) pages.size(); ++i) {
+            if (!pages[i].inFlight) {
+                freePage = i;
+                return true;
+            }
+        }
+        return false;
+    });
+    stallCount.fetch_add(1, std::memory_order_relaxed);
+    stallNsecs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+                         std::memory_order_relaxed);
+    return freePage;
+}
+
+void FileWriter::waitForAllWrites()
+{
+    std::unique_lock<std::mutex> lock(pageMutex);
+    pageDone.wait(lock, [this] { return numInFlight == 0; });
+}
+
+// Write data that may not satisfy O_DIRECT alignment, through the page cache.  Call only with no writes in flight.
+bool FileWriter::writeUnaligned(const char* data, int64_t numBytes, int64_t offset)
+{
+#ifndef _WIN32
+    int flags = fcntl(fd, F_GETFL);
+#ifdef O_DIRECT
+    if (directIOActive) fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+#endif
+    int64_t result = pwriteAll(fd, data, numBytes, offset);
+    if (directIOActive) fcntl(fd, F_SETFL, flags);
+    if (result < 0) {
+        recordError((int) -result);
+        return false;
+    }
+    return true;
+#else
+    (void) data;
+    (void) numBytes;
+    (void) offset;
+    return false;
+#endif
+}
+
+void FileWriter::recordError(int errorNumber)
+{
+    int noError = 0;
+    firstErrorNumber.compare_exchange_strong(noError, errorNumber);
+    writeErrors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileWriter::reportError()
+{
+    error = QString::fromLocal8Bit(strerror(firstErrorNumber.exchange(0)));
+    std::cerr << "FileWriter: Error writing " << fileName.toStdString() << ": " << error.toStdString() << '\n';
+}
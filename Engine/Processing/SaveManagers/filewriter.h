@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QString>
+#include <QFile>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+enum FileWriterBackend {
+    FileWriterSynchronous,  // QFile writes on the calling thread
+    FileWriterThreadPool,   // pwrite() on a shared pool of I/O threads
+    FileWriterIoUring       // io_uring submissions (Linux); falls back to FileWriterThreadPool if unavailable
+};
+
+struct FileWriterOptions {
+    FileWriterBackend backend;
+    bool directIO;          // Open files with O_DIRECT (Linux, asynchronous backends only)
+    int numBuffers;         // Maximum number of buffers per file; buffers beyond the first are allocated on demand
+
+    FileWriterOptions() : backend(FileWriterSynchronous), directIO(false), numBuffers(4) {}
+};
+
+// Totals across all FileWriter objects since the last call to FileWriter::resetBackpressure().  A stall is a call
+// to write() that had to wait because every buffer belonging to its file was still being written.
+struct FileWriterBackpressure {
+    int64_t stallCount;
+    int64_t stallNsecs;
+    int64_t maxBytesPending;
+    int64_t writeErrors;
+};
+
+// Writes a sequential stream of bytes to one file.  With an asynchronous backend, write() copies data into one of
+// up to numBuffers page-aligned buffers and returns; each buffer is written in the background at its own file offset,
+// so completions may arrive in any order.  Only whole buffers are submitted; the partial buffer at the end of the file
+// is written by flushToDisk() and close() (through the page cache, with directIO).
+class FileWriter
+{
+public:
+    FileWriter(const FileWriterOptions& options_, int bufferSize);
+    ~FileWriter();
+
+    bool open(const QString& fileName_, bool append);
+    bool isOpen() const { return opened; }
+    void write(const char* data, int64_t numBytes);
+    void flushToDisk();  // Make all data written so far visible in the file, and wait for outstanding writes.
+    void close();
+    QString errorString() const { return error; }
+
+    static FileWriterBackpressure backpressure();
+    static void resetBackpressure();
+
+    // Called by I/O threads when a submitted buffer has been written.  result is the number of bytes written,
+    // or a negative errno value.
+    void completeWrite(int page, int64_t result);
+
+private:
+    struct Page {
+        char* data;
+        int64_t numBytes;
+        bool inFlight;
+    };
+
+    FileWriterOptions options;
+    int64_t pageSize;
+    bool asynchronous;
+    bool opened;
+    QString fileName;
+    QString error;
+
+    QFile* file;  // Synchronous backend only
+
+    int fd;
+    bool directIOActive;
+    int64_t fileOffset;  // File offset of the start of the current page
+    std::vector<Page> pages;
+    int currentPage;
+    int numInFlight;
+    std::atomic<int> firstErrorNumber;
+    std::mutex pageMutex;
+    std::condition_variable pageDone;
+
+    void submitCurrentPage();
+    int acquireFreePage();
+    void waitForAllWrites();
+    bool writeUnaligned(const char* data, int64_t numBytes, int64_t offset);
+    void recordError(int errorNumber);
+    void reportError();
+};
+
+#endif // FILEWRITER_H
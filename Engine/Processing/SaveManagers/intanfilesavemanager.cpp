@@ -47,6 +47,7 @@ bool IntanFileSaveManager::openAllSaveFiles()
 {
     dateTimeStamp = getDateTimeStamp();
     int bufferSize = calculateBufferSize(state);
+    FileWriterOptions writerOptions = fileWriterOptions();
 
     QString subdirPath;
 
@@ -70,12 +71,13 @@ bool IntanFileSaveManager::openAllSaveFiles()
         state->saveGlobalSettings(subdirPath + "settings.xml");
     }
 
-    saveFile = new SaveFile(subdirPath + state->filename->getBaseFilename() + dateTimeStamp + intanFileExtension(), bufferSize);
+    saveFile = new SaveFile(subdirPath + state->filename->getBaseFilename() + dateTimeStamp + intanFileExtension(), bufferSize, writerOptions);
     if (!saveFile->isOpen()) {
         closeAllSaveFiles();
         return false;
     }
     liveNotesFileName = subdirPath + "notes.txt";
+    noiseLogFileName = subdirPath + "noise.csv";
     writeIntanFileHeader(saveFile);
     getAllWaveformPointers();
     return true;
@@ -88,6 +90,9 @@ void IntanFileSaveManager::closeAllSaveFiles()
         delete liveNotesFile;
         liveNotesFile = nullptr;
     }
+    if (noiseLogFile) {
+        noiseLogFile->close();
+    }
 
     if (saveFile) {
         saveFile->close();
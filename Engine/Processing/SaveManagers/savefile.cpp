@@ -29,35 +29,60 @@
 //------------------------------------------------------------------------------
 
 #include <iostream>
+#include <cstring>
 #include "savefile.h"
 
-SaveFile::SaveFile(const QString& fileName_, int bufferSize_) :
-    bufferSize(bufferSize_),
-    fileName(fileName_),
-    file(nullptr),
-    dataStream(nullptr)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SAVEFILE_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace {
+
+// Convert words from offset binary to two's complement and store them as little-endian bytes.
+void convertToSignedLittleEndian(char* dest, const uint16_t* word, int numWords)
 {
-    file = new QFile(fileName);
-    if (!file->open(QIODevice::WriteOnly)) {
-        std::cerr << "SaveFile: Cannot open file " << fileName.toStdString() << " for writing: " <<
-                qPrintable(file->errorString()) << '\n';
-        if (file) delete file;
-        file = nullptr;
-        return;
+    int i = 0;
+#ifdef SAVEFILE_SSE2
+    // x86 is little endian, so each converted register can be stored as-is.
+    const __m128i signBit = _mm_set1_epi16((short) 0x8000);
+    for (; i + 8 <= numWords; i += 8) {
+        __m128i words = _mm_loadu_si128((const __m128i*) (word + i));
+        _mm_storeu_si128((__m128i*) (dest + 2 * i), _mm_xor_si128(words, signBit));
+    }
+#endif
+    for (; i < numWords; ++i) {
+        uint16_t asSigned = word[i] ^ 0x8000U;   // convert from offset to two's complement
+        dest[2 * i] = (char)  (asSigned & 0x00ffU);
+        dest[2 * i + 1] = (char) ((asSigned & 0xff00U) >> 8);
     }
-    createDataStream(file);
+}
+
+}
 
+SaveFile::SaveFile(const QString& fileName_, int bufferSize_, const FileWriterOptions& writerOptions) :
+    bufferSize(bufferSize_),
+    fileName(fileName_),
+    writer(nullptr)
+{
     buffer = new char [bufferSize];
     bufferIndex = 0;
     bufferSizeMinus4 = bufferSize - 4;  // Precompute to save time.
     bufferSizeMinus2 = bufferSize - 2;  // Precompute to save time.
 
     resetNumBytesWritten();
+
+    writer = new FileWriter(writerOptions, bufferSize);
+    if (!writer->open(fileName, false)) {
+        std::cerr << "SaveFile: Cannot open file " << fileName.toStdString() << " for writing: " <<
+                qPrintable(writer->errorString()) << '\n';
+    }
 }
 
 SaveFile::~SaveFile()
 {
     close();
+    delete writer;
     delete [] buffer;
 }
 
@@ -308,21 +333,14 @@ void SaveFile::writeUInt16AsSigned(const uint16_t* wordArray, int numSamples)
     const int WordSize = 2;
     if (bufferIndex > bufferSize - WordSize * numSamples) flush();
     while (WordSize * numSamples > bufferSize) {
-        for (int i = 0; i < bufferSize / WordSize; ++i) {
-            uint16_t asSigned = (*word) ^ 0x8000U;   // convert from offset to two's complement
-            buffer[bufferIndex++] = (char)  (asSigned & 0x00ffU);
-            buffer[bufferIndex++] = (char) ((asSigned & 0xff00U) >> 8);
-            ++word;
-        }
+        convertToSignedLittleEndian(buffer + bufferIndex, word, bufferSize / WordSize);
+        bufferIndex += WordSize * (bufferSize / WordSize);
+        word += bufferSize / WordSize;
         flush();
         numSamples -= bufferSize / WordSize;
     }
-    for (int i = 0; i < numSamples; ++i) {
-        uint16_t asSigned = (*word) ^ 0x8000U;   // convert from offset to two's complement
-        buffer[bufferIndex++] = (char)  (asSigned & 0x00ffU);
-        buffer[bufferIndex++] = (char) ((asSigned & 0xff00U) >> 8);
-        ++word;
-    }
+    convertToSignedLittleEndian(buffer + bufferIndex, word, numSamples);
+    bufferIndex += WordSize * numSamples;
 }
 
 void SaveFile::writeUInt8(uint8_t byte)
@@ -333,24 +351,45 @@ void SaveFile::writeUInt8(uint8_t byte)
 
 void SaveFile::writeDouble(double x)
 {
-    if (bufferIndex > 0) flush();
-    *dataStream << x;   // Low-performance write; this method is not fast like writeIntXX and writeUIntXX.
-    numBytesWritten += 4; // There are 32 bits per double since we set floating point precision to single precision.
+    // Low-performance write; this method is not fast like writeIntXX and writeUIntXX.
+    // There are 32 bits per double since we set floating point precision to single precision.
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    configureDataStream(stream);
+    stream << x;
+    writeSerialized(bytes);
 }
 
 void SaveFile::writeQString(const QString& s)
 {
-    if (bufferIndex > 0) flush();
-    *dataStream << s;   // Low-performance write; this method is not fast like writeIntXX and writeUIntXX.
-    numBytesWritten += 4 + 2 * s.size();  // A QString consists of a 32-bit 'string length' field plus 16-bit characters.
+    // Low-performance write; this method is not fast like writeIntXX and writeUIntXX.
+    // A QString consists of a 32-bit 'string length' field plus 16-bit characters.
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    configureDataStream(stream);
+    stream << s;
+    writeSerialized(bytes);
 }
 
 void SaveFile::writeQStringAsAsciiText(const QString& s)
 {
-    if (bufferIndex > 0) flush();
     // Low-performance write; this method is not fast like writeIntXX and writeUIntXX.
-    dataStream->writeRawData(s.toLatin1().constData(), s.length());
-    numBytesWritten += s.size();
+    writeSerialized(s.toLatin1());
+}
+
+// Append bytes and flush them immediately, so that getNumBytesWritten() includes them (as it does for header items).
+void SaveFile::writeSerialized(const QByteArray& bytes)
+{
+    int length = bytes.size();
+    if (bufferIndex > bufferSize - length) flush();
+    if (length > bufferSize) {
+        if (writer->isOpen()) writer->write(bytes.constData(), length);
+        numBytesWritten += length;
+        return;
+    }
+    memcpy(buffer + bufferIndex, bytes.constData(), length);
+    bufferIndex += length;
+    flush();
 }
 
 void SaveFile::writeStringAsCharArray(const std::string& s)
@@ -409,75 +448,51 @@ void SaveFile::writeSignalGroup(const SignalGroup* signalGroup)
 
 void SaveFile::close()
 {
-    if (!file) return;
+    if (!writer->isOpen()) return;
     flush();
-    file->close();
-    if (dataStream) {
-        delete dataStream;
-        dataStream = nullptr;
-    }
-    delete file;
-    file = nullptr;
+    writer->close();
 }
 
 void SaveFile::flush()
 {
-    if (!dataStream) return;
-    dataStream->writeRawData(buffer, bufferIndex);
+    if (!writer->isOpen()) return;
+    writer->write(buffer, bufferIndex);
     numBytesWritten += bufferIndex;
     bufferIndex = 0;
 }
 
 
-// For Windows 10, it appears that there's an internal buffer of 16 KB when writing to files.
-// This is most cumbersome when writing spike.dat files, which can go long periods with minimal data writing.
-// Even when flushing, if less than 16 KB of data is to be written, it doesn't appear to actually get written,
-// unless the file is closed. A flush can thus be forced by closing then reopening the file.
+// Make everything written so far visible in the file (used for files such as spike.dat, which can go long periods
+// with minimal data writing).  See FileWriter::flushToDisk().
 void SaveFile::forceFlush()
 {
-    if (!file) return;
+    if (!writer->isOpen()) return;
     flush();
-    file->close();
-    if (dataStream) {
-        delete dataStream;
-        dataStream = nullptr;
-    }
-
-    if (!file->open(QIODevice::Append)) {
+    writer->flushToDisk();
+    if (!writer->isOpen()) {
         std::cerr << "SaveFile:: Cannot open file " << fileName.toStdString() << " for writing: " <<
-                qPrintable(file->errorString()) << '\n';
-        if (file) delete file;
-        file = nullptr;
-        return;
+                qPrintable(writer->errorString()) << '\n';
     }
-    createDataStream(file);
 }
 
 void SaveFile::openForAppend()
 {
     if (isOpen()) return;
 
-    file = new QFile(fileName);
-    if (!file->open(QIODevice::Append)) {
+    if (!writer->open(fileName, true)) {
         std::cerr << "SaveFile: Cannot open file " << fileName.toStdString() << " for appended writing: " <<
-                qPrintable(file->errorString()) << '\n';
-        if (file) delete file;
-        file = nullptr;
-        return;
+                qPrintable(writer->errorString()) << '\n';
     }
-    createDataStream(file);
 }
 
-void SaveFile::createDataStream(QFile* file_)
+void SaveFile::configureDataStream(QDataStream& stream)
 {
-    dataStream = new QDataStream(file_);
-
     // Maintain bit-level compatibility with existing code.
-    dataStream->setVersion(QDataStream::Qt_5_11);
+    stream.setVersion(QDataStream::Qt_5_11);
 
     // Set to little endian mode for compatibilty with MATLAB, which is little endian on all platforms.
-    dataStream->setByteOrder(QDataStream::LittleEndian);
+    stream.setByteOrder(QDataStream::LittleEndian);
 
     // Write 4-byte floating-point numbers (instead of the default 8-byte numbers) to save disk space.
-    dataStream->setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
 }
@@ -32,6 +32,7 @@
 #define SAVEFILE_H
 
 #include <QString>
+#include <QByteArray>
 #include <QFile>
 #include <QDataStream>
 
@@ -39,11 +40,12 @@
 #include <string>
 
 #include "signalsources.h"
+#include "filewriter.h"
 
 class SaveFile
 {
 public:
-    SaveFile(const QString& fileName_, int bufferSize_);
+    SaveFile(const QString& fileName_, int bufferSize_, const FileWriterOptions& writerOptions = FileWriterOptions());
     //SaveFile(const QString& fileName_, int bufferSize_ = 262144); // 262144 = 2^18 bytes = 256K
     //SaveFile(const QString& fileName_, int bufferSize_ = 2048);
     ~SaveFile();
@@ -72,8 +74,9 @@ public:
     void close();
     void flush();
     void forceFlush();
-    bool isOpen() const { return file != nullptr; }
+    bool isOpen() const { return writer->isOpen(); }
     void openForAppend();
+    QString getFileName() const { return fileName; }
     inline int64_t getNumBytesWritten() const { return numBytesWritten; }
     inline void resetNumBytesWritten() { numBytesWritten = 0; }
 
@@ -86,10 +89,10 @@ private:
     char* buffer;
 
     QString fileName;
-    QFile* file;
-    QDataStream* dataStream;
+    FileWriter* writer;
 
-    void createDataStream(QFile* file_);
+    void writeSerialized(const QByteArray& bytes);
+    static void configureDataStream(QDataStream& stream);
 };
 
 #endif // SAVEFILE_H
@@ -47,6 +47,7 @@ SaveManager::SaveManager(WaveformFifo* waveformFifo_, SystemState* state_) :
     type = state->getControllerTypeEnum();
     timeStampOffset = 0;
     liveNotesFile = nullptr;
+    noiseLogFile = nullptr;
 }
 
 SaveManager::~SaveManager()
@@ -55,6 +56,10 @@ SaveManager::~SaveManager()
         liveNotesFile->close();
         delete liveNotesFile;
     }
+    if (noiseLogFile) {
+        noiseLogFile->close();
+        delete noiseLogFile;
+    }
 }
 
 int64_t SaveManager::writeIntanFileHeader(SaveFile* saveFile)
@@ -154,6 +159,37 @@ void SaveManager::writeLiveNoteEntry(uint64_t timestamp, const QString& note)
     }
 }
 
+void SaveManager::writeNoiseLevels(const std::vector<float>& noiseLevels, int64_t numSamplesRecorded)
+{
+    // The noise log spans all the files of one recording (e.g., when a new Intan file is started every few minutes), so
+    // it is closed with the other save files but only replaced here if the recording has moved to a new directory.
+    if (noiseLogFile && noiseLogFile->getFileName() != noiseLogFileName) {
+        noiseLogFile->close();
+        delete noiseLogFile;
+        noiseLogFile = nullptr;
+    }
+    if (!noiseLogFile) {
+        noiseLogFile = new SaveFile(noiseLogFileName, 4096);
+        QString header = "Timestamp, Time";
+        for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
+            header += ", " + QString::fromStdString(saveList.amplifier[i]) + " noise (uV)";
+        }
+        noiseLogFile->writeQStringAsAsciiText(header + "\r\n");
+    } else if (!noiseLogFile->isOpen()) {
+        noiseLogFile->openForAppend();
+    }
+    if (!noiseLogFile->isOpen()) return;
+
+    int timeInSeconds = round((double) numSamplesRecorded / state->sampleRate->getNumericValue());
+    QString row = QString::number(numSamplesRecorded) + ", " + QTime(0, 0).addSecs(timeInSeconds).toString("HH:mm:ss");
+    for (int i = 0; i < (int) saveList.amplifier.size(); ++i) {
+        int handle = signalSources->channelHandle(saveList.amplifier[i]);
+        float level = (handle >= 0 && handle < (int) noiseLevels.size()) ? noiseLevels[handle] : -1.0F;
+        row += ", " + ((level >= 0.0F) ? QString::number(level, 'f', 2) : QString(""));
+    }
+    noiseLogFile->writeQStringAsAsciiText(row + "\r\n");
+}
+
 bool SaveManager::setPosStimAmplitude(int stream, int channel, int amplitude)
 {
     int index = saveList.getAmplifierIndexFromStreamChannel(stream, channel);
@@ -201,6 +237,15 @@ int SaveManager::calculateBufferSize(SystemState *state_)
     return baseBufferSize / ((int) state_->writeToDiskLatency->getNumericValue());
 }
 
+FileWriterOptions SaveManager::fileWriterOptions() const
+{
+    FileWriterOptions options;
+    options.backend = (FileWriterBackend) state->saveFileWriter->getNumericValue();
+    options.directIO = state->saveFileDirectIO->getValue();
+    options.numBuffers = state->saveFileWriteBuffers->getValue();
+    return options;
+}
+
 uint16_t SaveManager::convertAmplifierValue(float voltage) const  // voltage in microvolts
 {
     int result = ((int) round(voltage / 0.195F)) + 32768;
@@ -56,6 +56,9 @@ public:
 
     QString saveFileDateTimeStamp() const { return dateTimeStamp; }
     void writeLiveNote(const QString& note, int64_t numSamplesRecorded);
+    // Append one row of noise levels (NoiseEstimator results indexed by channel handle) for the saved amplifier
+    // channels to noise.csv.
+    void writeNoiseLevels(const std::vector<float>& noiseLevels, int64_t numSamplesRecorded);
 
     bool setPosStimAmplitude(int stream, int channel, int amplitude);
     bool setNegStimAmplitude(int stream, int channel, int amplitude);
@@ -86,12 +89,15 @@ protected:
     QString dateTimeStamp;
     SaveFile* liveNotesFile;
     QString liveNotesFileName;
+    SaveFile* noiseLogFile;
+    QString noiseLogFileName;
 
     static QString getDateTimeStamp();
     void getAllWaveformPointers();
     QString intanFileExtension() const;
 
     static int calculateBufferSize(SystemState* state_);
+    FileWriterOptions fileWriterOptions() const;
 
     uint16_t convertAmplifierValue(float voltage) const;
     void convertAmplifierValue(uint16_t* dest, const float* voltage, int numSamples) const;
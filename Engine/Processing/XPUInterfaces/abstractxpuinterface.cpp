@@ -28,7 +28,11 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
+#include <iostream>
+
 #include "xpucontroller.h"
+#include "spikeclassifier.h"
 
 AbstractXPUInterface::AbstractXPUInterface(SystemState* state_, QObject *parent) :
     QObject(parent),
@@ -127,15 +131,19 @@ void AbstractXPUInterface::runDiagnostic(int XPUIndex)
     uint32_t* spike_ = spike;
     uint8_t* spikeIDs_ = spikeIDs;
 
+    // Process in batches of the size WaveformProcessorThread dispatches, so that an XPU that overlaps consecutive
+    // blocks within a batch is timed the way it will actually run.
+    int batchBlocks = state->processingBatchBlocks->getValue();
     auto start = std::chrono::steady_clock::now();
-    for (int block = 0; block < DiagnosticBlocks; block++) {
-        processDataBlock(data_, low_, wide_, high_, spike_, spikeIDs_);
-        data_ += wordsPerBlock;
-        low_ += FramesPerBlock * channels;
-        wide_ += FramesPerBlock * channels;
-        high_ += FramesPerBlock * channels;
-        spike_ += SnippetsPerBlock * channels;
-        spikeIDs_ += SnippetsPerBlock * channels;
+    for (int block = 0; block < DiagnosticBlocks; block += batchBlocks) {
+        int numBlocks = std::min(batchBlocks, DiagnosticBlocks - block);
+        processDataBlocks(numBlocks, data_, low_, wide_, high_, spike_, spikeIDs_);
+        data_ += numBlocks * wordsPerBlock;
+        low_ += numBlocks * FramesPerBlock * channels;
+        wide_ += numBlocks * FramesPerBlock * channels;
+        high_ += numBlocks * FramesPerBlock * channels;
+        spike_ += numBlocks * SnippetsPerBlock * channels;
+        spikeIDs_ += numBlocks * SnippetsPerBlock * channels;
     }
     auto end = std::chrono::steady_clock::now();
 
@@ -144,10 +152,21 @@ void AbstractXPUInterface::runDiagnostic(int XPUIndex)
     delete [] wideOriginal;
     delete [] highOriginal;
 
-    float elapsedMs = (float) std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    float elapsedMs = (float) std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0F;
     if (XPUIndex == 0) state->cpuInfo.diagnosticTime = elapsedMs;
     else state->gpuList[XPUIndex - 1].diagnosticTime = elapsedMs;
     qDebug() << "Elapsed time: " << elapsedMs << " ms\n";
+
+    QString name = (XPUIndex == 0) ? state->cpuInfo.name : state->gpuList[XPUIndex - 1].name;
+    state->writeToLog(name + " diagnostic: " + QString::number(diagnosticBlocksPerSecond(elapsedMs), 'f', 0) +
+                      " blocks/s in batches of " + QString::number(batchBlocks));
+}
+
+// Data blocks per second achieved in runDiagnostic(), given its elapsed time (0 if the diagnostic did not run).
+double AbstractXPUInterface::diagnosticBlocksPerSecond(float diagnosticTime)
+{
+    if (diagnosticTime <= 0.0F) return 0.0;
+    return 1000.0 * DiagnosticBlocks / diagnosticTime;
 }
 
 void AbstractXPUInterface::updateFilters()
@@ -253,12 +272,23 @@ void AbstractXPUInterface::updateFromState()
     // If any filter params have changed, recalculate them for notch, low, and high.
     updateFilters();
 
-    // If any AmplifierSignal spikeThresholds have changed, update value in 'hoops' to inform XPU
-    std::vector<std::string> ampChannelNames = state->signalSources->amplifierChannelsNameList();
-    for (auto name : ampChannelNames) {
-        int channelIndex = state->getSerialIndex(QString::fromStdString(name));
-        Channel* thisChannel = state->signalSources->channelByName(QString::fromStdString(name));
+    // If any AmplifierSignal spikeThresholds or spike classifier settings have changed, update 'hoops' to inform XPU
+    cl_char classifier = SpikeClassifierThreshold;
+    if (state->spikeClassifierMode->getValue() == "Hoops") classifier = SpikeClassifierHoops;
+    else if (state->spikeClassifierMode->getValue() == "Templates") classifier = SpikeClassifierTemplates;
+    float templateMaxRms = (float) state->spikeTemplateMaxRms->getValue();
+    float templateMaxDistance = templateMaxRms * templateMaxRms * SnippetSize;
+    if ((int) classifierSources.size() != channels) {
+        classifierSources.assign(channels, { SpikeClassifierThreshold, 0.0, QString() });
+    }
+
+    int channelsPerStream = RHXDataBlock::channelsPerStream(state->getControllerTypeEnum());
+    for (int handle : state->signalSources->amplifierChannelHandles()) {
+        Channel* thisChannel = state->signalSources->channelByHandle(handle);
+        int channelIndex = thisChannel->getBoardStream() * channelsPerStream + thisChannel->getChipChannel();
         hoops[channelIndex].threshold = thisChannel->getSpikeThreshold();
+        hoops[channelIndex].templateMaxDistance = templateMaxDistance;
+        updateSpikeClassifier(channelIndex, thisChannel, classifier);
     }
 
     // If spikeMax or suppressionEnabled have changed, update them.
@@ -272,6 +302,42 @@ void AbstractXPUInterface::updateFromState()
 
     // Update GPU arrays (to substitute structs) with new values from hoops
     updateHoopsVariables();
+
+    // Apply any changes to the number of CPU processing threads or the CPU filter implementation.
+    updateCPUOptions();
+}
+
+// Recompile one channel's hoops or templates if its definition, the classifier mode, or the sample rate has changed
+// since they were last compiled.  filterMutex must already be held.
+void AbstractXPUInterface::updateSpikeClassifier(int channelIndex, const Channel* channel, cl_char classifier)
+{
+    QString definition;
+    if (classifier == SpikeClassifierHoops) definition = channel->getSpikeHoops();
+    else if (classifier == SpikeClassifierTemplates) definition = channel->getSpikeTemplates();
+    double currentSampleRate = state->sampleRate->getNumericValue();
+
+    ClassifierSource& source = classifierSources[channelIndex];
+    if (source.classifier == classifier && source.sampleRate == currentSampleRate && source.definition == definition) {
+        return;
+    }
+    source = { classifier, currentSampleRate, definition };
+
+    ChannelHoopsStruct& channelHoops = hoops[channelIndex];
+    clearSpikeClassifier(channelHoops);
+    bool valid = true;
+    if (classifier == SpikeClassifierHoops) {
+        valid = compileSpikeHoops(definition, currentSampleRate, channelHoops);
+    } else if (classifier == SpikeClassifierTemplates) {
+        valid = compileSpikeTemplates(definition, channelHoops);
+    }
+    if (!valid) {
+        std::cerr << "Error: ignoring malformed spike " << (classifier == SpikeClassifierHoops ? "hoops" : "templates") <<
+                     " on channel " << channel->getNativeNameString() << '\n';
+    }
+
+    // Channels without any units keep the classifier, so their threshold crossings are reported as unclassified rather
+    // than as unit 1.
+    channelHoops.classifier = classifier;
 }
 
 // Default implementation - do nothing (should only be reimplemented by GPUInterface)
@@ -293,3 +359,8 @@ void AbstractXPUInterface::updateConstChars()
 void AbstractXPUInterface::updateConstFloats()
 {
 }
+
+// Default implementation - do nothing (should only be reimplemented by CPUInterface)
+void AbstractXPUInterface::updateCPUOptions()
+{
+}
@@ -39,18 +39,21 @@
 #endif
 
 #include <mutex>
+#include <vector>
 
 #include "systemstate.h"
 #include "filter.h"
 
 #define MAX_SOURCE_SIZE (0x100000) // memory allocated for kernel.cl source code
 
+// Hoop geometry, precompiled by compileSpikeHoops() into snippet sample indices so that no time conversion or
+// rounding is needed per snippet.  The hoop line at snippet sample s is y0 + slope * s.
 typedef struct _HoopInfo
 {
-    cl_float tA;
-    cl_float yA;
-    cl_float tB;
-    cl_float yB;
+    cl_int sA;       // First sample index of the hoop, or -1 if this hoop is inactive (always passes)
+    cl_int sB;       // Last sample index of the hoop; equal to sA for a vertical hoop
+    cl_float y0;     // Hoop line at sample index 0 (microvolts); lower bound of a vertical hoop
+    cl_float slope;  // Hoop line slope (microvolts per sample); upper bound of a vertical hoop
 } HoopInfoStruct;
 
 typedef struct _UnitHoops
@@ -58,13 +61,23 @@ typedef struct _UnitHoops
     HoopInfoStruct hoopInfo[4];
 } UnitHoopsStruct;
 
+// Per-channel spike detection and classification parameters (hoops, or unit templates for nearest-centroid matching).
 typedef struct _Channel_Hoops
 {
     UnitHoopsStruct unitHoops[4];
+    cl_float templates[4][SnippetSize];  // Unit centroids (microvolts), starting at the threshold crossing
+    cl_float templateMaxDistance;  // Largest accepted sum of squared differences from the nearest centroid
     cl_float threshold;
-    cl_char useHoops; // Ideally would be bool, but bool can't be passed to OpenCL. 1 = true, 0 = false
+    cl_char classifier;   // SpikeClassifierThreshold, SpikeClassifierHoops, or SpikeClassifierTemplates
+    cl_char activeUnits;  // Bit n is set if unit n has at least one hoop (hoop mode) or a template (template mode)
 } ChannelHoopsStruct;
 
+// ChannelHoopsStruct::classifier values.  With hoops or templates, channels with no active units report every threshold
+// crossing as unclassified.
+const cl_char SpikeClassifierThreshold = 0;  // Every threshold crossing is unit 1
+const cl_char SpikeClassifierHoops = 1;      // Unit whose hoops are all crossed, else unclassified
+const cl_char SpikeClassifierTemplates = 2;  // Nearest unit template within templateMaxDistance, else unclassified
+
 typedef struct _FilterIterationParams
 {
     cl_float b2;
@@ -95,20 +108,73 @@ typedef struct _FilterParams
     FilterIterationParamStruct highParams[4];
 } FilterParamStruct;
 
+// Field-by-field comparisons of the parameter structs (their padding bytes are undefined, so memcmp cannot be used).
+inline bool operator==(const HoopInfoStruct& a, const HoopInfoStruct& b)
+{
+    return a.sA == b.sA && a.sB == b.sB && a.y0 == b.y0 && a.slope == b.slope;
+}
+
+inline bool operator==(const UnitHoopsStruct& a, const UnitHoopsStruct& b)
+{
+    for (int hoop = 0; hoop < 4; ++hoop) {
+        if (!(a.hoopInfo[hoop] == b.hoopInfo[hoop])) return false;
+    }
+    return true;
+}
+
+inline bool operator==(const ChannelHoopsStruct& a, const ChannelHoopsStruct& b)
+{
+    for (int unit = 0; unit < 4; ++unit) {
+        if (!(a.unitHoops[unit] == b.unitHoops[unit])) return false;
+        for (int s = 0; s < SnippetSize; ++s) {
+            if (a.templates[unit][s] != b.templates[unit][s]) return false;
+        }
+    }
+    return a.templateMaxDistance == b.templateMaxDistance && a.threshold == b.threshold &&
+            a.classifier == b.classifier && a.activeUnits == b.activeUnits;
+}
+
+inline bool operator==(const FilterIterationParamStruct& a, const FilterIterationParamStruct& b)
+{
+    return a.b2 == b.b2 && a.b1 == b.b1 && a.b0 == b.b0 && a.a2 == b.a2 && a.a1 == b.a1;
+}
+
+inline bool operator==(const GlobalParamStruct& a, const GlobalParamStruct& b)
+{
+    return a.wordsPerFrame == b.wordsPerFrame && a.type == b.type && a.numStreams == b.numStreams &&
+            a.snippetSize == b.snippetSize && a.sampleRate == b.sampleRate && a.spikeMax == b.spikeMax &&
+            a.spikeMaxEnabled == b.spikeMaxEnabled;
+}
+
+inline bool operator==(const FilterParamStruct& a, const FilterParamStruct& b)
+{
+    if (a.lowOrder != b.lowOrder || a.highOrder != b.highOrder || !(a.notchParams == b.notchParams)) return false;
+    for (int i = 0; i < 4; ++i) {
+        if (!(a.lowParams[i] == b.lowParams[i]) || !(a.highParams[i] == b.highParams[i])) return false;
+    }
+    return true;
+}
+
 class AbstractXPUInterface : public QObject
 {
     Q_OBJECT
 public:
     explicit AbstractXPUInterface(SystemState* state_, QObject *parent = nullptr);
 
-    void resetPrev();
-    virtual void processDataBlock(uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
-                                  uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) = 0;
+    virtual void resetPrev();
+    void processDataBlock(uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
+                          uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk)
+        { processDataBlocks(1, data, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk); }
+    // Process numBlocks consecutive data blocks in one call.  Outputs for block b start at b * FramesPerBlock * channels
+    // in lowChunk, wideChunk, and highChunk, and at b * SnippetsPerBlock * channels in spikeChunk and spikeIDChunk.
+    virtual void processDataBlocks(int numBlocks, uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
+                                   uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) = 0;
     void updateNumStreams(int numStreams_);
     void updateFromState();
     virtual void speedTest() = 0;
     virtual bool setupMemory() = 0;
     virtual bool cleanupMemory() = 0;
+    static double diagnosticBlocksPerSecond(float diagnosticTime);
 
 protected:
     virtual void updateMemory();
@@ -118,6 +184,8 @@ protected:
     virtual void updateFilterConstArray();
     virtual void updateConstChars();
     virtual void updateConstFloats();
+    virtual void updateCPUOptions();
+    void updateSpikeClassifier(int channelIndex, const Channel* channel, cl_char classifier);
     std::mutex filterMutex;
 
     bool allocated;
@@ -142,6 +210,15 @@ protected:
     uint16_t* startSearchPos;
     ChannelHoopsStruct* hoops;
 
+    // Hoop or template definition each channel's classifier was last compiled from; cleared whenever hoops is
+    // reallocated.
+    struct ClassifierSource {
+        cl_char classifier;
+        double sampleRate;
+        QString definition;
+    };
+    std::vector<ClassifierSource> classifierSources;
+
     uint16_t* parsedPrevHighOriginal;
     uint16_t* parsedPrevHigh;
     uint64_t* inputIndex, outputIndex, spikeIndex;
@@ -0,0 +1,472 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <cmath>
+
+#include "cpufilterkernels.h"
+
+// Every kernel must round exactly like CPUInterface's scalar filter, so never fuse a multiply and an add into a single
+// FMA instruction (which GCC would otherwise do in the AVX-512 kernel, since AVX-512F includes FMA).
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC optimize ("fp-contract=off")
+#elif defined(__clang__)
+    #pragma clang fp contract(off)
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define CPU_FILTER_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define TARGET_AVX2
+        #define TARGET_AVX512
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+        #define TARGET_AVX512 __attribute__((target("avx512f")))
+    #endif
+#endif
+
+namespace {
+
+// Offsets of each value within one channel's prevLast2 record (see CPUInterface::processChannels()).
+const int StateLowPrev2 = 0;
+const int StateLowPrev1 = 4;
+const int StateHighPrev2 = 8;
+const int StateHighPrev1 = 12;
+const int StateInPrev2 = 16;
+const int StateInPrev1 = 17;
+const int StateWidePrev2 = 18;
+const int StateWidePrev1 = 19;
+
+const float ClipLimit = 6389.0f;  // Largest magnitude (in microvolts) that fits in a uint16_t output sample.
+
+const int PortableLanes = 8;
+
+inline int numFilterIterations(int order)
+{
+    return floor((float)(order - 1) / 2.0f) + 1;
+}
+
+inline float clip(float value)
+{
+    if (value > ClipLimit) return ClipLimit;
+    else if (value < -ClipLimit) return -ClipLimit;
+    return value;
+}
+
+inline float biquad(const FilterIterationParamStruct& c, float x2, float x1, float x0, float y2, float y1)
+{
+    return c.b2 * x2 + c.b1 * x1 + c.b0 * x0 - c.a2 * y2 - c.a1 * y1;
+}
+
+// Portable kernel.  The innermost loops run across channels, so the compiler is free to vectorize them with whatever
+// instruction set the build targets.
+void filterGroupPortable(const FilterParamStruct& p, FilterGroupBuffers& b)
+{
+    const int M = MaxFilterLanes;
+    const int numLow = numFilterIterations(p.lowOrder);
+    const int numHigh = numFilterIterations(p.highOrder);
+
+    float in2[PortableLanes], in1[PortableLanes], wide2[PortableLanes], wide1[PortableLanes];
+    float low2[4][PortableLanes], low1[4][PortableLanes], high2[4][PortableLanes], high1[4][PortableLanes];
+
+    for (int i = 0; i < PortableLanes; ++i) {
+        in2[i] = b.state[StateInPrev2 * M + i];
+        in1[i] = b.state[StateInPrev1 * M + i];
+        wide2[i] = b.state[StateWidePrev2 * M + i];
+        wide1[i] = b.state[StateWidePrev1 * M + i];
+        for (int k = 0; k < 4; ++k) {
+            low2[k][i] = b.state[(StateLowPrev2 + k) * M + i];
+            low1[k][i] = b.state[(StateLowPrev1 + k) * M + i];
+            high2[k][i] = b.state[(StateHighPrev2 + k) * M + i];
+            high1[k][i] = b.state[(StateHighPrev1 + k) * M + i];
+        }
+    }
+
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        for (int i = 0; i < PortableLanes; ++i) {
+            float x = b.in[s * M + i];
+
+            // (1) IIR notch filter
+            float w = biquad(p.notchParams, in2[i], in1[i], x, wide2[i], wide1[i]);
+            in2[i] = in1[i];
+            in1[i] = x;
+
+            // (2) IIR Nth-order low-pass; each iteration uses the previous iteration's output as its input.
+            float x2 = wide2[i], x1 = wide1[i], x0 = w;
+            for (int k = 0; k < numLow; ++k) {
+                float y = biquad(p.lowParams[k], x2, x1, x0, low2[k][i], low1[k][i]);
+                x2 = low2[k][i];
+                x1 = low1[k][i];
+                x0 = y;
+                low2[k][i] = low1[k][i];
+                low1[k][i] = y;
+            }
+            b.low[s * M + i] = x0;
+
+            // (3) IIR Nth-order high-pass
+            x2 = wide2[i];
+            x1 = wide1[i];
+            x0 = w;
+            for (int k = 0; k < numHigh; ++k) {
+                float y = biquad(p.highParams[k], x2, x1, x0, high2[k][i], high1[k][i]);
+                x2 = high2[k][i];
+                x1 = high1[k][i];
+                x0 = y;
+                high2[k][i] = high1[k][i];
+                high1[k][i] = y;
+            }
+            b.high[s * M + i] = x0;
+
+            b.wide[s * M + i] = w;
+            wide2[i] = wide1[i];
+            wide1[i] = w;
+        }
+    }
+
+    // Unused filter iterations are stored as zero, and the stored wideband values are clipped, matching CPUInterface.
+    for (int i = 0; i < PortableLanes; ++i) {
+        b.state[StateInPrev2 * M + i] = in2[i];
+        b.state[StateInPrev1 * M + i] = in1[i];
+        b.state[StateWidePrev2 * M + i] = clip(wide2[i]);
+        b.state[StateWidePrev1 * M + i] = clip(wide1[i]);
+        for (int k = 0; k < 4; ++k) {
+            b.state[(StateLowPrev2 + k) * M + i] = (k < numLow) ? low2[k][i] : 0.0f;
+            b.state[(StateLowPrev1 + k) * M + i] = (k < numLow) ? low1[k][i] : 0.0f;
+            b.state[(StateHighPrev2 + k) * M + i] = (k < numHigh) ? high2[k][i] : 0.0f;
+            b.state[(StateHighPrev1 + k) * M + i] = (k < numHigh) ? high1[k][i] : 0.0f;
+        }
+    }
+}
+
+void convertGroupPortable(const FilterGroupBuffers& b, int numLanes, uint16_t* lowChunk, uint16_t* wideChunk,
+                          uint16_t* highChunk, int stride)
+{
+    const int M = MaxFilterLanes;
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        for (int i = 0; i < numLanes; ++i) {
+            int outIndex = s * stride + i;
+            lowChunk[outIndex] = (uint16_t) round((clip(b.low[s * M + i]) / 0.195f) + 32768);
+            wideChunk[outIndex] = (uint16_t) round((clip(b.wide[s * M + i]) / 0.195f) + 32768);
+            highChunk[outIndex] = (uint16_t) round((clip(b.high[s * M + i]) / 0.195f) + 32768);
+        }
+    }
+}
+
+const CPUFilterKernel PortableKernel = { "Portable", PortableLanes, filterGroupPortable, convertGroupPortable };
+
+#ifdef CPU_FILTER_X86
+
+TARGET_AVX2 inline void broadcastAVX2(const FilterIterationParamStruct& c, __m256* v)
+{
+    v[0] = _mm256_set1_ps(c.b2);
+    v[1] = _mm256_set1_ps(c.b1);
+    v[2] = _mm256_set1_ps(c.b0);
+    v[3] = _mm256_set1_ps(c.a2);
+    v[4] = _mm256_set1_ps(c.a1);
+}
+
+TARGET_AVX2 inline __m256 biquadAVX2(const __m256* c, __m256 x2, __m256 x1, __m256 x0, __m256 y2, __m256 y1)
+{
+    __m256 acc = _mm256_mul_ps(c[0], x2);
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(c[1], x1));
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(c[2], x0));
+    acc = _mm256_sub_ps(acc, _mm256_mul_ps(c[3], y2));
+    return _mm256_sub_ps(acc, _mm256_mul_ps(c[4], y1));
+}
+
+TARGET_AVX2 inline __m256 clipAVX2(__m256 v)
+{
+    return _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-ClipLimit)), _mm256_set1_ps(ClipLimit));
+}
+
+TARGET_AVX2 void filterGroupAVX2(const FilterParamStruct& p, FilterGroupBuffers& b)
+{
+    const int M = MaxFilterLanes;
+    const int numLow = numFilterIterations(p.lowOrder);
+    const int numHigh = numFilterIterations(p.highOrder);
+
+    __m256 notchC[5], lowC[4][5], highC[4][5];
+    broadcastAVX2(p.notchParams, notchC);
+    for (int k = 0; k < 4; ++k) {
+        broadcastAVX2(p.lowParams[k], lowC[k]);
+        broadcastAVX2(p.highParams[k], highC[k]);
+    }
+
+    __m256 in2 = _mm256_load_ps(&b.state[StateInPrev2 * M]);
+    __m256 in1 = _mm256_load_ps(&b.state[StateInPrev1 * M]);
+    __m256 wide2 = _mm256_load_ps(&b.state[StateWidePrev2 * M]);
+    __m256 wide1 = _mm256_load_ps(&b.state[StateWidePrev1 * M]);
+    __m256 low2[4], low1[4], high2[4], high1[4];
+    for (int k = 0; k < 4; ++k) {
+        low2[k] = _mm256_load_ps(&b.state[(StateLowPrev2 + k) * M]);
+        low1[k] = _mm256_load_ps(&b.state[(StateLowPrev1 + k) * M]);
+        high2[k] = _mm256_load_ps(&b.state[(StateHighPrev2 + k) * M]);
+        high1[k] = _mm256_load_ps(&b.state[(StateHighPrev1 + k) * M]);
+    }
+
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        __m256 x = _mm256_load_ps(&b.in[s * M]);
+        __m256 w = biquadAVX2(notchC, in2, in1, x, wide2, wide1);
+        in2 = in1;
+        in1 = x;
+
+        __m256 x2 = wide2, x1 = wide1, x0 = w;
+        for (int k = 0; k < numLow; ++k) {
+            __m256 y = biquadAVX2(lowC[k], x2, x1, x0, low2[k], low1[k]);
+            x2 = low2[k];
+            x1 = low1[k];
+            x0 = y;
+            low2[k] = low1[k];
+            low1[k] = y;
+        }
+        _mm256_store_ps(&b.low[s * M], x0);
+
+        x2 = wide2;
+        x1 = wide1;
+        x0 = w;
+        for (int k = 0; k < numHigh; ++k) {
+            __m256 y = biquadAVX2(highC[k], x2, x1, x0, high2[k], high1[k]);
+            x2 = high2[k];
+            x1 = high1[k];
+            x0 = y;
+            high2[k] = high1[k];
+            high1[k] = y;
+        }
+        _mm256_store_ps(&b.high[s * M], x0);
+
+        _mm256_store_ps(&b.wide[s * M], w);
+        wide2 = wide1;
+        wide1 = w;
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    _mm256_store_ps(&b.state[StateInPrev2 * M], in2);
+    _mm256_store_ps(&b.state[StateInPrev1 * M], in1);
+    _mm256_store_ps(&b.state[StateWidePrev2 * M], clipAVX2(wide2));
+    _mm256_store_ps(&b.state[StateWidePrev1 * M], clipAVX2(wide1));
+    for (int k = 0; k < 4; ++k) {
+        _mm256_store_ps(&b.state[(StateLowPrev2 + k) * M], (k < numLow) ? low2[k] : zero);
+        _mm256_store_ps(&b.state[(StateLowPrev1 + k) * M], (k < numLow) ? low1[k] : zero);
+        _mm256_store_ps(&b.state[(StateHighPrev2 + k) * M], (k < numHigh) ? high2[k] : zero);
+        _mm256_store_ps(&b.state[(StateHighPrev1 + k) * M], (k < numHigh) ? high1[k] : zero);
+    }
+}
+
+TARGET_AVX2 void convertBandAVX2(const float* band, uint16_t* chunk, int stride)
+{
+    const __m256 scale = _mm256_set1_ps(0.195f);
+    const __m256 offset = _mm256_set1_ps(32768.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        __m256 v = _mm256_add_ps(_mm256_div_ps(clipAVX2(_mm256_load_ps(&band[s * MaxFilterLanes])), scale), offset);
+        // After clipping v is always positive, so truncating v + 0.5 rounds half away from zero exactly like round().
+        __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(v, half));
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+        _mm_storeu_si128((__m128i*) &chunk[s * stride], packed);
+    }
+}
+
+TARGET_AVX2 void convertGroupAVX2(const FilterGroupBuffers& b, int numLanes, uint16_t* lowChunk, uint16_t* wideChunk,
+                                  uint16_t* highChunk, int stride)
+{
+    if (numLanes != 8) {
+        convertGroupPortable(b, numLanes, lowChunk, wideChunk, highChunk, stride);
+        return;
+    }
+    convertBandAVX2(b.low, lowChunk, stride);
+    convertBandAVX2(b.wide, wideChunk, stride);
+    convertBandAVX2(b.high, highChunk, stride);
+}
+
+TARGET_AVX512 inline void broadcastAVX512(const FilterIterationParamStruct& c, __m512* v)
+{
+    v[0] = _mm512_set1_ps(c.b2);
+    v[1] = _mm512_set1_ps(c.b1);
+    v[2] = _mm512_set1_ps(c.b0);
+    v[3] = _mm512_set1_ps(c.a2);
+    v[4] = _mm512_set1_ps(c.a1);
+}
+
+TARGET_AVX512 inline __m512 biquadAVX512(const __m512* c, __m512 x2, __m512 x1, __m512 x0, __m512 y2, __m512 y1)
+{
+    __m512 acc = _mm512_mul_ps(c[0], x2);
+    acc = _mm512_add_ps(acc, _mm512_mul_ps(c[1], x1));
+    acc = _mm512_add_ps(acc, _mm512_mul_ps(c[2], x0));
+    acc = _mm512_sub_ps(acc, _mm512_mul_ps(c[3], y2));
+    return _mm512_sub_ps(acc, _mm512_mul_ps(c[4], y1));
+}
+
+TARGET_AVX512 inline __m512 clipAVX512(__m512 v)
+{
+    return _mm512_min_ps(_mm512_max_ps(v, _mm512_set1_ps(-ClipLimit)), _mm512_set1_ps(ClipLimit));
+}
+
+TARGET_AVX512 void filterGroupAVX512(const FilterParamStruct& p, FilterGroupBuffers& b)
+{
+    const int M = MaxFilterLanes;
+    const int numLow = numFilterIterations(p.lowOrder);
+    const int numHigh = numFilterIterations(p.highOrder);
+
+    __m512 notchC[5], lowC[4][5], highC[4][5];
+    broadcastAVX512(p.notchParams, notchC);
+    for (int k = 0; k < 4; ++k) {
+        broadcastAVX512(p.lowParams[k], lowC[k]);
+        broadcastAVX512(p.highParams[k], highC[k]);
+    }
+
+    __m512 in2 = _mm512_load_ps(&b.state[StateInPrev2 * M]);
+    __m512 in1 = _mm512_load_ps(&b.state[StateInPrev1 * M]);
+    __m512 wide2 = _mm512_load_ps(&b.state[StateWidePrev2 * M]);
+    __m512 wide1 = _mm512_load_ps(&b.state[StateWidePrev1 * M]);
+    __m512 low2[4], low1[4], high2[4], high1[4];
+    for (int k = 0; k < 4; ++k) {
+        low2[k] = _mm512_load_ps(&b.state[(StateLowPrev2 + k) * M]);
+        low1[k] = _mm512_load_ps(&b.state[(StateLowPrev1 + k) * M]);
+        high2[k] = _mm512_load_ps(&b.state[(StateHighPrev2 + k) * M]);
+        high1[k] = _mm512_load_ps(&b.state[(StateHighPrev1 + k) * M]);
+    }
+
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        __m512 x = _mm512_load_ps(&b.in[s * M]);
+        __m512 w = biquadAVX512(notchC, in2, in1, x, wide2, wide1);
+        in2 = in1;
+        in1 = x;
+
+        __m512 x2 = wide2, x1 = wide1, x0 = w;
+        for (int k = 0; k < numLow; ++k) {
+            __m512 y = biquadAVX512(lowC[k], x2, x1, x0, low2[k], low1[k]);
+            x2 = low2[k];
+            x1 = low1[k];
+            x0 = y;
+            low2[k] = low1[k];
+            low1[k] = y;
+        }
+        _mm512_store_ps(&b.low[s * M], x0);
+
+        x2 = wide2;
+        x1 = wide1;
+        x0 = w;
+        for (int k = 0; k < numHigh; ++k) {
+            __m512 y = biquadAVX512(highC[k], x2, x1, x0, high2[k], high1[k]);
+            x2 = high2[k];
+            x1 = high1[k];
+            x0 = y;
+            high2[k] = high1[k];
+            high1[k] = y;
+        }
+        _mm512_store_ps(&b.high[s * M], x0);
+
+        _mm512_store_ps(&b.wide[s * M], w);
+        wide2 = wide1;
+        wide1 = w;
+    }
+
+    const __m512 zero = _mm512_setzero_ps();
+    _mm512_store_ps(&b.state[StateInPrev2 * M], in2);
+    _mm512_store_ps(&b.state[StateInPrev1 * M], in1);
+    _mm512_store_ps(&b.state[StateWidePrev2 * M], clipAVX512(wide2));
+    _mm512_store_ps(&b.state[StateWidePrev1 * M], clipAVX512(wide1));
+    for (int k = 0; k < 4; ++k) {
+        _mm512_store_ps(&b.state[(StateLowPrev2 + k) * M], (k < numLow) ? low2[k] : zero);
+        _mm512_store_ps(&b.state[(StateLowPrev1 + k) * M], (k < numLow) ? low1[k] : zero);
+        _mm512_store_ps(&b.state[(StateHighPrev2 + k) * M], (k < numHigh) ? high2[k] : zero);
+        _mm512_store_ps(&b.state[(StateHighPrev1 + k) * M], (k < numHigh) ? high1[k] : zero);
+    }
+}
+
+TARGET_AVX512 void convertBandAVX512(const float* band, uint16_t* chunk, int stride)
+{
+    const __m512 scale = _mm512_set1_ps(0.195f);
+    const __m512 offset = _mm512_set1_ps(32768.0f);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    for (int s = 0; s < FramesPerBlock; ++s) {
+        __m512 v = _mm512_add_ps(_mm512_div_ps(clipAVX512(_mm512_load_ps(&band[s * MaxFilterLanes])), scale), offset);
+        __m512i i = _mm512_cvttps_epi32(_mm512_add_ps(v, half));
+        _mm256_storeu_si256((__m256i*) &chunk[s * stride], _mm512_cvtepi32_epi16(i));
+    }
+}
+
+TARGET_AVX512 void convertGroupAVX512(const FilterGroupBuffers& b, int numLanes, uint16_t* lowChunk, uint16_t* wideChunk,
+                                      uint16_t* highChunk, int stride)
+{
+    if (numLanes != 16) {
+        convertGroupPortable(b, numLanes, lowChunk, wideChunk, highChunk, stride);
+        return;
+    }
+    convertBandAVX512(b.low, lowChunk, stride);
+    convertBandAVX512(b.wide, wideChunk, stride);
+    convertBandAVX512(b.high, highChunk, stride);
+}
+
+const CPUFilterKernel AVX2Kernel = { "AVX2", 8, filterGroupAVX2, convertGroupAVX2 };
+const CPUFilterKernel AVX512Kernel = { "AVX-512", 16, filterGroupAVX512, convertGroupAVX512 };
+
+#if defined(_MSC_VER) && !defined(__clang__)
+// Check that the processor supports the given leaf-7 feature bit, and that the operating system saves the register
+// state given by xcr0Mask on context switches.
+bool cpuSupportsFeature(int leaf7EbxBit, unsigned long long xcr0Mask)
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & xcr0Mask) != xcr0Mask) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << leaf7EbxBit)) != 0;
+}
+
+bool cpuSupportsAVX2() { return cpuSupportsFeature(5, 0x06); }
+bool cpuSupportsAVX512() { return cpuSupportsFeature(16, 0xe6); }
+#else
+bool cpuSupportsAVX2() { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }
+bool cpuSupportsAVX512() { __builtin_cpu_init(); return __builtin_cpu_supports("avx512f"); }
+#endif
+
+#endif // CPU_FILTER_X86
+
+}
+
+const CPUFilterKernel* portableCPUFilterKernel()
+{
+    return &PortableKernel;
+}
+
+const CPUFilterKernel* bestCPUFilterKernel()
+{
+#ifdef CPU_FILTER_X86
+    static const CPUFilterKernel* best = cpuSupportsAVX512() ? &AVX512Kernel :
+                                         (cpuSupportsAVX2() ? &AVX2Kernel : &PortableKernel);
+    return best;
+#else
+    return &PortableKernel;
+#endif
+}
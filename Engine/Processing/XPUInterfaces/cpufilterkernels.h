@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef CPUFILTERKERNELS_H
+#define CPUFILTERKERNELS_H
+
+#include "abstractxpuinterface.h"
+
+// Largest number of channels filtered together by any kernel (16 single-precision lanes with AVX-512).
+const int MaxFilterLanes = 16;
+
+// Number of entries per channel in the prevLast2 filter state array.
+const int FilterStateSize = 20;
+
+// Working buffers for one group of amplifier channels filtered together, stored as structure-of-arrays: sample s of the
+// i-th channel in the group is found at [s * MaxFilterLanes + i], and state[k * MaxFilterLanes + i] holds entry k of
+// that channel's prevLast2 record.
+struct FilterGroupBuffers
+{
+    alignas(64) float in[FramesPerBlock * MaxFilterLanes];
+    alignas(64) float wide[FramesPerBlock * MaxFilterLanes];
+    alignas(64) float low[FramesPerBlock * MaxFilterLanes];
+    alignas(64) float high[FramesPerBlock * MaxFilterLanes];
+    alignas(64) float state[FilterStateSize * MaxFilterLanes];
+};
+
+// Set of routines that run the notch, lowpass, and highpass biquad cascades on 'lanes' channels at once.  Every kernel
+// performs exactly the same single-precision operations, in the same order, as CPUInterface's channel-at-a-time code,
+// so all kernels produce bit-identical results.
+struct CPUFilterKernel
+{
+    const char* name;
+    int lanes;
+
+    // Filter one data block of a group, updating buffers.state in place.  Unused lanes are filtered but ignored.
+    void (*filter)(const FilterParamStruct& params, FilterGroupBuffers& buffers);
+
+    // Clip, scale, and convert the first numLanes channels of a filtered group to uint16_t, writing sample s of
+    // lane i to chunk[s * stride + i] for the wideband, lowpass, and highpass outputs.
+    void (*convert)(const FilterGroupBuffers& buffers, int numLanes, uint16_t* lowChunk, uint16_t* wideChunk,
+                    uint16_t* highChunk, int stride);
+};
+
+const CPUFilterKernel* portableCPUFilterKernel();
+const CPUFilterKernel* bestCPUFilterKernel();  // Fastest kernel supported by the processor we are running on.
+
+#endif // CPUFILTERKERNELS_H
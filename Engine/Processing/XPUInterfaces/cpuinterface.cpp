@@ -28,10 +28,15 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
+#include <vector>
+
 #include "cpuinterface.h"
 
 CPUInterface::CPUInterface(SystemState *state_, QObject *parent) :
-    AbstractXPUInterface(state_, parent)
+    AbstractXPUInterface(state_, parent),
+    workerPool(state_->cpuProcessingThreads->getValue()),
+    filterKernel(nullptr)
 {
     updateFromState();
 }
@@ -43,17 +48,67 @@ CPUInterface::~CPUInterface()
     }
 }
 
-void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_t *wideChunk, uint16_t *highChunk,
-                                    uint32_t *spikeChunk, uint8_t *spikeIDChunk)
+void CPUInterface::processDataBlocks(int numBlocks, uint16_t *data, uint16_t *lowChunk, uint16_t *wideChunk,
+                                     uint16_t *highChunk, uint32_t *spikeChunk, uint8_t *spikeIDChunk)
 {
     std::lock_guard<std::mutex> lockFilter(filterMutex);
 
-    if (channels == 0)
+    processDataBlocks(filterKernel, numBlocks, data, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk);
+}
+
+// Process data blocks using the given filter kernel, or the channel-at-a-time filter if kernel is nullptr.
+// filterMutex must already be held.
+void CPUInterface::processDataBlocks(const CPUFilterKernel *kernel, int numBlocks, uint16_t *data, uint16_t *lowChunk,
+                                     uint16_t *wideChunk, uint16_t *highChunk, uint32_t *spikeChunk,
+                                     uint8_t *spikeIDChunk)
+{
+    if (channels == 0 || numBlocks < 1)
         return;
 
-    uint16_t* rawBlock = data;
+    const int samplesPerBlock = FramesPerBlock * channels;
+    const int snippetsPerBlock = SnippetsPerBlock * channels;
+
+    // Each worker filters a contiguous range of channels that starts on a stream boundary.  Channels are independent of
+    // one another, so each worker owns its own slice of prevLast2 and startSearchPos, and the results are identical to
+    // processing all channels on a single thread.  Each worker runs through the blocks in order, so the previous
+    // block's highpass data needed for spike detection was written by the same worker.
+    workerPool.run([&](int worker, int numWorkers) {
+        int firstChannel, lastChannel;
+        WorkerPool::partition(channels, channelsPerStream, worker, numWorkers, firstChannel, lastChannel);
+        if (firstChannel >= lastChannel) return;
+        const uint16_t* prevHigh = parsedPrevHigh;
+        SpikeSnippetBatch snippetBatch;
+        for (int block = 0; block < numBlocks; ++block) {
+            uint16_t* blockData = data + block * wordsPerBlock;
+            uint16_t* blockLow = lowChunk + block * samplesPerBlock;
+            uint16_t* blockWide = wideChunk + block * samplesPerBlock;
+            uint16_t* blockHigh = highChunk + block * samplesPerBlock;
+            uint32_t* blockSpike = spikeChunk + block * snippetsPerBlock;
+            uint8_t* blockSpikeID = spikeIDChunk + block * snippetsPerBlock;
+            if (kernel) {
+                processChannelsVectorized(kernel, blockData, blockLow, blockWide, blockHigh, blockSpike, blockSpikeID,
+                                          prevHigh, firstChannel, lastChannel, snippetBatch);
+            } else {
+                processChannels(blockData, blockLow, blockWide, blockHigh, blockSpike, blockSpikeID, prevHigh,
+                                firstChannel, lastChannel, snippetBatch);
+            }
+            prevHigh = &blockHigh[(FramesPerBlock - SnippetSize) * channels];
+        }
+        classifySpikeSnippets(hoops, snippetBatch);
+    });
 
-    float samplePeriod = 1.0f / sampleRate;
+    // Set the last 50 samples of high to parsedPrevHigh so that they can be used in the next data block
+//    memcpy(parsedPrevHigh, &highChunk[(FramesPerBlock - SnippetSize) * channels], SnippetSize * sizeof(uint16_t));
+    parsedPrevHigh = &highChunk[(numBlocks - 1) * samplesPerBlock + (FramesPerBlock - SnippetSize) * channels];
+}
+
+// Filter and detect spikes on amplifier channels [firstChannel, lastChannel) of one data block.  May be called
+// concurrently from several worker threads as long as the channel ranges do not overlap.
+void CPUInterface::processChannels(uint16_t *data, uint16_t *lowChunk, uint16_t *wideChunk, uint16_t *highChunk,
+                                   uint32_t *spikeChunk, uint8_t *spikeIDChunk, const uint16_t *prevHigh,
+                                   int firstChannel, int lastChannel, SpikeSnippetBatch &snippetBatch)
+{
+    uint16_t* rawBlock = data;
 
     float notchB2 = filterParameters.notchParams.b2;
     float notchB1 = filterParameters.notchParams.b1;
@@ -89,17 +144,13 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
         highA1[filterIndex] = filterParameters.highParams[filterIndex].a1;
     }
 
-    const unsigned int snippetsPerBlock = (int) ceil((double) ((double) FramesPerBlock / (double) SnippetSize) + 1.0);
-
     float inFloat[FramesPerBlock];
-    float prevHighFloat[FramesPerBlock];
     float lowFloat[4][FramesPerBlock];
     float wideFloat[FramesPerBlock];
     float highFloat[4][FramesPerBlock];
 
     for (int a = 0; a < FramesPerBlock; ++a) {
         inFloat[a] = 0.0f;
-        prevHighFloat[a] = 0.0f;
         wideFloat[a] = 0.0f;
         for (int b = 0; b < 4; ++b) {
             lowFloat[b][a] = 0.0f;
@@ -120,7 +171,7 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
     float high2ndToLast[4];
     float highLast[4];
 
-    for (int channelIndex = 0; channelIndex < channels; channelIndex++) {
+    for (int channelIndex = firstChannel; channelIndex < lastChannel; channelIndex++) {
         uint32_t lastDataStart = channelIndex * 20;
 
         for (int i = 0; i < 4; ++i) {
@@ -134,8 +185,6 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
         uint32_t wide2ndToLastIndex = lastDataStart + 18;
         uint32_t wideLastIndex = lastDataStart + 19;
 
-        int32_t snippetIndex = 0;
-
         for (int i = 0; i < 4; ++i) {
             low2ndToLast[i] = prevLast2[low2ndToLastIndex[i]];
             lowLast[i] = prevLast2[lowLastIndex[i]];
@@ -147,18 +196,6 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
         float inLast = prevLast2[inLastIndex];
         float wide2ndToLast = prevLast2[wide2ndToLastIndex];
         float wideLast = prevLast2[wideLastIndex];
-        float threshold = hoops[channelIndex].threshold;
-        bool useHoops = (hoops[channelIndex].useHoops == 1) ? true : false;
-
-        for (s = 0; s < snippetsPerBlock; ++s) {
-            spikeChunk[s * channels + channelIndex] = 0;
-            spikeIDChunk[s * channels + channelIndex] = 0;
-        }
-
-        for (s = 0; s < SnippetSize; ++s) {
-            prevHighFloat[s] = (float) (0.195f * (((double)parsedPrevHigh[s * channels + channelIndex]) - 32768));
-        }
-
         int32_t inIndexStream, inIndexChannel;
         if (type == ControllerRecordUSB2 || type == ControllerRecordUSB3) {
             inIndexStream = channelIndex / 32;
@@ -295,216 +332,8 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
             filteredLow[s] = lowFloat[numLowFilterIterations - 1][s];
         }
 
-        // Across this block, look for any valid rectangle and look back to this block and the previous block to
-        // determine valid t0. Add earliest t0 for each rectangle to 'spike' output.
-        snippetIndex = 0;
-
-        // Start with threshS = startSearchPos[channelIndex]. This is 0 unless the previous data block ended with a spike.
-        // In that case, threshS is a non-zero offset to avoid double-detecting a snippet.
-        for (int threshS = startSearchPos[channelIndex] - SnippetSize; threshS < FramesPerBlock - SnippetSize; ++threshS) {
-
-            startSearchPos[channelIndex] = 0;
-
-            // Look to both this data block and the previous block to determine if the threshold was surpassed.
-            bool surpassed = false;
-
-            if (threshold >= 0) {  // If threshold was positive:
-                if (threshS >= 0) {
-                    if (filteredHigh[threshS] > threshold) surpassed = true;
-                } else {
-                    if (prevHighFloat[SnippetSize + threshS] > threshold) surpassed = true;
-                }
-            } else {  // If threshold was negative:
-                if (threshS >= 0) {
-                    if (filteredHigh[threshS] < threshold) surpassed = true;
-                } else {
-                    if (prevHighFloat[SnippetSize + threshS] < threshold) surpassed = true;
-                }
-            }
-
-            // Threshold was surpassed.
-            if (surpassed) {
-                // For ease of understanding, move the samples from [threshS, threshS + SnippetSize] to [0, snippetSize].
-                float thisSnippet[FramesPerBlock];
-                for (int i = 0; i < SnippetSize; ++i) {
-                    int thisS = threshS + i;
-                    if (thisS < 0) {
-                        thisSnippet[i] = prevHighFloat[SnippetSize + thisS];
-                    } else {
-                        thisSnippet[i] = filteredHigh[thisS];
-                    }
-                }
-
-                // Create a struct to hold this channel's hoop info.
-                ChannelDetectionStruct detection;
-                for (int unit = 0; unit < 4; ++unit) {
-                    for (int hoop = 0; hoop < 4; ++hoop) {
-                        detection.units[unit].hoops[hoop] = false;
-                    }
-                }
-                detection.maxSurpassed = false;
-
-                // If spikeMaxEnabled is true, then see if any samples in this snippet surpass spikeMax. If they do,
-                // then mark detetion.maxSurpassed as true and save which sample.
-                if (globalParameters.spikeMaxEnabled) {
-                    for (int i = 0; i < SnippetSize; ++i) {
-                        if (globalParameters.spikeMax >= 0 && thisSnippet[i] >= globalParameters.spikeMax) {
-                            detection.maxSurpassed = true;
-                            break;
-                        }
-                        if (globalParameters.spikeMax < 0 && thisSnippet[i] <= globalParameters.spikeMax) {
-                            detection.maxSurpassed = true;
-                            break;
-                        }
-                    }
-                }
-
-                // If useHoops is true, then go through all units populating detection.units[unit].hoops[hoop].
-                if (useHoops) {
-                    // Go through all units.
-                    for (int unit = 0; unit < 4; ++unit) {
-
-                        // If this unit has no valid hoops (all tA values are -1.0f), then this is an inactive unit which
-                        // should be treated as having no intersect; just go on to the next unit.
-                        if (hoops[channelIndex].unitHoops[unit].hoopInfo[0].tA == -1.0f &&
-                                hoops[channelIndex].unitHoops[unit].hoopInfo[1].tA == -1.0f &&
-                                hoops[channelIndex].unitHoops[unit].hoopInfo[2].tA == -1.0f &&
-                                hoops[channelIndex].unitHoops[unit].hoopInfo[3].tA == -1.0f) {
-                            continue;
-                        }
-
-                        // Go through all hoops.
-                        for (int hoop = 0; hoop < 4; ++hoop) {
-                            HoopInfoStruct thisHoop = hoops[channelIndex].unitHoops[unit].hoopInfo[hoop];
-
-                            // If this hoop info is invalid (tA is -1.0f), then this is an inactive hoop, which by default passes.
-                            // Set true and continue. If all hoops are inactive, then we would have already passed on to the next
-                            // unit without flaggin an intersect.
-                            if (thisHoop.tA == -1.0f) {
-                                detection.units[unit].hoops[hoop] = true;
-                                continue;
-                            }
-
-                            float tA = thisHoop.tA;
-                            float yA = thisHoop.yA;
-                            float tB = thisHoop.tB;
-                            float yB = thisHoop.yB;
-
-                            // In range [tA, tB], does line segment from (t1, y1) to (t2, y2) intersect user-defined hoop?
-                            // If so, mark hoop as jumped through by setting intersect to true.
-                            bool intersect = false;
-
-                            // Round tA down and tB up to the nearest discrete sample.
-                            int sA = floor(sampleRate * tA);
-                            int sB = ceil(sampleRate * tB);
-
-                            // Special case: vertical hoop
-                            if (sA == sB) {
-                                float y1Data = thisSnippet[sA];
-                                if (yB > yA) {
-                                    intersect = (y1Data < yB && y1Data > yA);
-                                } else {
-                                    intersect = (y1Data > yB && y1Data < yA);
-                                }
-                            } else {
-                                // General case: non-vertical hoop
-                                float slope = (yB - yA) / (tB - tA);
-                                // Examine every two adjacent samples in the range [sA, sB] and determine if they intersect the hoop.
-                                for (int s1 = sA; s1 < sB - 1; ++s1) {
-                                    int s2 = s1 + 1;
-                                    float y1Data = thisSnippet[s1];
-                                    float y2Data = thisSnippet[s2];
-
-                                    // Convert s1 and s2 to the float t1 and t2 domain.
-                                    float t1 = ((float) s1) * samplePeriod;
-                                    float t2 = ((float) s2) * samplePeriod;
-
-                                    float y1Hoop = yA + slope * (t1 - tA);
-                                    float y2Hoop = yA + slope * (t2 - tA);
-
-                                    // If the data transitions from below to above the hoop (or vice versa), then an intersection
-                                    // occurred. Break the loop for checking this hoop.
-                                    if ((y1Data >= y1Hoop && y2Data <= y2Hoop) ||
-                                            (y1Data <= y1Hoop && y2Data >= y2Hoop)) {
-                                        intersect = true;
-                                        break;
-                                    }
-
-                                    // Otherwise, keep looking over the course of this hoop.
-                                }
-                            }
-
-                            if (intersect) {  // If intersect occurred, mark this hoop as jumped through.
-                                detection.units[unit].hoops[hoop] = true;
-                            } else {
-                                // If not, exit the hoop loop (default value is false, so effectively setting it false)
-                                // and move on to the next unit.
-                                break;
-                            }
-                        } // End loop across all hoops.
-                    } // End loop across all units.
-                } else {  // If useHoops is false, then just populate detection.units[unit].hoops[hoop] with true.
-                    for (int unit = 0; unit < 4; ++unit) {
-                        for (int hoop = 0; hoop < 4; ++hoop) {
-                            detection.units[unit].hoops[hoop] = true;
-                        }
-                    }
-                }
-
-                uchar ID = 0;
-                // Determine correct ID
-
-
-                if (detection.maxSurpassed) {  // If max has been detected, ID is 128 for max surpassing.
-                    ID = 128;
-                } else if (true) {
-                //} else if (!useHoops) {  // If useHoops is false, ID is 1 to signify threshold crossing.
-                    ID = 1;
-                } else {  // If useHoops is true, ID is either (a) an active unit or (b) just a threshold crossing.
-                    // (a) If a unit is active, ID is either 1, 2, 4, or 8 for the unit.
-                    for (uint8_t unit = 0; unit < 4; ++unit) {
-                        if (detection.units[unit].hoops[0] && detection.units[unit].hoops[1] &&
-                                detection.units[unit].hoops[2] && detection.units[unit].hoops[3]) {
-//                            ID = (uint8_t) pow(2.0f, (float) unit);
-                            ID = 1u << unit;  // faster implementation of 2^unit
-                            break;
-                        }
-                    }
-
-                    // (b) If no unit is active, ID is 64 to signify threshold crossing.
-                    if (ID == 0) ID = 64;
-                }
-
-                // Populate spike with timestamp
-                // Extract the timestamp of the first frame in this data block
-                uint32_t timestampLSW = rawBlock[4]; // Timestamp is always the bytes 8-11 of the datablock (16-bit words 4-5).
-                uint32_t timestampMSW = rawBlock[5];
-                uint32_t timestamp = (timestampMSW << 16) + timestampLSW;
-
-                // Add threshS to this timestamp to index right (for positive threshS) or left (for negative threshS).
-                timestamp += threshS;
-
-                // Write spike detection at this timestamp.
-                spikeChunk[snippetIndex * channels + channelIndex] = timestamp;
-
-                // Populate spikeID with correct ID.
-                spikeIDChunk[snippetIndex * channels + channelIndex] = ID;
-
-                // Advance by SnippetSize samples since activity up until then will already be flagged as a spike.
-                threshS += SnippetSize;
-
-                // Continue detection, preparing for another spike in this block to take the next snippetIndex;
-                ++snippetIndex;
-
-                // If the end of this spike snippet is encroaching on the territory of the next data block
-                // (with SnippetSize of the next block's start), populate startSearchPos[channel] with
-                // the end position of this snippet. This allows the next block to start at a later sample,
-                // so there's no risk of double-counting a spike.
-                if (threshS > FramesPerBlock - SnippetSize) {
-                    startSearchPos[channelIndex] = threshS - (FramesPerBlock - SnippetSize);
-                }
-            }
-        }
+        // Look for spikes in the highpass-filtered data.
+        detectSpikes(rawBlock, channelIndex, filteredHigh, prevHigh, spikeChunk, spikeIDChunk, snippetBatch);
 
         for (s = 0; s < FramesPerBlock; ++s) {
             // Boundary check to make sure result will fit in a uint16_t.
@@ -538,10 +367,278 @@ void CPUInterface::processDataBlock(uint16_t * data, uint16_t *lowChunk, uint16_
         prevLast2[wide2ndToLastIndex] = wideFloat[FramesPerBlock - 2];
         prevLast2[wideLastIndex] = wideFloat[FramesPerBlock - 1];
     }
+}
 
-    // Set the last 50 samples of high to parsedPrevHigh so that they can be used in the next data block
-//    memcpy(parsedPrevHigh, &highChunk[(FramesPerBlock - SnippetSize) * channels], SnippetSize * sizeof(uint16_t));
-    parsedPrevHigh = &highChunk[(FramesPerBlock - SnippetSize) * channels];
+// Vectorized version of processChannels(): channels are gathered into groups of kernel->lanes, each group is filtered
+// in a single pass with one channel per SIMD lane, and the results are scattered back for spike detection and output.
+void CPUInterface::processChannelsVectorized(const CPUFilterKernel *kernel, uint16_t *data, uint16_t *lowChunk,
+                                             uint16_t *wideChunk, uint16_t *highChunk, uint32_t *spikeChunk,
+                                             uint8_t *spikeIDChunk, const uint16_t *prevHigh, int firstChannel,
+                                             int lastChannel, SpikeSnippetBatch &snippetBatch)
+{
+    FilterGroupBuffers buffers;
+    float filteredHigh[FramesPerBlock];
+
+    for (int groupStart = firstChannel; groupStart < lastChannel; groupStart += kernel->lanes) {
+        int groupLanes = std::min(kernel->lanes, lastChannel - groupStart);
+
+        // (0) Gather each channel's input data (converted to float exactly as in processChannels()) and filter state.
+        // Lanes past the end of the channel range are filled with zeros and their results are discarded.
+        for (int lane = 0; lane < kernel->lanes; ++lane) {
+            if (lane >= groupLanes) {
+                for (int frame = 0; frame < FramesPerBlock; ++frame) {
+                    buffers.in[frame * MaxFilterLanes + lane] = 0.0f;
+                }
+                for (int k = 0; k < FilterStateSize; ++k) {
+                    buffers.state[k * MaxFilterLanes + lane] = 0.0f;
+                }
+                continue;
+            }
+
+            int channelIndex = groupStart + lane;
+            int inIndexStream = channelIndex / channelsPerStream;
+            int inIndexChannel = channelIndex % channelsPerStream;
+            int rawOffset;
+            if (type == ControllerStimRecord) {
+                rawOffset = 6 + (numStreams * 3 * 2) + (inIndexChannel * numStreams * 2) + (2 * inIndexStream + 1);
+            } else {
+                rawOffset = 6 + (numStreams * 3) + inIndexChannel * numStreams + inIndexStream;
+            }
+            for (int frame = 0; frame < FramesPerBlock; ++frame) {
+                uint16_t acSample = data[wordsPerFrame * frame + rawOffset];
+                buffers.in[frame * MaxFilterLanes + lane] = (float)(0.195f * (((double)acSample) - 32768));
+            }
+            for (int k = 0; k < FilterStateSize; ++k) {
+                buffers.state[k * MaxFilterLanes + lane] = prevLast2[channelIndex * FilterStateSize + k];
+            }
+        }
+
+        // (1) - (3) Notch, lowpass, and highpass filters for every channel in the group.
+        kernel->filter(filterParameters, buffers);
+
+        for (int lane = 0; lane < groupLanes; ++lane) {
+            int channelIndex = groupStart + lane;
+            for (int k = 0; k < FilterStateSize; ++k) {
+                prevLast2[channelIndex * FilterStateSize + k] = buffers.state[k * MaxFilterLanes + lane];
+            }
+            for (int s = 0; s < FramesPerBlock; ++s) {
+                filteredHigh[s] = buffers.high[s * MaxFilterLanes + lane];
+            }
+            detectSpikes(data, channelIndex, filteredHigh, prevHigh, spikeChunk, spikeIDChunk, snippetBatch);
+        }
+
+        // (4) Convert outputs to uint16_t.
+        kernel->convert(buffers, groupLanes, &lowChunk[groupStart], &wideChunk[groupStart], &highChunk[groupStart],
+                        channels);
+    }
+}
+
+// Look for threshold crossings on one channel, using its highpass-filtered samples (in microvolts) from this data block
+// and the last SnippetSize samples of the previous block (prevHigh), and write any detected spikes to spikeChunk and
+// spikeIDChunk.  Spikes on channels with hoops or templates are added to snippetBatch, and their IDs are written when
+// the batch is classified.
+void CPUInterface::detectSpikes(const uint16_t *rawBlock, int channelIndex, const float *filteredHigh,
+                                const uint16_t *prevHigh, uint32_t *spikeChunk, uint8_t *spikeIDChunk,
+                                SpikeSnippetBatch &snippetBatch)
+{
+    const unsigned int snippetsPerBlock = (int) ceil((double) ((double) FramesPerBlock / (double) SnippetSize) + 1.0);
+
+    float threshold = hoops[channelIndex].threshold;
+    bool classify = hoops[channelIndex].classifier != SpikeClassifierThreshold;
+    bool anyUnits = hoops[channelIndex].activeUnits != 0;
+
+    for (unsigned int s = 0; s < snippetsPerBlock; ++s) {
+        spikeChunk[s * channels + channelIndex] = 0;
+        spikeIDChunk[s * channels + channelIndex] = 0;
+    }
+
+    float prevHighFloat[SnippetSize];
+    for (int s = 0; s < SnippetSize; ++s) {
+        prevHighFloat[s] = (float) (0.195f * (((double)prevHigh[s * channels + channelIndex]) - 32768));
+    }
+
+    // Across this block, look for any valid rectangle and look back to this block and the previous block to
+    // determine valid t0. Add earliest t0 for each rectangle to 'spike' output.
+    int32_t snippetIndex = 0;
+
+    // Start with threshS = startSearchPos[channelIndex]. This is 0 unless the previous data block ended with a spike.
+    // In that case, threshS is a non-zero offset to avoid double-detecting a snippet.
+    for (int threshS = startSearchPos[channelIndex] - SnippetSize; threshS < FramesPerBlock - SnippetSize; ++threshS) {
+
+        startSearchPos[channelIndex] = 0;
+
+        // Look to both this data block and the previous block to determine if the threshold was surpassed.
+        bool surpassed = false;
+
+        if (threshold >= 0) {  // If threshold was positive:
+            if (threshS >= 0) {
+                if (filteredHigh[threshS] > threshold) surpassed = true;
+            } else {
+                if (prevHighFloat[SnippetSize + threshS] > threshold) surpassed = true;
+            }
+        } else {  // If threshold was negative:
+            if (threshS >= 0) {
+                if (filteredHigh[threshS] < threshold) surpassed = true;
+            } else {
+                if (prevHighFloat[SnippetSize + threshS] < threshold) surpassed = true;
+            }
+        }
+
+        // Threshold was surpassed.
+        if (surpassed) {
+            // For ease of understanding, move the samples from [threshS, threshS + SnippetSize] to [0, snippetSize].
+            float thisSnippet[FramesPerBlock];
+            for (int i = 0; i < SnippetSize; ++i) {
+                int thisS = threshS + i;
+                if (thisS < 0) {
+                    thisSnippet[i] = prevHighFloat[SnippetSize + thisS];
+                } else {
+                    thisSnippet[i] = filteredHigh[thisS];
+                }
+            }
+
+            // If spikeMaxEnabled is true, then see if any samples in this snippet surpass spikeMax.
+            bool maxSurpassed = false;
+            if (globalParameters.spikeMaxEnabled) {
+                for (int i = 0; i < SnippetSize; ++i) {
+                    if (globalParameters.spikeMax >= 0 && thisSnippet[i] >= globalParameters.spikeMax) {
+                        maxSurpassed = true;
+                        break;
+                    }
+                    if (globalParameters.spikeMax < 0 && thisSnippet[i] <= globalParameters.spikeMax) {
+                        maxSurpassed = true;
+                        break;
+                    }
+                }
+            }
+
+            // Populate spike with timestamp
+            // Extract the timestamp of the first frame in this data block
+            uint32_t timestampLSW = rawBlock[4]; // Timestamp is always the bytes 8-11 of the datablock (16-bit words 4-5).
+            uint32_t timestampMSW = rawBlock[5];
+            uint32_t timestamp = (timestampMSW << 16) + timestampLSW;
+
+            // Add threshS to this timestamp to index right (for positive threshS) or left (for negative threshS).
+            timestamp += threshS;
+
+            // Write spike detection at this timestamp.
+            spikeChunk[snippetIndex * channels + channelIndex] = timestamp;
+
+            // Populate spikeID: 128 if max was surpassed, 1 for a plain threshold crossing, 64 (unclassified) if the
+            // channel has no units to classify against, otherwise queue the snippet for hoop or template classification.
+            uint8_t* spikeID = &spikeIDChunk[snippetIndex * channels + channelIndex];
+            if (maxSurpassed) {
+                *spikeID = 128;
+            } else if (!classify) {
+                *spikeID = 1;
+            } else if (!anyUnits) {
+                *spikeID = 64;
+            } else {
+                int lane = snippetBatch.count++;
+                for (int i = 0; i < SnippetSize; ++i) {
+                    snippetBatch.samples[i][lane] = thisSnippet[i];
+                }
+                snippetBatch.channel[lane] = channelIndex;
+                snippetBatch.spikeID[lane] = spikeID;
+                if (snippetBatch.count == SpikeSnippetBatch::Capacity) {
+                    classifySpikeSnippets(hoops, snippetBatch);
+                }
+            }
+
+            // Advance by SnippetSize samples since activity up until then will already be flagged as a spike.
+            threshS += SnippetSize;
+
+            // Continue detection, preparing for another spike in this block to take the next snippetIndex;
+            ++snippetIndex;
+
+            // If the end of this spike snippet is encroaching on the territory of the next data block
+            // (with SnippetSize of the next block's start), populate startSearchPos[channel] with
+            // the end position of this snippet. This allows the next block to start at a later sample,
+            // so there's no risk of double-counting a spike.
+            if (threshS > FramesPerBlock - SnippetSize) {
+                startSearchPos[channelIndex] = threshS - (FramesPerBlock - SnippetSize);
+            }
+        }
+    }
+}
+
+void CPUInterface::updateCPUOptions()
+{
+    workerPool.setNumThreads(state->cpuProcessingThreads->getValue());
+    filterKernel = (state->cpuFilterMode->getValue() == "Vectorized") ? bestCPUFilterKernel() : nullptr;
+}
+
+// Run the same pseudorandom data through the scalar filter (one block at a time) and the vectorized filter (all blocks in
+// one batch), and return true if every output (filtered waveforms, spike timestamps, and spike IDs) is bit-identical.
+// Filter state is restored afterwards, so this may be called whether or not memory is currently allocated.
+bool CPUInterface::validateFilterModes()
+{
+    std::lock_guard<std::mutex> lockFilter(filterMutex);
+
+    if (channels == 0)
+        return true;
+
+    bool wasAllocated = allocated;
+    if (!wasAllocated) initializeMemory();
+
+    std::vector<float> savedPrevLast2(prevLast2, prevLast2 + channels * FilterStateSize);
+    std::vector<uint16_t> savedStartSearchPos(startSearchPos, startSearchPos + channels);
+    uint16_t* savedParsedPrevHigh = parsedPrevHigh;
+
+    // Small random noise (to cross the default -70 uV threshold now and then) with occasional full-scale samples (to
+    // exercise output clipping).
+    const int ValidationBlocks = 8;
+    std::vector<uint16_t> data(ValidationBlocks * wordsPerBlock);
+    uint32_t seed = 12345;
+    for (int i = 0; i < (int) data.size(); ++i) {
+        seed = 1664525 * seed + 1013904223;
+        uint16_t value = seed >> 16;
+        data[i] = (((seed >> 8) & 0x3f) == 0) ? value : (uint16_t) (32768 - 2000 + value % 4001);
+    }
+
+    const int samplesPerBlock = FramesPerBlock * channels;
+    const int snippetsPerBlock = SnippetsPerBlock * channels;
+    std::vector<uint16_t> low[2], wide[2], high[2];
+    std::vector<uint32_t> spikes[2];
+    std::vector<uint8_t> spikeIDs[2];
+    const CPUFilterKernel* kernels[2] = { nullptr, bestCPUFilterKernel() };
+
+    for (int mode = 0; mode < 2; ++mode) {
+        low[mode].resize(ValidationBlocks * samplesPerBlock);
+        wide[mode].resize(ValidationBlocks * samplesPerBlock);
+        high[mode].resize(ValidationBlocks * samplesPerBlock);
+        spikes[mode].resize(ValidationBlocks * snippetsPerBlock);
+        spikeIDs[mode].resize(ValidationBlocks * snippetsPerBlock);
+
+        resetPrev();
+        for (int c = 0; c < channels; ++c) {
+            startSearchPos[c] = 0;
+        }
+        parsedPrevHigh = parsedPrevHighOriginal;
+
+        if (mode == 0) {
+            // Scalar reference: one data block at a time.
+            for (int block = 0; block < ValidationBlocks; ++block) {
+                processDataBlocks(nullptr, 1, &data[block * wordsPerBlock], &low[mode][block * samplesPerBlock],
+                                  &wide[mode][block * samplesPerBlock], &high[mode][block * samplesPerBlock],
+                                  &spikes[mode][block * snippetsPerBlock], &spikeIDs[mode][block * snippetsPerBlock]);
+            }
+        } else {
+            // Vectorized filter, with all blocks processed in a single batch.
+            processDataBlocks(kernels[mode], ValidationBlocks, data.data(), low[mode].data(), wide[mode].data(),
+                              high[mode].data(), spikes[mode].data(), spikeIDs[mode].data());
+        }
+    }
+
+    bool identical = low[0] == low[1] && wide[0] == wide[1] && high[0] == high[1] &&
+            spikes[0] == spikes[1] && spikeIDs[0] == spikeIDs[1];
+
+    std::copy(savedPrevLast2.begin(), savedPrevLast2.end(), prevLast2);
+    std::copy(savedStartSearchPos.begin(), savedStartSearchPos.end(), startSearchPos);
+    parsedPrevHigh = savedParsedPrevHigh;
+    if (!wasAllocated) freeMemory();
+
+    return identical;
 }
 
 void CPUInterface::freeMemory()
@@ -604,17 +701,11 @@ void CPUInterface::initializeMemory()
 
     // Simple spike detection initialization w/o using hoops
     for (int c = 0; c < channels; ++c) {
-        for (int unit = 0; unit < 4; ++unit) {
-            for (int hoop = 0; hoop < 4; ++hoop) {
-                hoops[c].unitHoops[unit].hoopInfo[hoop].tA = 0.0F;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].yA = 0.0F;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].tB = 0.0F;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].yB = 0.0F;
-            }
-        }
+        clearSpikeClassifier(hoops[c]);
         hoops[c].threshold = -70.0F;
-        //hoops[c].useHoops = 0; // 1 = true, 0 = false
+        hoops[c].templateMaxDistance = 0.0F;
     }
+    classifierSources.clear();
 
     // Prep before loop.
     parsedPrevHighOriginal = new uint16_t[SnippetSize * channels];
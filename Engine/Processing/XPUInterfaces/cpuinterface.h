@@ -32,17 +32,9 @@
 #define CPUINTERFACE_H
 
 #include "abstractxpuinterface.h"
-
-typedef struct _UnitDetection
-{
-    bool hoops[4];
-} HoopDetectionStruct;
-
-typedef struct _ChannelDetection
-{
-    HoopDetectionStruct units[4];
-    bool maxSurpassed;
-} ChannelDetectionStruct;
+#include "workerpool.h"
+#include "cpufilterkernels.h"
+#include "spikeclassifier.h"
 
 class CPUInterface : public AbstractXPUInterface
 {
@@ -51,15 +43,33 @@ public:
     explicit CPUInterface(SystemState* state_, QObject *parent = nullptr);
     ~CPUInterface();
 
-    void processDataBlock(uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
-                          uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) override;
+    void processDataBlocks(int numBlocks, uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
+                           uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) override;
     void speedTest() override;
     bool setupMemory() override;
     bool cleanupMemory() override;
+    bool validateFilterModes();
+
+protected:
+    void updateCPUOptions() override;
 
 private:
+    void processDataBlocks(const CPUFilterKernel* kernel, int numBlocks, uint16_t* data, uint16_t* lowChunk,
+                           uint16_t* wideChunk, uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk);
+    void processChannels(uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk, uint16_t* highChunk,
+                         uint32_t* spikeChunk, uint8_t* spikeIDChunk, const uint16_t* prevHigh,
+                         int firstChannel, int lastChannel, SpikeSnippetBatch& snippetBatch);
+    void processChannelsVectorized(const CPUFilterKernel* kernel, uint16_t* data, uint16_t* lowChunk,
+                                   uint16_t* wideChunk, uint16_t* highChunk, uint32_t* spikeChunk,
+                                   uint8_t* spikeIDChunk, const uint16_t* prevHigh, int firstChannel, int lastChannel,
+                                   SpikeSnippetBatch& snippetBatch);
+    void detectSpikes(const uint16_t* rawBlock, int channelIndex, const float* filteredHigh, const uint16_t* prevHigh,
+                      uint32_t* spikeChunk, uint8_t* spikeIDChunk, SpikeSnippetBatch& snippetBatch);
     void initializeMemory();
     void freeMemory();
+
+    WorkerPool workerPool;
+    const CPUFilterKernel* filterKernel;  // nullptr selects the channel-at-a-time (scalar) filter.
 };
 
 #endif // CPUINTERFACE_H
@@ -28,11 +28,23 @@
 //
 //------------------------------------------------------------------------------
 
+#include <cstring>
+
 #include "gpuinterface.h"
+#include "spikeclassifier.h"
 
 GPUInterface::GPUInterface(SystemState *state_, QObject *parent) :
-    AbstractXPUInterface(state_, parent)
+    AbstractXPUInterface(state_, parent),
+    uploadedHoops(nullptr),
+    parametersStale(true),
+    filterStateStale(true),
+    spikeStateStale(true)
 {
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        writeDone[slot] = nullptr;
+        kernelDone[slot] = nullptr;
+        readDone[slot] = nullptr;
+    }
     updateFromState();
 }
 
@@ -43,14 +55,62 @@ GPUInterface::~GPUInterface()
     }
 }
 
-void GPUInterface::processDataBlock(uint16_t *data, uint16_t *lowChunk, uint16_t *wideChunk, uint16_t *highChunk, uint32_t *spikeChunk, uint8_t *spikeIDChunk)
+void GPUInterface::processDataBlocks(int numBlocks, uint16_t *data, uint16_t *lowChunk, uint16_t *wideChunk, uint16_t *highChunk, uint32_t *spikeChunk, uint8_t *spikeIDChunk)
 {
     std::lock_guard<std::mutex> lockFilter(filterMutex);
 
-    if (channels == 0)
+    if (channels == 0 || numBlocks < 1)
         return;
 
-    // Load all inputs
+    // Filter state, spike search positions, and the previous block's highpass samples stay on the device between
+    // calls; parameters are only uploaded when updateFromState() has changed them.
+    uploadParameters();
+    uploadDeviceState();
+
+    // Blocks alternate between the two pipeline slots.  While block N is being processed, block N+1 is uploaded and
+    // the outputs of block N-1 are copied from pinned memory into the caller's chunks.
+    enqueueInput(0, data);
+    for (int block = 0; block < numBlocks; ++block) {
+        int slot = block % PipelineSlots;
+        if (block + 1 < numBlocks) {
+            enqueueInput(block + 1, data + (block + 1) * wordsPerBlock);
+        }
+        enqueueKernel(slot);
+        enqueueOutput(slot);
+        clFlush(commandQueue);
+        clFlush(transferQueue);
+
+        if (block > 0) {
+            copyOutput(block - 1, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk);
+        }
+    }
+    copyOutput(numBlocks - 1, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk);
+}
+
+void GPUInterface::resetPrev()
+{
+    AbstractXPUInterface::resetPrev();
+    filterStateStale = true;
+}
+
+// Called at the end of every updateFromState(); mark the parameter buffers for upload only if something the kernel
+// reads has actually changed.
+void GPUInterface::updateHoopsVariables()
+{
+    if (!allocated) return;
+
+    bool changed = !(uploadedGlobalParameters == globalParameters) || !(uploadedFilterParameters == filterParameters);
+    for (int channel = 0; channel < channels && !changed; ++channel) {
+        changed = !(uploadedHoops[channel] == hoops[channel]);
+    }
+    if (changed) parametersStale = true;
+}
+
+void GPUInterface::uploadParameters()
+{
+    if (!parametersStale) return;
+
+    // Blocking writes on the in-order compute queue, so they land after any kernel still using the old values.
     ret = clEnqueueWriteBuffer(commandQueue, globalParametersHandle, CL_TRUE, 0, sizeof(GlobalParamStruct), &globalParameters, 0, nullptr, nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error A0";
 
@@ -60,47 +120,134 @@ void GPUInterface::processDataBlock(uint16_t *data, uint16_t *lowChunk, uint16_t
     ret = clEnqueueWriteBuffer(commandQueue, gpuHoopsHandle, CL_TRUE, 0, channels * sizeof(ChannelHoopsStruct), hoops, 0, nullptr, nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error A2";
 
-    ret = clEnqueueWriteBuffer(commandQueue, gpuDatablockBuffHandle, CL_TRUE, 0, wordsPerBlock * sizeof(uint16_t), data, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error A3";
+    memcpy(&uploadedGlobalParameters, &globalParameters, sizeof(GlobalParamStruct));
+    memcpy(&uploadedFilterParameters, &filterParameters, sizeof(FilterParamStruct));
+    memcpy(uploadedHoops, hoops, channels * sizeof(ChannelHoopsStruct));
+    parametersStale = false;
+}
+
+void GPUInterface::uploadDeviceState()
+{
+    if (filterStateStale) {
+        ret = clEnqueueWriteBuffer(commandQueue, gpuPrevLast2BuffHandle, CL_TRUE, 0, channels * 20 * sizeof(float), prevLast2, 0, nullptr, nullptr);
+        if (ret != CL_SUCCESS) qDebug() << "Error A4";
+        filterStateStale = false;
+    }
+
+    if (spikeStateStale) {
+        ret = clEnqueueWriteBuffer(commandQueue, gpuPrevHighHandle, CL_TRUE, 0, SnippetSize * channels * sizeof(uint16_t), parsedPrevHighOriginal, 0, nullptr, nullptr);
+        if (ret != CL_SUCCESS) qDebug() << "Error A5";
+
+        ret = clEnqueueWriteBuffer(commandQueue, gpuStartSearchPosHandle, CL_TRUE, 0, channels * sizeof(uint16_t), startSearchPos, 0, nullptr, nullptr);
+        if (ret != CL_SUCCESS) qDebug() << "Error A7";
+        spikeStateStale = false;
+    }
+}
 
-    ret = clEnqueueWriteBuffer(commandQueue, gpuPrevLast2BuffHandle, CL_TRUE, 0, channels * 20 * sizeof(float), prevLast2, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error A4";
+// Stage one block of USB data in pinned memory and queue its upload to the device.
+void GPUInterface::enqueueInput(int block, const uint16_t* blockData)
+{
+    int slot = block % PipelineSlots;
 
-    ret = clEnqueueWriteBuffer(commandQueue, gpuPrevHighHandle, CL_TRUE, 0, SnippetSize * channels * sizeof(uint16_t), parsedPrevHigh, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error A5";
+    // This slot's staging buffer was last used by block - 2; its upload must finish before it is overwritten.
+    if (writeDone[slot]) {
+        clWaitForEvents(1, &writeDone[slot]);
+        clReleaseEvent(writeDone[slot]);
+        writeDone[slot] = nullptr;
+    }
+    memcpy(pinnedInput[slot], blockData, wordsPerBlock * sizeof(uint16_t));
 
-    ret = clEnqueueWriteBuffer(commandQueue, gpuStartSearchPosHandle, CL_TRUE, 0, channels * sizeof(uint16_t), startSearchPos, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error A7";
+    // The device input buffer may not be overwritten until block - 2's kernel has finished reading it.
+    cl_uint numWaitEvents = kernelDone[slot] ? 1 : 0;
+    ret = clEnqueueWriteBuffer(transferQueue, gpuDatablockBuffHandle[slot], CL_FALSE, 0, wordsPerBlock * sizeof(uint16_t), pinnedInput[slot],
+                               numWaitEvents, kernelDone[slot] ? &kernelDone[slot] : nullptr, &writeDone[slot]);
+    if (ret != CL_SUCCESS) qDebug() << "Error A3";
+}
+
+void GPUInterface::enqueueKernel(int slot)
+{
+    // Wait for this block's input, and for block - 2's outputs (same slot) to be read back before overwriting them.
+    cl_event waitEvents[2];
+    cl_uint numWaitEvents = 0;
+    waitEvents[numWaitEvents++] = writeDone[slot];
+    if (readDone[slot]) waitEvents[numWaitEvents++] = readDone[slot];
+
+    if (kernelDone[slot]) clReleaseEvent(kernelDone[slot]);
 
-    // Execute kernel
     size_t globalItemSize = channels;
-    ret = clEnqueueNDRangeKernel(commandQueue, kernel, 1, nullptr, &globalItemSize, nullptr, 0, nullptr, nullptr);
+    ret = clEnqueueNDRangeKernel(commandQueue, kernels[slot], 1, nullptr, &globalItemSize, nullptr, numWaitEvents, waitEvents, &kernelDone[slot]);
     if (ret != CL_SUCCESS) qDebug() << "clEnqueueNDRangeKernel() failed. Ret: " << ret;
 
-    // Read all outputs
-    ret = clEnqueueReadBuffer(commandQueue, gpuPrevLast2BuffHandle, CL_TRUE, 0, channels * 20 * sizeof(float), prevLast2, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error C0";
+    // The last 50 samples of high become the previous highpass samples for the next block.  The compute queue is
+    // in order, so the next kernel sees them without a round trip through the host.
+    ret = clEnqueueCopyBuffer(commandQueue, gpuHighBuffHandle[slot], gpuPrevHighHandle, (FramesPerBlock - SnippetSize) * channels * sizeof(uint16_t), 0,
+                              SnippetSize * channels * sizeof(uint16_t), 0, nullptr, nullptr);
+    if (ret != CL_SUCCESS) qDebug() << "Error C7";
+}
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuStartSearchPosHandle, CL_TRUE, 0, channels * sizeof(uint16_t), startSearchPos, 0, nullptr, nullptr);
-    if (ret != CL_SUCCESS) qDebug() << "Error C1";
+// Queue reads of one block's outputs into this slot's pinned staging buffer.
+void GPUInterface::enqueueOutput(int slot)
+{
+    const size_t sampleBytes = FramesPerBlock * channels * sizeof(uint16_t);
+    const size_t snippets = SnippetsPerBlock * channels;
+    uint8_t* staging = pinnedOutput[slot];
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuLowBuffHandle, CL_TRUE, 0, FramesPerBlock * channels * sizeof(uint16_t), lowChunk, 0, nullptr, nullptr);
+    if (readDone[slot]) clReleaseEvent(readDone[slot]);
+
+    ret = clEnqueueReadBuffer(transferQueue, gpuLowBuffHandle[slot], CL_FALSE, 0, sampleBytes, staging, 1, &kernelDone[slot], nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error C2";
+    staging += sampleBytes;
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuWideBuffHandle, CL_TRUE, 0, FramesPerBlock * channels * sizeof(uint16_t), wideChunk, 0, nullptr, nullptr);
+    ret = clEnqueueReadBuffer(transferQueue, gpuWideBuffHandle[slot], CL_FALSE, 0, sampleBytes, staging, 0, nullptr, nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error C3";
+    staging += sampleBytes;
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuHighBuffHandle, CL_TRUE, 0, FramesPerBlock * channels * sizeof(uint16_t), highChunk, 0, nullptr, nullptr);
+    ret = clEnqueueReadBuffer(transferQueue, gpuHighBuffHandle[slot], CL_FALSE, 0, sampleBytes, staging, 0, nullptr, nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error C4";
+    staging += sampleBytes;
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuSpikeBuffHandle, CL_TRUE, 0, channels * SnippetsPerBlock * sizeof(uint32_t), spikeChunk, 0, nullptr, nullptr);
+    ret = clEnqueueReadBuffer(transferQueue, gpuSpikeBuffHandle[slot], CL_FALSE, 0, snippets * sizeof(uint32_t), staging, 0, nullptr, nullptr);
     if (ret != CL_SUCCESS) qDebug() << "Error C5";
+    staging += snippets * sizeof(uint32_t);
 
-    ret = clEnqueueReadBuffer(commandQueue, gpuSpikeIDsHandle, CL_TRUE, 0, channels * SnippetsPerBlock * sizeof(uint8_t), spikeIDChunk, 0, nullptr, nullptr);
+    // The transfer queue is in order, so completion of the last read means all of this block's outputs are in place.
+    ret = clEnqueueReadBuffer(transferQueue, gpuSpikeIDsHandle[slot], CL_FALSE, 0, snippets * sizeof(uint8_t), staging, 0, nullptr, &readDone[slot]);
     if (ret != CL_SUCCESS) qDebug() << "Error C6";
+}
 
-    // Set the last 50 samples of high to parsedPrevHigh so that they can be used in the next data block.
-    parsedPrevHigh = &highChunk[(FramesPerBlock - SnippetSize) * channels];
+// Wait for one block's outputs to arrive in pinned memory, then copy them into the caller's chunks.
+void GPUInterface::copyOutput(int block, uint16_t* lowChunk, uint16_t* wideChunk, uint16_t* highChunk,
+                              uint32_t* spikeChunk, uint8_t* spikeIDChunk)
+{
+    const int slot = block % PipelineSlots;
+    const int samplesPerBlock = FramesPerBlock * channels;
+    const int snippetsPerBlock = SnippetsPerBlock * channels;
+    const uint8_t* staging = pinnedOutput[slot];
+
+    ret = clWaitForEvents(1, &readDone[slot]);
+    if (ret != CL_SUCCESS) qDebug() << "Error C8";
+
+    memcpy(lowChunk + block * samplesPerBlock, staging, samplesPerBlock * sizeof(uint16_t));
+    staging += samplesPerBlock * sizeof(uint16_t);
+    memcpy(wideChunk + block * samplesPerBlock, staging, samplesPerBlock * sizeof(uint16_t));
+    staging += samplesPerBlock * sizeof(uint16_t);
+    memcpy(highChunk + block * samplesPerBlock, staging, samplesPerBlock * sizeof(uint16_t));
+    staging += samplesPerBlock * sizeof(uint16_t);
+    memcpy(spikeChunk + block * snippetsPerBlock, staging, snippetsPerBlock * sizeof(uint32_t));
+    staging += snippetsPerBlock * sizeof(uint32_t);
+    memcpy(spikeIDChunk + block * snippetsPerBlock, staging, snippetsPerBlock * sizeof(uint8_t));
+}
+
+void GPUInterface::releaseEvents()
+{
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        if (writeDone[slot]) clReleaseEvent(writeDone[slot]);
+        if (kernelDone[slot]) clReleaseEvent(kernelDone[slot]);
+        if (readDone[slot]) clReleaseEvent(readDone[slot]);
+        writeDone[slot] = nullptr;
+        kernelDone[slot] = nullptr;
+        readDone[slot] = nullptr;
+    }
 }
 
 void GPUInterface::speedTest()
@@ -141,32 +288,48 @@ void GPUInterface::initializeKernelMemory()
     gpuHoopsHandle = clCreateBuffer(context, CL_MEM_READ_ONLY, channels * sizeof(ChannelHoopsStruct), nullptr, &ret);
     if (ret != CL_SUCCESS) qDebug() << "Error I2";
 
-    gpuDatablockBuffHandle = clCreateBuffer(context, CL_MEM_READ_ONLY, wordsPerBlock * sizeof(uint16_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I3";
-
     gpuPrevLast2BuffHandle = clCreateBuffer(context, CL_MEM_READ_WRITE, channels * 20 * sizeof(float), nullptr, &ret);
     if (ret != CL_SUCCESS) qDebug() << "Error I4";
 
-    gpuPrevHighHandle = clCreateBuffer(context, CL_MEM_READ_ONLY, SnippetSize * channels * sizeof(uint16_t), nullptr, &ret);
+    gpuPrevHighHandle = clCreateBuffer(context, CL_MEM_READ_WRITE, SnippetSize * channels * sizeof(uint16_t), nullptr, &ret);
     if (ret != CL_SUCCESS) qDebug() << "Error I5";
 
-    gpuLowBuffHandle = clCreateBuffer(context, CL_MEM_WRITE_ONLY, channels * FramesPerBlock * sizeof(uint16_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I6";
+    gpuStartSearchPosHandle = clCreateBuffer(context, CL_MEM_READ_WRITE, channels * sizeof(uint16_t), nullptr, &ret);
+    if (ret != CL_SUCCESS) qDebug() << "Error I11";
+
+    const size_t inputBytes = wordsPerBlock * sizeof(uint16_t);
+    const size_t sampleBytes = channels * FramesPerBlock * sizeof(uint16_t);
+    const size_t outputBytes = 3 * sampleBytes + totalSnippetsPerBlock * (sizeof(uint32_t) + sizeof(uint8_t));
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        gpuDatablockBuffHandle[slot] = clCreateBuffer(context, CL_MEM_READ_ONLY, inputBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I3";
 
-    gpuWideBuffHandle = clCreateBuffer(context, CL_MEM_WRITE_ONLY, channels * FramesPerBlock * sizeof(uint16_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I7";
+        gpuLowBuffHandle[slot] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sampleBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I6";
 
-    gpuHighBuffHandle = clCreateBuffer(context, CL_MEM_WRITE_ONLY, channels * FramesPerBlock * sizeof(uint16_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I8";
+        gpuWideBuffHandle[slot] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sampleBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I7";
 
-    gpuSpikeBuffHandle = clCreateBuffer(context, CL_MEM_WRITE_ONLY, totalSnippetsPerBlock * sizeof(uint32_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I9";
+        gpuHighBuffHandle[slot] = clCreateBuffer(context, CL_MEM_READ_WRITE, sampleBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I8";
 
-    gpuSpikeIDsHandle = clCreateBuffer(context, CL_MEM_WRITE_ONLY, totalSnippetsPerBlock * sizeof(uint8_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I10";
+        gpuSpikeBuffHandle[slot] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, totalSnippetsPerBlock * sizeof(uint32_t), nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I9";
 
-    gpuStartSearchPosHandle = clCreateBuffer(context, CL_MEM_READ_WRITE, channels * sizeof(uint16_t), nullptr, &ret);
-    if (ret != CL_SUCCESS) qDebug() << "Error I11";
+        gpuSpikeIDsHandle[slot] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, totalSnippetsPerBlock * sizeof(uint8_t), nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I10";
+
+        // Pinned staging buffers, mapped once here and unmapped in freeKernelMemory().
+        pinnedInputHandle[slot] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, inputBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I12";
+        pinnedInput[slot] = (uint16_t*) clEnqueueMapBuffer(transferQueue, pinnedInputHandle[slot], CL_TRUE, CL_MAP_WRITE, 0, inputBytes, 0, nullptr, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I13";
+
+        pinnedOutputHandle[slot] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, outputBytes, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I14";
+        pinnedOutput[slot] = (uint8_t*) clEnqueueMapBuffer(transferQueue, pinnedOutputHandle[slot], CL_TRUE, CL_MAP_READ, 0, outputBytes, 0, nullptr, nullptr, &ret);
+        if (ret != CL_SUCCESS) qDebug() << "Error I15";
+    }
 
     state->writeToLog("Buffers initialized");
 
@@ -186,87 +349,56 @@ void GPUInterface::initializeKernelMemory()
         startSearchPos[c] = 0;
     }
 
-//    // Default no-detection initialization
-//    for (int c = 0; c < channels; ++c) {
-//        for (int unit = 0; unit < 4; ++unit) {
-//            for (int hoop = 0; hoop < 4; ++hoop) {
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].tA = -1.0F;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].yA = 10000.0F;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].tB = -1.0F;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].yB = 10000.0F;
-//            }
-//        }
-//        gpuHoops[c].threshold = 10000.0F;
-//        gpuHoops[c].useHoops = 0; // 1 = true, 0 = false
-//    }
-
-
     // Simple spike detection initialization w/o using hoops
     for (int c = 0; c < channels; ++c) {
-        for (int unit = 0; unit < 4; ++unit) {
-            for (int hoop = 0; hoop < 4; ++hoop) {
-                hoops[c].unitHoops[unit].hoopInfo[hoop].tA = 0.0f;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].yA = 0.0f;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].tB = 0.0f;
-                hoops[c].unitHoops[unit].hoopInfo[hoop].yB = 0.0f;
-            }
-        }
+        clearSpikeClassifier(hoops[c]);
         hoops[c].threshold = -70.0F;
-        //hoops[c].useHoops = 0;  // 1 = true, 0 = false
+        hoops[c].templateMaxDistance = 0.0F;
     }
-
-//    // Simple spike detection initialization: 70 uV threshold, single unit with single horizontal 70 uV hoop between 100 us and 1 ms
-//    for (int c = 0; c < channels; ++c) {
-//        for (int unit = 0; unit < 4; ++unit) {
-//            for (int hoop = 0; hoop < 4; ++hoop) {
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].tA = 0.0001f;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].yA = 70.0f;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].tB = 0.001f;
-//                gpuHoops[c].unitHoops[unit].hoopInfo[hoop].yB = 70.0f;
-//            }
-//        }
-//        gpuHoops[c].threshold = -70.0f;
-//        gpuHoops[c].useHoops = 1; // 1 = true, 0 = false
-//    }
+    classifierSources.clear();
 
     state->writeToLog("Sources and sinks initialized");
 
-    // Set kernel args.
-    ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&globalParametersHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J0";
+    // Set kernel args.  Each slot's kernel shares the parameter and state buffers, and has its own input and outputs.
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        cl_kernel kernel = kernels[slot];
 
-    ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&filterParametersHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J1";
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&globalParametersHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J0";
 
-    ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&gpuHoopsHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J2";
+        ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&filterParametersHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J1";
 
-    ret = clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&gpuDatablockBuffHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J3";
+        ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&gpuHoopsHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J2";
 
-    ret = clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&gpuPrevLast2BuffHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J4";
+        ret = clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&gpuDatablockBuffHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug() << "J3";
 
-    ret = clSetKernelArg(kernel, 5, sizeof(cl_mem), (void*)&gpuPrevHighHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J5";
+        ret = clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&gpuPrevLast2BuffHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J4";
 
-    ret = clSetKernelArg(kernel, 6, sizeof(cl_mem), (void*)&gpuLowBuffHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J6";
+        ret = clSetKernelArg(kernel, 5, sizeof(cl_mem), (void*)&gpuPrevHighHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J5";
 
-    ret = clSetKernelArg(kernel, 7, sizeof(cl_mem), (void*)&gpuWideBuffHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J7";
+        ret = clSetKernelArg(kernel, 6, sizeof(cl_mem), (void*)&gpuLowBuffHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug() << "J6";
 
-    ret = clSetKernelArg(kernel, 8, sizeof(cl_mem), (void*)&gpuHighBuffHandle);
-    if (ret != CL_SUCCESS) qDebug( )<< "J8";
+        ret = clSetKernelArg(kernel, 7, sizeof(cl_mem), (void*)&gpuWideBuffHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug() << "J7";
 
-    ret = clSetKernelArg(kernel, 9, sizeof(cl_mem), (void*)&gpuSpikeBuffHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J9";
+        ret = clSetKernelArg(kernel, 8, sizeof(cl_mem), (void*)&gpuHighBuffHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug( )<< "J8";
 
-    ret = clSetKernelArg(kernel, 10, sizeof(cl_mem), (void*)&gpuSpikeIDsHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J10";
+        ret = clSetKernelArg(kernel, 9, sizeof(cl_mem), (void*)&gpuSpikeBuffHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug() << "J9";
 
-    ret = clSetKernelArg(kernel, 11, sizeof(cl_mem), (void*)&gpuStartSearchPosHandle);
-    if (ret != CL_SUCCESS) qDebug() << "J11";
+        ret = clSetKernelArg(kernel, 10, sizeof(cl_mem), (void*)&gpuSpikeIDsHandle[slot]);
+        if (ret != CL_SUCCESS) qDebug() << "J10";
+
+        ret = clSetKernelArg(kernel, 11, sizeof(cl_mem), (void*)&gpuStartSearchPosHandle);
+        if (ret != CL_SUCCESS) qDebug() << "J11";
+    }
 
     // Populate global parameters.
     globalParameters.wordsPerFrame = wordsPerFrame;
@@ -287,6 +419,12 @@ void GPUInterface::initializeKernelMemory()
     }
     parsedPrevHigh = parsedPrevHighOriginal;
     inputIndex = 0, outputIndex = 0, spikeIndex = 0;
+
+    // Everything is uploaded before the first block is processed.
+    uploadedHoops = new ChannelHoopsStruct[channels];
+    parametersStale = true;
+    filterStateStale = true;
+    spikeStateStale = true;
     allocated = true;
 
     state->writeToLog("Prep before loop complete. End of initializeKernelMemory()");
@@ -325,6 +463,8 @@ void GPUInterface::freeKernelMemory()
     delete [] prevLast2;
     delete [] startSearchPos;
     delete [] hoops;
+    delete [] uploadedHoops;
+    uploadedHoops = nullptr;
 
     delete [] parsedPrevHighOriginal;
     state->writeToLog("Deleted arrays");
@@ -341,8 +481,20 @@ void GPUInterface::freeKernelMemory()
     ret = clFinish(commandQueue);
     if (ret != CL_SUCCESS) state->writeToLog("Error finishing command queue. Ret: " + QString::number(ret));
 
-    ret = clReleaseKernel(kernel);
-    if (ret != CL_SUCCESS) state->writeToLog("Error releasing kernel. Ret: " + QString::number(ret));
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        clEnqueueUnmapMemObject(transferQueue, pinnedInputHandle[slot], pinnedInput[slot], 0, nullptr, nullptr);
+        clEnqueueUnmapMemObject(transferQueue, pinnedOutputHandle[slot], pinnedOutput[slot], 0, nullptr, nullptr);
+    }
+
+    ret = clFinish(transferQueue);
+    if (ret != CL_SUCCESS) state->writeToLog("Error finishing transfer queue. Ret: " + QString::number(ret));
+
+    releaseEvents();
+
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        ret = clReleaseKernel(kernels[slot]);
+        if (ret != CL_SUCCESS) state->writeToLog("Error releasing kernel. Ret: " + QString::number(ret));
+    }
 
     ret = clReleaseProgram(program);
     if (ret != CL_SUCCESS) state->writeToLog("Error releasing program. Ret: " + QString::number(ret));
@@ -350,16 +502,21 @@ void GPUInterface::freeKernelMemory()
     clReleaseMemObject(globalParametersHandle);
     clReleaseMemObject(filterParametersHandle);
     clReleaseMemObject(gpuHoopsHandle);
-    clReleaseMemObject(gpuDatablockBuffHandle);
     clReleaseMemObject(gpuPrevLast2BuffHandle);
     clReleaseMemObject(gpuPrevHighHandle);
-    clReleaseMemObject(gpuLowBuffHandle);
-    clReleaseMemObject(gpuWideBuffHandle);
-    clReleaseMemObject(gpuHighBuffHandle);
-    clReleaseMemObject(gpuSpikeBuffHandle);
-    clReleaseMemObject(gpuSpikeIDsHandle);
     clReleaseMemObject(gpuStartSearchPosHandle);
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        clReleaseMemObject(gpuDatablockBuffHandle[slot]);
+        clReleaseMemObject(gpuLowBuffHandle[slot]);
+        clReleaseMemObject(gpuWideBuffHandle[slot]);
+        clReleaseMemObject(gpuHighBuffHandle[slot]);
+        clReleaseMemObject(gpuSpikeBuffHandle[slot]);
+        clReleaseMemObject(gpuSpikeIDsHandle[slot]);
+        clReleaseMemObject(pinnedInputHandle[slot]);
+        clReleaseMemObject(pinnedOutputHandle[slot]);
+    }
 
+    clReleaseCommandQueue(transferQueue);
     clReleaseCommandQueue(commandQueue);
     clReleaseContext(context);
     state->writeToLog("Finished CL releases");
@@ -572,6 +729,14 @@ bool GPUInterface::createKernel(int devIndex)
         gpuErrorMessage("Error creating OpenCL commandqueue. Returned error code: " + QString::number(ret));
         return false;
     }
+
+    // Transfers go on a second queue so that they can overlap kernel execution; the two are ordered with events.
+    transferQueue = clCreateCommandQueue(context, id, 0, &ret);
+    if (ret != CL_SUCCESS) {
+        state->writeToLog("Failure creating OpenCL transfer commandqueue. Ret: " + QString::number(ret));
+        gpuErrorMessage("Error creating OpenCL commandqueue. Returned error code: " + QString::number(ret));
+        return false;
+    }
     state->writeToLog("Completed clCreateCommandQueue");
 
     QString filename(qApp->applicationDirPath() + "/kernel.cl");
@@ -624,8 +789,10 @@ bool GPUInterface::createKernel(int devIndex)
 
     // Create the OpenCL kernel.
     state->writeToLog("About to call clCreateKernel()");
-    kernel = clCreateKernel(program, "process_block", &ret);
-    if (ret != CL_SUCCESS) gpuErrorMessage(tr("Error creating OpenCL kernel."));
+    for (int slot = 0; slot < PipelineSlots; ++slot) {
+        kernels[slot] = clCreateKernel(program, "process_block", &ret);
+        if (ret != CL_SUCCESS) gpuErrorMessage(tr("Error creating OpenCL kernel."));
+    }
     state->writeToLog("Finished clCreateKernel(). End of createKernel()");
     return true;
 }
@@ -43,11 +43,15 @@ public:
     ~GPUInterface();
 
     // Called within class in runDiagnostic(), and externally in waveformprocessorthread
-    void processDataBlock(uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
-                          uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) override;
+    void processDataBlocks(int numBlocks, uint16_t* data, uint16_t* lowChunk, uint16_t* wideChunk,
+                           uint16_t* highChunk, uint32_t* spikeChunk, uint8_t* spikeIDChunk) override;
     bool setupMemory() override;
     bool cleanupMemory() override;
     void speedTest() override;
+    void resetPrev() override;
+
+protected:
+    void updateHoopsVariables() override;
 
 private:
     bool findPlatformDevices();
@@ -56,6 +60,19 @@ private:
     void freeKernelMemory();
     void gpuErrorMessage(const QString& errorMessage);
 
+    void uploadParameters();
+    void uploadDeviceState();
+    void enqueueInput(int block, const uint16_t* blockData);
+    void enqueueKernel(int slot);
+    void enqueueOutput(int slot);
+    void copyOutput(int block, uint16_t* lowChunk, uint16_t* wideChunk, uint16_t* highChunk,
+                    uint32_t* spikeChunk, uint8_t* spikeIDChunk);
+    void releaseEvents();
+
+    // Consecutive blocks alternate between two sets of device and pinned host buffers, so that block N+1 can be
+    // uploaded (and block N-1 read back) while block N is being processed.
+    static const int PipelineSlots = 2;
+
     cl_platform_id* platformIds;
     cl_device_id* deviceIds;
     cl_int ret;
@@ -64,22 +81,44 @@ private:
     cl_bool deviceAvailable;
     cl_device_id id;
     cl_context context;
-    cl_command_queue commandQueue;
+    cl_command_queue commandQueue;   // Kernels and device-to-device copies
+    cl_command_queue transferQueue;  // Host-to-device and device-to-host transfers
     cl_program program;
-    cl_kernel kernel;
+    cl_kernel kernels[PipelineSlots];  // One kernel per slot, with that slot's buffers bound as arguments
 
     cl_mem globalParametersHandle;
     cl_mem filterParametersHandle;
     cl_mem gpuHoopsHandle;
-    cl_mem gpuDatablockBuffHandle;
+    cl_mem gpuDatablockBuffHandle[PipelineSlots];
     cl_mem gpuPrevLast2BuffHandle;
     cl_mem gpuPrevHighHandle;
-    cl_mem gpuLowBuffHandle;
-    cl_mem gpuWideBuffHandle;
-    cl_mem gpuHighBuffHandle;
-    cl_mem gpuSpikeBuffHandle;
-    cl_mem gpuSpikeIDsHandle;
+    cl_mem gpuLowBuffHandle[PipelineSlots];
+    cl_mem gpuWideBuffHandle[PipelineSlots];
+    cl_mem gpuHighBuffHandle[PipelineSlots];
+    cl_mem gpuSpikeBuffHandle[PipelineSlots];
+    cl_mem gpuSpikeIDsHandle[PipelineSlots];
     cl_mem gpuStartSearchPosHandle;
+
+    // Pinned (CL_MEM_ALLOC_HOST_PTR) staging buffers, mapped for the lifetime of the allocation.  Each output
+    // staging buffer holds low, wide, high, spike, and spike ID outputs for one block, in that order.
+    cl_mem pinnedInputHandle[PipelineSlots];
+    cl_mem pinnedOutputHandle[PipelineSlots];
+    uint16_t* pinnedInput[PipelineSlots];
+    uint8_t* pinnedOutput[PipelineSlots];
+
+    cl_event writeDone[PipelineSlots];
+    cl_event kernelDone[PipelineSlots];
+    cl_event readDone[PipelineSlots];
+
+    // Host copies of the parameters last uploaded, so that updateFromState() only triggers an upload when something
+    // the kernel reads has changed.
+    GlobalParamStruct uploadedGlobalParameters;
+    FilterParamStruct uploadedFilterParameters;
+    ChannelHoopsStruct* uploadedHoops;
+
+    bool parametersStale;   // globalParameters, filterParameters, or hoops differ from the device copies
+    bool filterStateStale;  // prevLast2 must be uploaded (after allocation or resetPrev())
+    bool spikeStateStale;   // startSearchPos and previous highpass samples must be uploaded (after allocation)
 };
 
 #endif // GPUINTERFACE_H
@@ -0,0 +1,280 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "waveformfifo.h"
+#include "spikeclassifier.h"
+
+void clearSpikeClassifier(ChannelHoopsStruct& channelHoops)
+{
+    for (int unit = 0; unit < 4; ++unit) {
+        for (int hoop = 0; hoop < 4; ++hoop) {
+            HoopInfoStruct& info = channelHoops.unitHoops[unit].hoopInfo[hoop];
+            info.sA = -1;
+            info.sB = -1;
+            info.y0 = 0.0F;
+            info.slope = 0.0F;
+        }
+        for (int s = 0; s < SnippetSize; ++s) {
+            channelHoops.templates[unit][s] = 0.0F;
+        }
+    }
+    channelHoops.classifier = SpikeClassifierThreshold;
+    channelHoops.activeUnits = 0;
+}
+
+// Split one "unit:values" entry of a hoop or template definition into a unit index (0-3) and its values.
+static bool parseUnitEntry(const QString& entry, int& unit, std::vector<float>& values)
+{
+    int colon = entry.indexOf(':');
+    if (colon < 0) return false;
+
+    bool ok;
+    unit = entry.left(colon).trimmed().toInt(&ok) - 1;
+    if (!ok || unit < 0 || unit > 3) return false;
+
+    values.clear();
+    const QStringList fields = entry.mid(colon + 1).split(',');
+    for (const QString& field : fields) {
+        float value = field.trimmed().toFloat(&ok);
+        if (!ok) return false;
+        values.push_back(value);
+    }
+    return true;
+}
+
+bool compileSpikeHoops(const QString& definition, double sampleRate, ChannelHoopsStruct& channelHoops)
+{
+    bool valid = true;
+    int hoopsPerUnit[4] = { 0, 0, 0, 0 };
+    const double samplesPerMs = sampleRate / 1000.0;
+
+    const QStringList entries = definition.split('|', Qt::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        int unit;
+        std::vector<float> values;
+        if (!parseUnitEntry(entry, unit, values) || values.size() != 4 || hoopsPerUnit[unit] == 4) {
+            valid = false;
+            continue;
+        }
+        float tA = values[0];
+        float yA = values[1];
+        float tB = values[2];
+        float yB = values[3];
+        if (tB < tA) {
+            std::swap(tA, tB);
+            std::swap(yA, yB);
+        }
+
+        // Round tA down and tB up to the nearest discrete sample; the hoop must lie within the snippet.
+        int sA = (int) floor(samplesPerMs * tA);
+        int sB = (int) ceil(samplesPerMs * tB);
+        if (sA < 0 || sB > SnippetSize - 1) {
+            valid = false;
+            continue;
+        }
+
+        HoopInfoStruct& info = channelHoops.unitHoops[unit].hoopInfo[hoopsPerUnit[unit]++];
+        if (tA == tB) {
+            // Vertical hoop: the sample nearest tA must lie strictly between yA and yB.
+            info.sA = (int) round(samplesPerMs * tA);
+            info.sB = info.sA;
+            info.y0 = std::min(yA, yB);
+            info.slope = std::max(yA, yB);
+        } else {
+            info.sA = sA;
+            info.sB = sB;
+            info.slope = (float) ((yB - yA) / ((tB - tA) * samplesPerMs));
+            info.y0 = (float) (yA - info.slope * samplesPerMs * tA);
+        }
+        channelHoops.activeUnits |= (cl_char) (1 << unit);
+    }
+    return valid;
+}
+
+bool compileSpikeTemplates(const QString& definition, ChannelHoopsStruct& channelHoops)
+{
+    bool valid = true;
+
+    const QStringList entries = definition.split('|', Qt::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        int unit;
+        std::vector<float> values;
+        if (!parseUnitEntry(entry, unit, values) || (int) values.size() != SnippetSize) {
+            valid = false;
+            continue;
+        }
+        for (int s = 0; s < SnippetSize; ++s) {
+            channelHoops.templates[unit][s] = values[s];
+        }
+        channelHoops.activeUnits |= (cl_char) (1 << unit);
+    }
+    return valid;
+}
+
+// Hoop classification: a snippet belongs to the first unit whose active hoops it crosses.  Each hoop is tested for all
+// snippets at once; lanes whose hoop does not cover a sample are masked off rather than branched around.
+static void classifyByHoops(const ChannelHoopsStruct* hoops, const SpikeSnippetBatch& batch, uint8_t* ids)
+{
+    const int count = batch.count;
+    uint8_t matched[SpikeSnippetBatch::Capacity];
+    for (int i = 0; i < count; ++i) {
+        matched[i] = hoops[batch.channel[i]].classifier != SpikeClassifierHoops;
+    }
+
+    for (int unit = 0; unit < 4; ++unit) {
+        uint8_t pass[SpikeSnippetBatch::Capacity];
+        bool anyCandidate = false;
+        for (int i = 0; i < count; ++i) {
+            pass[i] = !matched[i] && ((hoops[batch.channel[i]].activeUnits >> unit) & 1);
+            anyCandidate |= (pass[i] != 0);
+        }
+        if (!anyCandidate) continue;
+
+        for (int hoop = 0; hoop < 4; ++hoop) {
+            int sA[SpikeSnippetBatch::Capacity];
+            int sB[SpikeSnippetBatch::Capacity];
+            float y0[SpikeSnippetBatch::Capacity];
+            float slope[SpikeSnippetBatch::Capacity];
+            uint8_t crossed[SpikeSnippetBatch::Capacity];
+
+            for (int i = 0; i < count; ++i) {
+                const HoopInfoStruct& info = hoops[batch.channel[i]].unitHoops[unit].hoopInfo[hoop];
+                sA[i] = info.sA;
+                sB[i] = info.sB;
+                y0[i] = info.y0;
+                slope[i] = info.slope;
+                if (info.sA < 0) {
+                    crossed[i] = 1;  // Inactive hoop always passes.
+                } else if (info.sA == info.sB) {
+                    float y = batch.samples[info.sA][i];  // Vertical hoop
+                    crossed[i] = (y > info.y0 && y < info.slope);
+                } else {
+                    crossed[i] = 0;
+                }
+            }
+
+            // Does the line between adjacent samples s and s + 1 cross the hoop line?  Vertical and inactive hoops have
+            // an empty [sA, sB) range, so they are unaffected.
+            for (int s = 0; s < SnippetSize - 1; ++s) {
+                const float* y1 = batch.samples[s];
+                const float* y2 = batch.samples[s + 1];
+                for (int i = 0; i < count; ++i) {
+                    float hoop1 = y0[i] + slope[i] * (float) s;
+                    float hoop2 = hoop1 + slope[i];
+                    uint8_t inRange = (s >= sA[i]) & (s < sB[i]);
+                    crossed[i] |= inRange & ((y1[i] - hoop1) * (y2[i] - hoop2) <= 0.0F);
+                }
+            }
+
+            for (int i = 0; i < count; ++i) {
+                pass[i] &= crossed[i];
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (pass[i]) {
+                ids[i] = (uint8_t) (1u << unit);
+                matched[i] = 1;
+            }
+        }
+    }
+}
+
+// Nearest-centroid classification: a snippet belongs to the unit whose template has the smallest sum of squared
+// differences, as long as that is no more than the channel's templateMaxDistance.
+static void classifyByTemplates(const ChannelHoopsStruct* hoops, const SpikeSnippetBatch& batch, uint8_t* ids)
+{
+    const int count = batch.count;
+    float bestDistance[SpikeSnippetBatch::Capacity];
+    int bestUnit[SpikeSnippetBatch::Capacity];
+    for (int i = 0; i < count; ++i) {
+        bestDistance[i] = FLT_MAX;
+        bestUnit[i] = -1;
+    }
+
+    for (int unit = 0; unit < 4; ++unit) {
+        const float* centroid[SpikeSnippetBatch::Capacity];
+        float distance[SpikeSnippetBatch::Capacity];
+        for (int i = 0; i < count; ++i) {
+            centroid[i] = hoops[batch.channel[i]].templates[unit];
+            distance[i] = 0.0F;
+        }
+        for (int s = 0; s < SnippetSize; ++s) {
+            const float* y = batch.samples[s];
+            for (int i = 0; i < count; ++i) {
+                float difference = y[i] - centroid[i][s];
+                distance[i] += difference * difference;
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            const ChannelHoopsStruct& channelHoops = hoops[batch.channel[i]];
+            if (((channelHoops.activeUnits >> unit) & 1) && distance[i] < bestDistance[i]) {
+                bestDistance[i] = distance[i];
+                bestUnit[i] = unit;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const ChannelHoopsStruct& channelHoops = hoops[batch.channel[i]];
+        if (channelHoops.classifier == SpikeClassifierTemplates && bestUnit[i] >= 0 &&
+                bestDistance[i] <= channelHoops.templateMaxDistance) {
+            ids[i] = (uint8_t) (1u << bestUnit[i]);
+        }
+    }
+}
+
+void classifySpikeSnippets(const ChannelHoopsStruct* hoops, SpikeSnippetBatch& batch)
+{
+    if (batch.count == 0) return;
+
+    uint8_t ids[SpikeSnippetBatch::Capacity];
+    bool anyHoops = false;
+    bool anyTemplates = false;
+    for (int i = 0; i < batch.count; ++i) {
+        ids[i] = SpikeIdUnclassifiedSpike;
+        cl_char classifier = hoops[batch.channel[i]].classifier;
+        anyHoops |= (classifier == SpikeClassifierHoops);
+        anyTemplates |= (classifier == SpikeClassifierTemplates);
+    }
+
+    if (anyHoops) classifyByHoops(hoops, batch, ids);
+    if (anyTemplates) classifyByTemplates(hoops, batch, ids);
+
+    for (int i = 0; i < batch.count; ++i) {
+        *batch.spikeID[i] = ids[i];
+    }
+    batch.count = 0;
+}
@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef SPIKECLASSIFIER_H
+#define SPIKECLASSIFIER_H
+
+#include <QString>
+
+#include "abstractxpuinterface.h"
+
+// Reset a channel to threshold-only classification: no hoops, no templates, and no active units.  The detection
+// threshold and templateMaxDistance are left unchanged.
+void clearSpikeClassifier(ChannelHoopsStruct& channelHoops);
+
+// Compile a channel's SpikeHoops definition into sample-index tables and set activeUnits.  The definition is a list of
+// hoops separated by '|', each "unit:tA,yA,tB,yB" with unit 1-4, times in milliseconds after the threshold crossing,
+// and voltages in microvolts (e.g. "1:0.2,-80,0.4,-40|1:0.6,20,0.6,60").  Each unit may have up to four hoops, and a
+// spike belongs to a unit only if it crosses all of them.  Returns false if any hoop was malformed or did not fit in
+// the snippet; such hoops are skipped and the rest are still used.
+bool compileSpikeHoops(const QString& definition, double sampleRate, ChannelHoopsStruct& channelHoops);
+
+// Compile a channel's SpikeTemplates definition and set activeUnits.  The definition is a list of templates separated
+// by '|', each "unit:v0,v1,...,v49" giving SnippetSize microvolt values starting at the threshold crossing.  Returns
+// false if any template was malformed; such templates are skipped.
+bool compileSpikeTemplates(const QString& definition, ChannelHoopsStruct& channelHoops);
+
+// Detected spike snippets awaiting classification, stored sample-major so that the classifier's inner loops run across
+// snippets.
+struct SpikeSnippetBatch
+{
+    static const int Capacity = 64;
+
+    alignas(64) float samples[SnippetSize][Capacity];  // Sample s of the i-th snippet is samples[s][i]
+    int channel[Capacity];
+    uint8_t* spikeID[Capacity];  // Where each snippet's spike ID is written
+    int count = 0;
+};
+
+// Classify every snippet in the batch against its channel's hoops or templates, write each spike ID (1, 2, 4, or 8 for
+// units 1-4, or 64 for an unclassified threshold crossing), and empty the batch.
+void classifySpikeSnippets(const ChannelHoopsStruct* hoops, SpikeSnippetBatch& batch);
+
+#endif // SPIKECLASSIFIER_H
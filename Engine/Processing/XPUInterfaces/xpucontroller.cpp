@@ -65,6 +65,12 @@ void XPUController::processDataBlock(uint16_t *data, uint16_t *lowChunk, uint16_
     activeInterface->processDataBlock(data, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk);
 }
 
+void XPUController::processDataBlocks(int numBlocks, uint16_t *data, uint16_t *lowChunk, uint16_t *wideChunk,
+                                      uint16_t *highChunk, uint32_t *spikeChunk, uint8_t *spikeIDChunk)
+{
+    activeInterface->processDataBlocks(numBlocks, data, lowChunk, wideChunk, highChunk, spikeChunk, spikeIDChunk);
+}
+
 void XPUController::updateNumStreams(int numStreams)
 {
     cpuInterface->updateNumStreams(numStreams);
@@ -125,6 +131,23 @@ void XPUController::compare()
     }
     state->writeToLog("End of compare while loop");
 
+    // Report the throughput each OpenCL device achieved relative to the CPU.
+    double cpuBlocksPerSecond = AbstractXPUInterface::diagnosticBlocksPerSecond(state->cpuInfo.diagnosticTime);
+    for (const GPUInfo& gpu : state->gpuList) {
+        double gpuBlocksPerSecond = AbstractXPUInterface::diagnosticBlocksPerSecond(gpu.diagnosticTime);
+        if (cpuBlocksPerSecond > 0.0 && gpuBlocksPerSecond > 0.0) {
+            state->writeToLog(gpu.name + ": " + QString::number(gpuBlocksPerSecond, 'f', 0) + " blocks/s, " +
+                              QString::number(gpuBlocksPerSecond / cpuBlocksPerSecond, 'f', 2) + "x CPU");
+        }
+    }
+
+    // The vectorized CPU filter must give exactly the same results as the scalar filter; if it doesn't on this
+    // computer, fall back to the scalar filter.
+    if (state->cpuFilterMode->getValue() == "Vectorized" && !cpuInterface->validateFilterModes()) {
+        state->writeToLog("Vectorized CPU filter results differ from scalar results; using scalar CPU filter");
+        state->cpuFilterMode->setValue("Scalar");
+    }
+
     updateFromState();
 }
 
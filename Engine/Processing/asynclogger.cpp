@@ -0,0 +1,175 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "asynclogger.h"
+
+AsyncLogger::AsyncLogger() :
+    slots(new Slot[RingSize]),
+    enqueuePosition(0),
+    dequeuePosition(0),
+    numDropped(0),
+    numDroppedReported(0),
+    minimumSeverity(LogDebug),
+    startTimeNs(nowNs()),
+    flusherRunning(false),
+    stopFlusher(false)
+{
+    for (int i = 0; i < RingSize; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    close();
+    delete [] slots;
+}
+
+int64_t AsyncLogger::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* AsyncLogger::severityName(LogSeverity severity)
+{
+    switch (severity) {
+    case LogDebug:
+        return "DEBUG";
+    case LogInfo:
+        return "INFO";
+    case LogWarning:
+        return "WARNING";
+    case LogError:
+        return "ERROR";
+    }
+    return "";
+}
+
+bool AsyncLogger::open(const std::string& fileName)
+{
+    close();
+
+    logFile.open(fileName, std::ios::out | std::ios::trunc);
+    if (!logFile.is_open()) {
+        std::cerr << "AsyncLogger::open: cannot open " << fileName << '\n';
+        return false;
+    }
+    startTimeNs = nowNs();
+    logFile << "Log successfully opened\n";
+    logFile.flush();
+
+    stopFlusher = false;
+    flusherRunning = true;
+    flusher = std::thread(&AsyncLogger::flusherLoop, this);
+    return true;
+}
+
+void AsyncLogger::close()
+{
+    if (!flusherRunning) return;
+    {
+        std::lock_guard<std::mutex> lock(flusherMutex);
+        stopFlusher = true;
+    }
+    flusherCondition.notify_one();
+    flusher.join();
+    flusherRunning = false;
+    logFile.close();
+}
+
+void AsyncLogger::log(LogSeverity severity, const char* message)
+{
+    if (severity < minimumSeverity.load(std::memory_order_relaxed)) return;
+
+    // Claim a slot (bounded MPMC queue after D. Vyukov).  A slot is free for position pos when its sequence equals pos,
+    // and holds a message for the consumer when its sequence equals pos + 1.
+    uint64_t pos = enqueuePosition.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & (RingSize - 1)];
+        int64_t difference = (int64_t) slot->sequence.load(std::memory_order_acquire) - (int64_t) pos;
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (difference < 0) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);  // Ring is full.
+            return;
+        } else {
+            pos = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->timeNs = nowNs();
+    slot->severity = severity;
+    std::strncpy(slot->text, message, MaxMessageLength - 1);
+    slot->text[MaxMessageLength - 1] = '\0';
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+// Write all messages logged so far to the file.  Returns true if anything was written.
+bool AsyncLogger::writePending()
+{
+    bool written = false;
+    char timeText[32];
+    while (true) {
+        Slot& slot = slots[dequeuePosition & (RingSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) break;
+
+        std::snprintf(timeText, sizeof(timeText), "%.6f", (double) (slot.timeNs - startTimeNs) * 1.0e-9);
+        logFile << "[" << severityName(slot.severity) << "] " << slot.text << " ... seconds: " << timeText << '\n';
+
+        slot.sequence.store(dequeuePosition + RingSize, std::memory_order_release);
+        ++dequeuePosition;
+        written = true;
+    }
+
+    uint64_t dropped = numDropped.load(std::memory_order_relaxed);
+    if (dropped != numDroppedReported) {
+        logFile << "[" << severityName(LogWarning) << "] Log buffer full; " << (dropped - numDroppedReported) <<
+                   " messages dropped\n";
+        numDroppedReported = dropped;
+        written = true;
+    }
+    return written;
+}
+
+void AsyncLogger::flusherLoop()
+{
+    std::unique_lock<std::mutex> lock(flusherMutex);
+    while (!stopFlusher) {
+        flusherCondition.wait_for(lock, std::chrono::milliseconds(FlushIntervalMs));
+        if (writePending()) logFile.flush();
+    }
+    if (writePending()) logFile.flush();
+}
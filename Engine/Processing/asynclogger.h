@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum LogSeverity {
+    LogDebug = 0,
+    LogInfo,
+    LogWarning,
+    LogError
+};
+
+// Debug log written by a background thread.  log() may be called from any thread: it copies the message into a
+// fixed-size lock-free ring (multiple producers, one consumer) and returns without blocking or allocating memory.  The
+// flusher thread periodically writes pending messages to the log file, each with its severity and the time (from a
+// monotonic clock, in seconds since the log was opened) at which it was logged.  If the ring is full, messages are
+// dropped and the number dropped is written to the log.
+class AsyncLogger
+{
+public:
+    AsyncLogger();
+    ~AsyncLogger();
+
+    // Create (or truncate) fileName and start the flusher thread.  Returns false if the file cannot be opened.
+    bool open(const std::string& fileName);
+    // Write all pending messages, then stop the flusher thread and close the file.
+    void close();
+    bool isOpen() const { return flusherRunning; }
+
+    void setMinimumSeverity(LogSeverity severity) { minimumSeverity = severity; }
+    void log(LogSeverity severity, const char* message);
+    static const char* severityName(LogSeverity severity);
+
+private:
+    static const int RingSize = 4096;           // Must be a power of two.
+    static const int MaxMessageLength = 232;    // Longer messages are truncated.
+    static const int FlushIntervalMs = 50;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        int64_t timeNs;
+        LogSeverity severity;
+        char text[MaxMessageLength];
+    };
+
+    static int64_t nowNs();
+    bool writePending();
+    void flusherLoop();
+
+    Slot* slots;
+    std::atomic<uint64_t> enqueuePosition;
+    uint64_t dequeuePosition;       // Used only by the flusher thread
+    std::atomic<uint64_t> numDropped;
+    uint64_t numDroppedReported;
+    std::atomic<int> minimumSeverity;
+    int64_t startTimeNs;
+
+    std::ofstream logFile;
+    std::thread flusher;
+    std::mutex flusherMutex;
+    std::condition_variable flusherCondition;
+    std::atomic<bool> flusherRunning;
+    bool stopFlusher;
+};
+
+#endif // ASYNCLOGGER_H
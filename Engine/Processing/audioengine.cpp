@@ -0,0 +1,340 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_USE_SSE2
+#endif
+
+#include "rhxglobals.h"
+#include "audioengine.h"
+
+// Dot product of two float arrays; length must be a multiple of 4.
+static inline float dotProduct(const float* a, const float* b, int length)
+{
+#ifdef AUDIO_USE_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (int i = 0; i < length; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    float sum = 0.0F;
+    for (int i = 0; i < length; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+PolyphaseResampler::PolyphaseResampler(int numChannels_) :
+    numChannels(numChannels_),
+    tapsPerPhase(16),
+    step(1.0),
+    position(0.0)
+{
+    history.resize(numChannels);
+    setRates(1.0, 1.0);
+}
+
+void PolyphaseResampler::setRates(double inputRate, double outputRate)
+{
+    step = inputRate / outputRate;
+
+    // Cut off below the lower of the two Nyquist frequencies; when downsampling, the filter widens in proportion.
+    double cutoff = 0.45 * std::min(1.0, outputRate / inputRate);  // Cycles per input sample
+    tapsPerPhase = 16 * (int) ceil(std::max(1.0, step));
+
+    // Phase p holds the weights of input samples index, index + 1, ... for an output sample at index + p / NumPhases,
+    // delayed by half the filter length.  Blackman-windowed sinc, normalized to unity gain at DC in every phase.
+    const double center = 0.5 * (tapsPerPhase - 1);
+    const double halfWidth = 0.5 * tapsPerPhase;
+    coefficients.resize(NumPhases * tapsPerPhase);
+    for (int phase = 0; phase < NumPhases; ++phase) {
+        double sum = 0.0;
+        for (int tap = 0; tap < tapsPerPhase; ++tap) {
+            double t = tap - center - (double) phase / NumPhases;
+            double x = TwoPi * cutoff * t;
+            double sinc = (fabs(x) < 1.0e-9) ? 1.0 : sin(x) / x;
+            double w = 0.42 + 0.5 * cos(Pi * t / halfWidth) + 0.08 * cos(TwoPi * t / halfWidth);
+            double value = (fabs(t) < halfWidth) ? sinc * w : 0.0;
+            coefficients[phase * tapsPerPhase + tap] = (float) value;
+            sum += value;
+        }
+        for (int tap = 0; tap < tapsPerPhase; ++tap) {
+            coefficients[phase * tapsPerPhase + tap] /= (float) sum;
+        }
+    }
+    reset();
+}
+
+void PolyphaseResampler::reset()
+{
+    position = 0.0;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        history[channel].assign(tapsPerPhase, 0.0F);
+    }
+}
+
+int PolyphaseResampler::maxOutputSamples(int numInputSamples) const
+{
+    return (int) ceil(numInputSamples / step) + 2;
+}
+
+int PolyphaseResampler::process(const float* const* in, int numInputSamples, float* const* out)
+{
+    const int historyLength = tapsPerPhase;
+    const int available = historyLength + numInputSamples;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        if ((int) history[channel].size() < available) history[channel].resize(available);
+        std::memcpy(&history[channel][historyLength], in[channel], numInputSamples * sizeof(float));
+    }
+
+    int numOutputSamples = 0;
+    while ((int) position + tapsPerPhase + 1 <= available) {
+        int index = (int) position;
+        int phase = (int) ((position - index) * NumPhases + 0.5);
+        if (phase == NumPhases) {
+            ++index;
+            phase = 0;
+        }
+        const float* h = &coefficients[phase * tapsPerPhase];
+        for (int channel = 0; channel < numChannels; ++channel) {
+            out[channel][numOutputSamples] = dotProduct(h, &history[channel][index], tapsPerPhase);
+        }
+        ++numOutputSamples;
+        position += step;
+    }
+
+    position -= numInputSamples;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        std::memmove(history[channel].data(), &history[channel][numInputSamples], historyLength * sizeof(float));
+    }
+    return numOutputSamples;
+}
+
+
+AudioEngine::AudioEngine(double inputSampleRate_, int maxInputSamples_) :
+    inputSampleRate(inputSampleRate_),
+    maxInputSamples(maxInputSamples_),
+    mode(AudioSourceSingle),
+    numSources(0),
+    volume(0),
+    threshold(0.0F),
+    clickPosition(0.0),
+    resampler(2)
+{
+    resampler.setRates(inputSampleRate, OutputSampleRate);
+    mixLeft.resize(maxInputSamples);
+    mixRight.resize(maxInputSamples);
+    outLeft.resize(maxOutputFrames() + ClickLength);
+    outRight.resize(maxOutputFrames() + ClickLength);
+
+    // 3 kHz tone burst with a 0.4 ms decay, 100 uV peak before volume scaling.
+    click.resize(ClickLength);
+    for (int i = 0; i < ClickLength; ++i) {
+        double t = (double) i / OutputSampleRate;
+        click[i] = (float) (100.0 * sin(TwoPi * 3000.0 * t) * exp(-t / 0.0004));
+    }
+    setNumSources(1, AudioSourceSingle);
+}
+
+void AudioEngine::reset()
+{
+    resampler.reset();
+    std::fill(outLeft.begin(), outLeft.end(), 0.0F);
+    std::fill(outRight.begin(), outRight.end(), 0.0F);
+    clickPosition = 0.0;
+}
+
+// Set pan gains: a single channel is centered at full level; otherwise sources are spread evenly from left to right
+// with equal-power panning, and mixed waveforms are attenuated so that uncorrelated noise keeps the same loudness.
+void AudioEngine::setNumSources(int numSources_, AudioSourceMode mode_)
+{
+    if (mode_ != mode) reset();
+    numSources = numSources_;
+    mode = mode_;
+    gainLeft.resize(numSources);
+    gainRight.resize(numSources);
+    float mixScale = (mode == AudioSourceMix && numSources > 1) ? 1.0F / sqrtf((float) numSources) : 1.0F;
+    for (int i = 0; i < numSources; ++i) {
+        if (mode == AudioSourceSingle || numSources == 1) {
+            gainLeft[i] = 1.0F;
+            gainRight[i] = 1.0F;
+        } else {
+            double pan = 0.5 * Pi * i / (numSources - 1);
+            gainLeft[i] = mixScale * (float) cos(pan);
+            gainRight[i] = mixScale * (float) sin(pan);
+        }
+    }
+}
+
+int AudioEngine::maxOutputFrames() const
+{
+    return resampler.maxOutputSamples(maxInputSamples);
+}
+
+double AudioEngine::delaySeconds() const
+{
+    return (mode == AudioSourceSpikeClicks) ? 0.0 : resampler.delayInInputSamples() / inputSampleRate;
+}
+
+int AudioEngine::render(const float* const* sources, const uint16_t* const* spikes, int numInputSamples, uint8_t* pcmBytes)
+{
+    numInputSamples = std::min(numInputSamples, maxInputSamples);
+    int numFrames;
+    if (mode == AudioSourceSpikeClicks) {
+        numFrames = renderClicks(spikes, numInputSamples);
+    } else {
+        renderWaveforms(sources, numInputSamples);
+        const float* mix[2] = { mixLeft.data(), mixRight.data() };
+        float* out[2] = { outLeft.data(), outRight.data() };
+        numFrames = resampler.process(mix, numInputSamples, out);
+    }
+    convertToPcm(numFrames, pcmBytes);
+
+    if (mode == AudioSourceSpikeClicks) {
+        // Carry clicks that extend past this block into the next one.
+        std::memmove(outLeft.data(), &outLeft[numFrames], ClickLength * sizeof(float));
+        std::memmove(outRight.data(), &outRight[numFrames], ClickLength * sizeof(float));
+        std::fill(outLeft.begin() + ClickLength, outLeft.end(), 0.0F);
+        std::fill(outRight.begin() + ClickLength, outRight.end(), 0.0F);
+    }
+    return numFrames;
+}
+
+// Noise slicer (values within +/-threshold go to zero, and threshold is subtracted from the magnitude of the rest),
+// pan gain, and accumulation into the left and right mixes, in one pass over each source.
+void AudioEngine::renderWaveforms(const float* const* sources, int numInputSamples)
+{
+    std::fill(mixLeft.begin(), mixLeft.begin() + numInputSamples, 0.0F);
+    std::fill(mixRight.begin(), mixRight.begin() + numInputSamples, 0.0F);
+    float* left = mixLeft.data();
+    float* right = mixRight.data();
+
+    for (int source = 0; source < numSources; ++source) {
+        const float* x = sources[source];
+        const float gl = gainLeft[source];
+        const float gr = gainRight[source];
+        int t = 0;
+#ifdef AUDIO_USE_SSE2
+        const __m128 upper = _mm_set1_ps(threshold);
+        const __m128 lower = _mm_set1_ps(-threshold);
+        const __m128 gainL = _mm_set1_ps(gl);
+        const __m128 gainR = _mm_set1_ps(gr);
+        for (; t + 4 <= numInputSamples; t += 4) {
+            __m128 v = _mm_loadu_ps(x + t);
+            __m128 sliced = _mm_sub_ps(v, _mm_min_ps(_mm_max_ps(v, lower), upper));
+            _mm_storeu_ps(left + t, _mm_add_ps(_mm_loadu_ps(left + t), _mm_mul_ps(sliced, gainL)));
+            _mm_storeu_ps(right + t, _mm_add_ps(_mm_loadu_ps(right + t), _mm_mul_ps(sliced, gainR)));
+        }
+#endif
+        for (; t < numInputSamples; ++t) {
+            float sliced = x[t] - std::min(std::max(x[t], -threshold), threshold);
+            left[t] += gl * sliced;
+            right[t] += gr * sliced;
+        }
+    }
+}
+
+// Add a click at the output position of every spike.  Returns the number of output frames this block covers.
+int AudioEngine::renderClicks(const uint16_t* const* spikes, int numInputSamples)
+{
+    const double ratio = OutputSampleRate / inputSampleRate;
+    const double start = clickPosition;
+    const double end = start + numInputSamples * ratio;
+    const int numFrames = (int) end;
+    clickPosition = end - numFrames;
+
+    for (int source = 0; source < numSources; ++source) {
+        const uint16_t* s = spikes[source];
+        const float gl = gainLeft[source];
+        const float gr = gainRight[source];
+        int t = 0;
+        while (t < numInputSamples) {
+#ifdef AUDIO_USE_SSE2
+            // Spikes are rare; skip eight samples at a time while none are present.
+            if (t + 8 <= numInputSamples &&
+                    _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*) (s + t)), _mm_setzero_si128())) == 0xffff) {
+                t += 8;
+                continue;
+            }
+#endif
+            if (s[t] != 0) {
+                int position = std::min((int) (start + t * ratio), numFrames);
+                float* left = &outLeft[position];
+                float* right = &outRight[position];
+                for (int i = 0; i < ClickLength; ++i) {
+                    left[i] += gl * click[i];
+                    right[i] += gr * click[i];
+                }
+            }
+            ++t;
+        }
+    }
+    return numFrames;
+}
+
+// Volume scaling, clipping to 16 bits, integer conversion, and interleaving of left and right, in one pass.  Output is
+// little-endian regardless of host byte order.
+void AudioEngine::convertToPcm(int numFrames, uint8_t* pcmBytes) const
+{
+    const float scale = (float) (volume / 2) / 0.195F;
+    const float* left = outLeft.data();
+    const float* right = outRight.data();
+    int i = 0;
+#ifdef AUDIO_USE_SSE2
+    const __m128 scaleVector = _mm_set1_ps(scale);
+    const __m128 maxValue = _mm_set1_ps(32767.0F);
+    const __m128 minValue = _mm_set1_ps(-32768.0F);
+    for (; i + 4 <= numFrames; i += 4) {
+        __m128 l = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(left + i), scaleVector), minValue), maxValue);
+        __m128 r = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(right + i), scaleVector), minValue), maxValue);
+        __m128i li = _mm_cvtps_epi32(l);
+        __m128i ri = _mm_cvtps_epi32(r);
+        __m128i interleaved = _mm_packs_epi32(_mm_unpacklo_epi32(li, ri), _mm_unpackhi_epi32(li, ri));
+        _mm_storeu_si128((__m128i*) (pcmBytes + 4 * i), interleaved);
+    }
+#endif
+    for (; i < numFrames; ++i) {
+        int l = (int) lrintf(std::min(std::max(left[i] * scale, -32768.0F), 32767.0F));
+        int r = (int) lrintf(std::min(std::max(right[i] * scale, -32768.0F), 32767.0F));
+        pcmBytes[4 * i] = (uint8_t) (l & 0xff);
+        pcmBytes[4 * i + 1] = (uint8_t) ((l >> 8) & 0xff);
+        pcmBytes[4 * i + 2] = (uint8_t) (r & 0xff);
+        pcmBytes[4 * i + 3] = (uint8_t) ((r >> 8) & 0xff);
+    }
+}
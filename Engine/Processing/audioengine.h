@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <cstdint>
+#include <vector>
+
+// Polyphase FIR resampler with an arbitrary (not necessarily rational) ratio of input to output sample rates.  Each
+// output sample is the dot product of tapsPerPhase input samples with the nearest of NumPhases precomputed phases of a
+// windowed-sinc lowpass filter.  Several planar channels are resampled together, sharing the phase computation.
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler(int numChannels_ = 2);
+
+    void setRates(double inputRate, double outputRate);
+    void reset();
+
+    // Resample numInputSamples from each of in[0..numChannels-1], writing to out[0..numChannels-1].  Returns the
+    // number of output samples written per channel, which never exceeds maxOutputSamples(numInputSamples).
+    int process(const float* const* in, int numInputSamples, float* const* out);
+    int maxOutputSamples(int numInputSamples) const;
+    double delayInInputSamples() const { return 0.5 * (tapsPerPhase + 1); }
+
+private:
+    static const int NumPhases = 256;
+
+    int numChannels;
+    int tapsPerPhase;   // Multiple of 4
+    double step;        // Input samples per output sample
+    double position;    // Input position of the next output sample, relative to the start of history
+    std::vector<float> coefficients;            // [phase * tapsPerPhase + tap]
+    std::vector<std::vector<float> > history;   // Per channel: tapsPerPhase previous samples followed by new input
+};
+
+enum AudioSourceMode {
+    AudioSourceSingle,      // The single selected channel, in both ears
+    AudioSourceMix,         // Selected channels mixed and panned across the stereo field
+    AudioSourceSpikeClicks  // A click for every spike detected on the selected channels, panned by channel
+};
+
+// Renders amplifier waveforms (in microvolts, at the amplifier sample rate) to interleaved 16-bit little-endian
+// stereo PCM at OutputSampleRate.  In AudioSourceSingle and AudioSourceMix modes, each source passes through the noise
+// slicer, is scaled by its pan gains, and is accumulated into left and right buffers in one pass; the two buffers are
+// then resampled, and volume scaling, clipping, interleaving and integer conversion are done in one pass.  In
+// AudioSourceSpikeClicks mode, a short click is written at the output position of each spike instead.
+class AudioEngine
+{
+public:
+    static const int OutputSampleRate = 44100;
+
+    AudioEngine(double inputSampleRate_, int maxInputSamples_);
+
+    void reset();
+    void setVolume(int volume_) { volume = volume_; }
+    void setThreshold(float thresholdMicroVolts) { threshold = thresholdMicroVolts; }
+    void setNumSources(int numSources_, AudioSourceMode mode_);
+    int getNumSources() const { return numSources; }
+    AudioSourceMode getMode() const { return mode; }
+
+    // Render numInputSamples (at most maxInputSamples) to pcmBytes, which must hold maxOutputFrames() stereo
+    // frames.  In the waveform modes, sources[i] holds the samples of source i; in click mode, spikes[i] holds its spike
+    // flags (nonzero for a spike).  Returns the number of stereo frames written.
+    int render(const float* const* sources, const uint16_t* const* spikes, int numInputSamples, uint8_t* pcmBytes);
+    int maxOutputFrames() const;
+    double delaySeconds() const;
+
+private:
+    static const int ClickLength = 64;  // Output samples
+
+    double inputSampleRate;
+    int maxInputSamples;
+    AudioSourceMode mode;
+    int numSources;
+    int volume;
+    float threshold;
+
+    std::vector<float> gainLeft;    // Per source
+    std::vector<float> gainRight;
+    std::vector<float> mixLeft;     // Input rate
+    std::vector<float> mixRight;
+    std::vector<float> outLeft;     // Output rate; in click mode, with room for a click extending past the block
+    std::vector<float> outRight;
+    std::vector<float> click;
+    double clickPosition;           // Output position at the start of the next block, in click mode
+    PolyphaseResampler resampler;
+
+    void renderWaveforms(const float* const* sources, int numInputSamples);
+    int renderClicks(const uint16_t* const* spikes, int numInputSamples);
+    void convertToPcm(int numFrames, uint8_t* pcmBytes) const;
+};
+
+#endif // AUDIOENGINE_H
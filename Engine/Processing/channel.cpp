@@ -46,6 +46,8 @@ Channel::Channel(SignalType signalType_, const QString &customChannelName_, cons
     boardStream(boardStream_),
     chipChannel(chipChannel_),
     commandStream(commandStream_),
+    handle(InvalidHandle),
+    noiseLevel(-1.0F),
     color(nullptr),
     reference(nullptr),
     userOrder(nullptr),
@@ -60,6 +62,8 @@ Channel::Channel(SignalType signalType_, const QString &customChannelName_, cons
     outputToTcpDc(nullptr),
     outputToTcpStim(nullptr),
     spikeThreshold(nullptr),
+    spikeHoops(nullptr),
+    spikeTemplates(nullptr),
     electrodeImpedance({ false, 0.0, 0.0 })
 {
     if ((signalType == AmplifierSignal || signalType == BoardDacSignal || signalType == BoardDigitalOutSignal)) {
@@ -84,6 +88,8 @@ Channel::Channel(SignalType signalType_, const QString &customChannelName_, cons
     outputToTcp = new BooleanItem("TCPDataOutputEnabled", channelItems, state, false, XMLGroupNone);  // Wideband for amplifier channels, unfiltered for all others
     if (signalType == AmplifierSignal) {
         spikeThreshold = new IntRangeItem("SpikeThresholdMicroVolts", channelItems, state, -5000, 5000, -70, XMLGroupSpikeSettings);
+        spikeHoops = new StringItem("SpikeHoops", channelItems, state, "", XMLGroupSpikeSettings);
+        spikeTemplates = new StringItem("SpikeTemplates", channelItems, state, "", XMLGroupSpikeSettings);
         outputToTcpLow = new BooleanItem("TCPDataOutputEnabledLow", channelItems, state, false, XMLGroupNone);
         outputToTcpHigh = new BooleanItem("TCPDataOutputEnabledHigh", channelItems, state, false, XMLGroupNone);
         outputToTcpSpike = new BooleanItem("TCPDataOutputEnabledSpike", channelItems, state, false, XMLGroupNone);
@@ -227,6 +233,12 @@ void Channel::setImpedance(double magnitude_, double phase_)
     electrodeImpedance.valid = true;
 }
 
+void Channel::setImpedanceSpectrum(const std::vector<double>& magnitudes, const std::vector<double>& phases)
+{
+    impedanceSpectrumMagnitude = magnitudes;
+    impedanceSpectrumPhase = phases;
+}
+
 QString Channel::getImpedanceMagnitudeString() const
 {
     double zMag = electrodeImpedance.magnitude;
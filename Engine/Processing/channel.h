@@ -37,6 +37,7 @@
 
 #include <QString>
 #include <QColor>
+#include "channelregistry.h"
 #include "systemstate.h"
 
 class SignalGroup;
@@ -76,6 +77,11 @@ public:
     int getCommandStream() const { return commandStream; }
     void setCommandStream(int commandStream_);
 
+    // Dense index of this channel in SignalSources (see SignalSources::channelByHandle()), assigned by
+    // SignalSources::updateChannelMap(); InvalidHandle until then.
+    int getHandle() const { return handle; }
+    void setHandle(int handle_) { handle = handle_; }
+
     bool isImpedanceValid() const { return electrodeImpedance.valid; }
     double getImpedanceMagnitude() const { return electrodeImpedance.magnitude; }
     double getImpedancePhase() const { return electrodeImpedance.phase; }
@@ -83,6 +89,12 @@ public:
     QString getImpedanceMagnitudeString() const;
     QString getImpedancePhaseString() const;
 
+    // Electrode impedance at each frequency of the last impedance spectrum measurement (see
+    // SystemState::actualImpedanceSpectrumFreqs); empty if no spectrum has been measured.
+    const std::vector<double>& getImpedanceSpectrumMagnitudes() const { return impedanceSpectrumMagnitude; }
+    const std::vector<double>& getImpedanceSpectrumPhases() const { return impedanceSpectrumPhase; }
+    void setImpedanceSpectrum(const std::vector<double>& magnitudes, const std::vector<double>& phases);
+
     QString getReference() const { return signalType == AmplifierSignal ? reference->getValueString() : ""; }
     void setReference(QString reference_) { if (signalType == AmplifierSignal) reference->setValue(reference_); }
 
@@ -100,6 +112,14 @@ public:
     void setSpikeThreshold(int threshold) { spikeThreshold->setValue(threshold); }
     void setupSpikeThresholdSpinBox(QSpinBox *spinBox) { spikeThreshold->setupSpinBox(spinBox); }
 
+    // Unit definitions for the spike classifier; see compileSpikeHoops() and compileSpikeTemplates() for the format.
+    QString getSpikeHoops() const { return spikeHoops ? spikeHoops->getValueString() : QString(); }
+    QString getSpikeTemplates() const { return spikeTemplates ? spikeTemplates->getValueString() : QString(); }
+
+    // Latest NoiseEstimator result in microvolts, copied here on the GUI thread; negative if not yet estimated.
+    float getNoiseLevel() const { return noiseLevel; }
+    void setNoiseLevel(float noiseLevel_) { noiseLevel = noiseLevel_; }
+
     void clearTCPDataOutput();
 
     bool getOutputToTcp() const { return outputToTcp->getValue(); }
@@ -131,6 +151,10 @@ private:
     int boardStream;
     int chipChannel;
     int commandStream;
+    int handle;
+    float noiseLevel;
+    std::vector<double> impedanceSpectrumMagnitude;  // In ohms
+    std::vector<double> impedanceSpectrumPhase;      // In degrees
 
     StringItem *color;
     StringItem *reference;
@@ -151,6 +175,8 @@ private:
     BooleanItem *outputToTcpStim;  // Only applies to Stim amplifier channels
 
     IntRangeItem *spikeThreshold;
+    StringItem *spikeHoops;
+    StringItem *spikeTemplates;
 
     struct {
         bool valid;
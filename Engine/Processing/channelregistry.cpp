@@ -0,0 +1,170 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "channelregistry.h"
+
+ChannelRegistry::ChannelRegistry() :
+    slotMask(0),
+    numBuckets(1),
+    seed(0)
+{
+    clear();
+}
+
+void ChannelRegistry::clear()
+{
+    names.clear();
+    slots.assign(1, InvalidHandle);
+    displacements.assign(1, 0);
+    slotMask = 0;
+    numBuckets = 1;
+    seed = 0;
+}
+
+// 64-bit FNV-1a followed by a final avalanche step, so that names differing only in their last characters (as channel
+// names usually do) still spread over all bits.
+uint64_t ChannelRegistry::hash(const char* key, size_t length, uint64_t seed)
+{
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < length; ++i) {
+        h ^= (uint8_t) key[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void ChannelRegistry::build(const std::vector<std::string>& names_)
+{
+    clear();
+    names = names_;
+    if (names.empty()) return;
+
+    // Duplicate names keep their handles, but only the first of each can be found by name.
+    std::vector<int> uniqueHandles;
+    {
+        std::vector<int> order(names.size());
+        for (int i = 0; i < (int) order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return names[a] < names[b]; });
+        for (int i = 0; i < (int) order.size(); ++i) {
+            if (i > 0 && names[order[i]] == names[order[i - 1]]) {
+                std::cerr << "ChannelRegistry: duplicate name " << names[order[i]] << '\n';
+                continue;
+            }
+            uniqueHandles.push_back(order[i]);
+        }
+    }
+
+    // About four names per bucket, and a table at most 80% full.
+    uint32_t tableSize = 1;
+    while (tableSize < uniqueHandles.size() + uniqueHandles.size() / 4) tableSize *= 2;
+    slotMask = tableSize - 1;
+    numBuckets = (uint32_t) (uniqueHandles.size() + 3) / 4;
+
+    std::vector<uint64_t> hashes(names.size());
+    for (seed = 0; ; ++seed) {
+        for (int handle : uniqueHandles) {
+            hashes[handle] = hash(names[handle].data(), names[handle].size(), seed);
+        }
+        if (tryBuild(hashes, uniqueHandles)) break;
+    }
+}
+
+// Place buckets largest first, trying displacements until every name in the bucket lands in an empty slot.  Returns
+// false if some bucket cannot be placed, in which case build() retries with another seed.
+bool ChannelRegistry::tryBuild(const std::vector<uint64_t>& hashes, const std::vector<int>& uniqueHandles)
+{
+    std::vector<std::vector<int> > buckets(numBuckets);
+    for (int handle : uniqueHandles) {
+        buckets[(uint32_t) (hashes[handle] >> 32) % numBuckets].push_back(handle);
+    }
+    std::vector<uint32_t> bucketOrder(numBuckets);
+    for (uint32_t b = 0; b < numBuckets; ++b) bucketOrder[b] = b;
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(),
+                     [&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    slots.assign(slotMask + 1, InvalidHandle);
+    displacements.assign(numBuckets, 0);
+    std::vector<uint32_t> bucketSlots;
+    const uint32_t maxDisplacement = 4 * (slotMask + 1);
+    for (uint32_t b : bucketOrder) {
+        const std::vector<int>& bucket = buckets[b];
+        if (bucket.empty()) break;
+        bool placed = false;
+        for (uint32_t d = 0; d < maxDisplacement && !placed; ++d) {
+            bucketSlots.clear();
+            placed = true;
+            for (int handle : bucket) {
+                uint32_t h1 = (uint32_t) hashes[handle];
+                uint32_t h2 = ((uint32_t) (hashes[handle] >> 16)) | 1U;
+                uint32_t slot = (h1 + d * h2) & slotMask;
+                if (slots[slot] != InvalidHandle ||
+                        std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end()) {
+                    placed = false;
+                    break;
+                }
+                bucketSlots.push_back(slot);
+            }
+            if (placed) {
+                for (int i = 0; i < (int) bucket.size(); ++i) slots[bucketSlots[i]] = bucket[i];
+                displacements[b] = d;
+            }
+        }
+        if (!placed) return false;
+    }
+    return true;
+}
+
+int ChannelRegistry::lookup(const char* key, size_t length) const
+{
+    uint64_t h = hash(key, length, seed);
+    uint32_t d = displacements[(uint32_t) (h >> 32) % numBuckets];
+    uint32_t slot = ((uint32_t) h + d * (((uint32_t) (h >> 16)) | 1U)) & slotMask;
+    int handle = slots[slot];
+    if (handle == InvalidHandle) return InvalidHandle;
+    const std::string& candidate = names[handle];
+    if (candidate.size() != length || std::memcmp(candidate.data(), key, length) != 0) return InvalidHandle;
+    return handle;
+}
+
+int ChannelRegistry::lookupBaseName(const char* key, size_t length) const
+{
+    const void* bar = std::memchr(key, '|', length);
+    if (bar) length = (const char*) bar - key;
+    return lookup(key, length);
+}
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef CHANNELREGISTRY_H
+#define CHANNELREGISTRY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const int InvalidHandle = -1;
+
+// Assigns dense integer handles 0..size()-1 to a fixed set of names (handle i belongs to the i-th name passed to
+// build()), and finds the handle of a name in constant time with a minimal-probe perfect hash: each name hashes to a
+// bucket, and each bucket stores the displacement that sends all of its names to distinct empty slots.  A lookup is one
+// hash, one displacement read, and one string comparison to reject names that are not in the set.
+class ChannelRegistry
+{
+public:
+    ChannelRegistry();
+
+    void build(const std::vector<std::string>& names_);
+    void clear();
+
+    int size() const { return (int) names.size(); }
+    const std::string& name(int handle) const { return names[handle]; }
+
+    // Return the handle of a name, or InvalidHandle if it is not registered.
+    int lookup(const char* key, size_t length) const;
+    int lookup(const std::string& key) const { return lookup(key.data(), key.size()); }
+
+    // As lookup(), but ignores any suffix beginning with '|' (e.g., "A-000|HIGH" finds "A-000").
+    int lookupBaseName(const char* key, size_t length) const;
+    int lookupBaseName(const std::string& key) const { return lookupBaseName(key.data(), key.size()); }
+
+private:
+    std::vector<std::string> names;
+    std::vector<int> slots;             // Handle stored in each slot, or InvalidHandle
+    std::vector<uint32_t> displacements;  // Per bucket
+    uint32_t slotMask;
+    uint32_t numBuckets;
+    uint64_t seed;
+
+    static uint64_t hash(const char* key, size_t length, uint64_t seed);
+    bool tryBuild(const std::vector<uint64_t>& hashes, const std::vector<int>& uniqueHandles);
+};
+
+#endif // CHANNELREGISTRY_H
@@ -135,6 +135,14 @@ void CommandParser::getCommandSlot(QString parameter)
             getStateItemCommand(item);
             return;
         }
+        if (returnedParameter == "noiselevelmicrovolts") {
+            getNoiseLevelCommand(channel);
+            return;
+        }
+        if (returnedParameter == "spectralbandpowermicrovoltssquared") {
+            getSpectralBandPowerCommand(channel);
+            return;
+        }
     }
 
     // Parse next for port names before the first period.
@@ -174,6 +182,14 @@ void CommandParser::getCommandSlot(QString parameter)
         getTCPWaveformDataConnectionStatusCommand();
     else if (parameterLower == "tcpspikedataoutputconnectionstatus")
         getTCPSpikeDataConnectionStatusCommand();
+    else if (parameterLower == "tcpwaveformdataoutputthroughput")
+        getTCPWaveformDataThroughputCommand();
+    else if (parameterLower == "tcpspikedataoutputthroughput")
+        getTCPSpikeDataThroughputCommand();
+    else if (parameterLower == "pipelinelatencyreport")
+        getPipelineLatencyReportCommand();
+    else if (parameterLower == "audioperformancereport")
+        getAudioPerformanceReportCommand();
     else if (parameterLower == "currenttimestamp")
         getCurrentTimestampCommand();
     else if (parameterLower == "currenttimeseconds")
@@ -272,6 +288,8 @@ void CommandParser::setCommandSlot(QString parameter, QString value)
         setTCPWaveformDataConnectionStatusCommand(valueLower);
     else if (parameterLower == "tcpspikedataoutputconnectionstatus")
         setTCPSpikeDataConnectionStatusCommand(valueLower);
+    else if (parameterLower == "tcpwaveformdataoutputthroughput" || parameterLower == "tcpspikedataoutputthroughput")
+        emit TCPErrorSignal("Throughput is a read-only measurement of the TCP data output thread");
     // If parameter doesn't match an acceptable command, return an error.
     else emit TCPErrorSignal("Unrecognized parameter");
 }
@@ -288,12 +306,22 @@ void CommandParser::executeCommandSlot(QString action)
         }
     } else if (actionLower == "saveimpedance") {
         saveImpedanceCommand();
+    } else if (actionLower == "measureimpedancespectrum") {
+        if (!state->running) {
+            measureImpedanceSpectrumCommand();
+        } else {
+            emit TCPErrorSignal("MeasureImpedanceSpectrum cannot be executed while the board is running");
+        }
+    } else if (actionLower == "saveimpedancespectrum") {
+        saveImpedanceSpectrumCommand();
     } else if (actionLower == "rescanports") {
         if (!state->running) {
             rescanPortsCommand();
         } else {
             emit TCPErrorSignal("RescanPorts cannot be executed while the board is running");
         }
+    } else if (actionLower == "resetpipelinestatistics") {
+        state->pipelineProfiler->resetStatistics();
     } else if (actionLower == "connecttcpwaveformdataoutput") {
         connectTCPWaveformDataOutputCommand();
     } else if (actionLower == "connecttcpspikedataoutput") {
@@ -611,6 +639,66 @@ void CommandParser::getTCPSpikeDataConnectionStatusCommand()
         emit TCPReturnSignal("Return: TCPSpikeDataOutputConnectionStatus Disconnected");
 }
 
+void CommandParser::getTCPWaveformDataThroughputCommand()
+{
+    emit TCPReturnSignal("Return: TCPWaveformDataOutputThroughput " +
+                         QString::number(state->tcpWaveformDataCommunicator->throughput.load(), 'f', 0));
+}
+
+void CommandParser::getTCPSpikeDataThroughputCommand()
+{
+    emit TCPReturnSignal("Return: TCPSpikeDataOutputThroughput " +
+                         QString::number(state->tcpSpikeDataCommunicator->throughput.load(), 'f', 0));
+}
+
+void CommandParser::getPipelineLatencyReportCommand()
+{
+    if (!state->pipelineProfiling->getValue()) {
+        emit TCPErrorSignal("PipelineLatencyReport requires PipelineProfiling to be set to True before the board starts running");
+        return;
+    }
+    returnTCP("PipelineLatencyReport", QString::fromStdString(state->pipelineProfiler->report()));
+}
+
+void CommandParser::getAudioPerformanceReportCommand()
+{
+    QString report = controllerInterface->getAudioPerformanceReport();
+    if (report.isEmpty()) {
+        emit TCPErrorSignal("AudioPerformanceReport requires AudioEnabled to be set to True");
+        return;
+    }
+    returnTCP("AudioPerformanceReport", report);
+}
+
+void CommandParser::getNoiseLevelCommand(Channel* channel)
+{
+    float noiseLevel = controllerInterface->getNoiseEstimator()->getNoiseLevel(channel->getHandle());
+    if (channel->getSignalType() != AmplifierSignal || noiseLevel < 0.0F) {
+        emit TCPErrorSignal("NoiseLevelMicroVolts is only available for amplifier channels after the board has run for at "
+                            "least one second with NoiseEstimationEnabled set to True");
+        return;
+    }
+    returnTCP(channel->getNativeName() + ".NoiseLevelMicroVolts", QString::number(noiseLevel, 'f', 2));
+}
+
+// Return the newest band power of one channel as a comma-separated list of BandName:Power pairs.
+void CommandParser::getSpectralBandPowerCommand(Channel* channel)
+{
+    std::vector<SpectralBand> bands;
+    std::vector<float> bandPower;
+    if (!controllerInterface->getSpectralEngine()->getLatestChannelBandPower(channel->getNativeName().toStdString(),
+                                                                               bands, bandPower)) {
+        emit TCPErrorSignal("SpectralBandPowerMicroVoltsSquared is only available for analyzed amplifier channels while "
+                            "SpectralBandPowerEnabled is set to True and at least one spectrum has been computed");
+        return;
+    }
+    QStringList values;
+    for (int band = 0; band < (int) bands.size(); ++band) {
+        values.append(QString::fromStdString(bands[band].name) + ":" + QString::number(bandPower[band], 'f', 3));
+    }
+    returnTCP(channel->getNativeName() + ".SpectralBandPowerMicroVoltsSquared", values.join(","));
+}
+
 void CommandParser::getCurrentTimestampCommand()
 {
     if (state->running) {
@@ -639,6 +727,16 @@ void CommandParser::saveImpedanceCommand()
     controllerInterface->saveImpedances();
 }
 
+void CommandParser::measureImpedanceSpectrumCommand()
+{
+    controllerInterface->measureImpedanceSpectra();
+}
+
+void CommandParser::saveImpedanceSpectrumCommand()
+{
+    controllerInterface->saveImpedanceSpectra();
+}
+
 void CommandParser::rescanPortsCommand()
 {
     state->signalSources->undoManager->clearUndoStack();
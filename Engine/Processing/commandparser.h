@@ -120,11 +120,21 @@ private:
     void setTCPSpikeDataConnectionStatusCommand(const QString&);
     void getTCPSpikeDataConnectionStatusCommand();
 
+    void getTCPWaveformDataThroughputCommand();
+    void getTCPSpikeDataThroughputCommand();
+
+    void getPipelineLatencyReportCommand();
+    void getAudioPerformanceReportCommand();
+    void getNoiseLevelCommand(Channel* channel);
+    void getSpectralBandPowerCommand(Channel* channel);
+
     void getCurrentTimestampCommand();
     void getCurrentTimeSecondsCommand();
 
     void measureImpedanceCommand();
     void saveImpedanceCommand();
+    void measureImpedanceSpectrumCommand();
+    void saveImpedanceSpectrumCommand();
     void rescanPortsCommand();
     void connectTCPWaveformDataOutputCommand();
     void connectTCPSpikeDataOutputCommand();
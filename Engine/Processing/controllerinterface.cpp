@@ -58,6 +58,10 @@ ControllerInterface::ControllerInterface(SystemState* state_, AbstractRHXControl
     spikeSortingDialog(nullptr),
     audioThread(nullptr),
     saveToDiskThread(nullptr),
+    analysisThread(nullptr),
+    spectralEngine(nullptr),
+    noiseEstimator(nullptr),
+    lastNoiseUpdate(0),
     is7310(is7310_)
 {
     state->writeToLog("Entered ControllerInterface ctor");
@@ -78,7 +82,7 @@ ControllerInterface::ControllerInterface(SystemState* state_, AbstractRHXControl
 
     double memoryRequired = 0.0;
 
-    usbStreamFifo = new DataStreamFifo(fifoBufferSize, usbBufferSize);
+    usbStreamFifo = new DataStreamFifo(fifoBufferSize, usbBufferSize, true);
     if (!usbStreamFifo->memoryWasAllocated(memoryRequired)) {
         outOfMemoryError(memoryRequired);
     }
@@ -88,7 +92,7 @@ ControllerInterface::ControllerInterface(SystemState* state_, AbstractRHXControl
     hardwareFifoPercentFull = 0.0;
     waveformProcessorCpuLoad = 0.0;
 
-    usbDataThread = new USBDataThread(rhxController, usbStreamFifo, this);
+    usbDataThread = new USBDataThread(rhxController, usbStreamFifo, state->pipelineProfiler, this);
     if (!usbDataThread->memoryWasAllocated(memoryRequired)) {
         outOfMemoryError(memoryRequired);
     }
@@ -119,7 +123,7 @@ ControllerInterface::ControllerInterface(SystemState* state_, AbstractRHXControl
     double samplesPerDataBlock = (double) RHXDataBlock::samplesPerDataBlock(state->getControllerTypeEnum());
     int waveformFifoMemoryDataBlocks = ceil(waveformMemoryInSeconds * sampleRate / samplesPerDataBlock);
     int waveformFifoBufferDataBlocks = ceil((waveformMemoryInSeconds + waveformExtraBufferInSeconds) * sampleRate / samplesPerDataBlock);
-    waveformFifo = new WaveformFifo(state->signalSources, waveformFifoBufferDataBlocks, waveformFifoMemoryDataBlocks, 1, state);
+    waveformFifo = new WaveformFifo(state->signalSources, waveformFifoBufferDataBlocks, waveformFifoMemoryDataBlocks, MaxProcessingBatchBlocks, state);
     if (!waveformFifo->memoryWasAllocated(memoryRequired)) {
         outOfMemoryError(memoryRequired);
     }
@@ -141,6 +145,17 @@ ControllerInterface::ControllerInterface(SystemState* state_, AbstractRHXControl
     }
     state->writeToLog("Created saveToDiskThread");
 
+    analysisThread = new AnalysisThread(waveformFifo, this);
+    connect(analysisThread, SIGNAL(finished()), analysisThread, SLOT(deleteLater()));
+    state->writeToLog("Created analysisThread");
+
+    spectralEngine = new SpectralEngine(state);
+    analysisThread->replaceClient(nullptr, spectralEngine);
+
+    noiseEstimator = new NoiseEstimator(state);
+    analysisThread->replaceClient(nullptr, noiseEstimator);
+    saveToDiskThread->setNoiseEstimator(noiseEstimator);
+
     currentSweepPosition = 0;
     audioEnabled = false;
     tcpDataOutputEnabled = false;
@@ -158,6 +173,12 @@ ControllerInterface::~ControllerInterface()
     saveToDiskThread->wait();
     delete saveToDiskThread;
 
+    analysisThread->close();
+    analysisThread->wait();
+    delete analysisThread;
+    delete spectralEngine;
+    delete noiseEstimator;
+
     waveformProcessorThread->close();
     waveformProcessorThread->wait();
     delete waveformProcessorThread;
@@ -234,6 +255,11 @@ void ControllerInterface::updateCurrentAudioChannel(QString name)
     state->forceUpdate();
 }
 
+QString ControllerInterface::getAudioPerformanceReport() const
+{
+    return audioThread ? audioThread->performanceReport() : QString();
+}
+
 void ControllerInterface::runTCPDataOutputThread()
 {
         tcpDataOutputEnabled = true;
@@ -728,9 +754,15 @@ void ControllerInterface::runController()
         return;
     }
 
+    state->pipelineProfiler->start(state->pipelineProfiling->getValue(), RHXDataBlock::samplesPerDataBlock(state->getControllerTypeEnum()),
+                                   state->pipelineTraceFilename->getFullFilename().toStdString());
+
+    waveformFifo->applyLayoutSetting();  // Must happen before any thread starts using the waveform FIFO.
+
     usbDataThread->start();
     waveformProcessorThread->start();
     saveToDiskThread->start();
+    analysisThread->start();
 
     usbDataThread->startRunning();
     waveformProcessorThread->startRunning(rhxController->getNumEnabledDataStreams());
@@ -740,9 +772,13 @@ void ControllerInterface::runController()
     if (audioThread) audioThread->startRunning();
     if (tcpDataOutputThread) tcpDataOutputThread->startRunning();
 
-    int numSamples = display->getSamplesPerRefresh();  // 1000 at 20 kHz; 1500 at 30 kHz
+    int numSamples = samplesPerRefresh();  // 1000 at 20 kHz; 1500 at 30 kHz
+    spectralEngine->reset();
+    noiseEstimator->reset();
+    lastNoiseUpdate = 0;
+    analysisThread->startRunning(numSamples);
 
-    uint32_t* timeStamps = new uint32_t [display->getMaxSamplesPerRefresh()];
+    uint32_t* timeStamps = new uint32_t [maxSamplesPerRefresh()];
     int lastTimeStamp = -1;
     int currentTimeStamp = 0;
 
@@ -757,7 +793,7 @@ void ControllerInterface::runController()
 
     currentSweepPosition = 0;
     waveformFifo->resetBuffer();  // Clear any memory in waveform FIFO from previous running.
-    display->reset();
+    if (display) display->reset();
 
     int triggerWaitNotify = 0;
     YScaleUsed yScaleUsed;
@@ -775,7 +811,9 @@ void ControllerInterface::runController()
             // Main thread plots data:
 //            plotTimer.start();
 
-            if (!state->triggerModeDisplay->getValue()) {
+            if (!display) {
+                // Headless operation (e.g., benchmarking): display data is simply released below.
+            } else if (!state->triggerModeDisplay->getValue()) {
                 // Normal (non-triggered) display
                 yScaleUsed = display->loadWaveformData(waveformFifo);
                 emit setTopStatusLabel("");
@@ -851,13 +889,13 @@ void ControllerInterface::runController()
 
             if (controlPanel) controlPanel->updateSlidersEnabled(yScaleUsed);
 
-            if (isiDialog) isiDialog->updateISI(waveformFifo, numSamples);
-            if (psthDialog) psthDialog->updatePSTH(waveformFifo, numSamples);
-            if (spectrogramDialog) spectrogramDialog->updateSpectrogram(waveformFifo, numSamples);
-            if (spikeSortingDialog) spikeSortingDialog->updateSpikeScope(waveformFifo, numSamples);
-
+            // ISI, PSTH, spectrogram, and spike scope dialogs are updated from analysisThread.
             waveformFifo->freeOldData(WaveformFifo::ReaderDisplay);
 
+            if (noiseEstimator->getNumUpdates() != lastNoiseUpdate) {
+                applyNoiseEstimates(state->thresholdTrackingEnabled->getValue() && !state->absoluteThresholdsEnabled->getValue());
+            }
+
 //            double plotTime = (double) plotTimer.nsecsElapsed();
 
             if (!audioThread) {
@@ -910,7 +948,13 @@ void ControllerInterface::runController()
         }
 
         qApp->processEvents();
-        numSamples = display->getSamplesPerRefresh();
+        numSamples = samplesPerRefresh();
+        analysisThread->setNumSamplesPerRead(numSamples);
+    }
+
+    analysisThread->stopRunning();
+    while (analysisThread->isActive()) {
+        qApp->processEvents();
     }
 
     if (audioThread) {
@@ -945,6 +989,7 @@ void ControllerInterface::runController()
         qApp->processEvents();
     }
 
+    state->pipelineProfiler->stop();
     waveformFifo->pauseBuffer();
 
     usbStreamFifo->resetBuffer();
@@ -955,6 +1000,20 @@ void ControllerInterface::runController()
     emit haveStopped();
 }
 
+// Number of samples the main thread reads from the waveform FIFO per loop.  Without a display (headless operation),
+// read the same 50 msec of data that the display uses at its default time scale.
+int ControllerInterface::samplesPerRefresh() const
+{
+    if (display) return display->getSamplesPerRefresh();
+    return (int) round(0.05 * state->sampleRate->getNumericValue());
+}
+
+int ControllerInterface::maxSamplesPerRefresh() const
+{
+    if (display) return display->getMaxSamplesPerRefresh();
+    return samplesPerRefresh();
+}
+
 void ControllerInterface::runControllerSilently(double nSeconds, QProgressDialog* progress)
 {
     qint64 runTimeNsecs = nSeconds * 1e9;
@@ -970,6 +1029,8 @@ void ControllerInterface::runControllerSilently(double nSeconds, QProgressDialog
 
     int numSamples = 1000;
 
+    waveformFifo->applyLayoutSetting();  // Must happen before any thread starts using the waveform FIFO.
+
     usbDataThread->start();
     waveformProcessorThread->start();
 
@@ -998,11 +1059,15 @@ void ControllerInterface::runControllerSilently(double nSeconds, QProgressDialog
                 waveformFifo->freeOldData(WaveformFifo::ReaderTCP);
             }
 
+            if (waveformFifo->requestReadNewData(WaveformFifo::ReaderAnalysis, numSamples)) {
+                waveformFifo->freeOldData(WaveformFifo::ReaderAnalysis);
+            }
+
             qApp->processEvents();
         }
 
         qApp->processEvents();
-        numSamples = display->getSamplesPerRefresh();
+        numSamples = samplesPerRefresh();
 
         if (tickTimer.nsecsElapsed() >= progressTickNsecs) {
             tickTimer.restart();
@@ -1053,9 +1118,8 @@ void ControllerInterface::setAllSpikeDetectionThresholds()
 {
     if (state->absoluteThresholdsEnabled->getValue()) {
         double threshold = state->absoluteThreshold->getValue();
-        std::vector<std::string> waveNameList = state->signalSources->amplifierChannelsNameList();
-        for (int i = 0; i < (int) waveNameList.size(); ++i) {
-            Channel* channel = state->signalSources->channelByName(waveNameList[i]);
+        for (int handle : state->signalSources->amplifierChannelHandles()) {
+            Channel* channel = state->signalSources->channelByHandle(handle);
             if (channel) {
                 if (channel->isEnabled()) {
                     channel->setSpikeThreshold(round(threshold));
@@ -1063,6 +1127,9 @@ void ControllerInterface::setAllSpikeDetectionThresholds()
             }
         }
     } else {
+        // While running, use the continuous noise estimates rather than interrupting acquisition.
+        if (state->running && applyNoiseEstimates(true)) return;
+
         double rmsMultiple = state->rmsMultipleThreshold->getValue();
         if (state->negativeRelativeThreshold->getValue()) rmsMultiple *= -1;
         double numSecondsToMeasure = 3.0;
@@ -1085,6 +1152,31 @@ void ControllerInterface::setAllSpikeDetectionThresholds()
     }
 }
 
+// Copy the latest noise estimates to each amplifier channel and, if setThresholds is true, set the spike threshold of
+// each enabled amplifier channel to the relative threshold multiple of its noise level.  Called on the GUI thread.
+// Returns false if no estimates are available yet.
+bool ControllerInterface::applyNoiseEstimates(bool setThresholds)
+{
+    uint64_t numUpdates = noiseEstimator->getNoiseLevels(noiseLevels);
+    if (numUpdates == 0) return false;
+    lastNoiseUpdate = numUpdates;
+
+    double multiple = state->rmsMultipleThreshold->getValue();
+    if (state->negativeRelativeThreshold->getValue()) multiple *= -1;
+
+    state->holdUpdate();
+    for (int handle : state->signalSources->amplifierChannelHandles()) {
+        Channel* channel = state->signalSources->channelByHandle(handle);
+        float level = (handle < (int) noiseLevels.size()) ? noiseLevels[handle] : -1.0F;
+        channel->setNoiseLevel(level);
+        if (setThresholds && level >= 0.0F && channel->isEnabled()) {
+            channel->setSpikeThreshold(round(multiple * level));
+        }
+    }
+    state->releaseUpdate();
+    return true;
+}
+
 // Negative values of speed rewind into waveform FIFO memory; positive values fast forward, at the specified multiple of realtime.
 void ControllerInterface::sweepDisplay(double speed)
 {
@@ -1734,6 +1826,18 @@ bool ControllerInterface::saveImpedances()
     return zReader.saveImpedances();
 }
 
+bool ControllerInterface::measureImpedanceSpectra()
+{
+    ImpedanceReader zReader(state, rhxController);
+    return zReader.measureImpedanceSpectra();
+}
+
+bool ControllerInterface::saveImpedanceSpectra()
+{
+    ImpedanceReader zReader(state, rhxController);
+    return zReader.saveImpedanceSpectra();
+}
+
 double ControllerInterface::swBufferPercentFull() const
 {
     return std::max(waveformFifo->percentFull(), usbStreamFifo->percentFull());
@@ -1800,10 +1904,8 @@ void ControllerInterface::uploadStimParameters(Channel* channel)
 
 void ControllerInterface::uploadStimParameters()
 {
-    std::vector<std::string> allChannels = state->signalSources->completeChannelsNameList();
-    for (int i = 0; i < (int) allChannels.size(); i++) {
-        Channel* channel = state->signalSources->channelByName(QString::fromStdString(allChannels[i]));
-        uploadStimParameters(channel);
+    for (int handle = 0; handle < state->signalSources->numChannelHandles(); handle++) {
+        uploadStimParameters(state->signalSources->channelByHandle(handle));
     }
 }
 
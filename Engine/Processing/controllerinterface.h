@@ -49,6 +49,9 @@
 #include "savetodiskthread.h"
 #include "audiothread.h"
 #include "tcpdataoutputthread.h"
+#include "analysisthread.h"
+#include "spectralengine.h"
+#include "noiseestimator.h"
 #include "systemstate.h"
 #include "signalsources.h"
 #include "xpucontroller.h"
@@ -89,12 +92,24 @@ public:
 
     void setDisplay(MultiColumnDisplay* display_) { display = display_; }
     void setControlPanel(ControlPanel* controlPanel_) { controlPanel = controlPanel_; }
-    void setISIDialog(ISIDialog* isiDialog_) { isiDialog = isiDialog_; }
-    void setPSTHDialog(PSTHDialog* psthDialog_) { psthDialog = psthDialog_; }
-    void setSpectrogramDialog(SpectrogramDialog* spectrogramDialog_) { spectrogramDialog = spectrogramDialog_; }
-    void setSpikeSortingDialog(SpikeSortingDialog* spikeSortingDialog_) { spikeSortingDialog = spikeSortingDialog_; }
+    // Analysis dialogs are updated from analysisThread; set a dialog to nullptr here before deleting it.
+    void setISIDialog(ISIDialog* isiDialog_)
+        { analysisThread->replaceClient(isiDialog, isiDialog_); isiDialog = isiDialog_; }
+    void setPSTHDialog(PSTHDialog* psthDialog_)
+        { analysisThread->replaceClient(psthDialog, psthDialog_); psthDialog = psthDialog_; }
+    void setSpectrogramDialog(SpectrogramDialog* spectrogramDialog_)
+        { analysisThread->replaceClient(spectrogramDialog, spectrogramDialog_); spectrogramDialog = spectrogramDialog_; }
+    void setSpikeSortingDialog(SpikeSortingDialog* spikeSortingDialog_)
+        { analysisThread->replaceClient(spikeSortingDialog, spikeSortingDialog_); spikeSortingDialog = spikeSortingDialog_; }
+
+    // Band power of amplifier channels, updated on analysisThread while SpectralBandPowerEnabled is true.
+    SpectralEngine* getSpectralEngine() const { return spectralEngine; }
+    // Noise levels of amplifier channels, updated on analysisThread while NoiseEstimationEnabled or
+    // ThresholdTrackingEnabled is true.
+    NoiseEstimator* getNoiseEstimator() const { return noiseEstimator; }
 
     QString getCurrentAudioChannel() const { return currentAudioChannel; }
+    QString getAudioPerformanceReport() const;  // Empty if PC audio is not enabled
 
     void setStimSequenceParameters(Channel* ampChannel);
     void setAnalogOutSequenceParameters(Channel* anOutChannel);
@@ -137,6 +152,8 @@ public:
 
     bool measureImpedances();
     bool saveImpedances();
+    bool measureImpedanceSpectra();
+    bool saveImpedanceSpectra();
 
     double swBufferPercentFull() const;
     double latestWaveformProcessorCpuLoad() const { return waveformProcessorCpuLoad; }
@@ -179,6 +196,9 @@ private:
     void sendTCPError(QString errorMessage);
     void pipeReadErrorMessage(int errorID);
 
+    int samplesPerRefresh() const;
+    int maxSamplesPerRefresh() const;
+
     SystemState* state;
     AbstractRHXController* rhxController;
     DataFileReader* dataFileReader;
@@ -200,6 +220,11 @@ private:
 
     AudioThread* audioThread;
     SaveToDiskThread* saveToDiskThread;
+    AnalysisThread* analysisThread;
+    SpectralEngine* spectralEngine;
+    NoiseEstimator* noiseEstimator;
+    std::vector<float> noiseLevels;
+    uint64_t lastNoiseUpdate;
 
     int currentSweepPosition;
 
@@ -215,6 +240,7 @@ private:
     bool is7310;
 
     void outOfMemoryError(double memRequiredGB);
+    bool applyNoiseEstimates(bool setThresholds);
 };
 
 #endif // CONTROLLERINTERFACE_H
@@ -30,6 +30,13 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 #include "rhxglobals.h"
 #include "datastreamfifo.h"
@@ -37,23 +44,26 @@
 // Create a circular buffer for USB data.  If data will be read using a pointer returned from
 // pointerToData(), then a maxReadLength must be defined to allocate extra space beyond the 'end'
 // of the circular buffer to maintain contiguous data arrays during these reads.  If data will only
-// be read using readFromBuffer(), then maxReadLength can be omitted.
-DataStreamFifo::DataStreamFifo(int bufferSize_, int maxReadLength_) :
+// be read using readFromBuffer(), then maxReadLength can be omitted.  If useHugePages is true, the
+// buffer is mapped with huge pages where the operating system supports it, reducing TLB misses when
+// streaming through a large buffer; otherwise (or if that fails) ordinary memory is used.
+DataStreamFifo::DataStreamFifo(int bufferSize_, int maxReadLength_, bool useHugePages) :
+    buffer(nullptr),
     bufferSize(bufferSize_),
-    maxReadLength(maxReadLength_)
+    maxReadLength(maxReadLength_),
+    mappedBytes(0),
+    writeCount(0),
+    bufferWriteIndex(0),
+    readCount(0),
+    bufferReadIndex(0),
+    numWordsToBeRead(0),
+    consumerWaiting(false)
 {
     int bufferSizeWithExtra = bufferSize + maxReadLength;
     memoryNeededGB = sizeof(uint16_t) * bufferSizeWithExtra / (1024.0 * 1024.0 * 1024.0);
     std::cout << "DataStreamFifo: Allocating " << 2 * bufferSizeWithExtra / 1.0e6 << " MBytes for FIFO buffer." << '\n';
-    buffer = nullptr;
 
-    memoryAllocated = true;
-    try {
-        buffer = new uint16_t [bufferSizeWithExtra];
-    } catch (std::bad_alloc&) {
-        memoryAllocated = false;
-        std::cerr << "Error: DataStreamFifo constructor could not allocate " << memoryNeededGB << " GB of memory." << '\n';
-    }
+    allocateBuffer(bufferSizeWithExtra, useHugePages);
 
     if (!buffer) {
         std::cerr << "Error: DataStreamFifo constructor could not allocate " << 2 * bufferSizeWithExtra << " bytes of memory." << '\n';
@@ -63,54 +73,128 @@ DataStreamFifo::DataStreamFifo(int bufferSize_, int maxReadLength_) :
 
 DataStreamFifo::~DataStreamFifo()
 {
-    delete [] buffer;
+    freeBuffer();
 }
 
-bool DataStreamFifo::writeToBuffer(const uint8_t* dataSource, int numWords)
+void DataStreamFifo::allocateBuffer(int numWords, bool useHugePages)
 {
-    const uint8_t* pRead = dataSource;
-    uint16_t highByte, lowByte;
-
-    if (freeWords.tryAcquire(numWords)) {
-        for (int i = 0; i < numWords; ++i) {
-            // TODO: Try using bitfields or unions to speed up 2 x byte --> uint16.
-            lowByte = (uint16_t) (*pRead);
-            pRead++;
-            highByte = (uint16_t) (*pRead);
-            pRead++;
-            buffer[bufferWriteIndex++] = lowByte | (highByte << 8);
-            if (bufferWriteIndex >= bufferSize) {
-                bufferWriteIndex = 0;
+    memoryAllocated = true;
+#if defined(__linux__)
+    if (useHugePages) {
+        const size_t HugePageSize = 2 * 1024 * 1024;
+        size_t numBytes = ((sizeof(uint16_t) * numWords + HugePageSize - 1) / HugePageSize) * HugePageSize;
+        // Explicit huge pages need a reserved pool; if none is configured, fall back to asking for transparent huge pages.
+        void* p = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            p = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, numBytes, MADV_HUGEPAGE);
             }
         }
-        usedWords.release(numWords);
-        return true;
-    } else {
+        if (p != MAP_FAILED) {
+            buffer = (uint16_t*) p;
+            mappedBytes = numBytes;
+            return;
+        }
+    }
+#else
+    (void) useHugePages;
+#endif
+    try {
+        buffer = new uint16_t [numWords];
+    } catch (std::bad_alloc&) {
+        memoryAllocated = false;
+        std::cerr << "Error: DataStreamFifo constructor could not allocate " << memoryNeededGB << " GB of memory." << '\n';
+    }
+}
+
+void DataStreamFifo::freeBuffer()
+{
+#if defined(__linux__)
+    if (mappedBytes > 0) {
+        munmap(buffer, mappedBytes);
+        buffer = nullptr;
+        return;
+    }
+#endif
+    delete [] buffer;
+    buffer = nullptr;
+}
+
+// Producer: copy numWords little-endian words into the buffer as (at most) two contiguous spans, then publish them
+// with a single update of writeCount.
+bool DataStreamFifo::writeToBuffer(const uint8_t* dataSource, int numWords)
+{
+    int64_t wordsUsed = writeCount.load(std::memory_order_relaxed) - readCount.load(std::memory_order_acquire);
+    int freeWords = bufferSize - (int) wordsUsed;
+    if (numWords > freeWords) {
         std::cerr << "DataStreamFifo: Buffer overrun on request of " << numWords << " words." << '\n';
-        std::cerr << "   ...only " << freeWords.available() << " words are available." << '\n';
+        std::cerr << "   ...only " << freeWords << " words are available." << '\n';
         return false;  // Buffer overrun error
     }
+
+    const uint8_t* pRead = dataSource;
+    int wordsRemaining = numWords;
+    while (wordsRemaining > 0) {
+        int spanWords = std::min(wordsRemaining, bufferSize - bufferWriteIndex);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for (int i = 0; i < spanWords; ++i) {
+            buffer[bufferWriteIndex + i] = (uint16_t) pRead[2 * i] | ((uint16_t) pRead[2 * i + 1] << 8);
+        }
+#else
+        std::memcpy(&buffer[bufferWriteIndex], pRead, BytesPerWord * spanWords);
+#endif
+        pRead += BytesPerWord * spanWords;
+        wordsRemaining -= spanWords;
+        bufferWriteIndex += spanWords;
+        if (bufferWriteIndex >= bufferSize) {
+            bufferWriteIndex = 0;
+        }
+    }
+
+    writeCount.fetch_add(numWords, std::memory_order_seq_cst);
+    if (consumerWaiting.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        dataWritten.notify_one();
+    }
+    return true;
 }
 
 bool DataStreamFifo::dataAvailable(unsigned int numWords) const
 {
-    return ((unsigned int)(usedWords.available()) >= numWords);
+    return ((unsigned int) wordsAvailable() >= numWords);
+}
+
+// Consumer: block until at least numWords are available or timeoutUsec elapses, without sleep-polling.  Returns
+// true if the data is available.
+bool DataStreamFifo::waitForData(int numWords, int timeoutUsec)
+{
+    if (wordsAvailable() >= numWords) return true;
+
+    std::unique_lock<std::mutex> lock(waitMutex);
+    consumerWaiting.store(true, std::memory_order_seq_cst);
+    bool available = dataWritten.wait_for(lock, std::chrono::microseconds(timeoutUsec),
+                                          [this, numWords] {
+        return writeCount.load(std::memory_order_seq_cst) - readCount.load(std::memory_order_relaxed) >= numWords;
+    });
+    consumerWaiting.store(false, std::memory_order_relaxed);
+    return available;
 }
 
 int DataStreamFifo::wordsAvailable() const
 {
-    return usedWords.available();
+    return (int) (writeCount.load(std::memory_order_acquire) - readCount.load(std::memory_order_acquire));
 }
 
 double DataStreamFifo::percentFull() const
 {
-    return 100.0 * ((double)usedWords.available() / (double)bufferSize);
+    return 100.0 * ((double) wordsAvailable() / (double) bufferSize);
 }
 
 // Copy numWords of data from the circular buffer to memory location dataSink.
 bool DataStreamFifo::readFromBuffer(uint16_t *dataSink, int numWords)
 {
-    if (!usedWords.tryAcquire(numWords)) {
+    if (wordsAvailable() < numWords) {
         return false;  // Not enough data available in buffer
     }
 
@@ -128,7 +212,7 @@ bool DataStreamFifo::readFromBuffer(uint16_t *dataSink, int numWords)
         std::memcpy(&dataSink[numWordsFirstPart], buffer, BytesPerWord * numWordsSecondPart);
         bufferReadIndex = numWordsSecondPart;
     }
-    freeWords.release(numWords);
+    readCount.fetch_add(numWords, std::memory_order_release);
     return true;
 }
 
@@ -138,18 +222,17 @@ bool DataStreamFifo::readFromBuffer(uint16_t *dataSink, int numWords)
 // This method returns nullptr if there is insufficient data in the circular buffer.
 uint16_t* DataStreamFifo::pointerToData(int numWordsBeToRead_)
 {
-    numWordsToBeRead = numWordsBeToRead_;
-    if (numWordsToBeRead > maxReadLength) {
+    if (numWordsBeToRead_ > maxReadLength) {
         std::cerr << "DataStreamFifo::pointerToData: numWordsToBeRead exceeds maxReadLength." << '\n';
         return nullptr;
     }
-    if (!usedWords.tryAcquire(numWordsToBeRead)) {
+    if (wordsAvailable() < numWordsBeToRead_) {
         return nullptr;  // not enough data available to read
     }
+    numWordsToBeRead = numWordsBeToRead_;
     if (bufferReadIndex + numWordsToBeRead > bufferSize) {
         // Our read will overrun the end of the buffer; copy data to the extra space allocated after the
         // 'end' of the buffer to ensure a contiguous array of data for reading.
-//        cout << "DataStreamFifo::pointerToData: copying data to ensure contiguous array of data for reading." << EndOfLine;
         int extraWords = bufferReadIndex + numWordsToBeRead - bufferSize;
         std::memcpy(&buffer[bufferSize], &buffer[0], BytesPerWord * extraWords);
         // Note: You can avoid this potentially time-consuming memory copy by always reading the same
@@ -164,16 +247,16 @@ uint16_t* DataStreamFifo::pointerToData(int numWordsBeToRead_)
 void DataStreamFifo::freeData()
 {
     bufferReadIndex = (bufferReadIndex + numWordsToBeRead) % bufferSize; // okay to use % operator since first quantity must be positive
-    freeWords.release(numWordsToBeRead);
+    readCount.fetch_add(numWordsToBeRead, std::memory_order_release);
+    numWordsToBeRead = 0;
 }
 
+// Only call when neither the producer nor the consumer thread is active.
 void DataStreamFifo::resetBuffer()
 {
-    freeWords.acquire(freeWords.available());
-    usedWords.acquire(usedWords.available());
+    writeCount.store(0);
+    readCount.store(0);
     bufferWriteIndex = 0;
     bufferReadIndex = 0;
-    freeWords.release(bufferSize);
     numWordsToBeRead = 0;
 }
-
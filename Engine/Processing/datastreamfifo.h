@@ -27,19 +27,28 @@
 //  See <http://www.intantech.com> for documentation and product information.
 //
 //------------------------------------------------------------------------------
+
 #ifndef DATASTREAMFIFO_H
 #define DATASTREAMFIFO_H
 
-#include "semaphore.h"
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+const int CacheLineSize = 64;
 
+// Lock-free single-producer/single-consumer circular buffer for USB data.  Exactly one thread may write
+// (writeToBuffer()) and exactly one other thread may read (readFromBuffer() or pointerToData()/freeData()).
 class DataStreamFifo
 {
 public:
-    DataStreamFifo(int bufferSize_, int maxReadLength_ = 0);
+    DataStreamFifo(int bufferSize_, int maxReadLength_ = 0, bool useHugePages = false);
     ~DataStreamFifo();
 
     bool writeToBuffer(const uint8_t* dataSource, int numWords);
     bool dataAvailable(unsigned int numWords) const;
+    bool waitForData(int numWords, int timeoutUsec);
 
     bool readFromBuffer(uint16_t *dataSink, int numWords);
     uint16_t* pointerToData(int numWordsToBeRead_);
@@ -47,22 +56,36 @@ public:
 
     void resetBuffer();
     int wordsAvailable() const;
+    int wordsFree() const { return bufferSize - wordsAvailable(); }
     double percentFull() const;
 
     bool memoryWasAllocated(double& memoryRequestedGB) const { memoryRequestedGB += memoryNeededGB; return memoryAllocated; }
 
 private:
+    void allocateBuffer(int numWords, bool useHugePages);
+    void freeBuffer();
+
     uint16_t* buffer;
     int bufferSize;
     int maxReadLength;
-    int numWordsToBeRead;
-    Semaphore freeWords;
-    Semaphore usedWords;
-    int bufferWriteIndex;
-    int bufferReadIndex;
+    size_t mappedBytes;  // Nonzero if buffer was allocated with mmap() rather than new[].
 
     bool memoryAllocated;
     double memoryNeededGB;
+
+    // Total words ever written and read.  Each is stored only by its own side, and kept on its own cache line
+    // so the producer and consumer do not contend for the same line on every update.
+    alignas(CacheLineSize) std::atomic<int64_t> writeCount;
+    int bufferWriteIndex;   // Producer only
+
+    alignas(CacheLineSize) std::atomic<int64_t> readCount;
+    int bufferReadIndex;    // Consumer only
+    int numWordsToBeRead;   // Consumer only
+
+    // Used only when the consumer blocks in waitForData(); the producer takes the mutex only if a consumer is waiting.
+    alignas(CacheLineSize) std::atomic<bool> consumerWaiting;
+    std::mutex waitMutex;
+    std::condition_variable dataWritten;
 };
 
 #endif // DATASTREAMFIFO_H
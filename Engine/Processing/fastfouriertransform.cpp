@@ -28,12 +28,142 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_USE_SSE2
+#endif
+
 #include "rhxglobals.h"
 #include "fastfouriertransform.h"
 
+namespace {
+
+// Vector operations on one group of lanes (signals) in the batch layout used by realFft() and realFftBatch(), where
+// element i of signal c is stored at data[i * batchWidth + c].  Every butterfly applies the same twiddle factor to all
+// lanes, so the transforms of several signals vectorize without any shuffling.
+struct ScalarLanes
+{
+    typedef float Vector;
+    static const int Width = 1;
+    static inline Vector load(const float* p) { return *p; }
+    static inline void store(float* p, Vector v) { *p = v; }
+    static inline Vector set(float x) { return x; }
+    static inline Vector add(Vector a, Vector b) { return a + b; }
+    static inline Vector sub(Vector a, Vector b) { return a - b; }
+    static inline Vector mul(Vector a, Vector b) { return a * b; }
+};
+
+#ifdef FFT_USE_SSE2
+struct SseLanes
+{
+    typedef __m128 Vector;
+    static const int Width = 4;
+    static inline Vector load(const float* p) { return _mm_loadu_ps(p); }
+    static inline void store(float* p, Vector v) { _mm_storeu_ps(p, v); }
+    static inline Vector set(float x) { return _mm_set1_ps(x); }
+    static inline Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static inline Vector sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+    static inline Vector mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+};
+typedef SseLanes BatchLanes;
+#else
+typedef ScalarLanes BatchLanes;
+#endif
+
+// In-place radix-2 decimation-in-time FFT of m complex values per lane, stored as alternating real and imaginary rows
+// of batchWidth values.
+template <class L>
+void complexFftLanes(float *data, int batchWidth, unsigned int m, const std::vector<unsigned int>& swaps,
+                     const float* twReal, const float* twImag)
+{
+    typedef typename L::Vector V;
+    const int rowStride = 2 * batchWidth;
+
+    for (unsigned int s = 0; s < (unsigned int) swaps.size(); s += 2) {
+        float* a = data + swaps[s] * rowStride;
+        std::swap_ranges(a, a + rowStride, data + swaps[s + 1] * rowStride);
+    }
+
+    for (unsigned int half = 1; half < m; half <<= 1) {
+        unsigned int span = half << 1;
+        unsigned int twiddleStep = m / span;
+        for (unsigned int j = 0; j < half; ++j) {
+            V wReal = L::set(twReal[j * twiddleStep]);
+            V wImag = L::set(twImag[j * twiddleStep]);
+            for (unsigned int start = j; start < m; start += span) {
+                float* a = data + start * rowStride;
+                float* b = a + half * rowStride;
+                for (int c = 0; c < batchWidth; c += L::Width) {
+                    V aReal = L::load(a + c);
+                    V aImag = L::load(a + batchWidth + c);
+                    V bReal = L::load(b + c);
+                    V bImag = L::load(b + batchWidth + c);
+                    V tReal, tImag;
+                    if (j == 0) {    // Twiddle factor is one.
+                        tReal = bReal;
+                        tImag = bImag;
+                    } else {
+                        tReal = L::sub(L::mul(bReal, wReal), L::mul(bImag, wImag));
+                        tImag = L::add(L::mul(bReal, wImag), L::mul(bImag, wReal));
+                    }
+                    L::store(b + c, L::sub(aReal, tReal));
+                    L::store(b + batchWidth + c, L::sub(aImag, tImag));
+                    L::store(a + c, L::add(aReal, tReal));
+                    L::store(a + batchWidth + c, L::add(aImag, tImag));
+                }
+            }
+        }
+    }
+}
+
+// Turn the m-point complex FFT of z[t] = x[2t] + i x[2t+1] into the spectrum of the 2m real values x, in the packed
+// format documented for FastFourierTransform::realInputFft().
+template <class L>
+void splitRealSpectrumLanes(float *data, int batchWidth, unsigned int m, const float* twReal, const float* twImag)
+{
+    typedef typename L::Vector V;
+    const int rowStride = 2 * batchWidth;
+    const V half = L::set(0.5F);
+
+    for (int c = 0; c < batchWidth; c += L::Width) {
+        V zReal = L::load(data + c);
+        V zImag = L::load(data + batchWidth + c);
+        L::store(data + c, L::add(zReal, zImag));                // X[0]
+        L::store(data + batchWidth + c, L::sub(zReal, zImag));   // X[m]
+    }
+
+    for (unsigned int k = 1; k <= (m >> 1); ++k) {
+        float* a = data + k * rowStride;
+        float* b = data + (m - k) * rowStride;
+        V wReal = L::set(twReal[k]);
+        V wImag = L::set(twImag[k]);
+        for (int c = 0; c < batchWidth; c += L::Width) {
+            V aReal = L::load(a + c);
+            V aImag = L::load(a + batchWidth + c);
+            V bReal = L::load(b + c);
+            V bImag = L::load(b + batchWidth + c);
+            // Even part E = (Z[k] + conj(Z[m-k])) / 2; odd part O = -i (Z[k] - conj(Z[m-k])) / 2.
+            V eReal = L::mul(half, L::add(aReal, bReal));
+            V eImag = L::mul(half, L::sub(aImag, bImag));
+            V oReal = L::mul(half, L::add(aImag, bImag));
+            V oImag = L::mul(half, L::sub(bReal, aReal));
+            // X[k] = E + W^k O; X[m-k] = conj(E - W^k O).
+            V tReal = L::sub(L::mul(wReal, oReal), L::mul(wImag, oImag));
+            V tImag = L::add(L::mul(wReal, oImag), L::mul(wImag, oReal));
+            L::store(a + c, L::add(eReal, tReal));
+            L::store(a + batchWidth + c, L::add(eImag, tImag));
+            L::store(b + c, L::sub(eReal, tReal));
+            L::store(b + batchWidth + c, L::sub(tImag, eImag));
+        }
+    }
+}
+
+}
+
 FastFourierTransform::FastFourierTransform(float sampleRate_, unsigned int length_, WindowFunction function_) :
     sampleRate(sampleRate_),
     length(length_),
@@ -58,6 +188,7 @@ void FastFourierTransform::setLength(int length_)
     createWindow();
     createPsdVector();
     createFrequencyVector();
+    createTwiddleTables();
 }
 
 void FastFourierTransform::createWindow()
@@ -116,6 +247,43 @@ void FastFourierTransform::createFrequencyVector()
     }
 }
 
+void FastFourierTransform::createTwiddleTables()
+{
+    unsigned int m = length >> 1;
+
+    bitReversalSwaps.clear();
+    unsigned int j = 0;
+    for (unsigned int i = 0; i < m; ++i) {
+        if (j > i) {
+            bitReversalSwaps.push_back(i);
+            bitReversalSwaps.push_back(j);
+        }
+        unsigned int bit = m >> 1;
+        while (bit > 0 && (j & bit)) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+
+    // Compute twiddle factors directly in double precision, rather than by recurrence, so errors do not accumulate.
+    twiddleReal.resize(std::max(m >> 1, 1U));
+    twiddleImag.resize(twiddleReal.size());
+    for (unsigned int k = 0; k < (unsigned int) twiddleReal.size(); ++k) {
+        double theta = -TwoPi * (double) k / (double) m;
+        twiddleReal[k] = (float) cos(theta);
+        twiddleImag[k] = (float) sin(theta);
+    }
+
+    realTwiddleReal.resize((m >> 1) + 1);
+    realTwiddleImag.resize(realTwiddleReal.size());
+    for (unsigned int k = 0; k < (unsigned int) realTwiddleReal.size(); ++k) {
+        double theta = -TwoPi * (double) k / (double) length;
+        realTwiddleReal[k] = (float) cos(theta);
+        realTwiddleImag[k] = (float) sin(theta);
+    }
+}
+
 // Perform an FFT of an array of n complex numbers, where n must be a power of two.
 // The complex numbers are stored in data, an array of length 2n, where
 // data[0] = input_real[t]
@@ -227,6 +395,24 @@ void FastFourierTransform::realInputFft(float *data, unsigned int n)
     data[1] = h1Real - data[1];
 }
 
+// Perform an FFT of length real numbers in data, returning the result in the same format as realInputFft().  Uses
+// single-precision arithmetic and the twiddle factors precomputed by setLength().
+void FastFourierTransform::realFft(float *data) const
+{
+    complexFftLanes<ScalarLanes>(data, 1, length >> 1, bitReversalSwaps, twiddleReal.data(), twiddleImag.data());
+    splitRealSpectrumLanes<ScalarLanes>(data, 1, length >> 1, realTwiddleReal.data(), realTwiddleImag.data());
+}
+
+// Perform FFTs of batchWidth real signals of length samples at once.  The signals are interleaved in data, with
+// sample t of signal c at data[t * batchWidth + c], and each spectrum is returned interleaved the same way, in the
+// format of realInputFft() (e.g., the real component of frequency 1 of signal c is at data[2 * batchWidth + c]).
+// batchWidth must be a multiple of FftBatchLanes.
+void FastFourierTransform::realFftBatch(float *data, int batchWidth) const
+{
+    complexFftLanes<BatchLanes>(data, batchWidth, length >> 1, bitReversalSwaps, twiddleReal.data(), twiddleImag.data());
+    splitRealSpectrumLanes<BatchLanes>(data, batchWidth, length >> 1, realTwiddleReal.data(), realTwiddleImag.data());
+}
+
 // Calculate the logarithm of the square root of the PSD of data and normalizes values to facilitate calculation
 // of signal amplitude from PSD.  The values in data are overwritten with intermediate results.
 // Returns a pointer to the results, an array (length/2 + 1) long.
@@ -238,7 +424,7 @@ float* FastFourierTransform::logSqrtPowerSpectralDensity(float *data)
     }
 
     // Calculate FFT.
-    realInputFft(data, length);
+    realFft(data);
 
     float normalizationFactor = log10f(2.0F / (float) length); // add this to facilitate estimate of narrowband signal amplitude
                                                                // from PSD.
@@ -30,6 +30,10 @@
 #ifndef FASTFOURIERTRANSFORM_H
 #define FASTFOURIERTRANSFORM_H
 
+#include <vector>
+
+const int FftBatchLanes = 4;    // Batch widths passed to FastFourierTransform::realFftBatch() must be a multiple of this.
+
 class FastFourierTransform
 {
 public:
@@ -46,8 +50,12 @@ public:
     void setLength(int length_);
     static void complexInputFft(float *data, unsigned int n);
     static void realInputFft(float *data, unsigned int n);
+    void realFft(float *data) const;
+    void realFftBatch(float *data, int batchWidth) const;
     float* logSqrtPowerSpectralDensity(float *data);
     float getFrequency(int index) const;
+    const float* getWindow() const { return window; }
+    unsigned int getLength() const { return length; }
 
 private:
     float sampleRate;
@@ -58,7 +66,17 @@ private:
     float *logPsd;
     float *frequency;
 
+    // Precomputed tables for realFft() and realFftBatch(): index pairs to swap for reverse-binary reindexing of the
+    // length/2-point complex FFT, its twiddle factors exp(-2*pi*i*k/(length/2)) for k < length/4, and the twiddle
+    // factors exp(-2*pi*i*k/length) for k <= length/4 used to split it into the spectrum of the real input.
+    std::vector<unsigned int> bitReversalSwaps;
+    std::vector<float> twiddleReal;
+    std::vector<float> twiddleImag;
+    std::vector<float> realTwiddleReal;
+    std::vector<float> realTwiddleImag;
+
     void createWindow();
+    void createTwiddleTables();
     void createPsdVector();
     void createFrequencyVector();
 };
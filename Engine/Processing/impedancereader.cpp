@@ -29,33 +29,260 @@
 //------------------------------------------------------------------------------
 
 #include <QProgressDialog>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
 #include <QMessageBox>
 #include <QString>
 #include <QFile>
 #include <QTextStream>
+#include <QDataStream>
+#include <QStringList>
+#include <algorithm>
+#include <numeric>
 #include <cmath>
-#include <deque>
 #include <iostream>
 #include "signalsources.h"
 #include "impedancereader.h"
 
 ImpedanceReader::ImpedanceReader(SystemState* state_, AbstractRHXController* rhxController_) :
     state(state_),
-    rhxController(rhxController_)
+    rhxController(rhxController_),
+    acquisitionMsec(0)
 {
 }
 
 bool ImpedanceReader::measureImpedances()
 {
-    // We can't really measure impedances in playback mode, so just return false.
+    // We can't really measure impedances in playback mode, so just return false.  In synthetic mode,
+    // SyntheticRHXController emulates the impedance test circuit.
     if (state->playback->getValue()) return false;
 
-    if (state->synthetic->getValue()) {
-        // Plug in dummy impedance values in synthetic mode and return true.
-        runDemoImpedanceMeasurement();
-        return true;
+    if (state->actualImpedanceFreq->getValue() <= 0.0) {
+        std::cerr << "Error in ImpedanceReader::measureImpedances: Invalid impedance test frequency.\n";
+        return false;
     }
 
+    // Create a sine wave command list for the AuxCmd1 slot.
+    ControllerType controllerType = state->getControllerTypeEnum();
+    RHXRegisters chipRegisters(controllerType, state->sampleRate->getNumericValue(), state->getStimStepSizeEnum());
+    std::vector<TestWaveform> testWaveforms(1);
+    testWaveforms[0].period = round(state->sampleRate->getNumericValue() / state->actualImpedanceFreq->getValue());
+    testWaveforms[0].harmonics.push_back(1);
+    chipRegisters.createCommandListZcheckDac(testWaveforms[0].dacCommandList, state->actualImpedanceFreq->getValue(), 128.0);
+
+    ChannelImpedances impedances;
+    if (!measureTestWaveforms(testWaveforms, QObject::tr("Measuring Electrode Impedances"), impedances)) return false;
+
+    int numChannelsPerStream = RHXDataBlock::channelsPerStream(controllerType);
+    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+        for (int channel = 0; channel < numChannelsPerStream; ++channel) {
+            Channel* signalChannel = state->signalSources->getAmplifierChannel(stream, channel);
+            if (signalChannel) {
+                signalChannel->setImpedance(impedances[stream][channel][0].magnitude, impedances[stream][channel][0].phase);
+            }
+        }
+    }
+
+    state->impedancesHaveBeenMeasured->setValue(true);
+    state->displayLabelText->setValue("Impedance Magnitude");
+    return true;
+}
+
+// Measure the impedance of every amplifier channel at each frequency in desiredImpedanceSpectrumFreqs.  The frequencies
+// actually measured are written to actualImpedanceSpectrumFreqs, in increasing order, and each channel's spectrum is
+// stored in the same order.
+bool ImpedanceReader::measureImpedanceSpectra()
+{
+    if (state->playback->getValue()) return false;
+
+    std::vector<double> desiredFrequencies;
+    const QStringList fields = state->desiredImpedanceSpectrumFreqs->getValueString().split(',', Qt::SkipEmptyParts);
+    for (const QString& field : fields) {
+        bool ok;
+        double frequency = field.trimmed().toDouble(&ok);
+        if (ok && frequency > 0.0) {
+            desiredFrequencies.push_back(frequency);
+        } else {
+            std::cerr << "Warning in ImpedanceReader::measureImpedanceSpectra: Ignoring invalid frequency '" <<
+                         field.toStdString() << "'.\n";
+        }
+    }
+
+    std::vector<TestWaveform> testWaveforms = planSpectrumWaveforms(desiredFrequencies);
+    if (testWaveforms.empty()) {
+        std::cerr << "Error in ImpedanceReader::measureImpedanceSpectra: No measurable frequencies.\n";
+        return false;
+    }
+
+    ChannelImpedances impedances;
+    if (!measureTestWaveforms(testWaveforms, QObject::tr("Measuring Electrode Impedance Spectra"), impedances)) {
+        return false;
+    }
+
+    // Tones are numbered in waveform order; sort them by frequency.
+    double sampleRate = state->sampleRate->getNumericValue();
+    std::vector<double> frequencies;
+    for (const TestWaveform& testWaveform : testWaveforms) {
+        for (int harmonic : testWaveform.harmonics) {
+            frequencies.push_back(sampleRate * harmonic / testWaveform.period);
+        }
+    }
+    std::vector<int> order(frequencies.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&frequencies](int a, int b) { return frequencies[a] < frequencies[b]; });
+
+    QStringList frequencyList;
+    for (int tone : order) {
+        frequencyList.append(QString::number(frequencies[tone], 'f', 2));
+    }
+
+    int numChannelsPerStream = RHXDataBlock::channelsPerStream(state->getControllerTypeEnum());
+    std::vector<double> magnitudes(order.size());
+    std::vector<double> phases(order.size());
+    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+        for (int channel = 0; channel < numChannelsPerStream; ++channel) {
+            Channel* signalChannel = state->signalSources->getAmplifierChannel(stream, channel);
+            if (signalChannel) {
+                for (int i = 0; i < (int) order.size(); ++i) {
+                    magnitudes[i] = impedances[stream][channel][order[i]].magnitude;
+                    phases[i] = impedances[stream][channel][order[i]].phase;
+                }
+                signalChannel->setImpedanceSpectrum(magnitudes, phases);
+            }
+        }
+    }
+
+    state->actualImpedanceSpectrumFreqs->setValue(frequencyList.join(','));
+    state->impedanceSpectraHaveBeenMeasured->setValue(true);
+    return true;
+}
+
+// Group frequencies into as few test waveforms as possible.  The lowest remaining frequency sets the period of the next
+// waveform, and every other frequency within SpectrumFrequencyTolerance of one of its harmonics joins it.  Frequencies
+// outside the amplifier bandwidth or beyond the reach of the Zcheck DAC command list are skipped.
+std::vector<ImpedanceReader::TestWaveform> ImpedanceReader::planSpectrumWaveforms(const std::vector<double>& frequencies) const
+{
+    ControllerType controllerType = state->getControllerTypeEnum();
+    double sampleRate = state->sampleRate->getNumericValue();
+    int maxPeriod = RHXRegisters::maxCommandLength(controllerType);
+
+    // Same limits as for the single impedance test frequency.
+    double upperBandwidthLimit = state->actualUpperBandwidth->getValue() / 1.5;
+    double lowerBandwidthLimit = state->actualLowerBandwidth->getValue() * 1.5;
+    if (state->dspEnabled->getValue()) {
+        if (state->actualDspCutoffFreq->getValue() > state->actualLowerBandwidth->getValue()) {
+            lowerBandwidthLimit = state->actualDspCutoffFreq->getValue() * 1.5;
+        }
+    }
+
+    std::vector<double> remaining;
+    for (double frequency : frequencies) {
+        int period = round(sampleRate / frequency);
+        if (period < 4 || period > maxPeriod || frequency < lowerBandwidthLimit || frequency > upperBandwidthLimit) {
+            std::cerr << "Warning in ImpedanceReader::planSpectrumWaveforms: " << frequency <<
+                         " Hz is outside the measurable range and is skipped.\n";
+        } else {
+            remaining.push_back(frequency);
+        }
+    }
+    std::sort(remaining.begin(), remaining.end());
+
+    RHXRegisters chipRegisters(controllerType, sampleRate, state->getStimStepSizeEnum());
+    std::vector<TestWaveform> testWaveforms;
+    while (!remaining.empty()) {
+        TestWaveform testWaveform;
+        testWaveform.period = round(sampleRate / remaining.front());
+        testWaveform.harmonics.push_back(1);
+
+        std::vector<double> unassigned;
+        for (int i = 1; i < (int) remaining.size(); ++i) {
+            int harmonic = round(remaining[i] * testWaveform.period / sampleRate);
+            double shift = std::abs(sampleRate * harmonic / testWaveform.period - remaining[i]) / remaining[i];
+            bool duplicate = std::find(testWaveform.harmonics.begin(), testWaveform.harmonics.end(), harmonic) !=
+                    testWaveform.harmonics.end();
+            if (shift > SpectrumFrequencyTolerance) {
+                unassigned.push_back(remaining[i]);
+            } else if (!duplicate) {
+                if ((int) testWaveform.harmonics.size() < MaxTonesPerWaveform && 4 * harmonic <= testWaveform.period) {
+                    testWaveform.harmonics.push_back(harmonic);
+                } else {
+                    unassigned.push_back(remaining[i]);
+                }
+            }
+        }
+        chipRegisters.createCommandListZcheckDac(testWaveform.dacCommandList, testWaveform.period, testWaveform.harmonics,
+                                                 128.0);
+        testWaveforms.push_back(testWaveform);
+        remaining.swap(unassigned);
+    }
+    return testWaveforms;
+}
+
+// Find the amplitude and phase of each tone's test current from the DAC command list, choose the acquisition length, and
+// precompute the correlation waveforms over the measurement window, which is the same for every step.
+void ImpedanceReader::prepareTestWaveform(TestWaveform& testWaveform) const
+{
+    ControllerType controllerType = state->getControllerTypeEnum();
+    double sampleRate = state->sampleRate->getNumericValue();
+    const int period = testWaveform.period;
+    const int numTones = (int) testWaveform.harmonics.size();
+
+    // The DAC value is the low byte of each register write.  The test current through the series capacitor leads the
+    // DAC voltage by 90 degrees.
+    testWaveform.dacAmplitude.resize(numTones);
+    testWaveform.currentPhase.resize(numTones);
+    for (int tone = 0; tone < numTones; ++tone) {
+        const double K = TwoPi * testWaveform.harmonics[tone] / period;
+        double realComponent = 0.0;
+        double imagComponent = 0.0;
+        for (int t = 0; t < period; ++t) {
+            double value = (double)((int)(testWaveform.dacCommandList[t] & 0xffU) - 128);
+            realComponent += value * cos(K * t);
+            imagComponent -= value * sin(K * t);
+        }
+        testWaveform.dacAmplitude[tone] = (2.0 / period) * sqrt(realComponent * realComponent + imagComponent * imagComponent) *
+                (1.225 / 256.0);
+        testWaveform.currentPhase[tone] = RadiansToDegrees * atan2(imagComponent, realComponent) + 90.0;
+    }
+
+    // Select number of periods to measure impedance over
+    int numPeriods = round(0.020 * sampleRate / period); // Test each channel for at least 20 msec...
+    if (numPeriods < 5) numPeriods = 5; // ...but always measure across no fewer than 5 complete periods
+    int samplesPerDataBlock = RHXDataBlock::samplesPerDataBlock(controllerType);
+    testWaveform.numBlocks = ceil((numPeriods + 2) * period / (double) samplesPerDataBlock); // + 2 periods to give time to settle initially
+    if (testWaveform.numBlocks < 2) testWaveform.numBlocks = 2;   // need first block for command to switch channels to take effect
+
+    // Move the measurement window to the end of the waveform to ignore start-up transient.
+    int numSamples = samplesPerDataBlock * testWaveform.numBlocks;
+    int startIndex = 0;
+    int endIndex = startIndex + numPeriods * period - 1;
+    while (endIndex < numSamples - period) {
+        startIndex += period;
+        endIndex += period;
+    }
+    const int length = endIndex - startIndex + 1;
+    testWaveform.windowStart = startIndex;
+    testWaveform.windowLength = length;
+
+    testWaveform.cosineTable.resize(numTones * length);
+    testWaveform.sineTable.resize(numTones * length);
+    for (int tone = 0; tone < numTones; ++tone) {
+        const double K = TwoPi * testWaveform.harmonics[tone] / period;
+        double* cosine = &testWaveform.cosineTable[tone * length];
+        double* sine = &testWaveform.sineTable[tone * length];
+        for (int i = 0; i < length; ++i) {
+            cosine[i] = cos(K * (startIndex + i));
+            sine[i] = -1.0 * sin(K * (startIndex + i));
+        }
+    }
+}
+
+// Measure every amplifier channel with each test waveform, and return the electrode impedance of every channel at every
+// tone, with tones numbered in waveform order.
+bool ImpedanceReader::measureTestWaveforms(std::vector<TestWaveform>& testWaveforms, const QString& progressText,
+                                           ChannelImpedances& impedances)
+{
     bool rhd2164ChipPresent = false;
     for (int stream = 0; stream < (int) state->chipType.size(); ++stream) {
         if (state->chipType[stream] == RHD2164MISOBChip) {
@@ -85,43 +312,48 @@ bool ImpedanceReader::measureImpedances()
         rhxController->enableDac(i, false);
     }
 
+    for (TestWaveform& testWaveform : testWaveforms) {
+        prepareTestWaveform(testWaveform);
+    }
+
+    // We execute three complete electrode impedance measurements with each test waveform: one each with
+    // Cseries set to 0.1 pF, 1 pF, and 10 pF.  Then we select the best measurement
+    // for each channel so that we achieve a wide impedance measurement range.
+    int numChannelsPerStream = RHXDataBlock::channelsPerStream(controllerType);
+    std::vector<MeasurementStep> steps;
+    int numProgressSteps = 0;
+    for (int waveform = 0; waveform < (int) testWaveforms.size(); ++waveform) {
+        for (int capRange = 0; capRange < 3; ++capRange) {
+            for (int channel = 0; channel < numChannelsPerStream; ++channel) {
+                steps.push_back({ waveform, capRange, channel, false });
+                ++numProgressSteps;
+
+                // If an RHD2164 chip is plugged in, we have to set the Zcheck select register to channels 32-63
+                // and repeat the previous step.
+                if (rhd2164ChipPresent) {
+                    steps.push_back({ waveform, capRange, channel, true });
+                }
+            }
+        }
+    }
+
     // Create a progress bar to let user know how long this will take.
-    int maxProgress = (controllerType == ControllerStimRecord) ? 50 : 98;
-    QProgressDialog progress(QObject::tr("Measuring Electrode Impedances"), QString(), 0, maxProgress);
+    QProgressDialog progress(progressText, QString(), 0, numProgressSteps + 2);
     progress.setWindowTitle(QObject::tr("Progress"));
     progress.setMinimumDuration(0);
     progress.setModal(true);
     progress.setValue(0);
 
-    // Create a command list for the AuxCmd1 slot.
     RHXRegisters chipRegisters(controllerType, state->sampleRate->getNumericValue(), state->getStimStepSizeEnum());
-    std::vector<unsigned int> commandList;
-
-    int commandSequenceLength = chipRegisters.createCommandListZcheckDac(commandList, state->actualImpedanceFreq->getValue(),
-                                                                         128.0);
-
-    rhxController->uploadCommandList(commandList, AbstractRHXController::AuxCmd1, 1);
-    rhxController->selectAuxCommandLength(AbstractRHXController::AuxCmd1, 0, commandSequenceLength - 1);
-
-    if (controllerType == ControllerRecordUSB2 || controllerType == ControllerRecordUSB3) {
-        rhxController->selectAuxCommandBankAllPorts(AbstractRHXController::AuxCmd1, 1);
-    }
 
     progress.setValue(1);
 
-    // Select number of periods to measure impedance over
-    int numPeriods = round(0.020 * state->actualImpedanceFreq->getValue()); // Test each channel for at least 20 msec...
-    if (numPeriods < 5) numPeriods = 5; // ...but always measure across no fewer than 5 complete periods
-    double period = state->sampleRate->getNumericValue() / state->actualImpedanceFreq->getValue();
-    int numBlocks = ceil((numPeriods + 2) * period / (double) RHXDataBlock::samplesPerDataBlock(controllerType)); // + 2 periods to give time to settle initially
-    if (numBlocks < 2) numBlocks = 2;   // need first block for command to switch channels to take effect
-
-
-     chipRegisters.setDspCutoffFreq(state->desiredDspCutoffFreq->getValue());
+    chipRegisters.setDspCutoffFreq(state->desiredDspCutoffFreq->getValue());
     chipRegisters.setLowerBandwidth(state->desiredLowerBandwidth->getValue(), 0);
     chipRegisters.setUpperBandwidth(state->desiredUpperBandwidth->getValue());
     chipRegisters.enableDsp(state->dspEnabled->getValue());
     chipRegisters.enableZcheck(true);
+    int commandSequenceLength;
     if (controllerType == ControllerStimRecord) {
         commandSequenceLength = chipRegisters.createCommandListRHSRegisterConfig(commandList, false);
     } else {
@@ -138,221 +370,61 @@ bool ImpedanceReader::measureImpedances()
     }
 
     rhxController->setContinuousRunMode(false);
-    rhxController->setMaxTimeStep(RHXDataBlock::samplesPerDataBlock(controllerType) * numBlocks);
-
-    // Create matrices of doubles of size (numStreams x numChannelsPerStream x 3) to store complex amplitudes
-    // of all amplifier channels (32 or 16 on each data stream) at three different Cseries values
-    int numChannelsPerStream = RHXDataBlock::channelsPerStream(controllerType);
-    std::vector<std::vector<std::vector<ComplexPolar> > > measuredImpedance;
-    measuredImpedance.resize(rhxController->getNumEnabledDataStreams());
-    for (int i = 0; i < rhxController->getNumEnabledDataStreams(); ++i) {
-        measuredImpedance[i].resize(numChannelsPerStream);
-        for (int j = 0; j < numChannelsPerStream; ++j) {
-            measuredImpedance[i][j].resize(3);
-        }
-    }
-
-    // Data files used to examine data used in impedance measurement, only necessary for testing
-//    QFile cap0File("cap0.dat");
-//    cap0File.open(QIODevice::WriteOnly);
-//    QDataStream cap0Stream(&cap0File);
-//    cap0Stream.setVersion(QDataStream::Qt_5_11);
-//    cap0Stream.setByteOrder(QDataStream::LittleEndian);
-//    cap0Stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
-
-//    QFile cap1File("cap1.dat");
-//    cap1File.open(QIODevice::WriteOnly);
-//    QDataStream cap1Stream(&cap1File);
-//    cap1Stream.setVersion(QDataStream::Qt_5_11);
-//    cap1Stream.setByteOrder(QDataStream::LittleEndian);
-//    cap1Stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
-
-//    QFile cap2File("cap2.dat");
-//    cap2File.open(QIODevice::WriteOnly);
-//    QDataStream cap2Stream(&cap2File);
-//    cap2Stream.setVersion(QDataStream::Qt_5_11);
-//    cap2Stream.setByteOrder(QDataStream::LittleEndian);
-//    cap2Stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
-
-    // We execute three complete electrode impedance measurements: one each with
-    // Cseries set to 0.1 pF, 1 pF, and 10 pF.  Then we select the best measurement
-    // for each channel so that we achieve a wide impedance measurement range.
-    for (int capRange = 0; capRange < 3; ++capRange) {
-        switch (capRange) {
-        case 0:
-            chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs100fF);
-            break;
-        case 1:
-            chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs1pF);
-            break;
-        case 2:
-            chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs10pF);
-            break;
-        }
-
-        // Check all channels across all active data streams.
-        for (int channel = 0; channel < numChannelsPerStream; ++channel) {
-            progress.setValue(numChannelsPerStream * capRange + channel + 2);
-
-            chipRegisters.setZcheckChannel(channel);
-            if (controllerType == ControllerStimRecord) {
-                commandSequenceLength = chipRegisters.createCommandListRHSRegisterConfig(commandList, false);
-            } else {
-                commandSequenceLength = chipRegisters.createCommandListRHDRegisterConfig(commandList, false,
-                                                                                         RHXDataBlock::samplesPerDataBlock(controllerType));
-            }
-
-            // Upload version with no ADC calibration to AuxCmd3 RAM bank
-            rhxController->uploadCommandList(commandList, AbstractRHXController::AuxCmd3, 3);
-
-            rhxController->run();
-            while (rhxController->isRunning()) {
-                qApp->processEvents();
-            }
-            std::deque<RHXDataBlock*> dataQueue;
-            rhxController->readDataBlocks(numBlocks, dataQueue);
-
-            for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
-                if (state->chipType[stream] != RHD2164MISOBChip) {
-                    // Measure impedances, and pass measureComplexAmplitude() a file to write to. Only necessary for testing.
-                    // Otherwise, just call measureComplexAmplitude() without this file for all capRange and channel values.
-//                    if (channel == 0 && stream == 0) {
-//                        if (capRange == 0) {
-//                            measuredImpedance[stream][channel][capRange] =
-//                                    measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-//                                                            state->actualImpedanceFreq->getValue(), numPeriods, &cap0Stream);
-//                        } else if (capRange == 1) {
-//                            measuredImpedance[stream][channel][capRange] =
-//                                    measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-//                                                            state->actualImpedanceFreq->getValue(), numPeriods, &cap1Stream);
-//                        } else {
-//                            measuredImpedance[stream][channel][capRange] =
-//                                    measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-//                                                            state->actualImpedanceFreq->getValue(), numPeriods, &cap2Stream);
-//                        }
-//                    }
-
-//                    else {
-//                    measuredImpedance[stream][channel][capRange] =
-//                            measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-//                                                    state->actualImpedanceFreq->getValue(), numPeriods);
-//                    }
-                    measuredImpedance[stream][channel][capRange] =
-                            measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-                                                    state->actualImpedanceFreq->getValue(), numPeriods);
-                }
-            }
-            while (!dataQueue.empty()) {
-                delete dataQueue.back();
-                dataQueue.pop_back();
-            }
 
-            // If an RHD2164 chip is plugged in, we have to set the Zcheck select register to channels 32-63
-            // and repeat the previous steps.
-            if (rhd2164ChipPresent) {
-                chipRegisters.setZcheckChannel(channel + 32);  // Address channels 32-63.
-                commandSequenceLength =
-                        chipRegisters.createCommandListRHDRegisterConfig(commandList, false,
-                                                                         RHXDataBlock::samplesPerDataBlock(controllerType));
-                // Upload version with no ADC calibration to AuxCmd3 RAM Bank 1.
-                rhxController->uploadCommandList(commandList, AbstractRHXController::AuxCmd3, 3);
-
-                rhxController->run();
-                while (rhxController->isRunning()) {
-                    qApp->processEvents();
-                }
-                rhxController->readDataBlocks(numBlocks, dataQueue);
-
-                for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
-                    if (state->chipType[stream] == RHD2164MISOBChip) {
-                        measuredImpedance[stream][channel][capRange] =
-                                measureComplexAmplitude(dataQueue, stream, channel, state->sampleRate->getNumericValue(),
-                                                        state->actualImpedanceFreq->getValue(), numPeriods);
-                    }
-                }
-                while (!dataQueue.empty()) {
-                    delete dataQueue.back();
-                    dataQueue.pop_back();
+    // Create matrices of doubles of size (numStreams x numChannelsPerStream x 3) for each tone to store complex
+    // amplitudes of all amplifier channels (32 or 16 on each data stream) at three different Cseries values
+    int numStreams = rhxController->getNumEnabledDataStreams();
+    std::vector<std::vector<ComplexAmplitudes> > amplitudes(testWaveforms.size());
+    int maxNumBlocks = 0;
+    for (int waveform = 0; waveform < (int) testWaveforms.size(); ++waveform) {
+        amplitudes[waveform].resize(testWaveforms[waveform].harmonics.size());
+        for (ComplexAmplitudes& toneAmplitudes : amplitudes[waveform]) {
+            toneAmplitudes.resize(numStreams);
+            for (int i = 0; i < numStreams; ++i) {
+                toneAmplitudes[i].resize(numChannelsPerStream);
+                for (int j = 0; j < numChannelsPerStream; ++j) {
+                    toneAmplitudes[i][j].resize(3);
                 }
             }
         }
+        maxNumBlocks = std::max(maxNumBlocks, testWaveforms[waveform].numBlocks);
     }
 
-    // Close data files used to examine data used in impedance measurement, only necessary for testing
-//    cap0File.close();
-//    cap1File.close();
-//    cap2File.close();
-
-    const double DacVoltageAmplitude = 128.0 * (1.225 / 256.0); // this assumes the DAC amplitude was set to 128
-
-    double parasiticCapacitance;  // Estimate of on-chip parasitic capicitance, including effective amplifier input capacitance.
-    if (controllerType == ControllerStimRecord) {
-        parasiticCapacitance = 12.0e-12;  // 12 pF
-    } else {
-        parasiticCapacitance = 15.0e-12;  // 15 pF
+    int bufferSize = BytesPerWord * maxNumBlocks * RHXDataBlock::dataBlockSizeInWords(controllerType, numStreams);
+    rawBuffers[0].resize(bufferSize);
+    rawBuffers[1].resize(bufferSize);
+
+    // Analyze each step's data while the controller acquires data for the next step.
+    bool allDataRead = true;
+    int progressStep = 0;
+    for (int i = 0; i < (int) steps.size(); ++i) {
+        const MeasurementStep& step = steps[i];
+        if (!step.misoB) {
+            progress.setValue(2 + progressStep++);
+        }
+        bool newWaveform = (i == 0) || (steps[i - 1].waveform != step.waveform);
+        startAcquisition(step, testWaveforms[step.waveform], newWaveform, chipRegisters);
+        if (i > 0) {
+            analyzeAcquisition(steps[i - 1], testWaveforms[steps[i - 1].waveform], rawBuffers[(i - 1) % 2],
+                               amplitudes[steps[i - 1].waveform]);
+        }
+        allDataRead = finishAcquisition(testWaveforms[step.waveform].numBlocks, rawBuffers[i % 2]) && allDataRead;
+    }
+    if (!steps.empty()) {
+        analyzeAcquisition(steps.back(), testWaveforms[steps.back().waveform], rawBuffers[(steps.size() - 1) % 2],
+                           amplitudes[steps.back().waveform]);
     }
 
-    double relativeFreq = state->actualImpedanceFreq->getValue() / state->sampleRate->getNumericValue();
-    double saturationVoltage = approximateSaturationVoltage(state->actualImpedanceFreq->getValue(),
-                                                            state->actualUpperBandwidth->getValue());
-
-    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+    impedances.resize(numStreams);
+    std::vector<ComplexPolar> waveformImpedances;
+    for (int stream = 0; stream < numStreams; ++stream) {
+        impedances[stream].resize(numChannelsPerStream);
         for (int channel = 0; channel < numChannelsPerStream; ++channel) {
-            Channel* signalChannel = state->signalSources->getAmplifierChannel(stream, channel);
-            if (signalChannel) {
-                // Make sure chosen capacitor is below saturation voltage
-                int bestAmplitudeIndex;
-                if (measuredImpedance[stream][channel][2].magnitude < saturationVoltage) {
-                    bestAmplitudeIndex = 2;
-                } else if (measuredImpedance[stream][channel][1].magnitude < saturationVoltage) {
-                    bestAmplitudeIndex = 1;
-                } else {
-                    bestAmplitudeIndex = 0;
-                }
-
-                // If C2 and C3 are too close, C3 is probably saturated. Ignore C3.
-                double capRatio = measuredImpedance[stream][channel][1].magnitude / measuredImpedance[stream][channel][2].magnitude;
-                if (capRatio > 0.2) {
-                    if (bestAmplitudeIndex == 2) {
-                        bestAmplitudeIndex = 1;
-                    }
-                }
-
-                double cSeries = 0.0;
-                switch (bestAmplitudeIndex) {
-                case 0:
-                    cSeries = 0.1e-12;
-                    break;
-                case 1:
-                    cSeries = 1.0e-12;
-                    break;
-                case 2:
-                    cSeries = 10.0e-12;
-                    break;
-                }
-
-                // Calculate current amplitude produced by on-chip voltage DAC
-                double current = TwoPi * state->actualImpedanceFreq->getValue() * DacVoltageAmplitude * cSeries;
-
-                ComplexPolar impedance;
-
-                // Calculate impedance magnitude from calculated current and measured voltage.
-                impedance.magnitude = 1.0e-6 * (measuredImpedance[stream][channel][bestAmplitudeIndex].magnitude / current) *
-                        (18.0 * relativeFreq * relativeFreq + 1.0);
-
-                // Calculate impedance phase, with small correction factor accounting for the 3-command SPI pipeline delay.
-                impedance.phase = measuredImpedance[stream][channel][bestAmplitudeIndex].phase + (360.0 * (3.0 / period));
-
-                // Factor out on-chip parasitic capacitance from impedance measurement.
-                impedance = factorOutParallelCapacitance(impedance, state->actualImpedanceFreq->getValue(), parasiticCapacitance);
-
-                if (controllerType == ControllerStimRecord) {
-                    // Multiply by a factor of 10%: empirical tests indicate that RHS chips usually underestimate impedance
-                    // by about 10%
-                    impedance.magnitude = 1.1 * impedance.magnitude;
-                }
-
-                signalChannel->setImpedance(impedance.magnitude, impedance.phase);
+            impedances[stream][channel].clear();
+            for (int waveform = 0; waveform < (int) testWaveforms.size(); ++waveform) {
+                calculateImpedances(testWaveforms[waveform], amplitudes[waveform], stream, channel, waveformImpedances);
+                impedances[stream][channel].insert(impedances[stream][channel].end(), waveformImpedances.begin(),
+                                                   waveformImpedances.end());
             }
         }
     }
@@ -398,9 +470,97 @@ bool ImpedanceReader::measureImpedances()
     rhxController->enableDac(6, state->analogOut7Channel->getValueString().toLower() != "off");
     rhxController->enableDac(7, state->analogOut8Channel->getValueString().toLower() != "off");
 
-    state->impedancesHaveBeenMeasured->setValue(true);
-    state->displayLabelText->setValue("Impedance Magnitude");
-    return true;
+    return allDataRead;
+}
+
+// Choose a series capacitor for one channel and test waveform, and convert the voltage measured at each tone to an
+// electrode impedance.
+void ImpedanceReader::calculateImpedances(const TestWaveform& testWaveform, const std::vector<ComplexAmplitudes>& amplitudes,
+                                          int stream, int channel, std::vector<ComplexPolar>& impedances) const
+{
+    ControllerType controllerType = state->getControllerTypeEnum();
+    double sampleRate = state->sampleRate->getNumericValue();
+    const int numTones = (int) testWaveform.harmonics.size();
+
+    double parasiticCapacitance;  // Estimate of on-chip parasitic capicitance, including effective amplifier input capacitance.
+    if (controllerType == ControllerStimRecord) {
+        parasiticCapacitance = 12.0e-12;  // 12 pF
+    } else {
+        parasiticCapacitance = 15.0e-12;  // 15 pF
+    }
+
+    // Make sure chosen capacitor is below saturation voltage.  The amplifier saturates on the sum of all tones, so add
+    // up each tone's amplitude relative to the saturation voltage at its frequency.
+    double saturation[3] = { 0.0, 0.0, 0.0 };
+    for (int tone = 0; tone < numTones; ++tone) {
+        double saturationVoltage = approximateSaturationVoltage(sampleRate * testWaveform.harmonics[tone] / testWaveform.period,
+                                                                state->actualUpperBandwidth->getValue());
+        for (int capRange = 0; capRange < 3; ++capRange) {
+            saturation[capRange] += amplitudes[tone][stream][channel][capRange].magnitude / saturationVoltage;
+        }
+    }
+    int unsaturatedIndex;
+    if (saturation[2] < 1.0) {
+        unsaturatedIndex = 2;
+    } else if (saturation[1] < 1.0) {
+        unsaturatedIndex = 1;
+    } else {
+        unsaturatedIndex = 0;
+    }
+
+    impedances.resize(numTones);
+    for (int tone = 0; tone < numTones; ++tone) {
+        const std::vector<ComplexPolar>& measured = amplitudes[tone][stream][channel];
+        int bestAmplitudeIndex = unsaturatedIndex;
+
+        // If C2 and C3 are too close, C3 is probably saturated. Ignore C3.
+        double capRatio = measured[1].magnitude / measured[2].magnitude;
+        if (capRatio > 0.2) {
+            if (bestAmplitudeIndex == 2) {
+                bestAmplitudeIndex = 1;
+            }
+        }
+
+        double cSeries = 0.0;
+        switch (bestAmplitudeIndex) {
+        case 0:
+            cSeries = 0.1e-12;
+            break;
+        case 1:
+            cSeries = 1.0e-12;
+            break;
+        case 2:
+            cSeries = 10.0e-12;
+            break;
+        }
+
+        double frequency = sampleRate * testWaveform.harmonics[tone] / testWaveform.period;
+        double relativeFreq = frequency / sampleRate;
+
+        // Calculate current amplitude produced by on-chip voltage DAC
+        double current = TwoPi * frequency * testWaveform.dacAmplitude[tone] * cSeries;
+
+        ComplexPolar impedance;
+
+        // Calculate impedance magnitude from calculated current and measured voltage.
+        impedance.magnitude = 1.0e-6 * (measured[bestAmplitudeIndex].magnitude / current) *
+                (18.0 * relativeFreq * relativeFreq + 1.0);
+
+        // Calculate impedance phase relative to the test current, with small correction factor accounting for the
+        // 3-command SPI pipeline delay.
+        impedance.phase = measured[bestAmplitudeIndex].phase - testWaveform.currentPhase[tone] + (360.0 * 3.0 * relativeFreq);
+
+        // Factor out on-chip parasitic capacitance from impedance measurement.
+        impedance = factorOutParallelCapacitance(impedance, frequency, parasiticCapacitance);
+
+        if (controllerType == ControllerStimRecord) {
+            // Multiply by a factor of 10%: empirical tests indicate that RHS chips usually underestimate impedance
+            // by about 10%
+            impedance.magnitude = 1.1 * impedance.magnitude;
+        }
+
+        impedances[tone] = impedance;
+    }
 }
 
 // Use a 2nd order Low Pass Filter to model the approximate voltage at which the amplifiers saturate
@@ -438,43 +598,164 @@ ComplexPolar ImpedanceReader::factorOutParallelCapacitance(ComplexPolar impedanc
     return result;
 }
 
-ComplexPolar ImpedanceReader::measureComplexAmplitude(const std::deque<RHXDataBlock*> &dataQueue, int stream, int chipChannel,
-                                                      double sampleRate, double frequency, int numPeriods, QDataStream *outStream) const
+// Configure the chips for one measurement step and start the controller, without waiting for the data.  If this step
+// uses a different test waveform than the previous one, upload its DAC waveform to the AuxCmd1 slot first.
+void ImpedanceReader::startAcquisition(const MeasurementStep& step, const TestWaveform& testWaveform, bool newWaveform,
+                                       RHXRegisters& chipRegisters)
 {
-    int samplesPerDataBlock = RHXDataBlock::samplesPerDataBlock(state->getControllerTypeEnum());
-    int numBlocks = (int) dataQueue.size();
-
-    // Copy waveform data from data blocks.
-    std::vector<double> waveform(samplesPerDataBlock * numBlocks);
-    int index = 0;
-    for (int block = 0; block < numBlocks; ++block) {
-        for (int t = 0; t < samplesPerDataBlock; ++t) {
-            waveform[index++] = 0.195 * (double)(dataQueue[block]->amplifierData(stream, chipChannel, t) - 32768);
-            if (outStream) {
-                *outStream << 0.195 * (double)(dataQueue[block]->amplifierData(stream, chipChannel, t) - 32768);
-            }
+    ControllerType controllerType = state->getControllerTypeEnum();
+    if (newWaveform) {
+        rhxController->uploadCommandList(testWaveform.dacCommandList, AbstractRHXController::AuxCmd1, 1);
+        rhxController->selectAuxCommandLength(AbstractRHXController::AuxCmd1, 0, (int) testWaveform.dacCommandList.size() - 1);
+        if (controllerType == ControllerRecordUSB2 || controllerType == ControllerRecordUSB3) {
+            rhxController->selectAuxCommandBankAllPorts(AbstractRHXController::AuxCmd1, 1);
         }
+        rhxController->setMaxTimeStep(RHXDataBlock::samplesPerDataBlock(controllerType) * testWaveform.numBlocks);
+    }
+
+    switch (step.capRange) {
+    case 0:
+        chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs100fF);
+        break;
+    case 1:
+        chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs1pF);
+        break;
+    case 2:
+        chipRegisters.setZcheckScale(RHXRegisters::ZcheckCs10pF);
+        break;
+    }
+
+    if (step.misoB) {
+        chipRegisters.setZcheckChannel(step.channel + 32);  // Address channels 32-63.
+    } else {
+        chipRegisters.setZcheckChannel(step.channel);
+    }
+    if (controllerType == ControllerStimRecord) {
+        chipRegisters.createCommandListRHSRegisterConfig(commandList, false);
+    } else {
+        chipRegisters.createCommandListRHDRegisterConfig(commandList, false, RHXDataBlock::samplesPerDataBlock(controllerType));
+    }
+
+    // Upload version with no ADC calibration to AuxCmd3 RAM bank
+    rhxController->uploadCommandList(commandList, AbstractRHXController::AuxCmd3, 3);
+
+    rhxController->run();
+    acquisitionTimer.start();
+    acquisitionMsec = (qint64) ceil(1000.0 * RHXDataBlock::samplesPerDataBlock(controllerType) * testWaveform.numBlocks /
+                                    state->sampleRate->getNumericValue());
+}
+
+// Wait for the acquisition started by startAcquisition() to finish, and read its raw USB data into buffer.  Return false
+// if not all of it could be read.
+bool ImpedanceReader::finishAcquisition(int numBlocks, std::vector<uint8_t>& buffer)
+{
+    // The controller does not signal the end of a run, so sleep in an event loop until the acquisition should be
+    // complete, and only then check it at millisecond intervals (e.g., for USB latency).
+    if (rhxController->isRunning()) {
+        waitInEventLoop(acquisitionMsec - acquisitionTimer.elapsed());
+    }
+    while (rhxController->isRunning()) {
+        waitInEventLoop(1);
+    }
+
+    // A synthetic controller produces data at its own pace, so wait until all of it can be read.
+    long expectedBytes = (long) BytesPerWord * numBlocks *
+            RHXDataBlock::dataBlockSizeInWords(state->getControllerTypeEnum(), rhxController->getNumEnabledDataStreams());
+    QElapsedTimer timer;
+    timer.start();
+    long bytesRead;
+    while ((bytesRead = rhxController->readDataBlocksRaw(numBlocks, buffer.data())) == 0 && timer.elapsed() < 5000) {
+        waitInEventLoop(1);
+    }
+    if (bytesRead != expectedBytes) {
+        std::cerr << "Error in ImpedanceReader::finishAcquisition: read " << bytesRead << " of " << expectedBytes <<
+                     " bytes.\n";
+        return false;
     }
+    return true;
+}
+
+// Sleep for msec milliseconds in a local event loop, so the GUI stays responsive without busy-waiting.
+void ImpedanceReader::waitInEventLoop(qint64 msec)
+{
+    if (msec <= 0) return;
+    QEventLoop loop;
+    QTimer::singleShot((int) msec, Qt::PreciseTimer, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+// Measure the complex amplitude of each test tone on the channel tested in this step, on every stream it applies to.
+void ImpedanceReader::analyzeAcquisition(const MeasurementStep& step, const TestWaveform& testWaveform,
+                                         const std::vector<uint8_t>& buffer, std::vector<ComplexAmplitudes>& amplitudes)
+{
+    int numStreams = rhxController->getNumEnabledDataStreams();
+    int numSamples = RHXDataBlock::samplesPerDataBlock(state->getControllerTypeEnum()) * testWaveform.numBlocks;
+    extractChannel((const uint16_t*) buffer.data(), numSamples, numStreams, step.channel);
 
     if (state->notchFreq->getValue().toLower() != "none") {
-        double notchFreq = state->notchFreq->getNumericValue();
-        applyNotchFilter(waveform, notchFreq, (double) NotchBandwidth, sampleRate);
+        applyNotchFilter(numSamples, numStreams, state->notchFreq->getNumericValue(), (double) NotchBandwidth,
+                         state->sampleRate->getNumericValue());
     }
 
-    int period = round(sampleRate / frequency);
-    int startIndex = 0;
-    int endIndex = startIndex + numPeriods * period - 1;
+    // Perform correlation with sine and cosine waveforms.  The inner loop runs across streams so that it vectorizes.
+    const int numTones = (int) testWaveform.harmonics.size();
+    const int length = testWaveform.windowLength;
+    inPhase.assign(numTones * numStreams, 0.0);
+    quadrature.assign(numTones * numStreams, 0.0);
+    for (int tone = 0; tone < numTones; ++tone) {
+        double* meanI = &inPhase[tone * numStreams];
+        double* meanQ = &quadrature[tone * numStreams];
+        const double* cosine = &testWaveform.cosineTable[tone * length];
+        const double* sine = &testWaveform.sineTable[tone * length];
+        for (int i = 0; i < length; ++i) {
+            const double c = cosine[i];
+            const double s = sine[i];
+            const double* w = &waveforms[(testWaveform.windowStart + i) * numStreams];
+            for (int stream = 0; stream < numStreams; ++stream) {
+                meanI[stream] += w[stream] * c;
+                meanQ[stream] += w[stream] * s;
+            }
+        }
+    }
 
-    // Move the measurement window to the end of the waveform to ignore start-up transient.
-    while (endIndex < samplesPerDataBlock * numBlocks - period) {
-        startIndex += period;
-        endIndex += period;
+    for (int tone = 0; tone < numTones; ++tone) {
+        for (int stream = 0; stream < numStreams; ++stream) {
+            if ((state->chipType[stream] == RHD2164MISOBChip) != step.misoB) continue;
+
+            double realComponent = 2.0 * inPhase[tone * numStreams + stream] / (double) length;
+            double imagComponent = 2.0 * quadrature[tone * numStreams + stream] / (double) length;
+
+            ComplexPolar result;
+            result.magnitude = sqrt(realComponent * realComponent + imagComponent * imagComponent);
+            result.phase = RadiansToDegrees * atan2(imagComponent, realComponent);
+            amplitudes[tone][stream][step.channel][step.capRange] = result;
+        }
     }
+}
 
-    return amplitudeOfFreqComponent(waveform, startIndex, endIndex, sampleRate, frequency);
+// Copy one chip channel of every stream from raw USB data to waveforms (in microvolts), in a single pass.
+void ImpedanceReader::extractChannel(const uint16_t* usbWords, int numSamples, int numStreams, int chipChannel)
+{
+    ControllerType type = state->getControllerTypeEnum();
+    int misoWordSize = ((type == ControllerStimRecord) ? 2 : 1);
+    int frameSizeInWords = RHXDataBlock::dataBlockSizeInWords(type, numStreams) / RHXDataBlock::samplesPerDataBlock(type);
+
+    int offset = 6;  // Skip header and timestamp.
+    offset += misoWordSize * (numStreams * 3);  // Skip auxillary channels.
+    offset += misoWordSize * numStreams * chipChannel;  // Align with selected channel.
+    if (type == ControllerStimRecord) offset++;  // Skip top 16 bits of 32-bit MISO word from RHS system.
+
+    waveforms.resize(numSamples * numStreams);
+    double* pWrite = waveforms.data();
+    for (int t = 0; t < numSamples; ++t) {
+        const uint16_t* pRead = usbWords + t * frameSizeInWords + offset;
+        for (int stream = 0; stream < numStreams; ++stream) {
+            *pWrite++ = 0.195 * (double)((int) pRead[stream * misoWordSize] - 32768);
+        }
+    }
 }
 
-void ImpedanceReader::applyNotchFilter(std::vector<double> &waveform, double fNotch, double bandwidth, double sampleRate) const
+void ImpedanceReader::applyNotchFilter(int numSamples, int numStreams, double fNotch, double bandwidth, double sampleRate)
 {
     double d = exp(-1.0 * Pi * bandwidth / sampleRate);
     double b = (1.0 + d * d) * cos(TwoPi * fNotch / sampleRate);
@@ -483,41 +764,26 @@ void ImpedanceReader::applyNotchFilter(std::vector<double> &waveform, double fNo
     double b2 = b0;
     double a1 = b1;
     double a2 = d * d;
-    int length = (int) waveform.size();
 
-    double prevPrevIn = waveform[0];
-    double prevIn = waveform[1];
-    for (int t = 2; t < length; ++t) {
-        double in = waveform[t];
-        waveform[t] = b0 * in + b1 * prevIn + b2 * prevPrevIn - a1 * waveform[t - 1] - a2 * waveform[t - 2];  // Direct Form 1 implementation
-        prevPrevIn = prevIn;
-        prevIn = in;
+    notchState.resize(2 * numStreams);
+    double* prevPrevIn = notchState.data();
+    double* prevIn = prevPrevIn + numStreams;
+    for (int stream = 0; stream < numStreams; ++stream) {
+        prevPrevIn[stream] = waveforms[stream];
+        prevIn[stream] = waveforms[numStreams + stream];
     }
-}
-
-ComplexPolar ImpedanceReader::amplitudeOfFreqComponent(const std::vector<double> &waveform, int startIndex, int endIndex,
-                                                       double sampleRate, double frequency)
-{
-    const double K = TwoPi * frequency / sampleRate;  // precalculate for speed
-
-    // Perform correlation with sine and cosine waveforms.
-    double meanI = 0.0;
-    double meanQ = 0.0;
-    for (int t = startIndex; t <= endIndex; ++t) {
-        meanI += waveform[t] * cos(K * t);
-        meanQ += waveform[t] * -1.0 * sin(K * t);
+    for (int t = 2; t < numSamples; ++t) {
+        double* out = &waveforms[t * numStreams];
+        const double* prevOut = out - numStreams;
+        const double* prevPrevOut = prevOut - numStreams;
+        for (int stream = 0; stream < numStreams; ++stream) {
+            double in = out[stream];
+            out[stream] = b0 * in + b1 * prevIn[stream] + b2 * prevPrevIn[stream] - a1 * prevOut[stream] -
+                    a2 * prevPrevOut[stream];  // Direct Form 1 implementation
+            prevPrevIn[stream] = prevIn[stream];
+            prevIn[stream] = in;
+        }
     }
-    double length = (double)(endIndex - startIndex + 1);
-    meanI /= length;
-    meanQ /= length;
-
-    double realComponent = 2.0 * meanI;
-    double imagComponent = 2.0 * meanQ;
-
-    ComplexPolar result;
-    result.magnitude = sqrt(realComponent * realComponent + imagComponent * imagComponent);
-    result.phase = RadiansToDegrees * atan2(imagComponent, realComponent);
-    return result;
 }
 
 bool ImpedanceReader::saveImpedances()
@@ -574,39 +840,98 @@ bool ImpedanceReader::saveImpedances()
     return true;
 }
 
-void ImpedanceReader::runDemoImpedanceMeasurement()
+// Save the last impedance spectrum measurement, in CSV or binary format as selected by impedanceSpectrumFileFormat.
+//
+// The binary format is little-endian, with 32-bit floating-point numbers and QStrings as written by QDataStream:
+//   uint32 ImpedanceSpectrumFileMagicNumber; int16 major version (1); int16 minor version (0);
+//   float sample rate (Hz); uint16 number of frequencies; float frequencies (Hz);
+//   uint32 number of channels; and for each channel: QString native name; QString custom name; uint8 enabled;
+//   and for each frequency, float impedance magnitude (ohms) and float impedance phase (degrees).
+bool ImpedanceReader::saveImpedanceSpectra()
 {
-    ControllerType controllerType = state->getControllerTypeEnum();
-    int numChannelsPerStream = RHXDataBlock::channelsPerStream(controllerType);
-
-    // Create a progress bar to let user know how long this will take.
-    int maxProgress = (controllerType == ControllerStimRecord) ? 50 : 98;
-    QProgressDialog progress(QObject::tr("Measuring Electrode Impedances"), QString(), 0, maxProgress);
-    progress.setWindowTitle(QObject::tr("Progress"));
-    progress.setMinimumDuration(0);
-    progress.setModal(true);
-    progress.setValue(0);
+    std::vector<double> frequencies;
+    const QStringList fields = state->actualImpedanceSpectrumFreqs->getValueString().split(',', Qt::SkipEmptyParts);
+    for (const QString& field : fields) {
+        frequencies.push_back(field.toDouble());
+    }
+    if (frequencies.empty()) return false;
 
-    QElapsedTimer timer;
-    timer.start();
-    for (int i = 1; i < maxProgress; ++i) {
-        progress.setValue(i);
-        while (timer.nsecsElapsed() < qint64(50000000)) {
-            qApp->processEvents();
+    std::vector<Channel*> channels;
+    int numChannelsPerStream = RHXDataBlock::channelsPerStream(state->getControllerTypeEnum());
+    for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
+        for (int channel = 0; channel < numChannelsPerStream; ++channel) {
+            Channel* signalChannel = state->signalSources->getAmplifierChannel(stream, channel);
+            if (signalChannel && signalChannel->getImpedanceSpectrumMagnitudes().size() == frequencies.size()) {
+                channels.push_back(signalChannel);
+            }
         }
-        timer.restart();
     }
 
-    for (int channel = 0; channel < numChannelsPerStream; ++channel) {
-        for (int stream = 0; stream < rhxController->getNumEnabledDataStreams(); ++stream) {
-            Channel* signalChannel = state->signalSources->getAmplifierChannel(stream, channel);
-            if (signalChannel) {
-                signalChannel->setImpedance(100.0e3, -70.0);  // Dummy impedance values for demo mode.
+    bool binary = state->impedanceSpectrumFileFormat->getValue() == "Binary";
+    QString fileName = state->impedanceFilename->getFullFilename();
+    QString extension = binary ? ".dat" : ".csv";
+    if (fileName.right(4).toLower() != extension) {
+        fileName += extension;
+    }
+    QFile file(fileName);
+
+    if (binary) {
+        if (!file.open(QIODevice::WriteOnly)) return false;
+        QDataStream out(&file);
+        out.setVersion(QDataStream::Qt_5_11);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        out << (quint32) ImpedanceSpectrumFileMagicNumber;
+        out << (qint16) 1 << (qint16) 0;
+        out << (float) state->sampleRate->getNumericValue();
+        out << (quint16) frequencies.size();
+        for (double frequency : frequencies) {
+            out << (float) frequency;
+        }
+        out << (quint32) channels.size();
+        for (const Channel* signalChannel : channels) {
+            out << signalChannel->getNativeName();
+            out << signalChannel->getCustomName();
+            out << (quint8) signalChannel->isEnabled();
+            const std::vector<double>& magnitudes = signalChannel->getImpedanceSpectrumMagnitudes();
+            const std::vector<double>& phases = signalChannel->getImpedanceSpectrumPhases();
+            for (int i = 0; i < (int) frequencies.size(); ++i) {
+                out << (float) magnitudes[i] << (float) phases[i];
             }
         }
+    } else {
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+        QTextStream out(&file);
+
+        out << "Channel Number,Channel Name,Port,Enabled";
+        for (double frequency : frequencies) {
+            out << ",Impedance Magnitude at " << frequency << " Hz (ohms)";
+            out << ",Impedance Phase at " << frequency << " Hz (degrees)";
+        }
+        out << EndOfLine;
+
+        for (const Channel* signalChannel : channels) {
+            out << signalChannel->getNativeName() << ",";
+            out << signalChannel->getCustomName() << ",";
+            out << signalChannel->getGroupName() << ",";
+            out << signalChannel->isEnabled();
+
+            const std::vector<double>& magnitudes = signalChannel->getImpedanceSpectrumMagnitudes();
+            const std::vector<double>& phases = signalChannel->getImpedanceSpectrumPhases();
+            for (int i = 0; i < (int) frequencies.size(); ++i) {
+                out.setRealNumberNotation(QTextStream::ScientificNotation);
+                out.setRealNumberPrecision(2);
+                out << "," << magnitudes[i];
+
+                out.setRealNumberNotation(QTextStream::FixedNotation);
+                out.setRealNumberPrecision(0);
+                out << "," << phases[i];
+            }
+            out << EndOfLine;
+        }
     }
-    progress.setValue(progress.maximum());
 
-    state->impedancesHaveBeenMeasured->setValue(true);
-    state->displayLabelText->setValue("Impedance Magnitude");
+    file.close();
+    return true;
 }
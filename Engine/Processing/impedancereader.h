@@ -31,37 +31,98 @@
 #ifndef IMPEDANCEREADER_H
 #define IMPEDANCEREADER_H
 
+#include <QElapsedTimer>
+#include <cstdint>
 #include <vector>
-#include <deque>
 
 #include "systemstate.h"
 #include "abstractrhxcontroller.h"
 #include "rhxdatablock.h"
+#include "rhxregisters.h"
 
 struct ComplexPolar {
     double magnitude;
     double phase;
 };
 
+// Measures the impedance of every amplifier channel with the on-chip impedance test circuit.  Each measurement step
+// tests one channel (on every data stream at once) with one series capacitor and one Zcheck DAC test waveform.  Steps
+// are pipelined: while the controller acquires data for one step, the data from the previous step are analyzed.
+//
+// measureImpedances() uses a sine wave at the impedance test frequency.  measureImpedanceSpectra() measures at every
+// frequency in desiredImpedanceSpectrumFreqs, combining frequencies that are (nearly) harmonics of a common period into
+// one multi-tone waveform, so that one sweep of steps measures all of them.
 class ImpedanceReader
 {
 public:
     ImpedanceReader(SystemState* state_,  AbstractRHXController* rhxController_);
     bool measureImpedances();
     bool saveImpedances();
+    bool measureImpedanceSpectra();
+    bool saveImpedanceSpectra();
 
 private:
+    const int MaxTonesPerWaveform = 8;                  // More tones would leave too little DAC amplitude for each
+    const double SpectrumFrequencyTolerance = 0.02;     // Largest relative shift of a frequency to share a waveform
+
+    // One period of a Zcheck DAC waveform, carrying test tones at harmonics of (sample rate / period).
+    struct TestWaveform {
+        int period;
+        std::vector<int> harmonics;
+        std::vector<unsigned int> dacCommandList;
+        std::vector<double> dacAmplitude;       // Per tone, in volts
+        std::vector<double> currentPhase;       // Per tone: phase of the test current in the cosine reference, in degrees
+        int numBlocks;
+        int windowStart;
+        int windowLength;
+        std::vector<double> cosineTable;        // [tone][i]: cos(K t) over the measurement window
+        std::vector<double> sineTable;          // [tone][i]: -sin(K t) over the measurement window
+    };
+
+    // One acquisition: chip channel 'channel' tested with series capacitor capRange (0-2) on every stream.  If misoB is
+    // true, channel + 32 is tested on RHD2164 chips, and only their MISO B streams are analyzed.
+    struct MeasurementStep {
+        int waveform;
+        int capRange;
+        int channel;
+        bool misoB;
+    };
+
+    typedef std::vector<std::vector<std::vector<ComplexPolar> > > ComplexAmplitudes;  // [stream][channel][capRange]
+    typedef std::vector<std::vector<std::vector<ComplexPolar> > > ChannelImpedances;  // [stream][channel][tone]
+
     SystemState* state;
     AbstractRHXController* rhxController;
 
+    // Reused for every step.
+    std::vector<uint8_t> rawBuffers[2];     // Raw USB data of the step being acquired and the step being analyzed
+    std::vector<double> waveforms;          // [sample][stream], in microvolts
+    std::vector<double> inPhase;            // [tone][stream]
+    std::vector<double> quadrature;         // [tone][stream]
+    std::vector<double> notchState;         // Previous two inputs of the notch filter, per stream
+    std::vector<unsigned int> commandList;
+
+    // Started when the controller starts running each step.
+    QElapsedTimer acquisitionTimer;
+    qint64 acquisitionMsec;                 // Expected duration of the step's acquisition
+
     static double approximateSaturationVoltage(double actualZFreq, double highCutoff);
     static ComplexPolar factorOutParallelCapacitance(ComplexPolar impedance, double frequency, double parasiticCapacitance);
-    ComplexPolar measureComplexAmplitude(const std::deque<RHXDataBlock*> &dataQueue, int stream, int chipChannel,
-                                         double sampleRate, double frequency, int numPeriods, QDataStream *outStream = nullptr) const;
-    void applyNotchFilter(std::vector<double> &waveform, double fNotch, double bandwidth, double sampleRate) const;
-    static ComplexPolar amplitudeOfFreqComponent(const std::vector<double> &waveform, int startIndex, int endIndex,
-                                                 double sampleRate, double frequency);
-    void runDemoImpedanceMeasurement();
+
+    std::vector<TestWaveform> planSpectrumWaveforms(const std::vector<double>& frequencies) const;
+    void prepareTestWaveform(TestWaveform& testWaveform) const;
+    bool measureTestWaveforms(std::vector<TestWaveform>& testWaveforms, const QString& progressText,
+                              ChannelImpedances& impedances);
+    void startAcquisition(const MeasurementStep& step, const TestWaveform& testWaveform, bool newWaveform,
+                          RHXRegisters& chipRegisters);
+    bool finishAcquisition(int numBlocks, std::vector<uint8_t>& buffer);
+    static void waitInEventLoop(qint64 msec);
+    void analyzeAcquisition(const MeasurementStep& step, const TestWaveform& testWaveform,
+                            const std::vector<uint8_t>& buffer, std::vector<ComplexAmplitudes>& amplitudes);
+    void calculateImpedances(const TestWaveform& testWaveform, const std::vector<ComplexAmplitudes>& amplitudes,
+                             int stream, int channel, std::vector<ComplexPolar>& impedances) const;
+    void extractChannel(const uint16_t* usbWords, int numSamples, int numStreams, int chipChannel);
+    void applyNotchFilter(int numSamples, int numStreams, double fNotch, double bandwidth, double sampleRate);
 };
 
 #endif // IMPEDANCEREADER_H
@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "signalsources.h"
+#include "noiseestimator.h"
+
+// Histogram bin of |x| for a raw high-pass sample x (offset binary).  Bin 0 holds |x| = 0; above that, the float
+// exponent and top three mantissa bits of |x| give eight bins per octave, so bins 1..121 cover 1 to 32768 ADC steps.
+static inline int noiseBin(uint16_t raw)
+{
+    int magnitude = std::abs((int) raw - 32768);
+    if (magnitude == 0) return 0;
+    float f = (float) magnitude;
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return (int) (bits >> 20) - (127 << 3) + 1;
+}
+
+// Lower edge of bin k, treating each integer |x| as the interval [|x| - 0.5, |x| + 0.5) so that interpolation within a
+// bin is not biased by ADC quantization.  Below 8 ADC steps the bins are narrower than one step, so each nonempty bin
+// holds a single integer; rounding the nominal edge up to an integer keeps the interpolation width at one full step
+// there (empty bins in between get zero width).
+static inline float binLowerEdge(int k)
+{
+    if (k == 0) return 0.0F;
+    --k;
+    return std::ceil(std::ldexp(1.0F + 0.125F * (float) (k & 7), k >> 3)) - 0.5F;
+}
+
+// Median of |x| (in ADC steps) from a histogram, interpolated linearly within the bin containing it.
+static float histogramMedian(const float* histogram)
+{
+    float total = 0.0F;
+    for (int k = 0; k < NoiseHistogramBins; ++k) {
+        total += histogram[k];
+    }
+    float half = 0.5F * total;
+    float cumulative = 0.0F;
+    for (int k = 0; k < NoiseHistogramBins; ++k) {
+        if (histogram[k] > 0.0F && cumulative + histogram[k] >= half) {
+            float fraction = (half - cumulative) / histogram[k];
+            float lower = binLowerEdge(k);
+            return lower + fraction * (binLowerEdge(k + 1) - lower);
+        }
+        cumulative += histogram[k];
+    }
+    return 0.0F;
+}
+
+NoiseEstimator::NoiseEstimator(SystemState* state_) :
+    state(state_),
+    configChanged(true),
+    samplesAnalyzed(0),
+    sampleOffset(0),
+    samplesUntilUpdate(0),
+    updateIntervalSamples(0),
+    minimumSamples(0),
+    numUpdates(0)
+{
+}
+
+void NoiseEstimator::reset()
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    configChanged = true;
+}
+
+void NoiseEstimator::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
+{
+    if (!isEnabled()) return;
+
+    std::lock_guard<std::mutex> lock(configMutex);
+    if (configChanged) {
+        configure(waveformFifo);
+    }
+    if (waveformAddresses.empty()) return;
+
+    // Every NoiseDownsampleFactor-th sample is analyzed, continuing across blocks from sampleOffset.  Both
+    // samplesUntilUpdate and updateIntervalSamples are multiples of NoiseDownsampleFactor, so updates fall exactly
+    // between two analyzed samples.
+    int timeIndex = sampleOffset;
+    while (timeIndex < numSamples) {
+        int span = std::min(numSamples - timeIndex, samplesUntilUpdate);
+        int numAnalyzed = (span + NoiseDownsampleFactor - 1) / NoiseDownsampleFactor;
+        addSamples(waveformFifo, reader, timeIndex, numAnalyzed);
+        timeIndex += numAnalyzed * NoiseDownsampleFactor;
+        samplesUntilUpdate -= numAnalyzed * NoiseDownsampleFactor;
+        if (samplesUntilUpdate <= 0) {
+            publishEstimates();
+            samplesUntilUpdate += updateIntervalSamples;
+        }
+    }
+    sampleOffset = timeIndex - numSamples;
+}
+
+void NoiseEstimator::configure(WaveformFifo* waveformFifo)
+{
+    channelHandles.clear();
+    waveformAddresses.clear();
+    for (int handle : state->signalSources->amplifierChannelHandles()) {
+        std::string waveName = state->signalSources->channelByHandle(handle)->getNativeNameString() + "|HIGH";
+        GpuWaveformAddress address = waveformFifo->gpuWaveformAddressByHandle(waveformFifo->getWaveformHandle(waveName));
+        if (address.waveformIndex < 0) {
+            std::cerr << "NoiseEstimator::configure: waveform " << waveName << " not found." << '\n';
+            continue;
+        }
+        channelHandles.push_back(handle);
+        waveformAddresses.push_back(address);
+    }
+    histograms.assign(waveformAddresses.size() * NoiseHistogramBins, 0.0F);
+
+    double analyzedSampleRate = state->sampleRate->getNumericValue() / (double) NoiseDownsampleFactor;
+    updateIntervalSamples = NoiseDownsampleFactor * std::max((int) std::lround(NoiseUpdateIntervalSeconds * analyzedSampleRate), 1);
+    minimumSamples = (int) std::lround(NoiseMinimumSeconds * analyzedSampleRate);
+    samplesUntilUpdate = updateIntervalSamples;
+    sampleOffset = 0;
+    samplesAnalyzed = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        noiseLevels.assign(state->signalSources->numChannelHandles(), -1.0F);
+        numUpdates = 0;
+    }
+    configChanged = false;
+}
+
+// Add numAnalyzed samples of every channel, starting at timeIndex and spaced NoiseDownsampleFactor apart, to the
+// channel histograms.
+void NoiseEstimator::addSamples(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int timeIndex, int numAnalyzed)
+{
+    if ((int) rawBuffer.size() < NoiseBatchWidth * numAnalyzed) {
+        rawBuffer.resize(NoiseBatchWidth * numAnalyzed);
+    }
+    uint16_t* raw[NoiseBatchWidth];
+    for (int c = 0; c < NoiseBatchWidth; ++c) {
+        raw[c] = &rawBuffer[c * numAnalyzed];
+    }
+
+    const int numChannels = (int) waveformAddresses.size();
+    for (int first = 0; first < numChannels; first += NoiseBatchWidth) {
+        int n = std::min(NoiseBatchWidth, numChannels - first);
+        waveformFifo->copyGpuAmplifierChannelsRaw(reader, raw, &waveformAddresses[first], n, timeIndex, numAnalyzed,
+                                                  NoiseDownsampleFactor);
+        for (int c = 0; c < n; ++c) {
+            float* histogram = &histograms[(first + c) * NoiseHistogramBins];
+            const uint16_t* samples = raw[c];
+            for (int t = 0; t < numAnalyzed; ++t) {
+                histogram[noiseBin(samples[t])] += 1.0F;
+            }
+        }
+    }
+    samplesAnalyzed += numAnalyzed;
+}
+
+// Publish new estimates (once enough data have been analyzed), then decay the histograms so older data gradually lose
+// their influence.
+void NoiseEstimator::publishEstimates()
+{
+    const int numChannels = (int) channelHandles.size();
+    if (samplesAnalyzed >= minimumSamples) {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        for (int i = 0; i < numChannels; ++i) {
+            // MAD / 0.6745 estimates the standard deviation of Gaussian noise.
+            float mad = histogramMedian(&histograms[i * NoiseHistogramBins]);
+            noiseLevels[channelHandles[i]] = 0.195F * mad / 0.6745F;
+        }
+        ++numUpdates;
+    }
+
+    double timeConstant = (double) state->noiseTimeConstant->getValue();
+    float decay = (float) std::exp(-NoiseUpdateIntervalSeconds / timeConstant);
+    for (float& count : histograms) {
+        count *= decay;
+    }
+}
+
+uint64_t NoiseEstimator::getNumUpdates() const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return numUpdates;
+}
+
+float NoiseEstimator::getNoiseLevel(int channelHandle) const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (channelHandle < 0 || channelHandle >= (int) noiseLevels.size()) return -1.0F;
+    return noiseLevels[channelHandle];
+}
+
+uint64_t NoiseEstimator::getNoiseLevels(std::vector<float>& levels) const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    levels = noiseLevels;
+    return numUpdates;
+}
@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef NOISEESTIMATOR_H
+#define NOISEESTIMATOR_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "analysisthread.h"
+#include "systemstate.h"
+#include "waveformfifo.h"
+
+const int NoiseHistogramBins = 128;         // Covers |x| from 0 to 32768 ADC steps (see noiseBin())
+const int NoiseBatchWidth = 16;             // Channels copied from WaveformFifo together
+const int NoiseDownsampleFactor = 4;        // Analyze every fourth high-pass sample
+const double NoiseUpdateIntervalSeconds = 0.5;
+const double NoiseMinimumSeconds = 1.0;     // Data needed before the first estimate is published
+
+// Tracks the noise level of every amplifier channel on AnalysisThread, without interrupting acquisition.  The noise
+// level is the median absolute deviation of the high-pass amplifier waveform, scaled by 1/0.6745 to estimate the
+// standard deviation of Gaussian noise; unlike RMS, the median is barely affected by spikes.
+//
+// The median is read from a per-channel histogram of |x| with eight bins per octave (a quantile sketch with 12.5%
+// bin width, interpolated within each bin).  Every NoiseUpdateIntervalSeconds the histograms decay by
+// exp(-interval / NoiseTimeConstantSeconds), so estimates follow slow drift over long recordings, and the new estimates
+// are published.  Results are read from any thread, indexed by channel handle (see SignalSources::channelByHandle()).
+class NoiseEstimator : public AnalysisClient
+{
+public:
+    explicit NoiseEstimator(SystemState* state_);
+
+    // Estimation runs while NoiseEstimationEnabled or ThresholdTrackingEnabled is true.
+    bool isEnabled() const { return state->noiseEstimationEnabled->getValue() || state->thresholdTrackingEnabled->getValue(); }
+    void reset();   // Discard all estimates and restart with the next block of data (e.g., at the start of a new run).
+
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
+
+    // Number of times new estimates have been published since the last reset().
+    uint64_t getNumUpdates() const;
+    // Noise level (in microvolts) of the channel with this handle, or a negative value if none has been estimated.
+    float getNoiseLevel(int channelHandle) const;
+    // Copy noise levels of all channels to levels, indexed by channel handle.  Returns getNumUpdates().
+    uint64_t getNoiseLevels(std::vector<float>& levels) const;
+
+private:
+    SystemState* state;
+
+    std::mutex configMutex;
+    bool configChanged;
+
+    // Used only on AnalysisThread.
+    std::vector<int> channelHandles;
+    std::vector<GpuWaveformAddress> waveformAddresses;
+    std::vector<float> histograms;              // NoiseHistogramBins per channel
+    std::vector<uint16_t> rawBuffer;
+    int64_t samplesAnalyzed;                    // Per channel, since the last reset()
+    int sampleOffset;                           // Time index of the next analyzed sample in the next block
+    int samplesUntilUpdate;
+    int updateIntervalSamples;
+    int minimumSamples;
+
+    // Results, read by any thread.
+    mutable std::mutex resultMutex;
+    std::vector<float> noiseLevels;             // By channel handle
+    uint64_t numUpdates;
+
+    void configure(WaveformFifo* waveformFifo);
+    void addSamples(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int timeIndex, int numAnalyzed);
+    void publishEstimates();
+};
+
+#endif // NOISEESTIMATOR_H
@@ -0,0 +1,223 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include "pipelineprofiler.h"
+
+PipelineProfiler::PipelineProfiler() :
+    enabled(false),
+    samplesPerDataBlock(128),
+    blockTimes(NumPipelineStages * RingBlocks),
+    tracing(false)
+{
+    resetStatistics();
+}
+
+PipelineProfiler::~PipelineProfiler()
+{
+    stop();
+}
+
+void PipelineProfiler::start(bool enabled_, int samplesPerDataBlock_, const std::string& traceFileName)
+{
+    stop();
+    samplesPerDataBlock = samplesPerDataBlock_;
+    resetStatistics();
+    for (int stage = 0; stage < NumPipelineStages; ++stage) {
+        samplesPassed[stage].store(0);
+    }
+
+    if (enabled_ && !traceFileName.empty()) {
+        traceFile.open(traceFileName, std::ios::out | std::ios::trunc);
+        if (traceFile.is_open()) {
+            traceFile << "block,stage,time_ns,latency_ns\n";
+            tracing = true;
+        } else {
+            std::cerr << "Error: PipelineProfiler could not open trace file " << traceFileName << '\n';
+        }
+    }
+    enabled = enabled_;
+}
+
+void PipelineProfiler::stop()
+{
+    enabled = false;
+    std::lock_guard<std::mutex> lock(traceMutex);
+    tracing = false;
+    if (traceFile.is_open()) traceFile.close();
+}
+
+void PipelineProfiler::resetStatistics()
+{
+    for (int stage = 0; stage < NumPipelineStages; ++stage) {
+        StageStatistics& stats = statistics[stage];
+        for (int bin = 0; bin < NumLatencyBins; ++bin) {
+            stats.latencyBins[bin].store(0);
+        }
+        stats.count.store(0);
+        stats.totalLatencyNs.store(0);
+        stats.maxLatencyNs.store(0);
+        stats.maxQueueDepth.store(0);
+    }
+}
+
+int64_t PipelineProfiler::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PipelineStage PipelineProfiler::upstreamStage(PipelineStage stage)
+{
+    if (stage >= StageReaderDisplay) return StageWaveformCommit;
+    if (stage == StageUsbRead) return StageUsbRead;
+    return (PipelineStage) (stage - 1);
+}
+
+// Note that numSamples passed this stage at time now.  Every data block completed by these samples is time stamped, and
+// its latency since StageUsbRead is added to this stage's histogram.
+void PipelineProfiler::record(PipelineStage stage, int numSamples, int64_t now)
+{
+    if (!enabled) return;
+
+    int64_t samplesBefore = samplesPassed[stage].load(std::memory_order_relaxed);
+    int64_t samplesAfter = samplesBefore + numSamples;
+    int64_t firstBlock = samplesBefore / samplesPerDataBlock;
+    int64_t endBlock = samplesAfter / samplesPerDataBlock;
+    int64_t usbBlocks = samplesPassed[StageUsbRead].load(std::memory_order_acquire) / samplesPerDataBlock;
+    StageStatistics& stats = statistics[stage];
+
+    for (int64_t block = firstBlock; block < endBlock; ++block) {
+        int slot = (int) (block & (RingBlocks - 1));
+        blockTimes[stage * RingBlocks + slot].store(now, std::memory_order_relaxed);
+
+        int64_t latency = 0;
+        if (stage != StageUsbRead && block < usbBlocks && usbBlocks - block <= RingBlocks) {
+            latency = now - blockTimes[StageUsbRead * RingBlocks + slot].load(std::memory_order_relaxed);
+            if (latency < 0) latency = 0;
+            int bin = 0;
+            int64_t latencyUs = latency / 1000;
+            while (latencyUs > 1 && bin < NumLatencyBins - 1) {
+                latencyUs >>= 1;
+                ++bin;
+            }
+            stats.latencyBins[bin].fetch_add(1, std::memory_order_relaxed);
+            stats.count.fetch_add(1, std::memory_order_relaxed);
+            stats.totalLatencyNs.fetch_add(latency, std::memory_order_relaxed);
+            if (latency > stats.maxLatencyNs.load(std::memory_order_relaxed)) {
+                stats.maxLatencyNs.store(latency, std::memory_order_relaxed);
+            }
+        }
+
+        if (tracing) {
+            std::lock_guard<std::mutex> lock(traceMutex);
+            if (traceFile.is_open()) {
+                traceFile << block << ',' << stageName(stage) << ',' << now << ',' << latency << '\n';
+            }
+        }
+    }
+    samplesPassed[stage].store(samplesAfter, std::memory_order_release);
+
+    PipelineStage upstream = upstreamStage(stage);
+    if (upstream != stage) {
+        int64_t queueDepth = samplesPassed[upstream].load(std::memory_order_acquire) / samplesPerDataBlock - endBlock;
+        if (queueDepth > stats.maxQueueDepth.load(std::memory_order_relaxed)) {
+            stats.maxQueueDepth.store(queueDepth, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Return upper bound (in microseconds) of the histogram bin containing the given fraction of recorded latencies.
+int64_t PipelineProfiler::percentileUs(const StageStatistics& stats, double fraction) const
+{
+    int64_t count = stats.count.load(std::memory_order_relaxed);
+    if (count == 0) return 0;
+    int64_t target = (int64_t) (fraction * (double) count);
+    int64_t cumulative = 0;
+    for (int bin = 0; bin < NumLatencyBins; ++bin) {
+        cumulative += stats.latencyBins[bin].load(std::memory_order_relaxed);
+        if (cumulative > target) return (int64_t) 2 << bin;
+    }
+    return (int64_t) 2 << (NumLatencyBins - 1);
+}
+
+// One entry per stage: blocks passed, mean/p50/p99/max latency since USB read (microseconds), and the deepest queue
+// seen between this stage and the stage feeding it (data blocks).
+PipelineStageSummary PipelineProfiler::summary(PipelineStage stage) const
+{
+    const StageStatistics& stats = statistics[stage];
+    int64_t count = stats.count.load(std::memory_order_relaxed);
+
+    PipelineStageSummary result;
+    result.blocks = samplesPassed[stage].load(std::memory_order_relaxed) / samplesPerDataBlock;
+    result.meanLatencyUs = count > 0 ? stats.totalLatencyNs.load(std::memory_order_relaxed) / count / 1000 : 0;
+    result.p50LatencyUs = percentileUs(stats, 0.5);
+    result.p99LatencyUs = percentileUs(stats, 0.99);
+    result.maxLatencyUs = stats.maxLatencyNs.load(std::memory_order_relaxed) / 1000;
+    result.maxQueueDepth = stats.maxQueueDepth.load(std::memory_order_relaxed);
+    return result;
+}
+
+std::string PipelineProfiler::report() const
+{
+    std::ostringstream out;
+    for (int s = 0; s < NumPipelineStages; ++s) {
+        PipelineStage stage = (PipelineStage) s;
+        PipelineStageSummary stageSummary = summary(stage);
+        if (s > 0) out << "; ";
+        out << stageName(stage) << " blocks=" << stageSummary.blocks;
+        if (stage != StageUsbRead) {
+            out << " meanUs=" << stageSummary.meanLatencyUs << " p50Us<=" << stageSummary.p50LatencyUs <<
+                   " p99Us<=" << stageSummary.p99LatencyUs << " maxUs=" << stageSummary.maxLatencyUs;
+        }
+        if (upstreamStage(stage) != stage) {
+            out << " maxQueue=" << stageSummary.maxQueueDepth;
+        }
+    }
+    return out.str();
+}
+
+const char* PipelineProfiler::stageName(PipelineStage stage)
+{
+    switch (stage) {
+    case StageUsbRead: return "UsbRead";
+    case StageFifoWrite: return "FifoWrite";
+    case StageXpuDone: return "XpuDone";
+    case StageWaveformCommit: return "WaveformCommit";
+    case StageReaderDisplay: return "Display";
+    case StageReaderDisk: return "Disk";
+    case StageReaderAudio: return "Audio";
+    case StageReaderTCP: return "TCP";
+    case StageReaderAnalysis: return "Analysis";
+    default: return "Unknown";
+    }
+}
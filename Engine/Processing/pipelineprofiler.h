@@ -0,0 +1,120 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef PIPELINEPROFILER_H
+#define PIPELINEPROFILER_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Points in the acquisition pipeline at which data blocks are time stamped.  The reader stages are in the same order
+// as WaveformFifo::Reader, so a reader's stage is StageReaderDisplay + reader.
+enum PipelineStage {
+    StageUsbRead = 0,       // USBDataThread: data read from controller
+    StageFifoWrite,         // USBDataThread: data written to DataStreamFifo
+    StageXpuDone,           // WaveformProcessorThread: filtering and spike detection complete
+    StageWaveformCommit,    // WaveformProcessorThread: data committed to WaveformFifo
+    StageReaderDisplay,     // Data released by each WaveformFifo reader
+    StageReaderDisk,
+    StageReaderAudio,
+    StageReaderTCP,
+    StageReaderAnalysis,
+    NumPipelineStages
+};
+
+// Statistics for one stage, as returned by PipelineProfiler::summary().  Latencies are in microseconds; percentiles
+// are upper bounds taken from the log2 histogram.
+struct PipelineStageSummary {
+    int64_t blocks;
+    int64_t meanLatencyUs;
+    int64_t p50LatencyUs;
+    int64_t p99LatencyUs;
+    int64_t maxLatencyUs;
+    int64_t maxQueueDepth;
+};
+
+// Records the time at which every data block passes each pipeline stage, and accumulates histograms of latency
+// (measured from StageUsbRead) and queue depth (blocks waiting between a stage and the stage feeding it).  Each stage
+// must be recorded from a single thread; statistics may be read from any thread.  When disabled, record() returns
+// immediately.
+class PipelineProfiler
+{
+public:
+    PipelineProfiler();
+    ~PipelineProfiler();
+
+    // Call only while the pipeline threads are idle.  If traceFileName is not empty, every block and stage is also
+    // written to that file as CSV (block,stage,time_ns,latency_ns).
+    void start(bool enabled_, int samplesPerDataBlock_, const std::string& traceFileName = std::string());
+    void stop();
+    void resetStatistics();
+    bool isEnabled() const { return enabled; }
+
+    void record(PipelineStage stage, int numSamples) { if (enabled) record(stage, numSamples, nowNs()); }
+    // As above, but time stamp the blocks with timeNs (taken earlier from nowNs()) instead of the current time.
+    void record(PipelineStage stage, int numSamples, int64_t timeNs);
+    static int64_t nowNs();
+
+    PipelineStageSummary summary(PipelineStage stage) const;
+    std::string report() const;
+    static const char* stageName(PipelineStage stage);
+
+private:
+    static const int RingBlocks = 4096;  // Must be a power of two.
+    static const int NumLatencyBins = 32;  // Bin k holds latencies in [2^k, 2^(k+1)) microseconds; bin 0 also holds < 1 us.
+
+    struct StageStatistics {
+        std::atomic<int64_t> latencyBins[NumLatencyBins];
+        std::atomic<int64_t> count;
+        std::atomic<int64_t> totalLatencyNs;
+        std::atomic<int64_t> maxLatencyNs;
+        std::atomic<int64_t> maxQueueDepth;
+    };
+
+    static PipelineStage upstreamStage(PipelineStage stage);
+    int64_t percentileUs(const StageStatistics& stats, double fraction) const;
+
+    volatile bool enabled;
+    int samplesPerDataBlock;
+
+    std::atomic<int64_t> samplesPassed[NumPipelineStages];
+    std::vector<std::atomic<int64_t> > blockTimes;  // [stage * RingBlocks + (block % RingBlocks)]
+    StageStatistics statistics[NumPipelineStages];
+
+    std::mutex traceMutex;
+    std::ofstream traceFile;
+    volatile bool tracing;
+};
+
+#endif // PIPELINEPROFILER_H
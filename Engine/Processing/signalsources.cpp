@@ -321,22 +321,30 @@ SignalSources::~SignalSources()
 
 void SignalSources::updateChannelMap()
 {
-    // Create map of native names to channel pointers for quick access.
-    channelMap.clear();
+    // Assign a handle to every channel, and index channels by handle and by native name for quick access.
+    channelTable.clear();
+    amplifierHandles.clear();
+    std::vector<std::string> names;
     for (int i = 0; i < numPortGroups(); i++) {
         const SignalGroup* group = portGroupByIndex(i);
         for (int j = 0; j < group->numChannels(); ++j) {
             Channel* channel = group->channelByIndex(j);
-            channelMap[channel->getNativeNameString()] = channel;
+            if (channel->getSignalType() == AmplifierSignal) amplifierHandles.push_back((int) channelTable.size());
+            channel->setHandle((int) channelTable.size());
+            channelTable.push_back(channel);
+            names.push_back(channel->getNativeNameString());
         }
     }
     for (int i = 0; i < numBaseGroups(); i++) {
         const SignalGroup* group = baseGroupByIndex(i);
         for (int j = 0; j < group->numChannels(); ++j) {
             Channel* channel = group->channelByIndex(j);
-            channelMap[channel->getNativeNameString()] = channel;
+            channel->setHandle((int) channelTable.size());
+            channelTable.push_back(channel);
+            names.push_back(channel->getNativeNameString());
         }
     }
+    channelRegistry.build(names);
 }
 
 void SignalSources::clearTCPDataOutput()
@@ -402,18 +410,18 @@ SignalGroup* SignalSources::groupByName(const QString& groupName) const
 // Return a pointer to a SignalChannel with a particular nativeName (e.g., "A-002").
 Channel* SignalSources::channelByName(const QString& nativeName) const
 {
-    std::string nativeNameStr = nativeName.section('|', 0, 0).toStdString();  // strip off filter name, if present
-    std::map<std::string, Channel*>::const_iterator p = channelMap.find(nativeNameStr);
-    if (p != channelMap.end()) {
-        return p->second;
-    }
-//    std::cerr << "SignalSources::channelByName: name not found: " << nativeNameStr << EndOfLine;
-    return nullptr;
+    return channelByHandle(channelHandle(nativeName));
 }
 
 Channel* SignalSources::channelByName(const std::string& nativeName) const
 {
-    return channelByName(QString::fromStdString(nativeName));
+    return channelByHandle(channelRegistry.lookupBaseName(nativeName));
+}
+
+int SignalSources::channelHandle(const QString& nativeName) const
+{
+    QByteArray name = nativeName.toUtf8();
+    return channelRegistry.lookupBaseName(name.constData(), (size_t) name.size());
 }
 
 // Return a pointer to a SignalChannel corresponding to a particular USB interface data stream and chip channel number.
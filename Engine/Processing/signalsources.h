@@ -115,6 +115,15 @@ public:
     SignalGroup* groupByName(const QString& groupName) const;
     Channel* channelByName(const QString& nativeName) const;
     Channel* channelByName(const std::string& nativeName) const;
+
+    // Channel handles are dense indices 0..numChannelHandles()-1, stable until the next updateChannelMap().  Filter
+    // suffixes (e.g., "|HIGH") are ignored when looking up a handle by name.
+    int channelHandle(const QString& nativeName) const;
+    int channelHandle(const std::string& nativeName) const { return channelRegistry.lookupBaseName(nativeName); }
+    int numChannelHandles() const { return (int) channelTable.size(); }
+    Channel* channelByHandle(int handle) const
+        { return (handle >= 0 && handle < (int) channelTable.size()) ? channelTable[handle] : nullptr; }
+    const std::vector<int>& amplifierChannelHandles() const { return amplifierHandles; }
     Channel* getAmplifierChannel(int boardStream, int chipChannel) const;
     QString getNativeAndCustomNames(const QString& nativeName) const;
     QString getNativeAndCustomNames(const std::string& nativeName) const;
@@ -175,7 +184,9 @@ private:
     std::vector<SignalGroup*> portGroups;   // signals from SPI ports (amplifiers, aux inputs, supply voltages)
     std::vector<SignalGroup*> baseGroups;   // signals from main controller unit (digital and analog I/O)
 
-    std::map<std::string, Channel*> channelMap;   // map from native name to channel pointer, for quick access
+    ChannelRegistry channelRegistry;        // native name -> channel handle
+    std::vector<Channel*> channelTable;     // channel handle -> channel
+    std::vector<int> amplifierHandles;      // handles of amplifier channels, in amplifierChannelsNameList() order
 
     MultiColumnDisplay* display;  // needed for undo/redo operations with pinned waveforms and scroll bar state
 
@@ -0,0 +1,355 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "signalsources.h"
+#include "spectralengine.h"
+
+// One-sided power of frequency bin k of channel c in a batch of spectra from FastFourierTransform::realFftBatch().
+static inline float binPower(const float* spectrum, int k, int halfLength, int c)
+{
+    if (k == 0) {
+        return spectrum[c] * spectrum[c];
+    } else if (k == halfLength) {
+        return spectrum[SpectralBatchWidth + c] * spectrum[SpectralBatchWidth + c];
+    }
+    float re = spectrum[(2 * k) * SpectralBatchWidth + c];
+    float im = spectrum[(2 * k + 1) * SpectralBatchWidth + c];
+    return 2.0F * (re * re + im * im);    // Count negative frequencies, too.
+}
+
+SpectralEngine::SpectralEngine(SystemState* state_) :
+    state(state_),
+    requestedHistoryLength(DefaultSpectralHistoryFrames),
+    configChanged(true),
+    fftSize(0),
+    downsampleFactor(0),
+    windowSpan(0),
+    hopSpan(0),
+    powerScale(0.0F),
+    samplesUntilFrame(0),
+    fft(nullptr),
+    workerPool(1),
+    frameIntervalSeconds(0.0),
+    historyLength(0),
+    historyIndex(0),
+    numFramesComputed(0)
+{
+    requestedBands = {
+        { "Delta", 1.0F, 4.0F },
+        { "Theta", 4.0F, 8.0F },
+        { "Alpha", 8.0F, 13.0F },
+        { "Beta", 13.0F, 30.0F },
+        { "Gamma", 30.0F, 80.0F },
+        { "HighGamma", 80.0F, 200.0F }
+    };
+}
+
+SpectralEngine::~SpectralEngine()
+{
+    delete fft;
+}
+
+void SpectralEngine::setChannels(const std::vector<std::string>& channelNames_)
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    requestedChannelNames = channelNames_;
+    configChanged = true;
+}
+
+void SpectralEngine::setBands(const std::vector<SpectralBand>& bands_)
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    requestedBands = bands_;
+    configChanged = true;
+}
+
+void SpectralEngine::setHistoryLength(int numFrames)
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    requestedHistoryLength = std::max(numFrames, 1);
+    configChanged = true;
+}
+
+// Discard all results and restart windowing with the next block of data (e.g., at the start of a new run).
+void SpectralEngine::reset()
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    configChanged = true;
+}
+
+void SpectralEngine::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
+{
+    if (!state->spectralBandPowerEnabled->getValue()) return;
+
+    std::lock_guard<std::mutex> lock(configMutex);
+    if (configChanged || fftSize != (int) state->spectralBandPowerFFTSize->getNumericValue() ||
+            downsampleFactor != (int) state->spectralBandPowerDownsampleFactor->getNumericValue()) {
+        configure(waveformFifo);
+    }
+    if (waveformAddresses.empty()) return;
+
+    // Windows end every hopSpan samples; the data of each window are read back from WaveformFifo's memory.
+    int end = samplesUntilFrame;
+    while (end <= numSamples) {
+        int timeIndex = end - windowSpan;
+        if (timeIndex >= -waveformFifo->numWordsInMemory(reader)) {
+            computeFrame(waveformFifo, reader, timeIndex);
+        }
+        end += hopSpan;
+    }
+    samplesUntilFrame = end - numSamples;
+}
+
+void SpectralEngine::configure(WaveformFifo* waveformFifo)
+{
+    std::vector<std::string> names = requestedChannelNames;
+    if (names.empty()) {
+        names = state->signalSources->amplifierChannelsNameList();
+    }
+    std::vector<std::string> validNames;
+    waveformAddresses.clear();
+    for (const std::string& name : names) {
+        if (!waveformFifo->gpuWaveformPresent(name + "|LOW")) {
+            std::cerr << "SpectralEngine::configure: amplifier channel " << name << " not found." << '\n';
+            continue;
+        }
+        validNames.push_back(name);
+        waveformAddresses.push_back(waveformFifo->getGpuWaveformAddress(name + "|LOW"));
+    }
+
+    fftSize = (int) state->spectralBandPowerFFTSize->getNumericValue();
+    downsampleFactor = (int) state->spectralBandPowerDownsampleFactor->getNumericValue();
+    windowSpan = fftSize * downsampleFactor;
+    hopSpan = windowSpan / 2;
+    samplesUntilFrame = windowSpan;
+
+    double sampleRate = state->sampleRate->getNumericValue();
+    float analysisSampleRate = (float) (sampleRate / (double) downsampleFactor);
+    delete fft;
+    fft = new FastFourierTransform(analysisSampleRate, fftSize, FastFourierTransform::WindowHann);
+
+    // Scale |FFT|^2 to mean-square microvolts: Parseval's theorem gives sum(|X|^2) = N sum((w x)^2), and the window
+    // reduces mean-square amplitude by sum(w^2) / N.
+    const float* window = fft->getWindow();
+    double windowPowerSum = 0.0;
+    for (int t = 0; t < fftSize; ++t) {
+        windowPowerSum += (double) window[t] * (double) window[t];
+    }
+    powerScale = (float) (1.0 / ((double) fftSize * windowPowerSum));
+
+    // Each band includes the bins whose center frequencies lie in [fLow, fHigh), or the bin nearest its center if it is
+    // narrower than the frequency resolution.
+    float deltaF = analysisSampleRate / (float) fftSize;
+    int halfLength = fftSize / 2;
+    bandFirstBin.resize(requestedBands.size());
+    bandLastBin.resize(requestedBands.size());
+    for (int b = 0; b < (int) requestedBands.size(); ++b) {
+        int first = std::max((int) std::ceil(requestedBands[b].fLow / deltaF), 0);
+        int last = std::min((int) std::ceil(requestedBands[b].fHigh / deltaF) - 1, halfLength);
+        if (last < first) {
+            first = std::min((int) std::lround(0.5F * (requestedBands[b].fLow + requestedBands[b].fHigh) / deltaF), halfLength);
+            last = first;
+        }
+        bandFirstBin[b] = first;
+        bandLastBin[b] = last;
+    }
+
+    workerPool.setNumThreads(state->spectralBandPowerThreads->getValue());
+    rawBuffers.resize(workerPool.numThreads());
+    batchBuffers.resize(workerPool.numThreads());
+    for (int i = 0; i < workerPool.numThreads(); ++i) {
+        rawBuffers[i].resize(SpectralBatchWidth * fftSize);
+        batchBuffers[i].resize(SpectralBatchWidth * fftSize);
+    }
+    newFrame.assign(requestedBands.size() * validNames.size(), 0.0F);
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        channelNames = validNames;
+        bands = requestedBands;
+        frameIntervalSeconds = (double) hopSpan / sampleRate;
+        historyLength = requestedHistoryLength;
+        historyIndex = 0;
+        numFramesComputed = 0;
+        bandPowerHistory.assign(historyLength * newFrame.size(), 0.0F);
+        frameTimeStamps.assign(historyLength, 0);
+    }
+    configChanged = false;
+}
+
+// Compute band power of all channels for the window starting at timeIndex, and add it to the history.
+void SpectralEngine::computeFrame(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int timeIndex)
+{
+    const int numChannels = (int) waveformAddresses.size();
+    const int numBands = (int) bandFirstBin.size();
+    const int halfLength = fftSize / 2;
+    const float* window = fft->getWindow();
+
+    workerPool.run([&](int worker, int numWorkers) {
+        int firstChannel, lastChannel;
+        WorkerPool::partition(numChannels, SpectralBatchWidth, worker, numWorkers, firstChannel, lastChannel);
+
+        uint16_t* raw[SpectralBatchWidth];
+        for (int c = 0; c < SpectralBatchWidth; ++c) {
+            raw[c] = &rawBuffers[worker][c * fftSize];
+        }
+        float* batch = batchBuffers[worker].data();
+
+        for (int first = firstChannel; first < lastChannel; first += SpectralBatchWidth) {
+            int n = std::min(SpectralBatchWidth, lastChannel - first);
+            waveformFifo->copyGpuAmplifierChannelsRaw(reader, raw, &waveformAddresses[first], n, timeIndex, fftSize,
+                                                      downsampleFactor);
+
+            // Remove each channel's mean, convert to microvolts, apply the window, and interleave the channels into the
+            // batch layout.  Unused lanes of a partial batch are set to zero.
+            float mean[SpectralBatchWidth];
+            for (int c = 0; c < n; ++c) {
+                uint32_t sum = 0;
+                for (int t = 0; t < fftSize; ++t) {
+                    sum += raw[c][t];
+                }
+                mean[c] = (float) sum / (float) fftSize;
+            }
+            for (int t = 0; t < fftSize; ++t) {
+                float scale = 0.195F * window[t];
+                float* row = batch + t * SpectralBatchWidth;
+                for (int c = 0; c < n; ++c) {
+                    row[c] = scale * ((float) raw[c][t] - mean[c]);
+                }
+                for (int c = n; c < SpectralBatchWidth; ++c) {
+                    row[c] = 0.0F;
+                }
+            }
+
+            fft->realFftBatch(batch, SpectralBatchWidth);
+
+            for (int b = 0; b < numBands; ++b) {
+                float bandSum[SpectralBatchWidth] = {};
+                for (int k = bandFirstBin[b]; k <= bandLastBin[b]; ++k) {
+                    for (int c = 0; c < n; ++c) {
+                        bandSum[c] += binPower(batch, k, halfLength, c);
+                    }
+                }
+                for (int c = 0; c < n; ++c) {
+                    newFrame[b * numChannels + first + c] = powerScale * bandSum[c];
+                }
+            }
+        }
+    });
+
+    uint32_t timeStamp = waveformFifo->getTimeStamp(reader, timeIndex + windowSpan - 1);
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+    std::copy(newFrame.begin(), newFrame.end(), bandPowerHistory.begin() + historyIndex * newFrame.size());
+    frameTimeStamps[historyIndex] = timeStamp;
+    if (++historyIndex == historyLength) historyIndex = 0;
+    ++numFramesComputed;
+}
+
+std::vector<std::string> SpectralEngine::getChannelNames() const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return channelNames;
+}
+
+std::vector<SpectralBand> SpectralEngine::getBands() const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return bands;
+}
+
+double SpectralEngine::getFrameIntervalSeconds() const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return frameIntervalSeconds;
+}
+
+uint64_t SpectralEngine::getNumFramesComputed() const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return numFramesComputed;
+}
+
+bool SpectralEngine::getLatestBandPower(std::vector<float>& bandPower, uint32_t& timeStamp) const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (numFramesComputed == 0) return false;
+
+    size_t frameSize = bands.size() * channelNames.size();
+    int latest = (historyIndex + historyLength - 1) % historyLength;
+    bandPower.assign(bandPowerHistory.begin() + latest * frameSize, bandPowerHistory.begin() + (latest + 1) * frameSize);
+    timeStamp = frameTimeStamps[latest];
+    return true;
+}
+
+bool SpectralEngine::getLatestChannelBandPower(const std::string& channelName, std::vector<SpectralBand>& bands_,
+                                               std::vector<float>& bandPower) const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (numFramesComputed == 0) return false;
+    auto it = std::find(channelNames.begin(), channelNames.end(), channelName);
+    if (it == channelNames.end()) return false;
+
+    int numChannels = (int) channelNames.size();
+    int channel = (int) (it - channelNames.begin());
+    size_t frameSize = bands.size() * channelNames.size();
+    int latest = (historyIndex + historyLength - 1) % historyLength;
+    bands_ = bands;
+    bandPower.resize(bands.size());
+    for (int band = 0; band < (int) bands.size(); ++band) {
+        bandPower[band] = bandPowerHistory[latest * frameSize + band * numChannels + channel];
+    }
+    return true;
+}
+
+int SpectralEngine::getBandPowerHistory(int band, int channel, std::vector<float>& values) const
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    values.clear();
+    int numChannels = (int) channelNames.size();
+    if (band < 0 || band >= (int) bands.size() || channel < 0 || channel >= numChannels) {
+        std::cerr << "SpectralEngine::getBandPowerHistory: band or channel out of range." << '\n';
+        return 0;
+    }
+
+    size_t frameSize = bands.size() * channelNames.size();
+    int numFrames = (int) std::min(numFramesComputed, (uint64_t) historyLength);
+    int slot = (historyIndex - numFrames + historyLength) % historyLength;
+    values.resize(numFrames);
+    for (int i = 0; i < numFrames; ++i) {
+        values[i] = bandPowerHistory[slot * frameSize + band * numChannels + channel];
+        if (++slot == historyLength) slot = 0;
+    }
+    return numFrames;
+}
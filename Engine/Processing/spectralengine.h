@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef SPECTRALENGINE_H
+#define SPECTRALENGINE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "analysisthread.h"
+#include "fastfouriertransform.h"
+#include "systemstate.h"
+#include "waveformfifo.h"
+#include "workerpool.h"
+
+const int SpectralBatchWidth = 8;           // Channels transformed together in one batched FFT
+const int DefaultSpectralHistoryFrames = 128;
+
+struct SpectralBand
+{
+    std::string name;
+    float fLow;     // Hz, inclusive
+    float fHigh;    // Hz, exclusive
+};
+
+// Computes overlapping-window (50% overlap, Hann window) power spectra of many amplifier channels at once on
+// AnalysisThread, and keeps a rolling matrix of band power (in uV^2) for each band and channel.  Spectra are computed
+// from the low-pass amplifier waveforms, decimated by the SpectralBandPowerDownsampleFactor setting, so the analyzed
+// bandwidth should not exceed the software low-pass filter cutoff.  Channels are transformed SpectralBatchWidth at a
+// time with FastFourierTransform::realFftBatch(), and the batches are divided among a WorkerPool.
+//
+// Configuration may be changed from any thread; new settings take effect with the next block of data.  Results are
+// read from any thread (e.g., by widgets or the TCP server) through the get...() functions, which copy them out.
+class SpectralEngine : public AnalysisClient
+{
+public:
+    explicit SpectralEngine(SystemState* state_);
+    ~SpectralEngine();
+
+    // Analyze the given amplifier channels (native names), or all amplifier channels if channelNames_ is empty.
+    void setChannels(const std::vector<std::string>& channelNames_);
+    void setBands(const std::vector<SpectralBand>& bands_);
+    void setHistoryLength(int numFrames);
+    void reset();
+
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
+
+    std::vector<std::string> getChannelNames() const;
+    std::vector<SpectralBand> getBands() const;
+    double getFrameIntervalSeconds() const;
+    uint64_t getNumFramesComputed() const;
+    // Copy the newest band power matrix to bandPower, indexed [band * numChannels + channel], and the timestamp of
+    // the last sample in its window to timeStamp.  Returns false if no frame has been computed yet.
+    bool getLatestBandPower(std::vector<float>& bandPower, uint32_t& timeStamp) const;
+    // Copy the newest band power of one channel (native name) to bandPower, one value per band in bands_ order.  Returns
+    // false if the channel is not being analyzed or no frame has been computed yet.
+    bool getLatestChannelBandPower(const std::string& channelName, std::vector<SpectralBand>& bands_,
+                                   std::vector<float>& bandPower) const;
+    // Copy the band power history of one band and channel to values, oldest first.  Returns the number of frames.
+    int getBandPowerHistory(int band, int channel, std::vector<float>& values) const;
+
+private:
+    SystemState* state;
+
+    // Requested settings, written by any thread.
+    std::mutex configMutex;
+    std::vector<std::string> requestedChannelNames;
+    std::vector<SpectralBand> requestedBands;
+    int requestedHistoryLength;
+    bool configChanged;
+
+    // Active settings and work buffers, used only on AnalysisThread.
+    std::vector<GpuWaveformAddress> waveformAddresses;
+    std::vector<int> bandFirstBin;
+    std::vector<int> bandLastBin;
+    int fftSize;
+    int downsampleFactor;
+    int windowSpan;         // Window length in amplifier samples
+    int hopSpan;            // Window advance in amplifier samples
+    float powerScale;
+    int samplesUntilFrame;  // Amplifier samples until the end of the next window
+    FastFourierTransform* fft;
+    WorkerPool workerPool;
+    std::vector<std::vector<uint16_t> > rawBuffers;   // Per worker
+    std::vector<std::vector<float> > batchBuffers;    // Per worker
+    std::vector<float> newFrame;
+
+    // Results, read by any thread.
+    mutable std::mutex resultMutex;
+    std::vector<std::string> channelNames;
+    std::vector<SpectralBand> bands;
+    double frameIntervalSeconds;
+    int historyLength;
+    int historyIndex;       // Slot for next frame
+    uint64_t numFramesComputed;
+    std::vector<float> bandPowerHistory;            // historyLength frames of [band][channel]
+    std::vector<uint32_t> frameTimeStamps;
+
+    void configure(WaveformFifo* waveformFifo);
+    void computeFrame(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int timeIndex);
+};
+
+#endif // SPECTRALENGINE_H
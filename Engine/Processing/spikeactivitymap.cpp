@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "spikeactivitymap.h"
+
+SpikeActivityMap::SpikeActivityMap() :
+    sampleRate(30000.0),
+    generation(0),
+    batches(0)
+{
+}
+
+void SpikeActivityMap::reset(int numChannelHandles, double sampleRate_)
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    sampleRate = sampleRate_;
+    batchCounts.assign(numChannelHandles, 0);
+
+    // std::atomic is neither copyable nor movable, so the arrays are rebuilt rather than resized.
+    std::vector<std::atomic<uint32_t> > newCounts(numChannelHandles);
+    std::vector<std::atomic<float> > newRates(numChannelHandles);
+    std::vector<std::atomic<uint64_t> > newBits((numChannelHandles + 63) / 64);
+    for (int i = 0; i < numChannelHandles; ++i) {
+        newCounts[i].store(0);
+        newRates[i].store(0.0F);
+    }
+    for (auto& word : newBits) word.store(0);
+    spikeCounts.swap(newCounts);
+    firingRates.swap(newRates);
+    activeBits.swap(newBits);
+
+    batches.store(0);
+    generation.fetch_add(1);
+}
+
+void SpikeActivityMap::addSpikes(int channelHandle, int numSpikes)
+{
+    if (channelHandle < 0 || channelHandle >= (int) batchCounts.size()) return;
+    batchCounts[channelHandle] += numSpikes;
+}
+
+void SpikeActivityMap::publish(int numSamples)
+{
+    const float decay = (float) exp(-((double) numSamples / sampleRate) / SpikeRateTimeConstantSeconds);
+    const float weight = (float) (1.0 / SpikeRateTimeConstantSeconds);
+
+    const int numChannels = (int) batchCounts.size();
+    for (int word = 0; word < (int) activeBits.size(); ++word) {
+        uint64_t bits = 0;
+        int end = std::min(numChannels, (word + 1) * 64);
+        for (int i = word * 64; i < end; ++i) {
+            uint32_t count = batchCounts[i];
+            float rate = firingRates[i].load(std::memory_order_relaxed) * decay + weight * (float) count;
+            firingRates[i].store(rate, std::memory_order_relaxed);
+            if (count > 0) {
+                spikeCounts[i].store(spikeCounts[i].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+                bits |= (uint64_t) 1 << (i - word * 64);
+                batchCounts[i] = 0;
+            }
+        }
+        activeBits[word].store(bits, std::memory_order_relaxed);
+    }
+    batches.fetch_add(1, std::memory_order_release);
+}
+
+void SpikeActivityMap::snapshot(SpikeActivitySnapshot& result) const
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    result.generation = generation.load();
+    result.batches = batches.load(std::memory_order_acquire);
+
+    const int numChannels = (int) spikeCounts.size();
+    result.spikeCounts.resize(numChannels);
+    result.firingRates.resize(numChannels);
+    result.activeBits.resize(activeBits.size());
+    for (int i = 0; i < numChannels; ++i) {
+        result.spikeCounts[i] = spikeCounts[i].load(std::memory_order_relaxed);
+        result.firingRates[i] = firingRates[i].load(std::memory_order_relaxed);
+    }
+    for (int word = 0; word < (int) activeBits.size(); ++word) {
+        result.activeBits[word] = activeBits[word].load(std::memory_order_relaxed);
+    }
+}
+
+int SpikeActivityMap::numChannels() const
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    return (int) spikeCounts.size();
+}
@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef SPIKEACTIVITYMAP_H
+#define SPIKEACTIVITYMAP_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+const double SpikeRateTimeConstantSeconds = 1.0;
+
+// Consistent copy of SpikeActivityMap, indexed by channel handle (see SignalSources::channelByHandle()).
+struct SpikeActivitySnapshot {
+    uint64_t generation;                // Incremented by every SpikeActivityMap::reset(); counts restart from zero
+    uint64_t batches;                   // Batches published since the last reset
+    std::vector<uint32_t> spikeCounts;  // Spikes detected since the last reset
+    std::vector<float> firingRates;     // Exponentially decaying firing rate, in spikes/s
+    std::vector<uint64_t> activeBits;   // Bit (handle % 64) of word (handle / 64) is set if the channel spiked in the
+                                        // most recent batch
+    bool spikedInLastBatch(int handle) const { return (activeBits[handle / 64] >> (handle % 64)) & 1u; }
+};
+
+// Per-channel spike activity, published by WaveformProcessorThread after each batch of data blocks and read by any
+// thread.  Publishing never blocks: every value is a separate atomic written only by WaveformProcessorThread, so a
+// snapshot is taken without locking out the writer (values of different channels may come from adjacent batches).
+// The firing rate of each channel decays with time constant SpikeRateTimeConstantSeconds.
+class SpikeActivityMap
+{
+public:
+    SpikeActivityMap();
+
+    // Resize for numChannelHandles channels and clear all activity.  Call only from WaveformProcessorThread, or while
+    // it is idle.
+    void reset(int numChannelHandles, double sampleRate_);
+
+    // Called only from WaveformProcessorThread: add spikes detected in the current batch, then publish the batch.
+    void addSpikes(int channelHandle, int numSpikes);
+    void publish(int numSamples);
+
+    // Callable from any thread.
+    void snapshot(SpikeActivitySnapshot& result) const;
+    int numChannels() const;
+
+private:
+    mutable std::mutex layoutMutex;  // Held by reset() and snapshot() only, so the arrays are not resized while read
+
+    double sampleRate;
+    std::vector<uint32_t> batchCounts;  // Spikes in the batch not yet published; used only by the writer
+
+    std::atomic<uint64_t> generation;
+    std::atomic<uint64_t> batches;
+    std::vector<std::atomic<uint32_t> > spikeCounts;
+    std::vector<std::atomic<float> > firingRates;
+    std::vector<std::atomic<uint64_t> > activeBits;
+};
+
+#endif // SPIKEACTIVITYMAP_H
@@ -29,10 +29,13 @@
 //------------------------------------------------------------------------------
 
 #include <iostream>
+#include <thread>
 #include "xmlinterface.h"
 #include "signalsources.h"
 #include "datafilereader.h"
+#include "filewriter.h"
 #include "systemstate.h"
+#include "waveformfifo.h"
 
 // Restrict functions for StateItem objects
 bool RestrictAlways(const SystemState*) { return true; }
@@ -153,6 +156,24 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     writeToDiskLatency->addItem("Lowest", "Lowest", 256.0);
     writeToDiskLatency->setValue("Highest");
 
+    saveFileWriter = new DiscreteItemList("SaveFileWriter", globalItems, this);
+    saveFileWriter->setRestricted(RestrictIfRunning, RunningErrorMessage);
+    saveFileWriter->addItem("Synchronous", "Synchronous", FileWriterSynchronous);
+    saveFileWriter->addItem("ThreadPool", "Thread Pool", FileWriterThreadPool);
+    saveFileWriter->addItem("IoUring", "io_uring", FileWriterIoUring);
+    saveFileWriter->setValue("Synchronous");
+
+    saveFileDirectIO = new BooleanItem("SaveFileDirectIO", globalItems, this, false);
+    saveFileDirectIO->setRestricted(RestrictIfRunning, RunningErrorMessage);
+
+    saveFileWriteBuffers = new IntRangeItem("SaveFileWriteBuffers", globalItems, this, 2, 8, 4);
+    saveFileWriteBuffers->setRestricted(RestrictIfRunning, RunningErrorMessage);
+
+    // Threads used to convert and buffer per-channel data in the One File Per Channel format.
+    int defaultSaveThreads = qBound(1, (int) std::thread::hardware_concurrency() / 4, 4);
+    saveThreads = new IntRangeItem("SaveThreads", globalItems, this, 1, 64, defaultSaveThreads);
+    saveThreads->setRestricted(RestrictIfRunning, RunningErrorMessage);
+
     createNewDirectory = new BooleanItem("CreateNewDirectory", globalItems, this, true);
     createNewDirectory->setRestricted(RestrictIfRunning, RunningErrorMessage);
 
@@ -252,6 +273,12 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     audioFilter->setValue("Wide");
     audioVolume = new IntRangeItem("AudioVolume", globalItems, this, 0, 100, 50);
     audioThreshold = new IntRangeItem("AudioThresholdMicroVolts", globalItems, this, 0, 200, 0);
+    audioSource = new DiscreteItemList("AudioSource", globalItems, this);
+    audioSource->addItem("Single", "Selected Channel", 0);
+    audioSource->addItem("Mix", "Mix Selected", 1);
+    audioSource->addItem("SpikeClicks", "Spike Clicks", 2);
+    audioSource->setValue("Single");
+    audioMaxChannels = new IntRangeItem("AudioMaxChannels", globalItems, this, 1, 256, 32);
 
     writeToLog("Created audio variables");
 
@@ -295,6 +322,9 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     tcpWaveformDataCommunicator = new TCPCommunicator("127.0.0.1", 5001);
     tcpSpikeDataCommunicator = new TCPCommunicator("127.0.0.1", 5002);
 
+    pipelineProfiler = new PipelineProfiler();
+    spikeActivity = new SpikeActivityMap();
+
     writeToLog("Created tcp communication variables");
 
     // Impedance testing
@@ -302,6 +332,13 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     impedanceFreqValid = new BooleanItem("ImpedanceFreqValid", globalItems, this, false, XMLGroupNone);
     desiredImpedanceFreq = new DoubleRangeItem("DesiredImpedanceFreqHertz", globalItems, this, 0.0, 7500.0, 1000.0);
     actualImpedanceFreq = new DoubleRangeItem("ActualImpedanceFreqHertz", globalItems, this, 0.0, 7500.0, 1000.0, XMLGroupReadOnly);
+    impedanceSpectraHaveBeenMeasured = new BooleanItem("ImpedanceSpectraHaveBeenMeasured", globalItems, this, false, XMLGroupReadOnly);
+    desiredImpedanceSpectrumFreqs = new StringItem("DesiredImpedanceSpectrumFreqsHertz", globalItems, this, "30,100,300,1000,3000,5000");
+    actualImpedanceSpectrumFreqs = new StringItem("ActualImpedanceSpectrumFreqsHertz", globalItems, this, "", XMLGroupReadOnly);
+    impedanceSpectrumFileFormat = new DiscreteItemList("ImpedanceSpectrumFileFormat", globalItems, this);
+    impedanceSpectrumFileFormat->addItem("CSV", "CSV");
+    impedanceSpectrumFileFormat->addItem("Binary", "Binary");
+    impedanceSpectrumFileFormat->setValue("CSV");
 
     writeToLog("Created impedance testing variables");
 
@@ -309,6 +346,35 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     useMedianReference = new BooleanItem("UseMedianReference", globalItems, this, false);
     useMedianReference->setRestricted(RestrictIfRunning, RunningErrorMessage);
 
+    // Processing
+    // Number of threads used to filter amplifier channels when the CPU (rather than a GPU) is the selected XPU.  This
+    // depends on the computer, not the experiment, so it is not saved in settings files.
+    int defaultCpuThreads = qBound(1, (int) std::thread::hardware_concurrency() / 2, 8);
+    cpuProcessingThreads = new IntRangeItem("CPUProcessingThreads", globalItems, this, 1, 64, defaultCpuThreads, XMLGroupNone);
+    // Scalar filters one channel at a time; Vectorized filters several channels at once with SIMD instructions and is
+    // checked against Scalar (and reverted to it if results differ) when the XPU diagnostic runs.
+    cpuFilterMode = new DiscreteItemList("CPUFilterMode", globalItems, this, XMLGroupNone);
+    cpuFilterMode->addItem("Scalar", "Scalar");
+    cpuFilterMode->addItem("Vectorized", "Vectorized");
+    cpuFilterMode->setValue("Vectorized");
+    // Upper limit on the number of data blocks WaveformProcessorThread may filter in one dispatch when it has fallen
+    // behind.  When keeping up in real time, blocks are always processed one at a time.
+    processingBatchBlocks = new IntRangeItem("ProcessingBatchBlocks", globalItems, this, 1, MaxProcessingBatchBlocks, 8, XMLGroupNone);
+    // Memory layout of the filtered amplifier waveforms in WaveformFifo (see WaveformLayout).  ChannelTiled makes
+    // per-channel reads (file-per-channel saving, display) contiguous at the cost of a transpose after each XPU write.
+    // Takes effect the next time the controller starts running.
+    waveformBufferLayout = new DiscreteItemList("WaveformBufferLayout", globalItems, this, XMLGroupNone);
+    waveformBufferLayout->setRestricted(RestrictIfRunning, RunningErrorMessage);
+    waveformBufferLayout->addItem("TimeMajor", "Time Major", WaveformLayoutTimeMajor);
+    waveformBufferLayout->addItem("ChannelTiled", "Channel Tiled", WaveformLayoutChannelTiled);
+    waveformBufferLayout->setValue("TimeMajor");
+    // Per-block latency and queue depth statistics for every pipeline stage, optionally traced to a CSV file
+    // (if PipelineTraceFilename is set).  Both take effect the next time the controller starts running.
+    pipelineProfiling = new BooleanItem("PipelineProfiling", globalItems, this, false, XMLGroupNone);
+    pipelineProfiling->setRestricted(RestrictIfRunning, RunningErrorMessage);
+    pipelineTraceFilename = new StateFilenameItem("PipelineTraceFilename", &stateFilenameItems, this, "", "", XMLGroupNone);
+    pipelineTraceFilename->setRestricted(RestrictIfRunning, RunningErrorMessage);
+
     // Filtering
 
     // Note: 'actual' parameter sometimes has a wider range than 'desired' parameter because the closest-fitting achievable
@@ -702,6 +768,31 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
 
     writeToLog("Created spectrogram variables");
 
+    // Band power of many channels, computed by SpectralEngine from decimated low-pass amplifier waveforms.
+    spectralBandPowerEnabled = new BooleanItem("SpectralBandPowerEnabled", globalItems, this, false);
+
+    spectralBandPowerFFTSize = new DiscreteItemList("SpectralBandPowerFFTSize", globalItems, this);
+    spectralBandPowerFFTSize->addItem("256", "256", 256);
+    spectralBandPowerFFTSize->addItem("512", "512", 512);
+    spectralBandPowerFFTSize->addItem("1024", "1024", 1024);
+    spectralBandPowerFFTSize->addItem("2048", "2048", 2048);
+    spectralBandPowerFFTSize->addItem("4096", "4096", 4096);
+    spectralBandPowerFFTSize->setValue("1024");
+
+    spectralBandPowerDownsampleFactor = new DiscreteItemList("SpectralBandPowerDownsampleFactor", globalItems, this);
+    spectralBandPowerDownsampleFactor->addItem("1", "1", 1);
+    spectralBandPowerDownsampleFactor->addItem("2", "2", 2);
+    spectralBandPowerDownsampleFactor->addItem("4", "4", 4);
+    spectralBandPowerDownsampleFactor->addItem("8", "8", 8);
+    spectralBandPowerDownsampleFactor->addItem("16", "16", 16);
+    spectralBandPowerDownsampleFactor->addItem("32", "32", 32);
+    spectralBandPowerDownsampleFactor->addItem("64", "64", 64);
+    spectralBandPowerDownsampleFactor->setValue("32");
+
+    int defaultSpectralThreads = qBound(1, (int) std::thread::hardware_concurrency() / 4, 4);
+    spectralBandPowerThreads = new IntRangeItem("SpectralBandPowerThreads", globalItems, this, 1, 64, defaultSpectralThreads);
+    spectralBandPowerThreads->setRestricted(RestrictIfRunning, RunningErrorMessage);
+
     // Spike scope
     spikeScopeChannel = new ChannelNameItem("SpikeScopeChannel", globalItems, this, "N/A");
     yScaleSpikeScope = new DiscreteItemList("SpikeScopeScaleMicroVolts", globalItems, this);
@@ -731,6 +822,14 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     artifactsShown = new BooleanItem("ArtifactsShown", globalItems, this, true);
     suppressionThreshold = new IntRangeItem("ArtifactSuppressionThresholdMicroVolts", globalItems, this, 0, 5000, 2500);
 
+    // Real-time spike classification using each amplifier channel's SpikeHoops or SpikeTemplates.
+    spikeClassifierMode = new DiscreteItemList("SpikeClassifierMode", globalItems, this, XMLGroupSpikeSettings);
+    spikeClassifierMode->addItem("Threshold", "Threshold");
+    spikeClassifierMode->addItem("Hoops", "Hoops");
+    spikeClassifierMode->addItem("Templates", "Templates");
+    spikeClassifierMode->setValue("Threshold");
+    spikeTemplateMaxRms = new IntRangeItem("SpikeTemplateMaxRmsMicroVolts", globalItems, this, 1, 1000, 40, XMLGroupSpikeSettings);
+
     writeToLog("Created spike scope variables");
 
     // Spike detection threshold setting options
@@ -739,6 +838,11 @@ SystemState::SystemState(const AbstractRHXController* controller_, StimStepSize
     rmsMultipleThreshold = new DoubleRangeItem("RmsMultipleThreshold", globalItems, this, 3.0, 20.0, 4.0);
     negativeRelativeThreshold = new BooleanItem("NegativeRelativeThreshold", globalItems, this, true);
 
+    // Continuous noise estimation (NoiseEstimator) and relative thresholds that follow it while running.
+    noiseEstimationEnabled = new BooleanItem("NoiseEstimationEnabled", globalItems, this, false);
+    thresholdTrackingEnabled = new BooleanItem("ThresholdTrackingEnabled", globalItems, this, false);
+    noiseTimeConstant = new IntRangeItem("NoiseTimeConstantSeconds", globalItems, this, 1, 3600, 30);
+
     writeToLog("Created spike detection threshold setting option variables");
 
     // Configure tab
@@ -793,6 +897,8 @@ SystemState::~SystemState()
 {
     delete signalSources;
     delete globalSettingsInterface;
+    delete pipelineProfiler;
+    delete spikeActivity;
 
     for (SingleItemList::const_iterator p = globalItems.begin(); p != globalItems.end(); ++p) {
         delete p->second;
@@ -1165,44 +1271,33 @@ void SystemState::enableLogging(bool enable)
 // Called from State ctor and enableLogging(). Checks QSettings to see if file should actually be created, and writes first message
 void SystemState::setupLog()
 {
+    logErrors = false;
+    logger.close();
+
     // Check QSettings to see if logging should happen
     QSettings settings;
-    logErrors = settings.value("generateLogFile", false).toBool();
-
-    if (!logErrors) return;
+    if (!settings.value("generateLogFile", false).toBool()) return;
 
     // If logging should occur, initialize file and write first message
     logFileName = settings.value("logFileName", "IntanRHXErrorLog.txt").toString();
-    QFile *file = new QFile(logFileName);
-    if (!file->open(QIODevice::WriteOnly)) {
+    logger.setMinimumSeverity((LogSeverity) settings.value("logMinimumSeverity", (int) LogDebug).toInt());
+    if (!logger.open(logFileName.toStdString())) {
         QMessageBox::warning(nullptr, "Problem Saving IntanRHX Error Log", "Cannot open text file for saving errors to disk. Is the file being used, or located in an administrator-only directory?");
-        logErrors = false;
-        if (file) delete file;
         return;
     }
-    file->write("Log successfully opened\n");
-    file->close();
-    delete file;
-    return;
+    logErrors = true;
 }
 
-void SystemState::writeToLog(QString message)
+void SystemState::writeToLog(const QString& message, LogSeverity severity)
 {
     if (!logErrors) return;
+    logger.log(severity, message.toLocal8Bit().constData());
+}
 
-    QFile *file = new QFile(logFileName);
-    if (!file->open(QIODevice::WriteOnly | QIODevice::Append)) {
-        QMessageBox::warning(nullptr, "Saving IntanRHX Error Message Error", "Cannot open text file for saving errors to disk (writeonly, append, SystemState)");
-        if (file) delete file;
-        return;
-    }
-    file->write(message.toLocal8Bit());
-    file->write(" ... seconds: ");
-    file->write(QString::number(((double) logTimer.elapsed()) / 1000.0).toLocal8Bit());
-    file->write("\n");
-    file->close();
-    delete file;
-    return;
+void SystemState::writeToLog(const char* message, LogSeverity severity)
+{
+    if (!logErrors) return;
+    logger.log(severity, message);
 }
 
 void SystemState::setReportSpikes(bool enable)
@@ -1225,16 +1320,6 @@ double SystemState::getDecayTime()
     return decayTime;
 }
 
-void SystemState::spikeReport(QString names)
-{
-    emit spikeReportSignal(names);
-}
-
-void SystemState::advanceSpikeTimer()
-{
-    emit spikeTimerTick();
-}
-
 int64_t SystemState::getPlaybackBlocks()
 {
     if (playback->getValue() && dataFileReader) {
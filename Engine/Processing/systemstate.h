@@ -34,6 +34,7 @@
 #include <QComboBox>
 #include <QDoubleSpinBox>
 #include <QFile>
+#include <atomic>
 #include <vector>
 
 #include "rhxglobals.h"
@@ -43,6 +44,9 @@
 #include "stateitem.h"
 #include "rhxregisters.h"
 #include "tcpcommunicator.h"
+#include "pipelineprofiler.h"
+#include "spikeactivitymap.h"
+#include "asynclogger.h"
 #ifdef __APPLE__
     #include <OpenCL/opencl.h>
 #else
@@ -74,6 +78,7 @@ struct GPUInfo : public CPUInfo {
 const int SnippetSize = 50;
 const int FramesPerBlock = 128;
 const int NotchBandwidth = 10;
+const int MaxProcessingBatchBlocks = 16;  // Largest number of data blocks filtered in a single XPU dispatch.
 
 bool RestrictAlways(const SystemState*);
 bool RestrictIfRunning(const SystemState* state);
@@ -123,7 +128,9 @@ public:
     void updateForChangeHeadstages();
 
     void enableLogging(bool enable); // Toggled externally, probably from ControlWindow
-    void writeToLog(QString message); // Callable from anywhere with access to SystemState
+    // Callable from any thread with access to SystemState; messages are written to the log file by a background thread.
+    void writeToLog(const QString& message, LogSeverity severity = LogInfo);
+    void writeToLog(const char* message, LogSeverity severity = LogInfo);
 
     void setReportSpikes(bool enable);
     bool getReportSpikes();
@@ -131,9 +138,6 @@ public:
     void setDecayTime(double time);
     double getDecayTime();
 
-    void spikeReport(QString names);
-    void advanceSpikeTimer();
-
     // Intrinsic variables that shouldn't be changed solely through software (e.g. hardware-related, or set in software upon startup)
     SignalSources* signalSources;
     DiscreteItemList* controllerType;
@@ -154,7 +158,7 @@ public:
     CPUInfo cpuInfo;
     QVector<GPUInfo> gpuList;
 
-    bool logErrors;
+    std::atomic<bool> logErrors;
     QString logFileName;
 
     // Read-only variables
@@ -165,6 +169,10 @@ public:
     // Saving data
     DiscreteItemList *fileFormat;
     DiscreteItemList *writeToDiskLatency;
+    DiscreteItemList *saveFileWriter;
+    BooleanItem *saveFileDirectIO;
+    IntRangeItem *saveFileWriteBuffers;
+    IntRangeItem *saveThreads;
     BooleanItem *createNewDirectory;
     BooleanItem *saveAuxInWithAmpWaveforms;
     BooleanItem *saveWidebandAmplifierWaveforms;
@@ -197,6 +205,9 @@ public:
     TCPCommunicator *tcpWaveformDataCommunicator;
     TCPCommunicator *tcpSpikeDataCommunicator;
 
+    PipelineProfiler *pipelineProfiler;
+    SpikeActivityMap *spikeActivity;  // Published by WaveformProcessorThread; read by ProbeMapWindow and others
+
     // XML
     ProbeMapSettings probeMapSettings;
 
@@ -205,6 +216,8 @@ public:
     DiscreteItemList *audioFilter;
     IntRangeItem *audioVolume;
     IntRangeItem *audioThreshold;
+    DiscreteItemList *audioSource;
+    IntRangeItem *audioMaxChannels;
 
     // Hardware Audio/Analog Out
     IntRangeItem *analogOutGainIndex;
@@ -244,10 +257,22 @@ public:
     DoubleRangeItem *desiredImpedanceFreq;
     DoubleRangeItem *actualImpedanceFreq;
     StateFilenameItem *impedanceFilename;
+    BooleanItem *impedanceSpectraHaveBeenMeasured;
+    StringItem *desiredImpedanceSpectrumFreqs;      // Comma-separated list, in Hz
+    StringItem *actualImpedanceSpectrumFreqs;       // Frequencies of the last spectrum measurement
+    DiscreteItemList *impedanceSpectrumFileFormat;
 
     // Referencing
     BooleanItem *useMedianReference;
 
+    // Processing
+    IntRangeItem *cpuProcessingThreads;
+    DiscreteItemList *cpuFilterMode;
+    IntRangeItem *processingBatchBlocks;
+    DiscreteItemList *waveformBufferLayout;
+    BooleanItem *pipelineProfiling;
+    StateFilenameItem *pipelineTraceFilename;
+
     // Filtering
     BooleanItem *dspEnabled;
     DoubleRangeItem *desiredDspCutoffFreq;
@@ -341,6 +366,12 @@ public:
     BooleanItem *saveMatFileSpectrogram;
     BooleanItem *savePngFileSpectrogram;
 
+    // Multichannel band power (SpectralEngine)
+    BooleanItem* spectralBandPowerEnabled;
+    DiscreteItemList* spectralBandPowerFFTSize;
+    DiscreteItemList* spectralBandPowerDownsampleFactor;
+    IntRangeItem* spectralBandPowerThreads;
+
     // Spike sorting
     ChannelNameItem* spikeScopeChannel;
     DiscreteItemList* yScaleSpikeScope;
@@ -349,12 +380,17 @@ public:
     BooleanItem* suppressionEnabled;
     BooleanItem* artifactsShown;
     IntRangeItem* suppressionThreshold;
+    DiscreteItemList* spikeClassifierMode;
+    IntRangeItem* spikeTemplateMaxRms;
 
     // Spike detection threshold setting options
     BooleanItem *absoluteThresholdsEnabled;
     IntRangeItem *absoluteThreshold;
     DoubleRangeItem *rmsMultipleThreshold;
     BooleanItem *negativeRelativeThreshold;
+    BooleanItem *noiseEstimationEnabled;
+    BooleanItem *thresholdTrackingEnabled;
+    IntRangeItem *noiseTimeConstant;
 
     // Configure tab
     BooleanItem* manualFastSettleEnabled;
@@ -381,8 +417,6 @@ public:
 signals:
     void stateChanged();
     void headstagesChanged();
-    void spikeReportSignal(QString names);
-    void spikeTimerTick();
 
 protected:
     void timerEvent(QTimerEvent *event) override;
@@ -405,7 +439,7 @@ private:
 
     void queueStateChangedSignal();
 
-    QElapsedTimer logTimer;
+    AsyncLogger logger;
 
     DataFileReader* dataFileReader;
 };
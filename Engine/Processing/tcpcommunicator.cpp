@@ -36,6 +36,7 @@ TCPCommunicator::TCPCommunicator(QString address_, int port_, QObject *parent) :
     status(Disconnected),
     address(address_),
     port(port_),
+    throughput(0.0),
     server(nullptr),
     socket(nullptr)
 {
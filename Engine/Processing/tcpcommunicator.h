@@ -33,6 +33,7 @@
 
 #include <QObject>
 #include <QtNetwork>
+#include <atomic>
 
 class TCPCommunicator : public QObject
 {
@@ -59,6 +60,10 @@ public:
     QString address;
     int port;
 
+    // Frames per second that the data output thread serializes and writes to this port, measured over the
+    // thread's busy time only.  Values above the sample rate mean output is keeping ahead of real time.
+    std::atomic<double> throughput;
+
 signals:
     void newConnection();
     void readyRead();
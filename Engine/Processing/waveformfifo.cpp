@@ -30,18 +30,86 @@
 
 #include <cmath>
 #include <cstring>
+#include <new>
 
 #include "rhxglobals.h"
 #include "rhxdatablock.h"
 #include "waveformfifo.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define WAVEFORMFIFO_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace {
+
+const int TransposeChannels = 8;  // Channels (and samples) per transposed square; 8 x 16-bit words fill one SSE2 register.
+
+// Transpose an 8 x 8 square of words: 8 consecutive channels from each of 8 consecutive frames (frameStride words apart)
+// to 8 consecutive samples in each of 8 channel arrays.
+inline void transpose8x8(uint16_t* const* dest, int destOffset, const uint16_t* frames, int frameStride)
+{
+#ifdef WAVEFORMFIFO_SSE2
+    __m128i r0 = _mm_loadu_si128((const __m128i*) (frames + 0 * frameStride));
+    __m128i r1 = _mm_loadu_si128((const __m128i*) (frames + 1 * frameStride));
+    __m128i r2 = _mm_loadu_si128((const __m128i*) (frames + 2 * frameStride));
+    __m128i r3 = _mm_loadu_si128((const __m128i*) (frames + 3 * frameStride));
+    __m128i r4 = _mm_loadu_si128((const __m128i*) (frames + 4 * frameStride));
+    __m128i r5 = _mm_loadu_si128((const __m128i*) (frames + 5 * frameStride));
+    __m128i r6 = _mm_loadu_si128((const __m128i*) (frames + 6 * frameStride));
+    __m128i r7 = _mm_loadu_si128((const __m128i*) (frames + 7 * frameStride));
+
+    __m128i t0 = _mm_unpacklo_epi16(r0, r1);
+    __m128i t1 = _mm_unpackhi_epi16(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi16(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi16(r2, r3);
+    __m128i t4 = _mm_unpacklo_epi16(r4, r5);
+    __m128i t5 = _mm_unpackhi_epi16(r4, r5);
+    __m128i t6 = _mm_unpacklo_epi16(r6, r7);
+    __m128i t7 = _mm_unpackhi_epi16(r6, r7);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    _mm_storeu_si128((__m128i*) (dest[0] + destOffset), _mm_unpacklo_epi64(u0, u4));
+    _mm_storeu_si128((__m128i*) (dest[1] + destOffset), _mm_unpackhi_epi64(u0, u4));
+    _mm_storeu_si128((__m128i*) (dest[2] + destOffset), _mm_unpacklo_epi64(u1, u5));
+    _mm_storeu_si128((__m128i*) (dest[3] + destOffset), _mm_unpackhi_epi64(u1, u5));
+    _mm_storeu_si128((__m128i*) (dest[4] + destOffset), _mm_unpacklo_epi64(u2, u6));
+    _mm_storeu_si128((__m128i*) (dest[5] + destOffset), _mm_unpackhi_epi64(u2, u6));
+    _mm_storeu_si128((__m128i*) (dest[6] + destOffset), _mm_unpacklo_epi64(u3, u7));
+    _mm_storeu_si128((__m128i*) (dest[7] + destOffset), _mm_unpackhi_epi64(u3, u7));
+#else
+    for (int t = 0; t < TransposeChannels; ++t) {
+        const uint16_t* frame = frames + t * frameStride;
+        for (int j = 0; j < TransposeChannels; ++j) {
+            dest[j][destOffset + t] = frame[j];
+        }
+    }
+#endif
+}
+
+}
+
 WaveformFifo::WaveformFifo(SignalSources *signalSources_, int bufferSizeInDataBlocks_, int memorySizeInDataBlocks_, int maxWriteSizeInDataBlocks_, SystemState* state_) :
     signalSources(signalSources_),
     bufferSizeInDataBlocks(bufferSizeInDataBlocks_),
     memorySizeInDataBlocks(memorySizeInDataBlocks_),
     maxWriteSizeInDataBlocks(maxWriteSizeInDataBlocks_),
     numReaders(NumberOfReaders),
-    state(state_)
+    state(state_),
+    gpuStagingWidebandBuffer(nullptr),
+    gpuStagingLowpassBuffer(nullptr),
+    gpuStagingHighpassBuffer(nullptr),
+    layout(WaveformLayoutTimeMajor),
+    minMaxPyramids(nullptr),
+    numMinMaxPyramids(0)
 {
     if (numReaders < 1) {
         std::cerr << "WaveformFifo constructor: numReaders must be one or greater." << '\n';
@@ -59,12 +127,21 @@ WaveformFifo::WaveformFifo(SignalSources *signalSources_, int bufferSizeInDataBl
         return;
     }
 
-    maxSpikesPerDataBlock = 4;  // TODO: change from hard-coded value to...?  Need to coordinate value with GPU.
+    maxSpikesPerDataBlock = MaxSpikesPerDataBlock;  // TODO: change from hard-coded value to...?  Need to coordinate value with GPU.
 
     int maxWriteSizeInSamples = maxWriteSizeInDataBlocks * samplesPerDataBlock;
     bufferAllocateSize = bufferSize + maxWriteSizeInSamples;
     bufferAllocateSizeInBlocks = bufferSizeInDataBlocks + maxWriteSizeInDataBlocks;
 
+    // Min/max pyramid levels: power-of-two decimations that evenly divide a data block.
+    pyramidBinsPerBlock = 0;
+    for (int decimation = MinMaxPyramidBaseDecimation; decimation <= samplesPerDataBlock; decimation *= 2) {
+        if (samplesPerDataBlock % decimation != 0) break;
+        pyramidDecimation.push_back(decimation);
+        pyramidLevelOffset.push_back(pyramidBinsPerBlock);
+        pyramidBinsPerBlock += samplesPerDataBlock / decimation;
+    }
+
     usedWordsNewData = new Semaphore [numReaders];
     bufferReadIndex.resize(numReaders);
     bufferMemoryIndex.resize(numReaders);
@@ -78,6 +155,8 @@ WaveformFifo::WaveformFifo(SignalSources *signalSources_, int bufferSizeInDataBl
 WaveformFifo::~WaveformFifo()
 {
     freeMemory();
+    freeStagingMemory();
+    freeMinMaxPyramids();
     delete [] usedWordsNewData;
 }
 
@@ -115,6 +194,17 @@ void WaveformFifo::allocateMemory()
         freeMemory();
     }
 
+    // Staging buffers depend on numAmplifierChannels; applyLayoutSetting() reallocates them if the tiled layout is selected.
+    freeStagingMemory();
+    layout = WaveformLayoutTimeMajor;
+
+    freeMinMaxPyramids();
+    numMinMaxPyramids = 3 * numAmplifierChannels;
+    minMaxPyramids = new std::atomic<MinMaxPyramid*> [numMinMaxPyramids];
+    for (int i = 0; i < numMinMaxPyramids; ++i) {
+        minMaxPyramids[i].store(nullptr);
+    }
+
     timeStampBuffer = nullptr;
     gpuAmplifierWidebandBuffer = nullptr;
     gpuAmplifierLowpassBuffer = nullptr;
@@ -193,6 +283,8 @@ void WaveformFifo::allocateMemory()
         }
     }
 
+    buildWaveformHandles();
+
     std::cout << "WaveformFifo: Allocated " << memoryNeededGB << " GBytes for waveform buffers." << '\n';
 }
 
@@ -216,6 +308,99 @@ void WaveformFifo::freeMemory()
         delete [] i->second;
     }
     digitalWaveformIndices.clear();
+    gpuWaveformAddresses.clear();
+
+    waveformRegistry.clear();
+    analogByHandle.clear();
+    digitalByHandle.clear();
+    gpuByHandle.clear();
+}
+
+// Assign one handle per waveform name (e.g., "A-000|SPK" names both a digital buffer and a GPU address) and
+// fill the handle-indexed tables, so name lookups hash once and per-sample paths never touch the maps.
+void WaveformFifo::buildWaveformHandles()
+{
+    std::vector<std::string> names;
+    names.reserve(analogWaveformIndices.size() + digitalWaveformIndices.size() + gpuWaveformAddresses.size());
+    for (auto i = analogWaveformIndices.begin(); i != analogWaveformIndices.end(); ++i) names.push_back(i->first);
+    for (auto i = digitalWaveformIndices.begin(); i != digitalWaveformIndices.end(); ++i) names.push_back(i->first);
+    for (auto i = gpuWaveformAddresses.begin(); i != gpuWaveformAddresses.end(); ++i) names.push_back(i->first);
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    waveformRegistry.build(names);
+    analogByHandle.assign(names.size(), nullptr);
+    digitalByHandle.assign(names.size(), nullptr);
+    gpuByHandle.assign(names.size(), GpuWaveformAddress{ GpuWaveformWideband, -1 });
+    for (auto i = analogWaveformIndices.begin(); i != analogWaveformIndices.end(); ++i) {
+        analogByHandle[waveformRegistry.lookup(i->first)] = i->second;
+    }
+    for (auto i = digitalWaveformIndices.begin(); i != digitalWaveformIndices.end(); ++i) {
+        digitalByHandle[waveformRegistry.lookup(i->first)] = i->second;
+    }
+    for (auto i = gpuWaveformAddresses.begin(); i != gpuWaveformAddresses.end(); ++i) {
+        gpuByHandle[waveformRegistry.lookup(i->first)] = i->second;
+    }
+}
+
+void WaveformFifo::freeStagingMemory()
+{
+    delete [] gpuStagingWidebandBuffer;
+    delete [] gpuStagingLowpassBuffer;
+    delete [] gpuStagingHighpassBuffer;
+    gpuStagingWidebandBuffer = nullptr;
+    gpuStagingLowpassBuffer = nullptr;
+    gpuStagingHighpassBuffer = nullptr;
+}
+
+// Switch between time-major and channel-tiled amplifier buffers.  Buffer contents are not converted, so this should
+// only be called when the buffer is empty (i.e., from applyLayoutSetting()).
+void WaveformFifo::setLayout(WaveformLayout newLayout)
+{
+    freeStagingMemory();
+    layout = WaveformLayoutTimeMajor;
+    if (newLayout != WaveformLayoutChannelTiled) return;
+
+    int stagingSize = maxWriteSizeInDataBlocks * samplesPerDataBlock * numAmplifierChannels;
+    try {
+        gpuStagingWidebandBuffer = new uint16_t [stagingSize];
+        gpuStagingLowpassBuffer = new uint16_t [stagingSize];
+        gpuStagingHighpassBuffer = new uint16_t [stagingSize];
+    } catch (std::bad_alloc&) {
+        freeStagingMemory();
+        std::cerr << "WaveformFifo::setLayout(): unable to allocate staging memory; using time-major layout." << '\n';
+        return;
+    }
+    layout = WaveformLayoutChannelTiled;
+}
+
+// Blocked transpose of numDataBlocks time-major data blocks (frames) to channel-major tiles.  Channels are handled
+// in small groups so that each frame row is read a cache line at a time while only a few tile rows are being written.
+void WaveformFifo::transposeToTiles(uint16_t* tiles, const uint16_t* frames, int numDataBlocks) const
+{
+    const int ChannelGroup = 16;
+    const int tileSize = samplesPerDataBlock * numAmplifierChannels;
+    for (int block = 0; block < numDataBlocks; ++block) {
+        const uint16_t* source = frames + block * tileSize;
+        uint16_t* dest = tiles + block * tileSize;
+        for (int firstChannel = 0; firstChannel < numAmplifierChannels; firstChannel += ChannelGroup) {
+            int lastChannel = std::min(firstChannel + ChannelGroup, numAmplifierChannels);
+            for (int t = 0; t < samplesPerDataBlock; ++t) {
+                const uint16_t* frame = source + t * numAmplifierChannels;
+                for (int channel = firstChannel; channel < lastChannel; ++channel) {
+                    dest[channel * samplesPerDataBlock + t] = frame[channel];
+                }
+            }
+        }
+    }
+}
+
+const uint16_t* WaveformFifo::gpuAmplifierBuffer(GpuWaveformType waveformType) const
+{
+    if (waveformType == GpuWaveformWideband) return gpuAmplifierWidebandBuffer;
+    else if (waveformType == GpuWaveformLowpass) return gpuAmplifierLowpassBuffer;
+    else if (waveformType == GpuWaveformHighpass) return gpuAmplifierHighpassBuffer;
+    return nullptr;
 }
 
 bool WaveformFifo::requestWriteSpace(int numDataBlocks)
@@ -237,13 +422,28 @@ bool WaveformFifo::requestWriteSpace(int numDataBlocks)
 
 void WaveformFifo::commitNewData()
 {
+    // The display cannot be reading these data blocks (they were free space), so their summaries can be invalidated
+    // without holding the lock.
+    invalidateMinMaxPyramids(bufferWriteIndex / samplesPerDataBlock, numWordsToBeWritten / samplesPerDataBlock);
+
+    if (layout == WaveformLayoutChannelTiled) {
+        // Only the writing thread changes bufferWriteIndex, and readers cannot see this data until it is committed
+        // below, so the transpose can be done without holding the lock.
+        int numDataBlocks = numWordsToBeWritten / samplesPerDataBlock;
+        int offset = bufferWriteIndex * numAmplifierChannels;
+        transposeToTiles(&gpuAmplifierWidebandBuffer[offset], gpuStagingWidebandBuffer, numDataBlocks);
+        transposeToTiles(&gpuAmplifierLowpassBuffer[offset], gpuStagingLowpassBuffer, numDataBlocks);
+        transposeToTiles(&gpuAmplifierHighpassBuffer[offset], gpuStagingHighpassBuffer, numDataBlocks);
+    }
+
     std::lock_guard<std::mutex> lock(mtx);
 
     bufferWriteIndex += numWordsToBeWritten;
     if (bufferWriteIndex == bufferSize) {
         bufferWriteIndex = 0;
     } else if (bufferWriteIndex > bufferSize) {
-        // Copy 'overhanging' data to beginning of buffer.
+        // Copy 'overhanging' data to beginning of buffer.  (bufferSize is a whole number of data blocks, so this is
+        // also correct for whole tiles in WaveformLayoutChannelTiled.)
         // Note: You can avoid this potentially time-consuming memory copy by always writing the same
         // number of samples, and making the buffer size an integer multiple of this number.
 
@@ -260,7 +460,7 @@ void WaveformFifo::commitNewData()
         uint16_t* digitalWaveformBuffer = nullptr;
         for (std::map<std::string, uint16_t*>::const_iterator i = digitalWaveformIndices.begin(); i != digitalWaveformIndices.end(); ++i) {
             digitalWaveformBuffer = i->second;
-            std::memcpy(digitalWaveformBuffer, &digitalWaveformBuffer[bufferSize], sizeof(float) * (bufferWriteIndex - bufferSize));
+            std::memcpy(digitalWaveformBuffer, &digitalWaveformBuffer[bufferSize], sizeof(uint16_t) * (bufferWriteIndex - bufferSize));
         }
 
         std::memcpy(gpuAmplifierWidebandBuffer, &gpuAmplifierWidebandBuffer[bufferSize * numAmplifierChannels],
@@ -289,14 +489,15 @@ bool WaveformFifo::requestReadNewData(Reader reader, int numWords, bool lastRead
             numWordsToBeRead[reader] = numWords;
             return true;
         } else {
-            if (reader == ReaderDisplay) {
-                state->writeToLog("Failed to acquire words. numWords: " + QString::number(numWords));
+            if (reader == ReaderDisplay && state->logErrors) {
+                state->writeToLog("Failed to acquire words. numWords: " + QString::number(numWords), LogDebug);
             }
             return false;
         }
     } else {
-        if (reader == ReaderDisplay) {
-            state->writeToLog("Insufficient data available in buffer. Available: " + QString::number(numWords) + " ... requested: " + QString::number(usedWordsNewData[reader].available()));
+        if (reader == ReaderDisplay && state->logErrors) {
+            state->writeToLog("Insufficient data available in buffer. Available: " + QString::number(usedWordsNewData[reader].available()) +
+                              " ... requested: " + QString::number(numWords), LogDebug);
         }
         return false;   // insufficient data available in buffer
     }
@@ -329,26 +530,152 @@ void WaveformFifo::getMinMaxGpuAmplifierData(MinMax<float> &init, Reader reader,
         return;
     }
 
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddress.waveformType);
+    if (!buffer) return;
+
     int index = bufferReadIndex[reader] + timeIndex;
     if (index < 0) index += bufferSize;
     else if (index >= bufferSize) index -= bufferSize;
-    int channelIndex = waveformAddress.waveformIndex;
-    if (waveformAddress.waveformType == GpuWaveformWideband) {
-        for (int i = 0; i < numSamples; ++i) {
-            init.update(0.195F * (((float) gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F));
-            if (++index == bufferSize) index = 0;
+    int channel = waveformAddress.waveformIndex;
+
+    // Find the raw min and max, then convert only those two values to microvolts.
+    uint16_t rawMin = 0xffffu;
+    uint16_t rawMax = 0;
+
+    // Pyramids are only used by the display reader (the only reader that calls this method from a single thread), and
+    // only for spans long enough to contain at least one whole bin.
+    MinMaxPyramid* pyramid = nullptr;
+    if (reader == ReaderDisplay && !pyramidDecimation.empty() && numSamples >= 2 * pyramidDecimation[0]) {
+        pyramid = minMaxPyramid(waveformAddress);
+    }
+
+    if (!pyramid) {
+        scanMinMaxGpuAmplifierData(buffer, channel, index, numSamples, rawMin, rawMax);
+    } else {
+        // Step through the span using the coarsest aligned bin that fits, scanning raw samples only up to the first
+        // bin boundary and after the last one.
+        const int numLevels = (int) pyramidDecimation.size();
+        while (numSamples > 0) {
+            int offset = index % samplesPerDataBlock;
+            int level = numLevels - 1;
+            while (level >= 0 && (offset % pyramidDecimation[level] != 0 || pyramidDecimation[level] > numSamples)) --level;
+            if (level < 0) {
+                int length = std::min(numSamples, pyramidDecimation[0] - (offset % pyramidDecimation[0]));
+                scanMinMaxGpuAmplifierData(buffer, channel, index, length, rawMin, rawMax);
+                numSamples -= length;
+            } else {
+                const uint16_t* bins = minMaxPyramidBlock(pyramid, buffer, channel, index / samplesPerDataBlock);
+                const uint16_t* bin = &bins[2 * (pyramidLevelOffset[level] + offset / pyramidDecimation[level])];
+                rawMin = std::min(rawMin, bin[0]);
+                rawMax = std::max(rawMax, bin[1]);
+                numSamples -= pyramidDecimation[level];
+                index += pyramidDecimation[level];
+                if (index >= bufferSize) index -= bufferSize;
+            }
         }
-    } else if (waveformAddress.waveformType == GpuWaveformLowpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            init.update(0.195F * (((float) gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F));
-            if (++index == bufferSize) index = 0;
+    }
+
+    if (rawMin > rawMax) return;
+    init.update(0.195F * (((float) rawMin) - 32768.0F));
+    init.update(0.195F * (((float) rawMax) - 32768.0F));
+}
+
+// Update rawMin and rawMax from numSamples raw samples of one channel, starting at buffer index (which is advanced).
+void WaveformFifo::scanMinMaxGpuAmplifierData(const uint16_t* buffer, int channel, int& index, int numSamples,
+                                              uint16_t& rawMin, uint16_t& rawMax) const
+{
+    while (numSamples > 0) {
+        int stride, length;
+        const uint16_t* pRead = gpuAmplifierRun(buffer, channel, index, numSamples, stride, length);
+        for (int i = 0; i < length; ++i) {
+            uint16_t value = pRead[i * stride];
+            rawMin = std::min(rawMin, value);
+            rawMax = std::max(rawMax, value);
         }
-    } else if (waveformAddress.waveformType == GpuWaveformHighpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            init.update(0.195F * (((float) gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F));
-            if (++index == bufferSize) index = 0;
+        numSamples -= length;
+        index += length;
+        if (index >= bufferSize) index -= bufferSize;
+    }
+}
+
+// Return the min/max pyramid for a GPU amplifier waveform, creating it if necessary.  Returns nullptr if the waveform
+// has no pyramid or memory could not be allocated (in which case callers scan raw samples instead).
+MinMaxPyramid* WaveformFifo::minMaxPyramid(GpuWaveformAddress waveformAddress) const
+{
+    if (waveformAddress.waveformType == GpuWaveformSpike || waveformAddress.waveformIndex < 0 ||
+            waveformAddress.waveformIndex >= numAmplifierChannels || !minMaxPyramids) {
+        return nullptr;
+    }
+    std::atomic<MinMaxPyramid*>& slot = minMaxPyramids[waveformAddress.waveformType * numAmplifierChannels +
+            waveformAddress.waveformIndex];
+    MinMaxPyramid* pyramid = slot.load(std::memory_order_acquire);
+    if (!pyramid) {
+        try {
+            pyramid = new MinMaxPyramid;
+            pyramid->valid.assign(bufferSizeInDataBlocks, 0);
+            pyramid->bins.resize((size_t) bufferSizeInDataBlocks * pyramidBinsPerBlock * 2);
+        } catch (std::bad_alloc&) {
+            delete pyramid;
+            return nullptr;
         }
+        slot.store(pyramid, std::memory_order_release);
     }
+    return pyramid;
+}
+
+// Return the (min, max) bins of one data block of a pyramid, computing them from raw samples if they are not valid.
+const uint16_t* WaveformFifo::minMaxPyramidBlock(MinMaxPyramid* pyramid, const uint16_t* buffer, int channel, int block) const
+{
+    uint16_t* bins = &pyramid->bins[(size_t) block * pyramidBinsPerBlock * 2];
+    if (pyramid->valid[block]) return bins;
+
+    // Finest level from raw samples.
+    int index = block * samplesPerDataBlock;
+    int numBins = samplesPerDataBlock / pyramidDecimation[0];
+    for (int b = 0; b < numBins; ++b) {
+        uint16_t rawMin = 0xffffu;
+        uint16_t rawMax = 0;
+        scanMinMaxGpuAmplifierData(buffer, channel, index, pyramidDecimation[0], rawMin, rawMax);
+        bins[2 * b] = rawMin;
+        bins[2 * b + 1] = rawMax;
+    }
+
+    // Each coarser level from pairs of bins in the level below.
+    for (int level = 1; level < (int) pyramidDecimation.size(); ++level) {
+        const uint16_t* finer = &bins[2 * pyramidLevelOffset[level - 1]];
+        uint16_t* coarser = &bins[2 * pyramidLevelOffset[level]];
+        numBins = samplesPerDataBlock / pyramidDecimation[level];
+        for (int b = 0; b < numBins; ++b) {
+            coarser[2 * b] = std::min(finer[4 * b], finer[4 * b + 2]);
+            coarser[2 * b + 1] = std::max(finer[4 * b + 1], finer[4 * b + 3]);
+        }
+    }
+
+    pyramid->valid[block] = 1;
+    return bins;
+}
+
+// Mark numBlocks data blocks, starting at firstBlock (which may be in the extra space beyond the end of the buffer),
+// as needing new summaries in every existing pyramid.
+void WaveformFifo::invalidateMinMaxPyramids(int firstBlock, int numBlocks)
+{
+    for (int i = 0; i < numMinMaxPyramids; ++i) {
+        MinMaxPyramid* pyramid = minMaxPyramids[i].load(std::memory_order_acquire);
+        if (!pyramid) continue;
+        for (int block = firstBlock; block < firstBlock + numBlocks; ++block) {
+            pyramid->valid[block % bufferSizeInDataBlocks] = 0;
+        }
+    }
+}
+
+void WaveformFifo::freeMinMaxPyramids()
+{
+    for (int i = 0; i < numMinMaxPyramids; ++i) {
+        delete minMaxPyramids[i].load();
+    }
+    delete [] minMaxPyramids;
+    minMaxPyramids = nullptr;
+    numMinMaxPyramids = 0;
 }
 
 void WaveformFifo::getMinMaxData(MinMax<float> &init, Reader reader, const float* waveform, int timeIndex, int numSamples) const
@@ -407,72 +734,78 @@ uint16_t WaveformFifo::getRasterData(Reader reader, const uint16_t* rasterData,
     return result;
 }
 
-bool WaveformFifo::extractGpuSpikeDataOneDataBlock(uint16_t* waveform, GpuWaveformAddress waveformAddress, bool firstTime) const
+// Convert the XPU spike detector output for numDataBlocks consecutive data blocks (starting at the current write
+// position) to a spike raster waveform.  Returns the number of spikes found.
+int WaveformFifo::extractGpuSpikeData(uint16_t* waveform, GpuWaveformAddress waveformAddress, int numDataBlocks,
+                                      bool firstTime) const
 {
-    bool spikeFound = false;
+    int totalSpikes = 0;
     if (waveformAddress.waveformType != GpuWaveformSpike) {
-        std::cerr << "Error: WaveformFifo::extractGpuSpikeDataOneDataBlock: waveform is not GpuWaveformSpike type." << '\n';
-        return spikeFound;
+        std::cerr << "Error: WaveformFifo::extractGpuSpikeData: waveform is not GpuWaveformSpike type." << '\n';
+        return totalSpikes;
     }
     if (bufferWriteIndex % samplesPerDataBlock != 0) {
-        std::cerr << "Error: WaveformFifo::extractGpuSpikeDataOneDataBlock: bufferWriteIndex is not an integer multiple of samplesPerDataBlock." << '\n';
-        return spikeFound;
-    }
-
-    int bufferWriteIndexPrev = bufferWriteIndex - samplesPerDataBlock;
-    if (bufferWriteIndexPrev < 0) bufferWriteIndexPrev += bufferSize;
-
-    // Read GPU spike detector output data and create lists of spike IDs along with corresponding timestamps.
-    std::vector<uint32_t> spikeTimeStampList;
-    std::vector<uint16_t> spikeIdList;
-    uint32_t spikeTimeStamp;
-    uint8_t spikeId;
-    int bufferWriteIndexBlock = bufferWriteIndex / samplesPerDataBlock;
-    int index = bufferWriteIndexBlock * numAmplifierChannels * maxSpikesPerDataBlock + waveformAddress.waveformIndex;
-    for (int k = 0; k < maxSpikesPerDataBlock; ++k) {
-        spikeId = gpuSpikeIds[index];
-        if (spikeId != SpikeIdNoSpike) {
-            spikeTimeStamp = gpuSpikeTimestamps[index];
-            spikeFound = true;
-            // std::cout << "found spike " << (int) spikeId << " at timestamp " << spikeTimeStamp << " in channel " << waveformAddress.waveformIndex << EndOfLine;
-            spikeTimeStampList.push_back(spikeTimeStamp);
-            spikeIdList.push_back((uint16_t) spikeId);
-        }
-        index += numAmplifierChannels;
-        if (index >= bufferAllocateSizeInBlocks * numAmplifierChannels * maxSpikesPerDataBlock) {
-            std::cerr << "Error!  Indexing outside of GPU spike timestamp allocated memory."  << '\n';
-        }
-    }
-
-    // Initialize spike output to all zeros (i.e., no spikes)
-    for (int i = bufferWriteIndex; i < bufferWriteIndex + samplesPerDataBlock; ++i) {
-        waveform[i]= 0;
-    }
-
-    for (int j = 0; j < (int) spikeTimeStampList.size(); ++j) {
-        bool found = false;
-        // First, search for spike timestamp in current datablock.
-        for (int i = bufferWriteIndex; i < bufferWriteIndex + samplesPerDataBlock; ++i) {
-            if (timeStampBuffer[i] == spikeTimeStampList[j]) {
-                found = true;
-                waveform[i] = spikeIdList[j];
+        std::cerr << "Error: WaveformFifo::extractGpuSpikeData: bufferWriteIndex is not an integer multiple of samplesPerDataBlock." << '\n';
+        return totalSpikes;
+    }
+
+    for (int block = 0; block < numDataBlocks; ++block) {
+        int blockWriteIndex = bufferWriteIndex + block * samplesPerDataBlock;
+        int blockWriteIndexPrev = blockWriteIndex - samplesPerDataBlock;
+        if (blockWriteIndexPrev < 0) blockWriteIndexPrev += bufferSize;
+        bool firstBlock = firstTime && block == 0;
+
+        // Read GPU spike detector output data and create lists of spike IDs along with corresponding timestamps.
+        uint32_t spikeTimeStampList[MaxSpikesPerDataBlock];
+        uint16_t spikeIdList[MaxSpikesPerDataBlock];
+        int numSpikes = 0;
+        int index = (blockWriteIndex / samplesPerDataBlock) * numAmplifierChannels * maxSpikesPerDataBlock +
+                waveformAddress.waveformIndex;
+        for (int k = 0; k < maxSpikesPerDataBlock; ++k) {
+            if (index >= bufferAllocateSizeInBlocks * numAmplifierChannels * maxSpikesPerDataBlock) {
+                std::cerr << "Error!  Indexing outside of GPU spike timestamp allocated memory."  << '\n';
                 break;
             }
+            uint8_t spikeId = gpuSpikeIds[index];
+            if (spikeId != SpikeIdNoSpike) {
+                spikeTimeStampList[numSpikes] = gpuSpikeTimestamps[index];
+                spikeIdList[numSpikes] = (uint16_t) spikeId;
+                ++numSpikes;
+            }
+            index += numAmplifierChannels;
+        }
+        totalSpikes += numSpikes;
+
+        // Initialize spike output to all zeros (i.e., no spikes)
+        for (int i = blockWriteIndex; i < blockWriteIndex + samplesPerDataBlock; ++i) {
+            waveform[i]= 0;
         }
-        if (!found && !firstTime) {   // If we don't find timestamp in current datablock, search previous datablock.
-            for (int i = bufferWriteIndexPrev + samplesPerDataBlock - 1; i >= bufferWriteIndexPrev; --i) {
+
+        for (int j = 0; j < numSpikes; ++j) {
+            bool found = false;
+            // First, search for spike timestamp in current datablock.
+            for (int i = blockWriteIndex; i < blockWriteIndex + samplesPerDataBlock; ++i) {
                 if (timeStampBuffer[i] == spikeTimeStampList[j]) {
                     found = true;
                     waveform[i] = spikeIdList[j];
                     break;
                 }
             }
-        }
-        if (!found && !firstTime) {
-            std::cout << "Error:: WaveformFifo::extractGpuSpikeDataOneDataBlock: timestamp " << spikeTimeStampList[j] << " not found!" << '\n';
+            if (!found && !firstBlock) {   // If we don't find timestamp in current datablock, search previous datablock.
+                for (int i = blockWriteIndexPrev + samplesPerDataBlock - 1; i >= blockWriteIndexPrev; --i) {
+                    if (timeStampBuffer[i] == spikeTimeStampList[j]) {
+                        found = true;
+                        waveform[i] = spikeIdList[j];
+                        break;
+                    }
+                }
+            }
+            if (!found && !firstBlock) {
+                std::cout << "Error:: WaveformFifo::extractGpuSpikeData: timestamp " << spikeTimeStampList[j] << " not found!" << '\n';
+            }
         }
     }
-    return spikeFound;
+    return totalSpikes;
 }
 
 float WaveformFifo::getGpuAmplifierData(Reader reader, GpuWaveformAddress waveformAddress, int timeIndex) const
@@ -482,19 +815,13 @@ float WaveformFifo::getGpuAmplifierData(Reader reader, GpuWaveformAddress wavefo
         return 0.0F;
     }
 
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddress.waveformType);
+    if (!buffer) return 0.0F;
+
     int index = bufferReadIndex[reader] + timeIndex;
     if (index < 0) index += bufferSize;
     else if (index >= bufferSize) index -= bufferSize;
-    int channelIndex = waveformAddress.waveformIndex;
-    if (waveformAddress.waveformType == GpuWaveformWideband) {
-        return 0.195F * (((float) gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-    } else if (waveformAddress.waveformType == GpuWaveformLowpass) {
-        return 0.195F * (((float) gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-    } else if (waveformAddress.waveformType == GpuWaveformHighpass) {
-        return 0.195F * (((float) gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-    } else {
-        return 0.0F;
-    }
+    return 0.195F * (((float) buffer[gpuAmplifierOffset(index, waveformAddress.waveformIndex)]) - 32768.0F);
 }
 
 uint16_t WaveformFifo::getGpuAmplifierDataRaw(Reader reader, GpuWaveformAddress waveformAddress, int timeIndex) const
@@ -505,19 +832,13 @@ uint16_t WaveformFifo::getGpuAmplifierDataRaw(Reader reader, GpuWaveformAddress
         return 32768U;
     }
 
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddress.waveformType);
+    if (!buffer) return 32768U;
+
     int index = bufferReadIndex[reader] + timeIndex;
     if (index < 0) index += bufferSize;
     else if (index >= bufferSize) index -= bufferSize;
-    int channelIndex = waveformAddress.waveformIndex;
-    if (waveformAddress.waveformType == GpuWaveformWideband) {
-        return gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex];
-    } else if (waveformAddress.waveformType == GpuWaveformLowpass) {
-        return gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex];
-    } else if (waveformAddress.waveformType == GpuWaveformHighpass) {
-        return gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex];
-    } else {
-        return 32768U;
-    }
+    return buffer[gpuAmplifierOffset(index, waveformAddress.waveformIndex)];
 }
 
 void WaveformFifo::copyGpuAmplifierData(Reader reader, float* dest, GpuWaveformAddress waveformAddress, int timeIndex, int numSamples) const
@@ -527,29 +848,23 @@ void WaveformFifo::copyGpuAmplifierData(Reader reader, float* dest, GpuWaveformA
         return;
     }
 
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddress.waveformType);
+    if (!buffer) return;
+
     float* pWrite = dest;
     int index = bufferReadIndex[reader] + timeIndex;
     if (index < 0) index += bufferSize;
     else if (index >= bufferSize) index -= bufferSize;
-    int channelIndex = waveformAddress.waveformIndex;
-    if (waveformAddress.waveformType == GpuWaveformWideband) {
-        for (int i = 0; i < numSamples; ++i) {
-            *pWrite = 0.195F * (((float) gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-            if (++index == bufferSize) index = 0;
-            ++pWrite;
-        }
-    } else if (waveformAddress.waveformType == GpuWaveformLowpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            *pWrite = 0.195F * (((float) gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-            if (++index == bufferSize) index = 0;
-            ++pWrite;
-        }
-    } else if (waveformAddress.waveformType == GpuWaveformHighpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            *pWrite = 0.195F * (((float) gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex]) - 32768.0F);
-            if (++index == bufferSize) index = 0;
-            ++pWrite;
+    while (numSamples > 0) {
+        int stride, length;
+        const uint16_t* pRead = gpuAmplifierRun(buffer, waveformAddress.waveformIndex, index, numSamples, stride, length);
+        for (int i = 0; i < length; ++i) {
+            pWrite[i] = 0.195F * (((float) pRead[i * stride]) - 32768.0F);
         }
+        pWrite += length;
+        numSamples -= length;
+        index += length;
+        if (index >= bufferSize) index -= bufferSize;
     }
 }
 
@@ -561,28 +876,33 @@ void WaveformFifo::copyGpuAmplifierDataRaw(Reader reader, uint16_t* dest, GpuWav
         return;
     }
 
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddress.waveformType);
+    if (!buffer) return;
+
     uint16_t* pWrite = dest;
     int index = bufferReadIndex[reader] + timeIndex;
     if (index < 0) index += bufferSize;
     else if (index >= bufferSize) index -= bufferSize;
     int channelIndex = waveformAddress.waveformIndex;
-    if (waveformAddress.waveformType == GpuWaveformWideband) {
-        for (int i = 0; i < numSamples; ++i) {
-            *pWrite = gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex];
-            index += downsampleFactor;
-            if (index >= bufferSize) index -= bufferSize;
-            ++pWrite;
-        }
-    } else if (waveformAddress.waveformType == GpuWaveformLowpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            *pWrite = gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex];
-            index += downsampleFactor;
+    if (downsampleFactor == 1) {
+        while (numSamples > 0) {
+            int stride, length;
+            const uint16_t* pRead = gpuAmplifierRun(buffer, channelIndex, index, numSamples, stride, length);
+            if (stride == 1) {
+                std::memcpy(pWrite, pRead, length * sizeof(uint16_t));
+            } else {
+                for (int i = 0; i < length; ++i) {
+                    pWrite[i] = pRead[i * stride];
+                }
+            }
+            pWrite += length;
+            numSamples -= length;
+            index += length;
             if (index >= bufferSize) index -= bufferSize;
-            ++pWrite;
         }
-    } else if (waveformAddress.waveformType == GpuWaveformHighpass) {
+    } else {
         for (int i = 0; i < numSamples; ++i) {
-            *pWrite = gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex];
+            *pWrite = buffer[gpuAmplifierOffset(index, channelIndex)];
             index += downsampleFactor;
             if (index >= bufferSize) index -= bufferSize;
             ++pWrite;
@@ -598,44 +918,142 @@ void WaveformFifo::copyGpuAmplifierDataArrayRaw(Reader reader, uint16_t* dest, c
         return;
     }
 
-    uint16_t* pWrite = dest;
-    int index = bufferReadIndex[reader] + timeIndex;
-    if (index < 0) index += bufferSize;
-    else if (index >= bufferSize) index -= bufferSize;
-    std::vector<int> channelIndex(waveformAddresses.size());
-    for (int j = 0; j < (int) waveformAddresses.size(); ++j) {
-        channelIndex[j] = waveformAddresses[j].waveformIndex;
-    }
-    if (waveformAddresses[0].waveformType == GpuWaveformWideband) {
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddresses[0].waveformType);
+    if (!buffer) return;
+
+    int startIndex = bufferReadIndex[reader] + timeIndex;
+    if (startIndex < 0) startIndex += bufferSize;
+    else if (startIndex >= bufferSize) startIndex -= bufferSize;
+    int numWaveforms = (int) waveformAddresses.size();
+
+    if (layout == WaveformLayoutTimeMajor) {
+        std::vector<int> channelIndex(numWaveforms);
+        for (int j = 0; j < numWaveforms; ++j) {
+            channelIndex[j] = waveformAddresses[j].waveformIndex;
+        }
+        uint16_t* pWrite = dest;
+        int index = startIndex;
         for (int i = 0; i < numSamples; ++i) {
-            for (int j = 0; j < (int) waveformAddresses.size(); ++j) {
-                *pWrite = gpuAmplifierWidebandBuffer[numAmplifierChannels * index + channelIndex[j]];
+            const uint16_t* frame = &buffer[numAmplifierChannels * index];
+            for (int j = 0; j < numWaveforms; ++j) {
+                *pWrite = frame[channelIndex[j]];
                 ++pWrite;
             }
             index += downsampleFactor;
             if (index >= bufferSize) index -= bufferSize;
         }
-    } else if (waveformAddresses[0].waveformType == GpuWaveformLowpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            for (int j = 0; j < (int) waveformAddresses.size(); ++j) {
-                *pWrite = gpuAmplifierLowpassBuffer[numAmplifierChannels * index + channelIndex[j]];
-                ++pWrite;
+    } else {
+        // Output is still interleaved by sample; read each channel's contiguous runs and scatter them.
+        for (int j = 0; j < numWaveforms; ++j) {
+            int channelIndex = waveformAddresses[j].waveformIndex;
+            uint16_t* pWrite = dest + j;
+            int index = startIndex;
+            for (int i = 0; i < numSamples; ++i) {
+                *pWrite = buffer[gpuAmplifierOffset(index, channelIndex)];
+                pWrite += numWaveforms;
+                index += downsampleFactor;
+                if (index >= bufferSize) index -= bufferSize;
             }
-            index += downsampleFactor;
-            if (index >= bufferSize) index -= bufferSize;
         }
-    } else if (waveformAddresses[0].waveformType == GpuWaveformHighpass) {
-        for (int i = 0; i < numSamples; ++i) {
-            for (int j = 0; j < (int) waveformAddresses.size(); ++j) {
-                *pWrite = gpuAmplifierHighpassBuffer[numAmplifierChannels * index + channelIndex[j]];
-                ++pWrite;
+    }
+}
+
+void WaveformFifo::copyGpuAmplifierChannelsRaw(Reader reader, uint16_t* const* dest, const GpuWaveformAddress* waveformAddresses,
+                                               int numChannels, int timeIndex, int numSamples, int downsampleFactor) const
+{
+    if (timeIndex + numSamples > numWordsToBeRead[reader] || timeIndex < -numWordsInMemory(reader)) {
+        std::cerr << "Error: WaveformFifo::copyGpuAmplifierChannelsRaw: timeIndex out of range." << '\n';
+        return;
+    }
+    if (numChannels < 1) return;
+
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformAddresses[0].waveformType);
+    if (!buffer) return;
+
+    int startIndex = bufferReadIndex[reader] + timeIndex;
+    if (startIndex < 0) startIndex += bufferSize;
+    else if (startIndex >= bufferSize) startIndex -= bufferSize;
+
+    if (layout == WaveformLayoutChannelTiled || downsampleFactor != 1) {
+        // Per-channel reads are already contiguous (tiled), or cannot use the transpose (downsampled).
+        for (int j = 0; j < numChannels; ++j) {
+            int channelIndex = waveformAddresses[j].waveformIndex;
+            uint16_t* pWrite = dest[j];
+            int index = startIndex;
+            int remaining = numSamples;
+            while (remaining > 0) {
+                if (downsampleFactor == 1) {
+                    int stride, length;
+                    const uint16_t* pRead = gpuAmplifierRun(buffer, channelIndex, index, remaining, stride, length);
+                    std::memcpy(pWrite, pRead, length * sizeof(uint16_t));
+                    pWrite += length;
+                    remaining -= length;
+                    index += length;
+                } else {
+                    *pWrite = buffer[gpuAmplifierOffset(index, channelIndex)];
+                    ++pWrite;
+                    --remaining;
+                    index += downsampleFactor;
+                }
+                if (index >= bufferSize) index -= bufferSize;
             }
-            index += downsampleFactor;
+        }
+        return;
+    }
+
+    // Time-major: work through groups of up to eight channels, reading a run of frames (up to the end of the circular
+    // buffer) for each group.  Groups whose channel indices are consecutive are transposed eight samples at a time.
+    for (int firstChannel = 0; firstChannel < numChannels; firstChannel += TransposeChannels) {
+        int groupSize = std::min(TransposeChannels, numChannels - firstChannel);
+        int channelIndex[TransposeChannels];
+        bool consecutive = groupSize == TransposeChannels;
+        for (int j = 0; j < groupSize; ++j) {
+            channelIndex[j] = waveformAddresses[firstChannel + j].waveformIndex;
+            if (j > 0 && channelIndex[j] != channelIndex[0] + j) consecutive = false;
+        }
+        uint16_t* const* groupDest = dest + firstChannel;
+
+        int index = startIndex;
+        int done = 0;
+        while (done < numSamples) {
+            int length = std::min(numSamples - done, bufferSize - index);
+            const uint16_t* frames = &buffer[numAmplifierChannels * index];
+            int t = 0;
+            if (consecutive) {
+                for (; t + TransposeChannels <= length; t += TransposeChannels) {
+                    transpose8x8(groupDest, done + t, frames + numAmplifierChannels * t + channelIndex[0], numAmplifierChannels);
+                }
+            }
+            for (; t < length; ++t) {
+                const uint16_t* frame = frames + numAmplifierChannels * t;
+                for (int j = 0; j < groupSize; ++j) {
+                    groupDest[j][done + t] = frame[channelIndex[j]];
+                }
+            }
+            done += length;
+            index += length;
             if (index >= bufferSize) index -= bufferSize;
         }
     }
 }
 
+void WaveformFifo::copyGpuAmplifierFrame(char* dest, GpuWaveformType waveformType, int index, int firstChannel, int numChannels) const
+{
+    const uint16_t* buffer = gpuAmplifierBuffer(waveformType);
+    if (!buffer) return;
+
+    if (layout == WaveformLayoutTimeMajor) {
+        std::memcpy(dest, &buffer[numAmplifierChannels * index + firstChannel], numChannels * sizeof(uint16_t));
+    } else {
+        const uint16_t* pRead = &buffer[gpuAmplifierOffset(index, firstChannel)];
+        for (int i = 0; i < numChannels; ++i) {
+            std::memcpy(dest, pRead, sizeof(uint16_t));
+            dest += sizeof(uint16_t);
+            pRead += samplesPerDataBlock;
+        }
+    }
+}
+
 void WaveformFifo::copyAnalogData(Reader reader, float* dest, const float* waveform, int timeIndex, int numSamples) const
 {
     if (timeIndex + numSamples > numWordsToBeRead[reader] || timeIndex < -numWordsInMemory(reader)) {
@@ -735,6 +1153,8 @@ void WaveformFifo::copyTimeStamps(Reader reader, uint32_t* dest, int timeIndex,
 // Call once after all reading is complete.
 void WaveformFifo::freeOldData(Reader reader)
 {
+    state->pipelineProfiler->record((PipelineStage) (StageReaderDisplay + reader), numWordsToBeRead[reader]);
+
     std::lock_guard<std::mutex> lock(mtx);
 
     int bufferWriteIndexFrozen = bufferWriteIndex;  // Save this value in case it changes from another thread.
@@ -800,8 +1220,22 @@ double WaveformFifo::percentFull() const
     return std::max(100.0 * (1.0 - ((double)freeWords.available() / (double)(bufferSize - memorySize))), 0.0);
 }
 
+// Switch to the layout selected by the WaveformBufferLayout setting, and empty the buffer if it changed.  The staging
+// buffers and the layout are used without locking, so this must only be called while no thread is writing to or
+// reading from this FIFO (i.e., before the threads are started for a run); the layout is then fixed for the whole run.
+void WaveformFifo::applyLayoutSetting()
+{
+    WaveformLayout requestedLayout = (WaveformLayout) state->waveformBufferLayout->getNumericValue();
+    if (requestedLayout == layout) return;
+
+    setLayout(requestedLayout);
+    resetBuffer();
+}
+
 void WaveformFifo::resetBuffer()
 {
+    invalidateMinMaxPyramids(0, bufferSizeInDataBlocks);
+
     std::lock_guard<std::mutex> lock(mtx);
 
     freeWords.acquire(freeWords.available());
@@ -827,41 +1261,30 @@ void WaveformFifo::pauseBuffer()
 
 float* WaveformFifo::getAnalogWaveformPointer(const std::string& waveName) const
 {
-    std::map<std::string, float*>::const_iterator p = analogWaveformIndices.find(waveName);
-    if (p == analogWaveformIndices.end()) {
+    float* pointer = analogWaveformByHandle(waveformRegistry.lookup(waveName));
+    if (!pointer) {
         std::cerr << "ERROR: WaveformFifo:getAnalogWaveformPointer: " << waveName << " not found." << '\n';
-        return nullptr;
     }
-    return p->second;
+    return pointer;
 }
 
 uint16_t* WaveformFifo::getDigitalWaveformPointer(const std::string& waveName) const
 {
-    std::map<std::string, uint16_t*>::const_iterator p = digitalWaveformIndices.find(waveName);
-    if (p == digitalWaveformIndices.end()) {
+    uint16_t* pointer = digitalWaveformByHandle(waveformRegistry.lookup(waveName));
+    if (!pointer) {
         std::cerr << "ERROR: WaveformFifo:getDigitalWaveformPointer: " << waveName << " not found." << '\n';
-        return nullptr;
     }
-    return p->second;
+    return pointer;
 }
 
 GpuWaveformAddress WaveformFifo::getGpuWaveformAddress(const std::string& waveName) const
 {
-    std::map<std::string, GpuWaveformAddress>::const_iterator p = gpuWaveformAddresses.find(waveName);
-    if (p == gpuWaveformAddresses.end()) {
-        return GpuWaveformAddress{ GpuWaveformWideband, -1 };
-        std::cerr << "ERROR: WaveformFifo::getGpuWaveformAddress: " << waveName << " not found." << '\n';
-    }
-    return p->second;
+    return gpuWaveformAddressByHandle(waveformRegistry.lookup(waveName));
 }
 
 bool WaveformFifo::gpuWaveformPresent(const std::string& waveName) const
 {
-    std::map<std::string, GpuWaveformAddress>::const_iterator p = gpuWaveformAddresses.find(waveName);
-    if (p == gpuWaveformAddresses.end()) {
-        return false;
-    }
-    return true;
+    return gpuWaveformAddressByHandle(waveformRegistry.lookup(waveName)).waveformIndex >= 0;
 }
 
 void WaveformFifo::updateForRescan()
@@ -869,4 +1292,5 @@ void WaveformFifo::updateForRescan()
     numAmplifierChannels = signalSources->numUSBAmpChannels();
     allocateMemory();
     resetBuffer();
+    applyLayoutSetting();
 }
@@ -36,11 +36,14 @@
 #include <map>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 
 #include "rhxglobals.h"
 #include "semaphore.h"
 #include "minmax.h"
 #include "signalsources.h"
+#include "channelregistry.h"
 
 // Multi-waveform FIFO implemented as a circular buffer.  Additional buffer space is allocated
 // beyond the end of the buffer to permit continuous writes to the buffer up to a specified
@@ -57,12 +60,35 @@ enum GpuWaveformType {
     GpuWaveformSpike
 };
 
+// Memory layout of the GPU-processed amplifier buffers.  In WaveformLayoutTimeMajor, all channels of one sample are
+// stored together, so reading one channel touches one word per frame.  In WaveformLayoutChannelTiled, each data block
+// is stored as a tile of numAmplifierChannels consecutive runs of samplesPerDataBlock samples, so one channel can be
+// read in contiguous runs.  The XPU always writes time-major data; in the tiled layout it writes to a staging area
+// that commitNewData() transposes into tiles.
+enum WaveformLayout {
+    WaveformLayoutTimeMajor,
+    WaveformLayoutChannelTiled
+};
+
 struct GpuWaveformAddress
 {
     GpuWaveformType waveformType;
     int waveformIndex;
 };
 
+const int MaxSpikesPerDataBlock = 4;
+
+const int MinMaxPyramidBaseDecimation = 32;  // Finest level of the min/max pyramid, in samples per bin.
+
+// Min/max summary of one GPU amplifier waveform (one channel in one band) at power-of-two decimations from
+// MinMaxPyramidBaseDecimation up to one data block.  The summary of each data block in the buffer is computed the first
+// time the display needs it, and is invalidated when that part of the buffer is overwritten.
+struct MinMaxPyramid
+{
+    std::vector<uint8_t> valid;     // One flag per data block in the buffer
+    std::vector<uint16_t> bins;     // Per data block: raw (min, max) pairs for each level, finest level first
+};
+
 const uint8_t SpikeIdNoSpike = 0x00u;
 const uint8_t SpikeIdSpikeType1 = 0x01u;
 const uint8_t SpikeIdSpikeType2 = 0x02u;
@@ -80,6 +106,7 @@ public:
         ReaderDisk,
         ReaderAudio,
         ReaderTCP,
+        ReaderAnalysis,
         NumberOfReaders   // Don't use this last enum; used only by constructor to count total number of readers.
     };
 
@@ -102,18 +129,22 @@ public:
         return (uint16_t*) (&waveform[bufferWriteIndex]);
     }
 
+    // Time-major write space for the XPU (a staging area in WaveformLayoutChannelTiled).
     inline uint16_t* pointerToGpuWidebandWriteSpace() const
     {
+        if (layout == WaveformLayoutChannelTiled) return gpuStagingWidebandBuffer;
         return &gpuAmplifierWidebandBuffer[bufferWriteIndex * numAmplifierChannels];
     }
 
     inline uint16_t* pointerToGpuLowpassWriteSpace() const
     {
+        if (layout == WaveformLayoutChannelTiled) return gpuStagingLowpassBuffer;
         return &gpuAmplifierLowpassBuffer[bufferWriteIndex * numAmplifierChannels];
     }
 
     inline uint16_t* pointerToGpuHighpassWriteSpace() const
     {
+        if (layout == WaveformLayoutChannelTiled) return gpuStagingHighpassBuffer;
         return &gpuAmplifierHighpassBuffer[bufferWriteIndex * numAmplifierChannels];
     }
 
@@ -127,7 +158,7 @@ public:
         return &gpuSpikeIds[(bufferWriteIndex/samplesPerDataBlock) * numAmplifierChannels * maxSpikesPerDataBlock];
     }
 
-    bool extractGpuSpikeDataOneDataBlock(uint16_t* waveform, GpuWaveformAddress waveformAddress, bool firstTime) const;
+    int extractGpuSpikeData(uint16_t* waveform, GpuWaveformAddress waveformAddress, int numDataBlocks, bool firstTime) const;
 
     inline uint32_t* pointerToTimeStampWriteSpace() const
     {
@@ -206,6 +237,21 @@ public:
         return timeStampBuffer[index];
     }
 
+    // Return the circular buffer index corresponding to timeIndex, for readers that serialize many waveforms per
+    // sample and index waveform pointers directly.  No range checking is performed; the caller must stay within
+    // the span set by requestReadNewData().
+    inline int bufferIndex(Reader reader, int timeIndex) const
+    {
+        int index = bufferReadIndex[reader] + timeIndex;
+        if (index < 0) index += bufferSize;
+        else if (index >= bufferSize) index -= bufferSize;
+        return index;
+    }
+
+    // Copy numChannels consecutive amplifier channels of one GPU waveform type, at a buffer index from bufferIndex(),
+    // to dest (which need not be aligned).
+    void copyGpuAmplifierFrame(char* dest, GpuWaveformType waveformType, int index, int firstChannel, int numChannels) const;
+
     float getGpuAmplifierData(Reader reader, GpuWaveformAddress waveformAddress, int timeIndex) const;
     uint16_t getGpuAmplifierDataRaw(Reader reader, GpuWaveformAddress waveformAddress, int timeIndex) const;
 
@@ -215,6 +261,10 @@ public:
                                  int numSamples, int downsampleFactor = 1) const;
     void copyGpuAmplifierDataArrayRaw(Reader reader, uint16_t* dest, const std::vector<GpuWaveformAddress>& waveformAddresses,
                                       int timeIndex, int numSamples, int downsampleFactor = 1) const;
+    // Copy numChannels amplifier channels of the same GPU waveform type to separate arrays dest[0..numChannels-1], reading
+    // each frame once for all channels (with a SIMD transpose where channel indices are consecutive).
+    void copyGpuAmplifierChannelsRaw(Reader reader, uint16_t* const* dest, const GpuWaveformAddress* waveformAddresses,
+                                     int numChannels, int timeIndex, int numSamples, int downsampleFactor = 1) const;
     void copyAnalogData(Reader reader, float* dest, const float* waveform, int timeIndex, int numSamples) const;
     void copyAnalogDataArray(Reader reader, float* dest, const std::vector<float*>& waveforms, int timeIndex, int numSamples) const;
     void copyDigitalData(Reader reader, uint16_t* dest, const uint16_t* waveform, int timeIndex, int numSamples) const;
@@ -235,13 +285,24 @@ public:
 
     void resetBuffer();
     void pauseBuffer();
+    void applyLayoutSetting();  // Only while no other thread is using this FIFO.
 
     float* getAnalogWaveformPointer(const std::string& waveName) const;
     uint16_t* getDigitalWaveformPointer(const std::string& waveName) const;
     GpuWaveformAddress getGpuWaveformAddress(const std::string& waveName) const;
     bool gpuWaveformPresent(const std::string& waveName) const;
 
+    // Handle-based access: resolve a waveform name once with getWaveformHandle(), then index these O(1) tables.
+    int getWaveformHandle(const std::string& waveName) const { return waveformRegistry.lookup(waveName); }
+    float* analogWaveformByHandle(int handle) const
+        { return (handle >= 0 && handle < (int) analogByHandle.size()) ? analogByHandle[handle] : nullptr; }
+    uint16_t* digitalWaveformByHandle(int handle) const
+        { return (handle >= 0 && handle < (int) digitalByHandle.size()) ? digitalByHandle[handle] : nullptr; }
+    GpuWaveformAddress gpuWaveformAddressByHandle(int handle) const
+        { return (handle >= 0 && handle < (int) gpuByHandle.size()) ? gpuByHandle[handle] : GpuWaveformAddress{ GpuWaveformWideband, -1 }; }
+
     void updateForRescan();
+    WaveformLayout getLayout() const { return layout; }
 
     bool memoryWasAllocated(double& memoryRequestedGB) const { memoryRequestedGB += memoryNeededGB; return memoryAllocated; }
 
@@ -261,6 +322,22 @@ private:
     uint16_t* gpuAmplifierLowpassBuffer;
     uint16_t* gpuAmplifierHighpassBuffer;
 
+    // Time-major XPU output for up to maxWriteSizeInDataBlocks data blocks, used in WaveformLayoutChannelTiled
+    uint16_t* gpuStagingWidebandBuffer;
+    uint16_t* gpuStagingLowpassBuffer;
+    uint16_t* gpuStagingHighpassBuffer;
+
+    WaveformLayout layout;
+
+    // Min/max pyramids for GPU amplifier waveforms, indexed by waveformType * numAmplifierChannels + waveformIndex
+    // for GpuWaveformWideband, GpuWaveformLowpass, and GpuWaveformHighpass.  Each is created by the display reader the
+    // first time it needs one, so only waveforms actually displayed use memory.
+    mutable std::atomic<MinMaxPyramid*>* minMaxPyramids;
+    int numMinMaxPyramids;
+    std::vector<int> pyramidDecimation;     // Samples per bin at each level
+    std::vector<int> pyramidLevelOffset;    // Index of each level's first bin within one data block's bins
+    int pyramidBinsPerBlock;
+
     // Buffers for GPU-processed spike detection data
     uint32_t* gpuSpikeTimestamps;
     uint8_t* gpuSpikeIds;
@@ -306,12 +383,53 @@ private:
     std::vector<int> bufferReadIndex;
     std::vector<int> bufferMemoryIndex;
     int numWordsToBeWritten;
+
+    void setLayout(WaveformLayout newLayout);
+    void freeStagingMemory();
+    void transposeToTiles(uint16_t* tiles, const uint16_t* frames, int numDataBlocks) const;
+    const uint16_t* gpuAmplifierBuffer(GpuWaveformType waveformType) const;
+
+    MinMaxPyramid* minMaxPyramid(GpuWaveformAddress waveformAddress) const;
+    const uint16_t* minMaxPyramidBlock(MinMaxPyramid* pyramid, const uint16_t* buffer, int channel, int block) const;
+    void invalidateMinMaxPyramids(int firstBlock, int numBlocks);
+    void freeMinMaxPyramids();
+    void scanMinMaxGpuAmplifierData(const uint16_t* buffer, int channel, int& index, int numSamples,
+                                    uint16_t& rawMin, uint16_t& rawMax) const;
+
+    // Offset of (buffer index, channel) within a GPU amplifier buffer.
+    inline int gpuAmplifierOffset(int index, int channel) const
+    {
+        if (layout == WaveformLayoutTimeMajor) return numAmplifierChannels * index + channel;
+        int block = index / samplesPerDataBlock;
+        return (block * numAmplifierChannels + channel) * samplesPerDataBlock + (index - block * samplesPerDataBlock);
+    }
+
+    // Return a pointer to the longest run of samples of one channel, starting at buffer index, that can be read with a
+    // constant stride (without wrapping around the circular buffer or leaving a tile), limited to maxSamples.
+    inline const uint16_t* gpuAmplifierRun(const uint16_t* buffer, int channel, int index, int maxSamples,
+                                           int& stride, int& length) const
+    {
+        if (layout == WaveformLayoutTimeMajor) {
+            stride = numAmplifierChannels;
+            length = std::min(maxSamples, bufferSize - index);
+        } else {
+            stride = 1;
+            length = std::min(maxSamples, samplesPerDataBlock - (index % samplesPerDataBlock));
+        }
+        return &buffer[gpuAmplifierOffset(index, channel)];
+    }
     std::vector<int> numWordsToBeRead;
 
     std::map<std::string, float*> analogWaveformIndices;
     std::map<std::string, uint16_t*> digitalWaveformIndices;
     std::map<std::string, GpuWaveformAddress> gpuWaveformAddresses;
 
+    ChannelRegistry waveformRegistry;
+    std::vector<float*> analogByHandle;
+    std::vector<uint16_t*> digitalByHandle;
+    std::vector<GpuWaveformAddress> gpuByHandle;
+    void buildWaveformHandles();
+
     bool memoryAllocated;
     double memoryNeededGB;
 
@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include "workerpool.h"
+
+WorkerPool::WorkerPool(int numThreads_) :
+    currentTask(nullptr),
+    currentNumWorkers(1),
+    generation(0),
+    numPending(0),
+    quit(false)
+{
+    startWorkers(std::max(numThreads_, 1) - 1);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stopWorkers();
+}
+
+void WorkerPool::setNumThreads(int numThreads_)
+{
+    numThreads_ = std::max(numThreads_, 1);
+    if (numThreads_ == numThreads()) return;
+
+    stopWorkers();
+    startWorkers(numThreads_ - 1);
+}
+
+void WorkerPool::run(const std::function<void(int, int)>& task)
+{
+    int numWorkers = numThreads();
+    if (numWorkers == 1) {
+        task(0, 1);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        currentTask = &task;
+        currentNumWorkers = numWorkers;
+        numPending = numWorkers - 1;
+        ++generation;
+    }
+    startCondition.notify_all();
+
+    // The calling thread does the first share of the work while the workers do the rest.
+    task(0, numWorkers);
+
+    std::unique_lock<std::mutex> lock(mtx);
+    while (numPending > 0) doneCondition.wait(lock);
+    currentTask = nullptr;
+}
+
+void WorkerPool::partition(int total, int granularity, int worker, int numWorkers, int &first, int &last)
+{
+    granularity = std::max(granularity, 1);
+    int numUnits = (total + granularity - 1) / granularity;
+    int unitsPerWorker = numUnits / numWorkers;
+    int remainder = numUnits % numWorkers;
+
+    // The first 'remainder' workers each take one extra unit.
+    int firstUnit = worker * unitsPerWorker + std::min(worker, remainder);
+    int lastUnit = firstUnit + unitsPerWorker + (worker < remainder ? 1 : 0);
+
+    first = std::min(firstUnit * granularity, total);
+    last = std::min(lastUnit * granularity, total);
+}
+
+void WorkerPool::startWorkers(int numWorkers)
+{
+    quit = false;
+    workers.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; ++i) {
+        // Hand each worker the current generation so that a task posted before the thread first runs is not missed.
+        workers.emplace_back(&WorkerPool::workerLoop, this, i + 1, generation);
+    }
+}
+
+void WorkerPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    startCondition.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void WorkerPool::workerLoop(int worker, uint64_t lastGeneration)
+{
+    while (true) {
+        const std::function<void(int, int)>* task = nullptr;
+        int numWorkers = 0;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (!quit && generation == lastGeneration) startCondition.wait(lock);
+            if (quit) return;
+            lastGeneration = generation;
+            task = currentTask;
+            numWorkers = currentNumWorkers;
+        }
+
+        (*task)(worker, numWorkers);
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            --numPending;
+        }
+        doneCondition.notify_one();
+    }
+}
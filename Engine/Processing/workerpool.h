@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads used to split one unit of work (e.g., one data block) across several CPU cores.
+// The thread calling run() always takes part as worker 0, so a pool with a single thread executes the task directly
+// on the calling thread with no synchronization overhead.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int numThreads_ = 1);
+    ~WorkerPool();
+
+    void setNumThreads(int numThreads_);
+    inline int numThreads() const { return (int) workers.size() + 1; }
+
+    // Call task(worker, numWorkers) once on each thread in the pool, and return after all calls have completed.
+    void run(const std::function<void(int, int)>& task);
+
+    // Divide the range [0, total) into numWorkers contiguous pieces whose boundaries fall on multiples of granularity,
+    // and return the piece [first, last) belonging to worker.  The last piece may be empty if total is small.
+    static void partition(int total, int granularity, int worker, int numWorkers, int &first, int &last);
+
+private:
+    void startWorkers(int numWorkers);
+    void stopWorkers();
+    void workerLoop(int worker, uint64_t lastGeneration);
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(int, int)>* currentTask;
+    int currentNumWorkers;
+    uint64_t generation;
+    int numPending;
+    bool quit;
+};
+
+#endif // WORKERPOOL_H
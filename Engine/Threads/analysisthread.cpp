@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "analysisthread.h"
+
+AnalysisThread::AnalysisThread(WaveformFifo* waveformFifo_, QObject* parent) :
+    QThread(parent),
+    waveformFifo(waveformFifo_),
+    numSamplesPerRead(0)
+{
+    keepGoing = false;
+    running = false;
+    stopThread = false;
+}
+
+void AnalysisThread::run()
+{
+    while (!stopThread) {
+        if (keepGoing) {
+            running = true;
+            while (keepGoing && !stopThread) {
+                int numSamples = numSamplesPerRead;
+                if (numSamples > 0 && waveformFifo->requestReadNewData(WaveformFifo::ReaderAnalysis, numSamples)) {
+                    {
+                        std::lock_guard<std::mutex> lock(clientMutex);
+                        for (AnalysisClient* client : clients) {
+                            client->analyzeNewData(waveformFifo, WaveformFifo::ReaderAnalysis, numSamples);
+                        }
+                    }
+                    waveformFifo->freeOldData(WaveformFifo::ReaderAnalysis);
+                } else {
+                    usleep(1000);    // If new data is not ready, wait 1000 microseconds and try again.
+                }
+            }
+            running = false;
+        } else {
+            usleep(1000);
+        }
+    }
+}
+
+void AnalysisThread::startRunning(int numSamplesPerRead_)
+{
+    numSamplesPerRead = numSamplesPerRead_;
+    keepGoing = true;
+}
+
+void AnalysisThread::stopRunning()
+{
+    keepGoing = false;
+}
+
+void AnalysisThread::close()
+{
+    keepGoing = false;
+    stopThread = true;
+}
+
+void AnalysisThread::replaceClient(AnalysisClient* oldClient, AnalysisClient* newClient)
+{
+    std::lock_guard<std::mutex> lock(clientMutex);
+    if (oldClient) {
+        clients.erase(std::remove(clients.begin(), clients.end(), oldClient), clients.end());
+    }
+    if (newClient && std::find(clients.begin(), clients.end(), newClient) == clients.end()) {
+        clients.push_back(newClient);
+    }
+}
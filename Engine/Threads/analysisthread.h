@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+//
+//  Intan Technologies RHX Data Acquisition Software
+//  Version 3.2.0
+//
+//  Copyright (c) 2020-2023 Intan Technologies
+//
+//  This file is part of the Intan Technologies RHX Data Acquisition Software.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published
+//  by the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  This software is provided 'as-is', without any express or implied warranty.
+//  In no event will the authors be held liable for any damages arising from
+//  the use of this software.
+//
+//  See <http://www.intantech.com> for documentation and product information.
+//
+//------------------------------------------------------------------------------
+
+#ifndef ANALYSISTHREAD_H
+#define ANALYSISTHREAD_H
+
+#include <QThread>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "waveformfifo.h"
+
+// Interface for tools (ISI, PSTH, spectrogram, spike scope) that analyze new waveform data on AnalysisThread.
+// analyzeNewData() is called from AnalysisThread, so implementations must protect any state they share with the GUI
+// thread, and must request repaints with queued calls rather than calling QWidget::update() directly.
+class AnalysisClient
+{
+public:
+    virtual ~AnalysisClient() {}
+    virtual void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) = 0;
+};
+
+// Reads new data from WaveformFifo with its own reader (ReaderAnalysis) and passes it to each registered client, so
+// analysis tools run off the GUI thread and neither slows down the waveform display nor is slowed down by it.
+class AnalysisThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit AnalysisThread(WaveformFifo* waveformFifo_, QObject* parent = nullptr);
+
+    void run() override;
+    void startRunning(int numSamplesPerRead_);
+    void stopRunning();
+    bool isActive() const { return running; }
+    void close();
+
+    void setNumSamplesPerRead(int numSamplesPerRead_) { numSamplesPerRead = numSamplesPerRead_; }
+
+    // Replace oldClient (if not nullptr) with newClient (if not nullptr).  Blocks until any analysis in progress is
+    // complete, so oldClient may be deleted as soon as this returns.
+    void replaceClient(AnalysisClient* oldClient, AnalysisClient* newClient);
+
+private:
+    WaveformFifo* waveformFifo;
+
+    std::mutex clientMutex;
+    std::vector<AnalysisClient*> clients;
+
+    std::atomic<int> numSamplesPerRead;
+
+    volatile bool keepGoing;
+    volatile bool running;
+    volatile bool stopThread;
+};
+
+#endif // ANALYSISTHREAD_H
@@ -36,6 +36,10 @@
 #endif
 
 #include <QAudioDeviceInfo>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
 
 #include "signalsources.h"
 #include "audiothread.h"
@@ -51,9 +55,20 @@ AudioThread::AudioThread(SystemState *state_, WaveformFifo *waveformFifo_, const
     minThreshold(state->audioThreshold->getMinValue()),
     maxThreshold(state->audioThreshold->getMaxValue()),
     sampleRate(sampleRate_),
+    blockSamples(1),
+    engine(nullptr),
+    pcmBytesPending(0),
+    pcmReadIndex(0),
     keepGoing(false),
     running(false),
-    stopThread(false)
+    stopThread(false),
+    latencyMsec(0.0),
+    cpuPercent(0.0),
+    droppedBlocks(0),
+    underruns(0),
+    mAudioOutput(nullptr),
+    audioDevice(nullptr),
+    bytesPerSecond(1)
 {
 }
 
@@ -62,40 +77,20 @@ void AudioThread::initialize()
     state->writeToLog("Audio Thread initialize begin");
     // Initialize variables.
     mDevice = QAudioDeviceInfo::defaultOutputDevice();
-    currentValue = 0.0F;
-    nextValue = 0.0F;
-    interpRatio = 0.0;
-    interpLength = 0;
-    dataRatio = sampleRate / 44100.0;
-    rawBlockSampleSize = ceil(dataRatio * NumSoundSamples);
-
-    // Initialize raw data array.
-    rawData = new float[rawBlockSampleSize];
-    for (int i = 0; i < rawBlockSampleSize; ++i) {
-        rawData[i] = 0.0F;
-    }
-
-    // Initialize interp float array.
-    interpFloats = new float[NumSoundSamples];
-    for (int i = 0; i < NumSoundSamples; ++i) {
-        interpFloats[i] = 0.0F;
-    }
-
-    // Initialize interp data array.
-    interpInts = new int32_t[NumSoundSamples];
-    for (int i = 0; i < NumSoundSamples; ++i) {
-        interpInts[i] = 0;
-    }
-
-    // Initialize buffer.
-    finalSoundBytesBuffer = new char[NumSoundBytes];
-    for (int i = 0; i < NumSoundBytes; ++i) {
-        finalSoundBytesBuffer[i] = (char) 0;
-    }
+    blockSamples = (int) ceil(sampleRate * BlockMsec / 1000.0);
+    engine = new AudioEngine(sampleRate, blockSamples);
+    pcmBuffer.assign(4 * engine->maxOutputFrames(), 0);
+    pcmBytesPending = 0;
+    pcmReadIndex = 0;
+    sourceKey.clear();
+    latencyMsec = 0.0;
+    cpuPercent = 0.0;
+    droppedBlocks = 0;
+    underruns = 0;
 
     // Set up audio format.
-    mFormat.setSampleRate(44100);
-    mFormat.setChannelCount(1);
+    mFormat.setSampleRate(AudioEngine::OutputSampleRate);
+    mFormat.setChannelCount(2);
     mFormat.setSampleSize(16);
     mFormat.setCodec("audio/pcm");
     mFormat.setByteOrder(QAudioFormat::LittleEndian);
@@ -105,12 +100,14 @@ void AudioThread::initialize()
         qWarning() << "Default format not supported - trying to use nearest";
         mFormat = info.nearestFormat(mFormat);
     }
+    bytesPerSecond = 4 * AudioEngine::OutputSampleRate;
 
-    // Create audio IO and output device.
-    buf = new QByteArray();
-    s = new QDataStream(buf, QIODevice::ReadWrite);
+    // Create audio output in push mode: rendered audio is written to audioDevice from this thread.
     mAudioOutput = new QAudioOutput(mDevice, mFormat);
-    connect(mAudioOutput, SIGNAL(stateChanged(QAudio::State)), this, SLOT(catchError()));
+    mAudioOutput->setBufferSize((int) (bytesPerSecond * OutputBufferMsec / 1000.0) & ~3);
+    // Handle state changes on this thread, where mAudioOutput lives and is deleted.
+    connect(mAudioOutput, SIGNAL(stateChanged(QAudio::State)), this, SLOT(catchError()), Qt::DirectConnection);
+    audioDevice = mAudioOutput->start();
     state->writeToLog("Audio Thread initialize end");
 }
 
@@ -123,52 +120,46 @@ void AudioThread::run()
             // Any 'start up' code goes here.
             initialize();
 
-            while (keepGoing && !stopThread) {
-
-                // Wait for samples to arrive from WaveformFifo (enough where, when scaled to 44.1 kHz audio, NumSoundSamples can be written)
-                if (waveformFifo->requestReadNewData(WaveformFifo::ReaderAudio, rawBlockSampleSize)) {
-                    s->device()->seek(0);
-                    s->writeRawData(finalSoundBytesBuffer, NumSoundBytes);
-                    s->device()->seek(0);
-
-                    // Populate rawData from WaveformFifo
-                    if (!fillBufferFromWaveformFifo()) {
-                        qDebug() << "Error with fillBufferFromWaveformFifo()";
-                    }
-                    waveformFifo->freeOldData(WaveformFifo::ReaderAudio);
-
-                    // Populate finalSoundBytesBuffer from rawData
-                    processAudioData();
-
-                    // Start audio (if it's not started already)
-                    if (mAudioOutput->state() != QAudio::ActiveState) {
-                        mAudioOutput->start(s->device());
-                    }
-                    qApp->processEvents();
-
-                } else {
-                    // Probably could sleep here for a while
-                    qApp->processEvents();
-                }
-           }
-
-           // Any 'finish up' code goes here.
-           mAudioOutput->stop();
-
-           delete [] rawData;
-           delete [] interpFloats;
-           delete [] interpInts;
-           delete [] finalSoundBytesBuffer;
-           delete s;
-           delete buf;
-
-           running = false;
+            // Render and write audio from this thread's event loop until stopRunning() or close() is called.
+            QTimer pumpTimer;
+            pumpTimer.setTimerType(Qt::PreciseTimer);
+            pumpTimer.setInterval(1);
+            connect(&pumpTimer, SIGNAL(timeout()), this, SLOT(pumpAudio()), Qt::DirectConnection);
+            pumpTimer.start();
+            exec();
+            pumpTimer.stop();
+
+            // Any 'finish up' code goes here.
+            mAudioOutput->stop();
+            delete mAudioOutput;
+            mAudioOutput = nullptr;
+            audioDevice = nullptr;
+            delete engine;
+            engine = nullptr;
+
+            running = false;
         } else {
             usleep(1000);
         }
     }
 }
 
+// Called every millisecond from this thread's event loop while playing.
+void AudioThread::pumpAudio()
+{
+    if (!keepGoing || stopThread) {
+        exit();
+        return;
+    }
+
+    // Hand rendered audio to the output as space frees up; render the next block once all of it is taken.
+    writePendingAudio();
+    while (pcmBytesPending == 0 && waveformFifo->requestReadNewData(WaveformFifo::ReaderAudio, blockSamples)) {
+        renderBlock();
+        writePendingAudio();
+    }
+}
+
 void AudioThread::startRunning()
 {
     keepGoing = true;
@@ -185,134 +176,167 @@ void AudioThread::close()
     stopThread = true;
 }
 
-bool AudioThread::fillBufferFromWaveformFifo()
+QString AudioThread::performanceReport() const
 {
-    // Update volume and noise slicer threshold values.
-    volume = state->audioVolume->getValue();
-    threshold = state->audioThreshold->getValue();
+    return "Latency: " + QString::number(latencyMsec.load(), 'f', 1) + " ms; CPU: " +
+            QString::number(cpuPercent.load(), 'f', 2) + "%; dropped blocks: " + QString::number(droppedBlocks.load()) +
+            "; underruns: " + QString::number(underruns.load());
+}
 
-    // Out of an abundance of caution, bound these values read from state in case of any glitches due to threading issues.
-    volume = qBound(minVolume, volume, maxVolume);
-    threshold = qBound(minThreshold, threshold, maxThreshold);
+// Rebuild the list of audio sources if the source mode, audio filter, or channel selection has changed.
+void AudioThread::updateSources()
+{
+    AudioSourceMode mode = (AudioSourceMode) (int) state->audioSource->getNumericValue();
+    QString filterName = state->audioFilter->getDisplayValueString();
 
-    // Fill rawData with samples from waveformFifo, based on single selected channel.
-    bool validAudioSource = true;
-    QString selectedChannelName = state->signalSources->singleSelectedAmplifierChannelName();
-    if (selectedChannelName.isEmpty()) validAudioSource = false;
-    QString selectedChannelFilterName = selectedChannelName + "|" + state->audioFilter->getDisplayValueString();
-    if (!waveformFifo->gpuWaveformPresent(selectedChannelFilterName.toStdString())) {
-        qDebug() << "Failure... channel name: " << selectedChannelFilterName;
-        validAudioSource = false;
+    QStringList names;
+    if (mode == AudioSourceSingle) {
+        QString selectedChannelName = state->signalSources->singleSelectedAmplifierChannelName();
+        if (!selectedChannelName.isEmpty()) names.append(selectedChannelName);
+    } else {
+        int maxChannels = state->audioMaxChannels->getValue();
+        QList<Channel*> selectedSignals;
+        state->signalSources->getSelectedSignals(selectedSignals);
+        for (Channel* channel : selectedSignals) {
+            if (channel->getSignalType() != AmplifierSignal) continue;
+            if (names.size() >= maxChannels) break;
+            names.append(QString::fromStdString(channel->getNativeNameString()));
+        }
     }
-    GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(selectedChannelFilterName.toStdString());
-    if (waveformAddress.waveformIndex < 0) validAudioSource = false;
 
-    QString newChannelString;
-    if (validAudioSource) {
-        newChannelString = selectedChannelFilterName;
-        for (int i = 0; i < rawBlockSampleSize; ++i) {
-            rawData[i] = waveformFifo->getGpuAmplifierData(WaveformFifo::ReaderAudio, waveformAddress, i);
-        }
-    } else {
-        newChannelString = "";
-        for (int i = 0; i < rawBlockSampleSize; ++i) {
-            rawData[i] = 0.0F;
+    QString newKey = QString::number((int) mode) + "|" + filterName + "|" + names.join(',');
+    if (newKey == sourceKey) return;
+    sourceKey = newKey;
+
+    sourceAddresses.clear();
+    spikeWaveforms.clear();
+    QString firstName;
+    for (const QString& name : names) {
+        if (mode == AudioSourceSpikeClicks) {
+            uint16_t* spikeWaveform = waveformFifo->getDigitalWaveformPointer((name + "|SPK").toStdString());
+            if (!spikeWaveform) continue;
+            spikeWaveforms.push_back(spikeWaveform);
+        } else {
+            std::string waveName = (name + "|" + filterName).toStdString();
+            if (!waveformFifo->gpuWaveformPresent(waveName)) {
+                qDebug() << "Failure... channel name: " << QString::fromStdString(waveName);
+                continue;
+            }
+            GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(waveName);
+            if (waveformAddress.waveformIndex < 0) continue;
+            sourceAddresses.push_back(waveformAddress);
         }
+        if (firstName.isEmpty()) firstName = name;
+    }
+
+    int numSources = (mode == AudioSourceSpikeClicks) ? (int) spikeWaveforms.size() : (int) sourceAddresses.size();
+    engine->setNumSources(numSources, mode);
+    sourceData.assign(std::max(1, (int) sourceAddresses.size()) * blockSamples, 0.0F);
+    spikeData.assign(std::max(1, (int) spikeWaveforms.size()) * blockSamples, 0);
+    sourcePointers.resize(sourceAddresses.size());
+    for (int i = 0; i < (int) sourceAddresses.size(); ++i) sourcePointers[i] = &sourceData[i * blockSamples];
+    spikePointers.resize(spikeWaveforms.size());
+    for (int i = 0; i < (int) spikeWaveforms.size(); ++i) spikePointers[i] = &spikeData[i * blockSamples];
+
+    QString newChannelString;
+    if (numSources == 1 && mode != AudioSourceSpikeClicks) {
+        newChannelString = firstName + "|" + filterName;
+    } else if (numSources > 0) {
+        newChannelString = ((mode == AudioSourceSpikeClicks) ? "Spikes: " : "Mix: ") + firstName;
+        if (numSources > 1) newChannelString += " +" + QString::number(numSources - 1);
     }
     if (newChannelString != currentChannelString) {
         emit newChannel(newChannelString);
         currentChannelString = newChannelString;
     }
-
-    return validAudioSource;
 }
 
-void AudioThread::processAudioData()
+// Read one block of amplifier data from waveformFifo and render it to pcmBuffer.
+void AudioThread::renderBlock()
 {
-    state->writeToLog("Process audio data start");
-    // Do floating point interpolation.
-    originalSamplesCopied = 0;
-    soundSamplesCopied = 0;
-    while (originalSamplesCopied < rawBlockSampleSize) {
-        qApp->processEvents();
-        currentValue = nextValue;
-        nextValue = rawData[originalSamplesCopied];
-
-        while (interpRatio < 1.0) {
-            // Ensure that no writing beyond allocated memory for interpFloats occurs
-            if (soundSamplesCopied >= NumSoundSamples) {
-                break;
-            }
-            interpFloats[soundSamplesCopied++] = currentValue + interpRatio * (nextValue - currentValue);
-            interpRatio += dataRatio;
-        }
+    QElapsedTimer renderTimer;
+    renderTimer.start();
 
-        interpRatio = interpRatio - floor(interpRatio);
-        ++originalSamplesCopied;
-    }
+    // Update volume and noise slicer threshold values.
+    volume = state->audioVolume->getValue();
+    threshold = state->audioThreshold->getValue();
 
-    // Extra while loop that will execute occasionally to make sure no samples are dropped due to remainder in interp ratio
-    while (soundSamplesCopied < NumSoundSamples) {
-        interpFloats[soundSamplesCopied] = interpFloats[soundSamplesCopied - 1];
-        ++soundSamplesCopied;
-    }
+    // Out of an abundance of caution, bound these values read from state in case of any glitches due to threading issues.
+    volume = qBound(minVolume, volume, maxVolume);
+    threshold = qBound(minThreshold, threshold, maxThreshold);
+    engine->setVolume(volume);
+    engine->setThreshold((float) threshold);
 
-    // Do thresholding.
-    for (int i = 0; i < soundSamplesCopied; ++i) {
-        if (interpFloats[i] > threshold) {
-            interpFloats[i] -= threshold;
-        } else if (interpFloats[i] < -threshold) {
-            interpFloats[i] += threshold;
-        } else {
-            interpFloats[i] = 0.0F;
-        }
+    updateSources();
+    for (int i = 0; i < (int) sourceAddresses.size(); ++i) {
+        waveformFifo->copyGpuAmplifierData(WaveformFifo::ReaderAudio, &sourceData[i * blockSamples], sourceAddresses[i],
+                                           0, blockSamples);
     }
-
-    // Do audio volume, and numerically convert to int.
-    for (int i = 0; i < soundSamplesCopied; ++i) {
-        interpFloats[i] = (volume / 2) * (interpFloats[i] / 0.195F);
+    for (int i = 0; i < (int) spikeWaveforms.size(); ++i) {
+        waveformFifo->copyDigitalData(WaveformFifo::ReaderAudio, &spikeData[i * blockSamples], spikeWaveforms[i],
+                                      0, blockSamples);
     }
+    waveformFifo->freeOldData(WaveformFifo::ReaderAudio);
 
-    // As float, trim to max of +- 32767.
-    for (int i = 0; i < soundSamplesCopied; ++i) {
-        interpFloats[i] = qBound(-32768.0F, interpFloats[i], 32767.0F);
-    }
+    int numFrames = engine->render(sourcePointers.data(), spikePointers.data(), blockSamples, pcmBuffer.data());
 
-    // Convert to int.
-    for (int i = 0; i < soundSamplesCopied; ++i) {
-        interpInts[i] = (int32_t) round(interpFloats[i]);
+    // Drop the block rather than let latency grow without bound if the audio output consumes data more slowly than it
+    // arrives (e.g., because the amplifier and sound card clocks differ slightly).
+    double queuedMsec = queuedAudioMsec();
+    if (queuedMsec > MaxLatencyMsec) {
+        ++droppedBlocks;
+        state->writeToLog("Audio block dropped; queued audio: " + QString::number(queuedMsec, 'f', 1) + " ms", LogDebug);
+    } else {
+        pcmBytesPending = 4 * numFrames;
+        pcmReadIndex = 0;
     }
 
-    // Fill buffer with final data.
-    char *ptr = finalSoundBytesBuffer;
-    for (int i = 0; i < NumSoundSamples; ++i) {
-        qToLittleEndian<int16_t>(interpInts[i], ptr);
-        ptr += 2;
+    double blockMsec = 1000.0 * blockSamples / sampleRate;
+    latencyMsec = queuedMsec + blockMsec + 1000.0 * engine->delaySeconds();
+    double renderPercent = 100.0 * (renderTimer.nsecsElapsed() / 1.0e6) / blockMsec;
+    cpuPercent = 0.9 * cpuPercent.load() + 0.1 * renderPercent;
+}
+
+void AudioThread::writePendingAudio()
+{
+    if (pcmBytesPending == 0 || !audioDevice) return;
+    int bytesFree = mAudioOutput->bytesFree() & ~3;
+    if (bytesFree <= 0) return;
+    qint64 bytesWritten = audioDevice->write((const char*) &pcmBuffer[pcmReadIndex], std::min(bytesFree, pcmBytesPending));
+    if (bytesWritten > 0) {
+        pcmReadIndex += (int) bytesWritten;
+        pcmBytesPending -= (int) bytesWritten;
     }
-    state->writeToLog("Process audio data end");
+}
+
+// Audio written to the output but not yet played, plus audio rendered but not yet written.
+double AudioThread::queuedAudioMsec() const
+{
+    int bytesQueued = mAudioOutput->bufferSize() - mAudioOutput->bytesFree() + pcmBytesPending;
+    return 1000.0 * bytesQueued / bytesPerSecond;
 }
 
 void AudioThread::catchError()
 {
-    QAudio::Error errorValue = mAudioOutput->error();
+    QAudio::Error errorValue = mAudioOutput ? mAudioOutput->error() : QAudio::NoError;
     switch (errorValue) {
     case QAudio::NoError:
         break;
     case QAudio::OpenError:
         qDebug() << "Open Error";
-        state->writeToLog("Open Error");
+        state->writeToLog("Open Error", LogError);
         break;
     case QAudio::IOError:
         qDebug() << "IO Error";
-        state->writeToLog("IO Error");
+        state->writeToLog("IO Error", LogError);
         break;
     case QAudio::UnderrunError:
-        qDebug() << "Underrun Error";
-        state->writeToLog("Underrun Error");
+        ++underruns;
+        state->writeToLog("Underrun Error", LogWarning);
         break;
     case QAudio::FatalError:
         qDebug() << "Fatal Error";
-        state->writeToLog("Fatal Error");
+        state->writeToLog("Fatal Error", LogError);
         break;
     }
 }
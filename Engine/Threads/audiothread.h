@@ -42,12 +42,19 @@
 #include <QAudioOutput>
 #include <QAudioFormat>
 
+#include <atomic>
 #include <cstdint>
-#include <mutex>
+#include <vector>
 
+#include "audioengine.h"
 #include "systemstate.h"
 #include "waveformfifo.h"
 
+// Plays amplifier data through the default audio output: the single selected channel, a stereo mix of the selected
+// channels, or clicks for spikes on the selected channels (AudioSource setting).  Audio is rendered by AudioEngine in
+// short blocks and pushed to the audio output as space becomes available.  While playing, this thread runs its own
+// event loop, because some audio backends (e.g., PulseAudio, CoreAudio) deliver QAudioOutput state changes and buffer
+// notifications through the event loop of the thread that owns the output.
 class AudioThread : public QThread
 {
     Q_OBJECT
@@ -60,22 +67,27 @@ public:
     bool isActive() const { return running; }  // Is this thread running?
     void close();  // Close thread.
 
+    // Audio latency (from arrival of amplifier data to output from the sound card), CPU use of rendering as a
+    // percentage of real time, blocks dropped to limit latency, and audio output underruns.
+    QString performanceReport() const;
+
 signals:
     void newChannel(QString name);
 
 private slots:
     void catchError();
+    void pumpAudio();
 
 private:
+    const double BlockMsec = 10.0;  // Amplifier data rendered at a time
 
-    // For some reason, Mac seems to do better with larger audio write periods, and Windows better with smaller write periods.
-    // These values don't completely eliminate audio popping, but seem to reduce them considerably, especially after running for a bit.
+    // For some reason, Mac seems to do better with larger audio buffers, and Windows better with smaller buffers.
 #if __APPLE__
-    const int NumSoundSamples = 24000;
+    const double OutputBufferMsec = 250.0;
 #else
-    const int NumSoundSamples = 5000;
+    const double OutputBufferMsec = 100.0;
 #endif
-    const int NumSoundBytes = 2 * NumSoundSamples;
+    const double MaxLatencyMsec = 2.0 * OutputBufferMsec;  // Beyond this, blocks are dropped (e.g., to absorb clock drift)
 
     SystemState* state;
     WaveformFifo* waveformFifo;
@@ -89,27 +101,28 @@ private:
     int maxThreshold;
 
     double sampleRate;
-
-    int rawBlockSampleSize;
-
-    float *rawData;
-    float *interpFloats;
-    int32_t *interpInts;
-    char* finalSoundBytesBuffer;
-
-    double dataRatio;
-
-    int originalSamplesCopied;
-    int soundSamplesCopied;
+    int blockSamples;
+
+    AudioEngine* engine;
+    QString sourceKey;  // Mode, filter, and channel names of the current sources
+    std::vector<GpuWaveformAddress> sourceAddresses;
+    std::vector<uint16_t*> spikeWaveforms;
+    std::vector<float> sourceData;              // [source * blockSamples + t]
+    std::vector<const float*> sourcePointers;
+    std::vector<uint16_t> spikeData;            // [source * blockSamples + t]
+    std::vector<const uint16_t*> spikePointers;
+    std::vector<uint8_t> pcmBuffer;
+    int pcmBytesPending;
+    int pcmReadIndex;
 
     volatile bool keepGoing;
     volatile bool running;
     volatile bool stopThread;
 
-    float currentValue;
-    float nextValue;
-    double interpRatio;
-    int interpLength;
+    std::atomic<double> latencyMsec;
+    std::atomic<double> cpuPercent;
+    std::atomic<int64_t> droppedBlocks;
+    std::atomic<int64_t> underruns;
 
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
     QAudioDevice mDevice;
@@ -118,17 +131,17 @@ private:
 #endif
 
     QAudioOutput* mAudioOutput;
+    QIODevice* audioDevice;
     QAudioFormat mFormat;
-
-    QByteArray* buf;
-    QDataStream* s;
-
+    int bytesPerSecond;
 
     QString currentChannelString;
 
     void initialize();
-    bool fillBufferFromWaveformFifo();
-    void processAudioData();
+    void updateSources();
+    void renderBlock();
+    void writePendingAudio();
+    double queuedAudioMsec() const;
 };
 
 #endif // AUDIOTHREAD_H
@@ -32,13 +32,15 @@
 #include "intanfilesavemanager.h"
 #include "filepersignaltypesavemanager.h"
 #include "fileperchannelsavemanager.h"
+#include "filewriter.h"
 #include "savetodiskthread.h"
 
 SaveToDiskThread::SaveToDiskThread(WaveformFifo* waveformFifo_, SystemState* state_, QObject *parent) :
     QThread(parent),
     waveformFifo(waveformFifo_),
     state(state_),
-    saveManager(nullptr)
+    saveManager(nullptr),
+    noiseEstimator(nullptr)
 {
     keepGoing = false;
     running = false;
@@ -81,12 +83,15 @@ void SaveToDiskThread::run()
 
         double glitchIgnoreInSeconds = 0.2;     // time period following trigger in which glitches in trigger are ignored
         int glitchThreshold = ceil(glitchIgnoreInSeconds * state->sampleRate->getNumericValue());
+        int64_t noiseLogSamples = std::max((int64_t) ceil(NoiseLogIntervalSeconds * state->sampleRate->getNumericValue()),
+                                           (int64_t) NumSamples);
 
 //        QElapsedTimer loopTimer, workTimer, reportTimer;
         QElapsedTimer statusBarUpdateTimer;
 
         if (keepGoing) {
             running = true;
+            FileWriter::resetBackpressure();
             int triggerBeginCounter = 0;    // used to ignore glitches shortly after trigger is activated
             int triggerEndCounter = 0;      // used to time postTriggerBuffer
             int triggerEndSamples = ceil(state->postTriggerBuffer->getValue() * state->sampleRate->getNumericValue());
@@ -209,6 +214,12 @@ void SaveToDiskThread::run()
                         }
 
                         if (isRecording) {
+                            // Log noise levels at the start of each recording and every NoiseLogIntervalSeconds.
+                            if (noiseEstimator && noiseEstimator->isEnabled() && totalRecordedSamples % noiseLogSamples < NumSamples) {
+                                if (noiseEstimator->getNoiseLevels(noiseLevels) > 0) {
+                                    saveManager->writeNoiseLevels(noiseLevels, totalRecordedSamples);
+                                }
+                            }
                             totalRecordedSamples += NumSamples;
                             totalSamplesInFile += NumSamples;
                             if (saveManager->maxSamplesInFile() > 0) {
@@ -392,11 +403,24 @@ void SaveToDiskThread::setStatusBarRecording(double bytesPerMinute, const QStrin
         break;
     }
 
+    // Report any time spent waiting on the disk (all write buffers busy) since the last status bar update.
+    QString backpressureString;
+    FileWriterBackpressure backpressure = FileWriter::backpressure();
+    if (backpressure.stallCount > 0 || backpressure.writeErrors > 0) {
+        backpressureString = tr("  Disk backpressure: ") + QString::number(backpressure.stallNsecs / 1.0e6, 'f', 1) +
+                tr(" ms waiting (") + QString::number(backpressure.stallCount) + tr(" stalls)");
+        if (backpressure.writeErrors > 0) {
+            backpressureString += tr(", ") + QString::number(backpressure.writeErrors) + tr(" write errors");
+        }
+        backpressureString += ".";
+        FileWriter::resetBackpressure();
+    }
+
     emit setStatusBar(tr("Saving data to ") + statusFilename +
                       ".  (" + QString::number(bytesPerMinute / (1024.0 * 1024.0), 'f', 1) +
                       tr(" MB/minute.  File size may be reduced by disabling unused inputs.)  "
                          "Total data saved: ") + QString::number(totalBytesSaved / (1024.0 * 1024.0), 'f', 1) +
-                      tr(" MB."));
+                      tr(" MB.") + backpressureString);
     emit setTimeLabel(timeString);
 }
 
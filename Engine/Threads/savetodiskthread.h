@@ -41,6 +41,9 @@
 #include "signalsources.h"
 #include "rhxdatablock.h"
 #include "savemanager.h"
+#include "noiseestimator.h"
+
+const double NoiseLogIntervalSeconds = 10.0;
 
 class SaveToDiskThread : public QThread
 {
@@ -56,6 +59,8 @@ public:
     void close();
 
     int64_t getTotalRecordedSamples() const { return totalRecordedSamples; }
+    // Noise levels from noiseEstimator_ are logged to each recording every NoiseLogIntervalSeconds.
+    void setNoiseEstimator(const NoiseEstimator* noiseEstimator_) { noiseEstimator = noiseEstimator_; }
 
     enum FindTriggerMode {
         FindTriggerBegin,
@@ -77,6 +82,8 @@ private:
     WaveformFifo* waveformFifo;
     SystemState* state;
     SaveManager* saveManager;
+    const NoiseEstimator* noiseEstimator;
+    std::vector<float> noiseLevels;
 
     volatile bool keepGoing;
     volatile bool running;
@@ -28,12 +28,21 @@
 //
 //------------------------------------------------------------------------------
 
+#include <QElapsedTimer>
+#include <cstring>
 #include "tcpdataoutputthread.h"
 
 TCPDataOutputThread::TCPDataOutputThread(WaveformFifo *waveformFifo_, const double sampleRate_, SystemState *state_, QObject *parent) :
     QThread(parent),
     tcpWaveformDataCommunicator(state_->tcpWaveformDataCommunicator),
     tcpSpikeDataCommunicator(state_->tcpSpikeDataCommunicator),
+    adcUsb2Scaling(false),
+    numBytesPerFrame(0),
+    numBytesPerDataBlock(0),
+    numBytesPerSpikeChunk(0),
+    maxChunksPerDataBlock(0),
+    throughputFrames(0),
+    throughputNsecs(0),
     waveformFifo(waveformFifo_),
     signalSources(state_->signalSources),
     sampleRate(sampleRate_),
@@ -42,8 +51,7 @@ TCPDataOutputThread::TCPDataOutputThread(WaveformFifo *waveformFifo_, const doub
     stopThread(false),
     parentObject(parent),
     connected(false),
-    state(state_),
-    previousSample(nullptr)
+    state(state_)
 {
 }
 
@@ -53,6 +61,8 @@ TCPDataOutputThread::~TCPDataOutputThread()
 
 void TCPDataOutputThread::run()
 {
+    QElapsedTimer busyTimer;
+
     while (!stopThread) {
         if (keepGoing) {
             running = true;
@@ -60,6 +70,8 @@ void TCPDataOutputThread::run()
 
             // Any 'start up' code goes here.
             updateEnabledChannels();
+            throughputFrames = 0;
+            throughputNsecs = 0;
 
             while (keepGoing && !stopThread) {
 
@@ -87,230 +99,26 @@ void TCPDataOutputThread::run()
                     }
 
                     // Wait for 'tcpNumDataBlocksWrite' prior to write
-                    if (waveformFifo->requestReadNewData(WaveformFifo::ReaderTCP, FramesPerBlock * state->tcpNumDataBlocksWrite->getValue())) {
+                    int numFrames = FramesPerBlock * state->tcpNumDataBlocksWrite->getValue();
+                    if (waveformFifo->requestReadNewData(WaveformFifo::ReaderTCP, numFrames)) {
+                        busyTimer.start();
 
-                        if (enabledChannelNames.size() == 0) {
+                        if (previousEnabledBands.isEmpty()) {
                             waveformFifo->freeOldData(WaveformFifo::ReaderTCP);
                             continue;
                         }
 
-                        for (int i = 0; i < FramesPerBlock * state->tcpNumDataBlocksWrite->getValue(); ++i) {
-                            if ((i % FramesPerBlock) == 0) {
-                                waveformArray.replace(waveformArrayIndex, sizeof(TCPWaveformMagicNumber), (const char*)(&TCPWaveformMagicNumber), sizeof(TCPWaveformMagicNumber));
-                                waveformArrayIndex += sizeof(TCPWaveformMagicNumber);
-                            }
-                            uint32_t timestamp = waveformFifo->getTimeStamp(WaveformFifo::ReaderTCP, i);
-                            waveformArray.replace(waveformArrayIndex, sizeof(timestamp), (const char*)(&timestamp), sizeof(timestamp));
-                            waveformArrayIndex += sizeof(timestamp);
-
-                            // Grab digital in word and digital out word
-                            uint16_t* boardDigitalInWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
-                            uint16_t digitalInWord = waveformFifo->getDigitalData(WaveformFifo::ReaderTCP, boardDigitalInWaveform, i);
-                            bool digitalInWordSent = false;
-                            uint16_t* boardDigitalOutWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-OUT-WORD");
-                            uint16_t digitalOutWord = waveformFifo->getDigitalData(WaveformFifo::ReaderTCP, boardDigitalOutWaveform, i);
-                            bool digitalOutWordSent = false;
-
-                            int stimChannelIndex = 0;
-
-                            for (int channel = 0; channel < enabledChannelNames.size(); ++channel) {
-
-                                Channel *thisChannel = signalSources->channelByName(enabledChannelNames[channel]);
-
-                                // If this channel is an amplifier signal, read all enabled bands
-                                if (thisChannel->getSignalType() == AmplifierSignal) {
-
-                                    if (thisChannel->getOutputToTcp()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|WIDE").toStdString();
-                                        if (!waveformFifo->gpuWaveformPresent(waveName)) continue; // Error happened here - we should flag that there was a problem.
-                                        GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(waveName);
-                                        if (waveformAddress.waveformIndex < 0) continue; // Error happened here - we should flag that there was a problem.
-                                        uint16_t thisSample = waveformFifo->getGpuAmplifierDataRaw(WaveformFifo::ReaderTCP, waveformAddress, i);
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-
-                                    if (thisChannel->getOutputToTcpLow()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|LOW").toStdString();
-                                        if (!waveformFifo->gpuWaveformPresent(waveName)) continue; // Error happened here - we should flag that there was a problem.
-                                        GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(waveName);
-                                        if (waveformAddress.waveformIndex < 0) continue; // Error happened here - we should flag that there was a problem.
-                                        uint16_t thisSample = waveformFifo->getGpuAmplifierDataRaw(WaveformFifo::ReaderTCP, waveformAddress, i);
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-
-                                    if (thisChannel->getOutputToTcpHigh()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|HIGH").toStdString();
-                                        if (!waveformFifo->gpuWaveformPresent(waveName)) continue; // Error happened here - we should flag that there was a problem.
-                                        GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(waveName);
-                                        if (waveformAddress.waveformIndex < 0) continue; // Error happened here - we should flag that there was a problem.
-                                        uint16_t thisSample = waveformFifo->getGpuAmplifierDataRaw(WaveformFifo::ReaderTCP, waveformAddress, i);
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-
-                                    if (thisChannel->getOutputToTcpSpike()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|SPK").toStdString();
-                                        uint16_t* spikeWaveform = waveformFifo->getDigitalWaveformPointer(waveName);
-                                        uint8_t spikeId = (uint8_t) waveformFifo->getDigitalData(WaveformFifo::ReaderTCP, spikeWaveform, i);
-                                        if (spikeId != SpikeIdNoSpike) {
-                                            // Create 14-byte chunk with magic num, native name, timestamp, and spike ID
-                                            char nativeName[5];
-                                            memcpy(nativeName, enabledChannelNames[channel].toLocal8Bit().constData(), sizeof(nativeName));
-
-                                            // Put that chunk in spikeArray
-                                            spikeArray.replace(spikeArrayIndex, sizeof(TCPSpikeMagicNumber), (const char*)(&TCPSpikeMagicNumber), sizeof(TCPSpikeMagicNumber));
-                                            spikeArrayIndex += sizeof(TCPSpikeMagicNumber);
-
-                                            spikeArray.replace(spikeArrayIndex, sizeof(nativeName), (const char*)(&nativeName), sizeof(nativeName));
-                                            spikeArrayIndex += sizeof(nativeName);
-
-                                            spikeArray.replace(spikeArrayIndex, sizeof(timestamp), (const char*)(&timestamp), sizeof(timestamp));
-                                            spikeArrayIndex += sizeof(timestamp);
-
-                                            spikeArray.replace(spikeArrayIndex, sizeof(spikeId), (const char*)(&spikeId), sizeof(spikeId));
-                                            spikeArrayIndex += sizeof(spikeId);
-                                        }
-                                    }
-
-                                    if (thisChannel->getOutputToTcpDc()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|DC").toStdString();
-                                        float *dcWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                        float thisSampleFloat = waveformFifo->getAnalogData(WaveformFifo::ReaderTCP, dcWaveform, i);
-                                        uint16_t thisSample = round((thisSampleFloat / -0.01923) + 512);
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-
-                                    if (thisChannel->getOutputToTcpStim()) {
-                                        std::string waveName = QString(enabledChannelNames[channel] + "|STIM").toStdString();
-                                        uint16_t *stimWaveform = waveformFifo->getDigitalWaveformPointer(waveName);
-                                        uint16_t thisSampleUSB = waveformFifo->getDigitalData(WaveformFifo::ReaderTCP, stimWaveform, i);
-                                        bool stimPolarityNegative = thisSampleUSB & (1 << 8);
-                                        bool stimOn = thisSampleUSB & 1;
-                                        uint8_t stimMagnitude;
-                                        if (stimOn) {
-                                            stimMagnitude = stimPolarityNegative ? negStimAmplitudes[stimChannelIndex++] : posStimAmplitudes[stimChannelIndex++];
-                                        } else {
-                                            stimMagnitude = 0;
-                                            stimChannelIndex++;
-                                        }
-                                        uint16_t thisSampleNoMagnitude = thisSampleUSB & 65280;
-                                        uint16_t thisSample = thisSampleNoMagnitude | stimMagnitude;
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-                                }
-
-                                // If this channel is an auxinputsignal, read it if outputToTcp is true.
-                                if (thisChannel->getSignalType() == AuxInputSignal) {
-
-                                    if (thisChannel->getOutputToTcp()) {
-                                        // Once every 4 samples, aux input actually gets a sample.
-                                        if (i % 4 == 0) {
-                                            std::string waveName = QString(enabledChannelNames[channel]).toStdString();
-                                            float *auxWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                            float thisSampleFloat = waveformFifo->getAnalogData(WaveformFifo::ReaderTCP, auxWaveform, i / 4);
-                                            uint16_t thisSample = round((thisSampleFloat / 37.4e-6));
-                                            waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                            waveformArrayIndex += sizeof(thisSample);
-                                            previousSample[channel] = thisSample;
-                                        } else {
-                                            // Every other data block, just repeat the previously gotten sample.
-                                            uint16_t thisSample = previousSample[channel];
-                                            waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                            waveformArrayIndex += sizeof(thisSample);
-                                        }
-                                    }
-                                }
-
-                                // If this channel is a supplyvoltagesignal, read it if outputToTcp is true.
-                                if (thisChannel->getSignalType() == SupplyVoltageSignal) {
-
-                                    if (thisChannel->getOutputToTcp()) {
-                                        // Once every data block, supply voltage actually gets a sample
-                                        if (i % FramesPerBlock == 0) {
-                                            std::string waveName = QString(enabledChannelNames[channel]).toStdString();
-                                            float *vddWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                            float thisSampleFloat = waveformFifo->getAnalogData(WaveformFifo::ReaderTCP, vddWaveform, i / FramesPerBlock);
-                                            uint16_t thisSample = round((thisSampleFloat / 74.8e-6));
-                                            waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                            waveformArrayIndex += sizeof(thisSample);
-                                            previousSample[channel] = thisSample;
-                                        } else {
-                                            // Every other data block, just repeat the previously g otten sample
-                                            uint16_t thisSample = previousSample[channel];
-                                            waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                            waveformArrayIndex += sizeof(thisSample);
-                                        }
-                                    }
-                                }
-
-                                // If this channel is a boardadcsignal, read it if outputToTcp is true.
-                                if (thisChannel->getSignalType() == BoardAdcSignal) {
-
-                                    if (thisChannel->getOutputToTcp()) {
-                                        std::string waveName = QString(enabledChannelNames[channel]).toStdString();
-                                        float *adcWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                        float thisSampleFloat = waveformFifo->getAnalogData(WaveformFifo::ReaderTCP, adcWaveform, i);
-                                        uint16_t thisSample;
-                                        if (state->getControllerTypeEnum() == ControllerRecordUSB2) {
-                                            thisSample = round(thisSampleFloat / 50.354e-6);
-                                        } else {
-                                            thisSample = round(thisSampleFloat * 3200) + 32768;
-                                        }
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-                                }
-
-                                // If this channel is a boarddacsignal, read it if outputToTcp is true.
-                                if (thisChannel->getSignalType() == BoardDacSignal) {
-
-                                    if (thisChannel->getOutputToTcp()) {
-                                        std::string waveName = QString(enabledChannelNames[channel]).toStdString();
-                                        float *dacWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                        float thisSampleFloat = waveformFifo->getAnalogData(WaveformFifo::ReaderTCP, dacWaveform, i);
-                                        uint16_t thisSample = round(thisSampleFloat * 3200) + 32768;
-                                        waveformArray.replace(waveformArrayIndex, sizeof(thisSample), (const char*)(&thisSample), sizeof(thisSample));
-                                        waveformArrayIndex += sizeof(thisSample);
-                                    }
-                                }
-
-
-                                // If this channel is a boarddigitalinsignal, read it if at least one digital in's outputtotcp is true.
-                                if (thisChannel->getSignalType() == BoardDigitalInSignal) {
-
-                                    if (numDigitalInChannels > 0) {
-                                        if (!digitalInWordSent) {
-                                            waveformArray.replace(waveformArrayIndex, sizeof(digitalInWord), (const char*)(&digitalInWord), sizeof(digitalInWord));
-                                            waveformArrayIndex += sizeof(digitalInWord);
-                                            digitalInWordSent = true;
-                                        }
-                                    }
-                                }
-
-                                // If this channel is a boarddigitaloutsignal, read it if at least one digital out's outputtotcp is true.
-                                if (thisChannel->getSignalType() == BoardDigitalOutSignal) {
-
-                                    if (numDigitalOutChannels > 0) {
-                                        if (!digitalOutWordSent) {
-                                            waveformArray.replace(waveformArrayIndex, sizeof(digitalOutWord), (const char*)(&digitalOutWord), sizeof(digitalOutWord));
-                                            waveformArrayIndex += sizeof(digitalOutWord);
-                                            digitalOutWordSent = true;
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                        qint64 waveformArrayIndex = 0;
+                        qint64 spikeArrayIndex = 0;
+                        encodeData(numFrames, waveformBuffer.data(), waveformArrayIndex, spikeBuffer.data(), spikeArrayIndex);
+                        waveformFifo->freeOldData(WaveformFifo::ReaderTCP);
+
                         if (tcpWaveformDataCommunicator->status == TCPCommunicator::Connected)
-                            tcpWaveformDataCommunicator->writeData(waveformArray.data(), waveformArrayIndex);
+                            tcpWaveformDataCommunicator->writeData(waveformBuffer.data(), waveformArrayIndex);
                         if (tcpSpikeDataCommunicator->status == TCPCommunicator::Connected)
-                            tcpSpikeDataCommunicator->writeData(spikeArray.data(), spikeArrayIndex);
-                        waveformArrayIndex = 0;
-                        spikeArrayIndex = 0;
-                        waveformFifo->freeOldData(WaveformFifo::ReaderTCP);
+                            tcpSpikeDataCommunicator->writeData(spikeBuffer.data(), spikeArrayIndex);
+
+                        updateThroughput(numFrames, busyTimer.nsecsElapsed());
                     }
                 }
                 qApp->processEvents();
@@ -318,8 +126,6 @@ void TCPDataOutputThread::run()
 
             // Any 'finish up' code goes here.
 
-            delete [] previousSample;
-            previousSample = nullptr;
             running = false;
         } else {
             qApp->processEvents();
@@ -328,146 +134,276 @@ void TCPDataOutputThread::run()
     }
 }
 
+// Serialize numFrames frames of the current WaveformFifo read into waveformData (magic number at the start of each
+// data block, then per frame a timestamp and every enabled word in plan order), and any spikes into spikeData.
+void TCPDataOutputThread::encodeData(int numFrames, char* waveformData, qint64& waveformBytes, char* spikeData, qint64& spikeBytes)
+{
+    waveformFifo->copyTimeStamps(WaveformFifo::ReaderTCP, timeStamps.data(), 0, numFrames);
+
+    char* pWaveform = waveformData;
+    char* pSpike = spikeData;
+    for (int i = 0; i < numFrames; ++i) {
+        if ((i % FramesPerBlock) == 0) {
+            memcpy(pWaveform, &TCPWaveformMagicNumber, sizeof(TCPWaveformMagicNumber));
+            pWaveform += sizeof(TCPWaveformMagicNumber);
+        }
+        int index = waveformFifo->bufferIndex(WaveformFifo::ReaderTCP, i);
+        uint32_t timestamp = timeStamps[i];
+        memcpy(pWaveform, &timestamp, sizeof(timestamp));
+
+        for (const GpuOutputRun& run : gpuRuns) {
+            waveformFifo->copyGpuAmplifierFrame(pWaveform + run.frameOffset, run.waveformType, index, run.firstChannel,
+                                                run.numChannels);
+        }
+
+        for (const OutputWord& word : outputWords) {
+            uint16_t thisSample = 0;
+            switch (word.type) {
+            case OutputDc:
+                thisSample = round((word.analogWaveform[index] / -0.01923) + 512);
+                break;
+            case OutputStim:
+            {
+                uint16_t thisSampleUSB = word.digitalWaveform[index];
+                bool stimPolarityNegative = thisSampleUSB & (1 << 8);
+                bool stimOn = thisSampleUSB & 1;
+                uint8_t stimMagnitude = 0;
+                if (stimOn) {
+                    stimMagnitude = stimPolarityNegative ? negStimAmplitudes[word.index] : posStimAmplitudes[word.index];
+                }
+                thisSample = (thisSampleUSB & 65280) | stimMagnitude;
+                break;
+            }
+            case OutputAux:
+                // Once every 4 samples, aux input actually gets a sample; otherwise repeat the previous one.
+                if (i % 4 == 0) {
+                    heldSamples[word.index] = round((word.analogWaveform[waveformFifo->bufferIndex(WaveformFifo::ReaderTCP, i / 4)] / 37.4e-6));
+                }
+                thisSample = heldSamples[word.index];
+                break;
+            case OutputVdd:
+                // Once every data block, supply voltage actually gets a sample; otherwise repeat the previous one.
+                if (i % FramesPerBlock == 0) {
+                    heldSamples[word.index] = round((word.analogWaveform[waveformFifo->bufferIndex(WaveformFifo::ReaderTCP, i / FramesPerBlock)] / 74.8e-6));
+                }
+                thisSample = heldSamples[word.index];
+                break;
+            case OutputAdc:
+                if (adcUsb2Scaling) {
+                    thisSample = round(word.analogWaveform[index] / 50.354e-6);
+                } else {
+                    thisSample = round(word.analogWaveform[index] * 3200) + 32768;
+                }
+                break;
+            case OutputDac:
+                thisSample = round(word.analogWaveform[index] * 3200) + 32768;
+                break;
+            case OutputDigitalIn:
+            case OutputDigitalOut:
+                thisSample = word.digitalWaveform[index];
+                break;
+            }
+            memcpy(pWaveform + word.frameOffset, &thisSample, sizeof(thisSample));
+        }
+        pWaveform += numBytesPerFrame;
+
+        for (const SpikeOutput& spike : spikeOutputs) {
+            uint8_t spikeId = (uint8_t) spike.spikeWaveform[index];
+            if (spikeId != SpikeIdNoSpike) {
+                // 14-byte chunk with magic num, native name, timestamp, and spike ID
+                memcpy(pSpike, &TCPSpikeMagicNumber, sizeof(TCPSpikeMagicNumber));
+                pSpike += sizeof(TCPSpikeMagicNumber);
+                memcpy(pSpike, spike.nativeName, sizeof(spike.nativeName));
+                pSpike += sizeof(spike.nativeName);
+                memcpy(pSpike, &timestamp, sizeof(timestamp));
+                pSpike += sizeof(timestamp);
+                memcpy(pSpike, &spikeId, sizeof(spikeId));
+                pSpike += sizeof(spikeId);
+            }
+        }
+    }
+    waveformBytes = pWaveform - waveformData;
+    spikeBytes = pSpike - spikeData;
+}
+
+// Publish the rate at which frames are encoded and written, averaged over roughly one second of data.
+void TCPDataOutputThread::updateThroughput(int numFrames, qint64 busyNsecs)
+{
+    throughputFrames += numFrames;
+    throughputNsecs += busyNsecs;
+    if (throughputFrames >= sampleRate && throughputNsecs > 0) {
+        double framesPerSecond = 1.0e9 * (double) throughputFrames / (double) throughputNsecs;
+        tcpWaveformDataCommunicator->throughput = framesPerSecond;
+        tcpSpikeDataCommunicator->throughput = framesPerSecond;
+        throughputFrames = 0;
+        throughputNsecs = 0;
+    }
+}
+
+void TCPDataOutputThread::addGpuOutput(const QString& waveName, int& frameOffset)
+{
+    std::string name = waveName.toStdString();
+    if (!waveformFifo->gpuWaveformPresent(name)) return;
+    GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(name);
+    if (waveformAddress.waveformIndex < 0) return;
+
+    // Extend the previous run if this word directly follows it in both the GPU frame and the output frame.
+    if (!gpuRuns.empty()) {
+        GpuOutputRun& last = gpuRuns.back();
+        if (last.waveformType == waveformAddress.waveformType &&
+                last.firstChannel + last.numChannels == waveformAddress.waveformIndex &&
+                last.frameOffset + last.numChannels * (int) sizeof(uint16_t) == frameOffset) {
+            last.numChannels++;
+            frameOffset += sizeof(uint16_t);
+            return;
+        }
+    }
+    gpuRuns.push_back({ waveformAddress.waveformType, waveformAddress.waveformIndex, 1, frameOffset });
+    frameOffset += sizeof(uint16_t);
+}
+
+void TCPDataOutputThread::addOutputWord(OutputWordType type, const float* analogWaveform, const uint16_t* digitalWaveform,
+                                        int& frameOffset, int index)
+{
+    if (!analogWaveform && !digitalWaveform) return;
+    outputWords.push_back({ type, analogWaveform, digitalWaveform, frameOffset, index });
+    frameOffset += sizeof(uint16_t);
+}
+
+// Compile the output plan: the byte offset of every enabled word within a frame, the GPU source of each amplifier
+// band, and the waveform pointers of all other signals.  Called at start-up and whenever TCP bands change.
 void TCPDataOutputThread::updateEnabledChannels()
 {
     // Always start with a clean slate
-    channelNames = signalSources->completeChannelsNameList();
-    if (previousSample) {
-        delete [] previousSample;
-        previousSample = nullptr;
-    }
+    std::vector<std::string> channelNames = signalSources->completeChannelsNameList();
 
-    enabledChannelNames.clear();
-    enabledStimChannelNames.clear();
+    gpuRuns.clear();
+    outputWords.clear();
+    spikeOutputs.clear();
 
     posStimAmplitudes.resize(0);
     negStimAmplitudes.resize(0);
 
-    totalEnabledBands = 0;
-    numAuxChannels = 0;
-    numVddChannels = 0;
-    numAdcChannels = 0;
-    numDacChannels = 0;
-    numDigitalInChannels = 0;
-    numDigitalOutChannels = 0;
+    bool stimController = state->getControllerTypeEnum() == ControllerStimRecord;
+    adcUsb2Scaling = state->getControllerTypeEnum() == ControllerRecordUSB2;
+    const uint16_t* digitalInWordWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
+    const uint16_t* digitalOutWordWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-OUT-WORD");
+    bool digitalInWordAdded = false;
+    bool digitalOutWordAdded = false;
+    int numHeldSamples = 0;
+
+    // Each frame has 4 bytes for timestamp, then 2 bytes per uint16 word.
+    int frameOffset = sizeof(uint32_t);
 
     for (int i = 0; i < (int) channelNames.size(); ++i) {
-        Channel* thisChannel = signalSources->channelByName(QString::fromStdString(channelNames[i]));
-        QStringList thisChannelBands;
+        Channel* thisChannel = signalSources->channelByName(channelNames[i]);
+        QString nativeName = thisChannel->getNativeName();
+        std::string waveName = nativeName.toStdString();
         switch (thisChannel->getSignalType()) {
 
-        // Get totalEnabledBands (amplifierSignals)
         case AmplifierSignal:
-            thisChannelBands = thisChannel->getTcpBandNames();
-            if (thisChannelBands.size() > 0) enabledChannelNames.append(thisChannel->getNativeName());
-            totalEnabledBands += thisChannelBands.size();
+            if (thisChannel->getTcpBandNames().isEmpty()) break;
+
+            if (thisChannel->getOutputToTcp()) addGpuOutput(nativeName + "|WIDE", frameOffset);
+            if (thisChannel->getOutputToTcpLow()) addGpuOutput(nativeName + "|LOW", frameOffset);
+            if (thisChannel->getOutputToTcpHigh()) addGpuOutput(nativeName + "|HIGH", frameOffset);
+
+            if (thisChannel->getOutputToTcpSpike()) {
+                const uint16_t* spikeWaveform = waveformFifo->getDigitalWaveformPointer(waveName + "|SPK");
+                if (spikeWaveform) {
+                    SpikeOutput spikeOutput;
+                    spikeOutput.spikeWaveform = spikeWaveform;
+                    memcpy(spikeOutput.nativeName, nativeName.toLocal8Bit().constData(), sizeof(spikeOutput.nativeName));
+                    spikeOutputs.push_back(spikeOutput);
+                }
+            }
+
+            if (!stimController) break;
+
+            if (thisChannel->getOutputToTcpDc()) {
+                addOutputWord(OutputDc, waveformFifo->getAnalogWaveformPointer(waveName + "|DC"), nullptr, frameOffset);
+            }
 
             // Get stim amplitudes for this channel
-            if (state->getControllerTypeEnum() == ControllerStimRecord) {
-                if (thisChannel->getOutputToTcpStim()) {
-                    enabledStimChannelNames.append(thisChannel->getNativeName());
-                    double stimStepSizeuA = RHXRegisters::stimStepSizeToDouble(state->getStimStepSizeEnum()) * 1e6;
-                    double firstPhaseAmplitudeuA = thisChannel->stimParameters->firstPhaseAmplitude->getValue();
-                    double secondPhaseAmplitudeuA = thisChannel->stimParameters->secondPhaseAmplitude->getValue();
-                    int firstPhaseAmplitude = round(firstPhaseAmplitudeuA / stimStepSizeuA);
-                    firstPhaseAmplitude = qBound(0, firstPhaseAmplitude, 255);
-                    int secondPhaseAmplitude = round(secondPhaseAmplitudeuA / stimStepSizeuA);
-                    secondPhaseAmplitude = qBound(0, secondPhaseAmplitude, 255);
-                    if (thisChannel->stimParameters->stimPolarity->getValue().toLower() == "negativefirst") {
-                        negStimAmplitudes.push_back((uint8_t) firstPhaseAmplitude);
-                        posStimAmplitudes.push_back((uint8_t) secondPhaseAmplitude);
-                    } else {
-                        posStimAmplitudes.push_back((uint8_t) firstPhaseAmplitude);
-                        negStimAmplitudes.push_back((uint8_t) secondPhaseAmplitude);
-                    }
+            if (thisChannel->getOutputToTcpStim()) {
+                addOutputWord(OutputStim, nullptr, waveformFifo->getDigitalWaveformPointer(waveName + "|STIM"), frameOffset,
+                              (int) posStimAmplitudes.size());
+                double stimStepSizeuA = RHXRegisters::stimStepSizeToDouble(state->getStimStepSizeEnum()) * 1e6;
+                double firstPhaseAmplitudeuA = thisChannel->stimParameters->firstPhaseAmplitude->getValue();
+                double secondPhaseAmplitudeuA = thisChannel->stimParameters->secondPhaseAmplitude->getValue();
+                int firstPhaseAmplitude = round(firstPhaseAmplitudeuA / stimStepSizeuA);
+                firstPhaseAmplitude = qBound(0, firstPhaseAmplitude, 255);
+                int secondPhaseAmplitude = round(secondPhaseAmplitudeuA / stimStepSizeuA);
+                secondPhaseAmplitude = qBound(0, secondPhaseAmplitude, 255);
+                if (thisChannel->stimParameters->stimPolarity->getValue().toLower() == "negativefirst") {
+                    negStimAmplitudes.push_back((uint8_t) firstPhaseAmplitude);
+                    posStimAmplitudes.push_back((uint8_t) secondPhaseAmplitude);
+                } else {
+                    posStimAmplitudes.push_back((uint8_t) firstPhaseAmplitude);
+                    negStimAmplitudes.push_back((uint8_t) secondPhaseAmplitude);
                 }
             }
-
             break;
 
-        // Get numAuxChannels
         case AuxInputSignal:
             if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numAuxChannels += 1;
+                addOutputWord(OutputAux, waveformFifo->getAnalogWaveformPointer(waveName), nullptr, frameOffset, numHeldSamples++);
             }
             break;
 
-        // Get numVddChannels
         case SupplyVoltageSignal:
             if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numVddChannels += 1;
+                addOutputWord(OutputVdd, waveformFifo->getAnalogWaveformPointer(waveName), nullptr, frameOffset, numHeldSamples++);
             }
             break;
 
-        // Get numAdcChannels
         case BoardAdcSignal:
             if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numAdcChannels += 1;
+                addOutputWord(OutputAdc, waveformFifo->getAnalogWaveformPointer(waveName), nullptr, frameOffset);
             }
             break;
 
-        // Get numDacChannels
         case BoardDacSignal:
             if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numDacChannels += 1;
+                addOutputWord(OutputDac, waveformFifo->getAnalogWaveformPointer(waveName), nullptr, frameOffset);
             }
             break;
 
-        // Get numDigitalInChannels
+        // A single digital in word is sent, in place of the first enabled digital in channel.
         case BoardDigitalInSignal:
-            if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numDigitalInChannels += 1;
+            if (thisChannel->getOutputToTcp() && !digitalInWordAdded) {
+                addOutputWord(OutputDigitalIn, nullptr, digitalInWordWaveform, frameOffset);
+                digitalInWordAdded = true;
             }
             break;
 
+        // A single digital out word is sent, in place of the first enabled digital out channel.
         case BoardDigitalOutSignal:
-            if (thisChannel->getOutputToTcp()) {
-                enabledChannelNames.append(thisChannel->getNativeName());
-                numDigitalOutChannels += 1;
+            if (thisChannel->getOutputToTcp() && !digitalOutWordAdded) {
+                addOutputWord(OutputDigitalOut, nullptr, digitalOutWordWaveform, frameOffset);
+                digitalOutWordAdded = true;
             }
             break;
         }
     }
 
-    previousSample = new uint16_t[enabledChannelNames.size()];
-    for (int i = 0; i < enabledChannelNames.size(); ++i) {
-        previousSample[i] = 0;
-    }
-
-    digInWordPresent = 0;
-    if (numDigitalInChannels > 0) {
-        digInWordPresent = 1;
-    }
+    heldSamples.assign(numHeldSamples, 0);
 
-    digOutWordPresent = 0;
-    if (numDigitalOutChannels > 0) {
-        digOutWordPresent = 1;
-    }
-
-    // Each frame has 4 bytes for timestamp, then 2 bytes per uint16 word.
-    numBytesPerFrame = 4 + 2 * (totalEnabledBands + numAuxChannels + numVddChannels + numAdcChannels + numDacChannels + digInWordPresent + digOutWordPresent);
+    numBytesPerFrame = frameOffset;
     // Each data block has 4 bytes for magic number, then 128 frames
     numBytesPerDataBlock = 4 + (FramesPerBlock * numBytesPerFrame);
 
-    waveformArray.clear();
-    waveformArray.resize(state->tcpNumDataBlocksWrite->getValue() * numBytesPerDataBlock);
-    waveformArrayIndex = 0;
-
     // For each chunk of spike data, there are 4 bytes for magic number, 5 bytes for 5 characters of native channel name,
     // 4 bytes for timestamp, and 1 byte for spikeID.
     numBytesPerSpikeChunk = 4 + 5 + 4 + 1;
     // The absolute maximum # of chunks that could be sent is 4 per data block, for all amplifier signals
     // (actual numbers will likely be much less), but the spike array should be allocated this size.
-    maxChunksPerDataBlock = 4 * signalSources->numAmplifierChannels();
+    maxChunksPerDataBlock = MaxSpikesPerDataBlock * signalSources->numAmplifierChannels();
 
-    spikeArray.clear();
-    spikeArray.resize(state->tcpNumDataBlocksWrite->getValue() * numBytesPerSpikeChunk * maxChunksPerDataBlock);
-    spikeArrayIndex = 0;
+    int numDataBlocks = state->tcpNumDataBlocksWrite->getValue();
+    timeStamps.resize(FramesPerBlock * numDataBlocks);
+    waveformBuffer.resize(numDataBlocks * numBytesPerDataBlock);
+    spikeBuffer.resize(numDataBlocks * numBytesPerSpikeChunk * maxChunksPerDataBlock);
 
     previousEnabledBands = state->signalSources->getTcpFilterBands();
 
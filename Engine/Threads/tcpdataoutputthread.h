@@ -61,42 +61,74 @@ signals:
     void outputData(QByteArray *array, qint64 len);
 
 private:
+    // Contiguous run of amplifier channels from one GPU band, copied into every frame with a single memcpy.
+    struct GpuOutputRun {
+        GpuWaveformType waveformType;
+        int firstChannel;
+        int numChannels;
+        int frameOffset;
+    };
+
+    enum OutputWordType {
+        OutputDc,
+        OutputStim,
+        OutputAux,
+        OutputVdd,
+        OutputAdc,
+        OutputDac,
+        OutputDigitalIn,
+        OutputDigitalOut
+    };
+
+    // Single non-GPU word in each frame that needs scaling or sample-and-hold before it is written.
+    struct OutputWord {
+        OutputWordType type;
+        const float* analogWaveform;
+        const uint16_t* digitalWaveform;
+        int frameOffset;
+        int index;  // Stim amplitude index for OutputStim; held-sample index for OutputAux and OutputVdd
+    };
+
+    struct SpikeOutput {
+        const uint16_t* spikeWaveform;
+        char nativeName[5];
+    };
+
     void closeInternal(); // Close thread from inside this thread.
     void updateEnabledChannels();
+    void addGpuOutput(const QString& waveName, int& frameOffset);
+    void addOutputWord(OutputWordType type, const float* analogWaveform, const uint16_t* digitalWaveform, int& frameOffset,
+                       int index = 0);
+    void encodeData(int numFrames, char* waveformData, qint64& waveformBytes, char* spikeData, qint64& spikeBytes);
+    void updateThroughput(int numFrames, qint64 busyNsecs);
 
     TCPCommunicator *tcpWaveformDataCommunicator;
     TCPCommunicator *tcpSpikeDataCommunicator;
 
-    std::vector<std::string> channelNames;
-    QVector<QString> enabledChannelNames;
-    QVector<QString> enabledStimChannelNames;
-
     QStringList previousEnabledBands;
 
-    int totalEnabledBands;
-    int numAuxChannels;
-    int numVddChannels;
-    int numAdcChannels;
-    int numDacChannels;
-    int numDigitalInChannels;
-    int numDigitalOutChannels;
-
-    uint16_t* previousSample;
+    // Output plan, compiled by updateEnabledChannels() so the run loop never looks up channels or waveforms by name.
+    std::vector<GpuOutputRun> gpuRuns;
+    std::vector<OutputWord> outputWords;
+    std::vector<SpikeOutput> spikeOutputs;
+    std::vector<uint16_t> heldSamples;
+    std::vector<uint32_t> timeStamps;
+    bool adcUsb2Scaling;
 
-    int digInWordPresent;
-    int digOutWordPresent;
     int numBytesPerFrame;
     int numBytesPerDataBlock;
 
-    QByteArray waveformArray;
-    qint64 waveformArrayIndex;
-
-    QByteArray spikeArray;
-    qint64 spikeArrayIndex;
+    // Preallocated serialization buffers, written straight to the sockets; writeData() is synchronous, so one of each
+    // is enough and the encoder never reallocates.
+    QByteArray waveformBuffer;
+    QByteArray spikeBuffer;
 
     int numBytesPerSpikeChunk;
     int maxChunksPerDataBlock;
 
+    qint64 throughputFrames;
+    qint64 throughputNsecs;
+
     WaveformFifo *waveformFifo;
 
     SignalSources *signalSources;
@@ -32,11 +32,13 @@
 #include <iostream>
 #include "usbdatathread.h"
 
-USBDataThread::USBDataThread(AbstractRHXController* controller_, DataStreamFifo* usbFifo_, QObject *parent) :
+USBDataThread::USBDataThread(AbstractRHXController* controller_, DataStreamFifo* usbFifo_, PipelineProfiler* pipelineProfiler_,
+                             QObject *parent) :
     QThread(parent),
     errorChecking(controller_->acquisitionMode() != PlaybackMode),
     controller(controller_),
     usbFifo(usbFifo_),
+    pipelineProfiler(pipelineProfiler_),
     keepGoing(false),
     running(false),
     stopThread(false),
@@ -80,6 +82,9 @@ void USBDataThread::run()
             int numBytesPerDataFrame = BytesPerWord *
                     RHXDataBlock::dataBlockSizeInWords(type, controller->getNumEnabledDataStreams()) /
                     RHXDataBlock::samplesPerDataBlock(type);
+            // A synthetic controller running faster than real time is throttled by the FIFO instead of the clock.
+            const bool waitForFifoSpace = controller->isSynthetic();
+            const int wordsPerRead = numUsbBlocksToRead * RHXDataBlock::dataBlockSizeInWords(type, controller->getNumEnabledDataStreams());
             int ledArray[8] = {1, 0, 0, 0, 0, 0, 0, 0};
             int ledIndex = 0;
             if (type == ControllerRecordUSB2) {
@@ -100,6 +105,10 @@ void USBDataThread::run()
                 // Performance note:  Executing the following command takes around 88% of the total time of this loop,
                 // with or without error checking enabled.
 
+                if (waitForFifoSpace && usbFifo->wordsFree() < wordsPerRead + usbBufferIndex / BytesPerWord) {
+                    usleep(100);
+                    continue;
+                }
                 numBytesRead = (int) controller->readDataBlocksRaw(numUsbBlocksToRead, &usbBuffer[usbBufferIndex]);
                 if (numBytesRead == -1) {
                     break;
@@ -107,29 +116,53 @@ void USBDataThread::run()
 
                 bytesInBuffer = usbBufferIndex + numBytesRead;
                 if (numBytesRead > 0) {
+                    // Blocks are time stamped as read only when they reach the FIFO, so that blocks discarded by error
+                    // checking do not shift the block count of StageUsbRead relative to later stages.
+                    int64_t readTime = pipelineProfiler->isEnabled() ? PipelineProfiler::nowNs() : 0;
                     if (!errorChecking) {
                         // If not checking for USB data glitches, just write all the data to the FIFO buffer.
                         if (!usbFifo->writeToBuffer(&usbBuffer[usbBufferIndex], (numBytesRead + usbBufferIndex) / BytesPerWord)) {
                             std::cerr << "USBDataThread: USB FIFO overrun (1)." << '\n';
+                        } else {
+                            pipelineProfiler->record(StageUsbRead, (numBytesRead + usbBufferIndex) / numBytesPerDataFrame, readTime);
+                            pipelineProfiler->record(StageFifoWrite, (numBytesRead + usbBufferIndex) / numBytesPerDataFrame);
                         }
                         usbBufferIndex = 0;
                     } else {
                         usbBufferIndex = 0;
-                        // Otherwise, check each USB data block for the correct header bytes before writing.
+                        // Otherwise, check each USB data block for the correct header bytes before writing.  Consecutive
+                        // good data blocks are committed to the FIFO buffer together.
+                        int runStart = 0;
+                        int runLength = 0;
                         while (usbBufferIndex <= bytesInBuffer - numBytesPerDataFrame - USBHeaderSizeInBytes) {
                             if (RHXDataBlock::checkUsbHeader(usbBuffer, usbBufferIndex, type) &&
                                 RHXDataBlock::checkUsbHeader(usbBuffer, usbBufferIndex + numBytesPerDataFrame, type)) {
-                                // If we find two correct headers, assume the data in between is a good data block,
-                                // and write it to the FIFO buffer.
-                                if (!usbFifo->writeToBuffer(&usbBuffer[usbBufferIndex], numBytesPerDataFrame / BytesPerWord)) {
-                                    std::cerr << "USBDataThread: USB FIFO overrun (2)." << '\n';
-                                }
+                                // If we find two correct headers, assume the data in between is a good data block.
+                                if (runLength == 0) runStart = usbBufferIndex;
+                                runLength += numBytesPerDataFrame;
                                 usbBufferIndex += numBytesPerDataFrame;
                             } else {
+                                if (runLength > 0) {
+                                    if (!usbFifo->writeToBuffer(&usbBuffer[runStart], runLength / BytesPerWord)) {
+                                        std::cerr << "USBDataThread: USB FIFO overrun (2)." << '\n';
+                                    } else {
+                                        pipelineProfiler->record(StageUsbRead, runLength / numBytesPerDataFrame, readTime);
+                                        pipelineProfiler->record(StageFifoWrite, runLength / numBytesPerDataFrame);
+                                    }
+                                    runLength = 0;
+                                }
                                 // If headers are not found, advance word by word until we find them
                                 usbBufferIndex += 2;
                             }
                         }
+                        if (runLength > 0) {
+                            if (!usbFifo->writeToBuffer(&usbBuffer[runStart], runLength / BytesPerWord)) {
+                                std::cerr << "USBDataThread: USB FIFO overrun (2)." << '\n';
+                            } else {
+                                pipelineProfiler->record(StageUsbRead, runLength / numBytesPerDataFrame, readTime);
+                                pipelineProfiler->record(StageFifoWrite, runLength / numBytesPerDataFrame);
+                            }
+                        }
                         // If any data remains in usbBuffer, shift it to the front.
                         if (usbBufferIndex > 0) {
                             int j = 0;
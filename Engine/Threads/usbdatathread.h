@@ -36,6 +36,7 @@
 #include "rhxdatablock.h"
 #include "abstractrhxcontroller.h"
 #include "datastreamfifo.h"
+#include "pipelineprofiler.h"
 
 const int BufferSizeInBlocks = 32;
 
@@ -43,7 +44,8 @@ class USBDataThread : public QThread
 {
     Q_OBJECT
 public:
-    explicit USBDataThread(AbstractRHXController* controller_, DataStreamFifo* usbFifo_,  QObject *parent = nullptr);
+    explicit USBDataThread(AbstractRHXController* controller_, DataStreamFifo* usbFifo_, PipelineProfiler* pipelineProfiler_,
+                           QObject *parent = nullptr);
     ~USBDataThread();
 
     bool errorChecking;
@@ -64,6 +66,7 @@ signals:
 private:
     AbstractRHXController* controller;
     DataStreamFifo* usbFifo;
+    PipelineProfiler* pipelineProfiler;
     volatile bool keepGoing;
     volatile bool running;
     volatile bool stopThread;
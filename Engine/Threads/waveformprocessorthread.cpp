@@ -49,6 +49,8 @@ WaveformProcessorThread::WaveformProcessorThread(SystemState* state_, int numDat
     usbFifo(usbFifo_),
     waveformFifo(waveformFifo_),
     numDataStreams(numDataStreams_),
+    digitalInWordWaveform(nullptr),
+    digitalOutWordWaveform(nullptr),
     xpuController(xpuController_),
     keepGoing(false),
     running(false),
@@ -59,12 +61,11 @@ WaveformProcessorThread::WaveformProcessorThread(SystemState* state_, int numDat
 
 void WaveformProcessorThread::run()
 {
-    const int NumBlocks = 1;  // Note: GPU spike extraction works on single data blocks only; this value must be 1 if spikes are read.
-    const int NumSamples = NumBlocks * RHXDataBlock::samplesPerDataBlock(type);
+    const int SamplesPerDataBlock = RHXDataBlock::samplesPerDataBlock(type);
     uint16_t* usbData = nullptr;
     bool firstTime = true;
     bool softwareRefInfoUpdated = false;
-    SoftwareReferenceProcessor swRefProcessor(type, numDataStreams, NumSamples, state);
+    SoftwareReferenceProcessor swRefProcessor(type, numDataStreams, SamplesPerDataBlock, state);
     QElapsedTimer loopTimer, workTimer, reportTimer;
 
     while (!stopThread) {
@@ -83,6 +84,9 @@ void WaveformProcessorThread::run()
 
             xpuController->resetPrev();
 
+            buildRoutingTable();
+            state->spikeActivity->reset(signalSources->numChannelHandles(), sampleRate);
+
             // Determine how many microseconds of data one block represents.
 //            float oneBlockus = (numSamples / sampleRate) * 1e6;
 
@@ -95,18 +99,22 @@ void WaveformProcessorThread::run()
                     softwareRefInfoUpdated = true;
                 }
 
-                usbData = usbFifo->pointerToData(numUsbWords);  // Get pointer to new USB data, if available.
+                // If we have fallen behind (e.g., after a stall), process all waiting data blocks, up to a limit, in one
+                // batch to catch up quickly.  When keeping up in real time, this is always a single data block.
+                int numBlocks = qBound(1, usbFifo->wordsAvailable() / numUsbWords, state->processingBatchBlocks->getValue());
+                int numSamples = numBlocks * SamplesPerDataBlock;
+
+                usbData = usbFifo->pointerToData(numBlocks * numUsbWords);  // Get pointer to new USB data, if available.
                 if (usbData) {
-                    if (state->getReportSpikes()) {
-                        state->advanceSpikeTimer();
-                    }
                     workTimer.restart();
 
                     // Perform any software referencing prior to filtering.
-                    swRefProcessor.applySoftwareReferences(usbData);
+                    for (int block = 0; block < numBlocks; ++block) {
+                        swRefProcessor.applySoftwareReferences(usbData + block * numUsbWords);
+                    }
 
                     // Check for space to write the waveform data.
-                    while (!waveformFifo->requestWriteSpace(NumBlocks)) {
+                    while (!waveformFifo->requestWriteSpace(numBlocks)) {
                         usleep(100);
                     }
 
@@ -118,10 +126,11 @@ void WaveformProcessorThread::run()
                     uint32_t* spike = waveformFifo->pointerToGpuSpikeTimestampsWriteSpace();
                     uint8_t* spikeID = waveformFifo->pointerToGpuSpikeIdsWriteSpace();
 
-                    // Process one data block through GPU, and write the results to WaveformFifo.
+                    // Process data blocks through XPU, and write the results to WaveformFifo.
 //                    auto start = chrono::steady_clock::now();
 
-                    xpuController->processDataBlock(usbData, low, wide, high, spike, spikeID);
+                    xpuController->processDataBlocks(numBlocks, usbData, low, wide, high, spike, spikeID);
+                    state->pipelineProfiler->record(StageXpuDone, numSamples);
 //                    auto end = chrono::steady_clock::now();
 
                     // Determine how long this processing took, and report if it's approaching real-time.
@@ -131,85 +140,57 @@ void WaveformProcessorThread::run()
 //                        qDebug() << "Warning: GPU process time approaching real-time. Real-time data block length: " << oneBlockus << " us. Processing time: " << elapsedus << " us. GPU is " << gpuAccel << "x faster";
 
                     // Read and process waveform data from USB buffer, and write data to waveform FIFO.
-                    RHXDataReader dataReader(type, numDataStreams, usbData, NumSamples);
-
-                    float* analogWaveform = nullptr;
-                    uint16_t* digitalWaveform = nullptr;
+                    RHXDataReader dataReader(type, numDataStreams, usbData, numSamples);
 
                     int lastTimestamp = dataReader.readTimeStampData(waveformFifo->pointerToTimeStampWriteSpace());
                     state->setLastTimestamp(lastTimestamp);
 
-                    QString spikingChannelNames("");
-
-                    for (int group = 0; group < signalSources->numGroups(); group++) {
-                        SignalGroup* signalGroup = signalSources->groupByIndex(group);
-                        for (int signal = 0; signal < signalGroup->numChannels(); signal++) {
-                            Channel* channel = signalGroup->channelByIndex(signal);
-                            std::string waveName = channel->getNativeNameString();
-                            if (channel->getSignalType() == AmplifierSignal) {
-                                GpuWaveformAddress gpuWaveformAddress = waveformFifo->getGpuWaveformAddress(waveName + "|SPK");
-                                digitalWaveform = waveformFifo->getDigitalWaveformPointer(waveName + "|SPK");
-                                // Note: GPU spike extraction only works on single data blocks.
-                                bool spikeFound = waveformFifo->extractGpuSpikeDataOneDataBlock(digitalWaveform, gpuWaveformAddress, firstTime);
-
-                                if (state->getReportSpikes()) {
-                                    if (spikeFound) {
-                                        spikingChannelNames.append(QString::fromStdString(waveName) + ",");
-                                        //state->spikeReport(QString::fromStdString(waveName));
-                                    }
-                                    // Find if a spike happened on this channel. If so, get its name
-                                    // If there's a name, send the spikeReport() signal.
-                                    // This signal should be ultimately received by ProbeMapWindow, which will then internally handle the time decay
-                                }
-
-                                if (signalSources->getControllerType() == ControllerStimRecord) {
-                                    // Load DC amplifier data and stimulation markers.
-                                    analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName + "|DC");
-                                    dataReader.readDcAmplifierData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                                   channel->getBoardStream(), channel->getChipChannel());
-                                    digitalWaveform = waveformFifo->getDigitalWaveformPointer(waveName + "|STIM");
-                                    dataReader.readStimParamData(waveformFifo->pointerToDigitalWriteSpace(digitalWaveform),
-                                                              channel->getBoardStream(), channel->getChipChannel());
-                                }
-                            } else if (channel->getSignalType() == AuxInputSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readAuxInData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                         channel->getBoardStream(), channel->getChipChannel());
-                            } else if (channel->getSignalType() == SupplyVoltageSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readSupplyVoltageData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                                 channel->getBoardStream());
-                            } else if (channel->getSignalType() == BoardAdcSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readBoardAdcData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                            channel->getNativeChannelNumber());
-                            } else if (channel->getSignalType() == BoardDacSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readBoardDacData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                            channel->getNativeChannelNumber());
-                            } else if (channel->getSignalType() == BoardDigitalInSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readDigInData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                         channel->getNativeChannelNumber());
-                            } else if (channel->getSignalType() == BoardDigitalOutSignal) {
-                                analogWaveform = waveformFifo->getAnalogWaveformPointer(waveName);
-                                dataReader.readDigOutData(waveformFifo->pointerToAnalogWriteSpace(analogWaveform),
-                                                         channel->getNativeChannelNumber());
-                            }
+                    for (const SpikeRoute& route : spikeRoutes) {
+                        int numSpikes = waveformFifo->extractGpuSpikeData(route.waveform, route.gpuWaveformAddress, numBlocks, firstTime);
+                        if (numSpikes > 0) {
+                            state->spikeActivity->addSpikes(route.channelHandle, numSpikes);
                         }
                     }
+                    state->spikeActivity->publish(numSamples);
+
+                    for (const StimRoute& route : stimRoutes) {
+                        dataReader.readStimParamData(waveformFifo->pointerToDigitalWriteSpace(route.waveform),
+                                                     route.stream, route.channel);
+                    }
 
-                    if (state->getReportSpikes()) {
-                        state->spikeReport(spikingChannelNames);
+                    for (const AnalogRoute& route : analogRoutes) {
+                        float* dest = waveformFifo->pointerToAnalogWriteSpace(route.waveform);
+                        switch (route.source) {
+                        case AnalogSourceDcAmplifier:
+                            dataReader.readDcAmplifierData(dest, route.stream, route.channel);
+                            break;
+                        case AnalogSourceAuxIn:
+                            dataReader.readAuxInData(dest, route.stream, route.channel);
+                            break;
+                        case AnalogSourceSupplyVoltage:
+                            dataReader.readSupplyVoltageData(dest, route.stream);
+                            break;
+                        case AnalogSourceBoardAdc:
+                            dataReader.readBoardAdcData(dest, route.channel);
+                            break;
+                        case AnalogSourceBoardDac:
+                            dataReader.readBoardDacData(dest, route.channel);
+                            break;
+                        case AnalogSourceDigIn:
+                            dataReader.readDigInData(dest, route.channel);
+                            break;
+                        case AnalogSourceDigOut:
+                            dataReader.readDigOutData(dest, route.channel);
+                            break;
+                        }
                     }
 
-                    digitalWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
-                    dataReader.readDigInData(waveformFifo->pointerToDigitalWriteSpace(digitalWaveform));
-                    digitalWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-OUT-WORD");
-                    dataReader.readDigOutData(waveformFifo->pointerToDigitalWriteSpace(digitalWaveform));
+                    dataReader.readDigInData(waveformFifo->pointerToDigitalWriteSpace(digitalInWordWaveform));
+                    dataReader.readDigOutData(waveformFifo->pointerToDigitalWriteSpace(digitalOutWordWaveform));
 
                     // Done reading and processing all waveforms.
                     waveformFifo->commitNewData();  // Commit waveform data we have just written.
+                    state->pipelineProfiler->record(StageWaveformCommit, numSamples);
                     usbFifo->freeData();  // Free raw data we just read from the USB buffer.
 
                     firstTime = false;
@@ -241,7 +222,9 @@ void WaveformProcessorThread::run()
                     workTimer.restart();
                     loopTimer.restart();
                 } else {
-                    usleep(100);    // Wait 100 microseconds.
+                    // Sleep until the USB data thread commits another data block (or briefly time out to recheck
+                    // keepGoing), rather than polling.
+                    usbFifo->waitForData(numUsbWords, 10000);
                 }
             }
             running = false;
@@ -254,6 +237,63 @@ void WaveformProcessorThread::run()
     }
 }
 
+// Look up the WaveformFifo destination of every waveform this thread writes, and the location of its source data in
+// the USB data block.
+void WaveformProcessorThread::buildRoutingTable()
+{
+    spikeRoutes.clear();
+    analogRoutes.clear();
+    stimRoutes.clear();
+
+    for (int group = 0; group < signalSources->numGroups(); group++) {
+        SignalGroup* signalGroup = signalSources->groupByIndex(group);
+        for (int signal = 0; signal < signalGroup->numChannels(); signal++) {
+            Channel* channel = signalGroup->channelByIndex(signal);
+            std::string waveName = channel->getNativeNameString();
+            int stream = channel->getBoardStream();
+            int chipChannel = channel->getChipChannel();
+            int nativeChannel = channel->getNativeChannelNumber();
+
+            switch (channel->getSignalType()) {
+            case AmplifierSignal:
+                spikeRoutes.push_back({ waveformFifo->getGpuWaveformAddress(waveName + "|SPK"),
+                                        waveformFifo->getDigitalWaveformPointer(waveName + "|SPK"),
+                                        channel->getHandle() });
+                if (type == ControllerStimRecord) {
+                    // DC amplifier data and stimulation markers.
+                    analogRoutes.push_back({ AnalogSourceDcAmplifier, waveformFifo->getAnalogWaveformPointer(waveName + "|DC"),
+                                             stream, chipChannel });
+                    stimRoutes.push_back({ waveformFifo->getDigitalWaveformPointer(waveName + "|STIM"), stream, chipChannel });
+                }
+                break;
+            case AuxInputSignal:
+                analogRoutes.push_back({ AnalogSourceAuxIn, waveformFifo->getAnalogWaveformPointer(waveName), stream, chipChannel });
+                break;
+            case SupplyVoltageSignal:
+                analogRoutes.push_back({ AnalogSourceSupplyVoltage, waveformFifo->getAnalogWaveformPointer(waveName), stream, 0 });
+                break;
+            case BoardAdcSignal:
+                analogRoutes.push_back({ AnalogSourceBoardAdc, waveformFifo->getAnalogWaveformPointer(waveName), 0, nativeChannel });
+                break;
+            case BoardDacSignal:
+                analogRoutes.push_back({ AnalogSourceBoardDac, waveformFifo->getAnalogWaveformPointer(waveName), 0, nativeChannel });
+                break;
+            case BoardDigitalInSignal:
+                analogRoutes.push_back({ AnalogSourceDigIn, waveformFifo->getAnalogWaveformPointer(waveName), 0, nativeChannel });
+                break;
+            case BoardDigitalOutSignal:
+                analogRoutes.push_back({ AnalogSourceDigOut, waveformFifo->getAnalogWaveformPointer(waveName), 0, nativeChannel });
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    digitalInWordWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
+    digitalOutWordWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-OUT-WORD");
+}
+
 void WaveformProcessorThread::startRunning(int numDataStreams_)
 {
     numDataStreams = numDataStreams_;
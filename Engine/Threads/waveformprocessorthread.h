@@ -56,6 +56,44 @@ signals:
     void cpuLoadPercent(double percent);
 
 private:
+    // Sources of the per-channel analog waveforms read from each USB data block.
+    enum AnalogSource {
+        AnalogSourceDcAmplifier,
+        AnalogSourceAuxIn,
+        AnalogSourceSupplyVoltage,
+        AnalogSourceBoardAdc,
+        AnalogSourceBoardDac,
+        AnalogSourceDigIn,
+        AnalogSourceDigOut
+    };
+
+    // Where one amplifier channel's spike raster is extracted from, and where it is written.
+    struct SpikeRoute
+    {
+        GpuWaveformAddress gpuWaveformAddress;
+        uint16_t* waveform;
+        int channelHandle;  // Index into SystemState::spikeActivity
+    };
+
+    // Where one analog waveform is read from in the USB data block, and where it is written.
+    struct AnalogRoute
+    {
+        AnalogSource source;
+        float* waveform;
+        int stream;
+        int channel;
+    };
+
+    // Where one amplifier channel's stimulation parameters are written (ControllerStimRecord only).
+    struct StimRoute
+    {
+        uint16_t* waveform;
+        int stream;
+        int channel;
+    };
+
+    void buildRoutingTable();
+
     SystemState* state;
     SignalSources* signalSources;
     ControllerType type;
@@ -66,6 +104,14 @@ private:
 
     std::vector<double> cpuLoadHistory;
 
+    // Routing table built once when running starts (the channel configuration cannot change while running), so that
+    // waveform destinations need not be looked up by name for every data block.
+    std::vector<SpikeRoute> spikeRoutes;
+    std::vector<AnalogRoute> analogRoutes;
+    std::vector<StimRoute> stimRoutes;
+    uint16_t* digitalInWordWaveform;
+    uint16_t* digitalOutWordWaveform;
+
     XPUController* xpuController;
 
     volatile bool keepGoing;
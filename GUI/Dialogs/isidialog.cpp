@@ -35,7 +35,8 @@
 
 ISIDialog::ISIDialog(SystemState *state_, QWidget *parent) :
     QDialog(parent),
-    state(state_)
+    state(state_),
+    visible(false)
 {
     connect(state, SIGNAL(stateChanged()), this, SLOT(updateFromState()));
 
@@ -194,10 +195,23 @@ void ISIDialog::activate()
     activateWindow();
 }
 
-void ISIDialog::updateISI(WaveformFifo *waveformFifo, int numSamples)
+// Called from AnalysisThread.
+void ISIDialog::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
+{
+    if (!visible) return;
+    isiPlot->updateWaveforms(waveformFifo, reader, numSamples);
+}
+
+void ISIDialog::showEvent(QShowEvent* event)
+{
+    visible = true;
+    QDialog::showEvent(event);
+}
+
+void ISIDialog::hideEvent(QHideEvent* event)
 {
-    if (this->isHidden()) return;
-    isiPlot->updateWaveforms(waveformFifo, numSamples);
+    visible = false;
+    QDialog::hideEvent(event);
 }
 
 void ISIDialog::setToSelected()
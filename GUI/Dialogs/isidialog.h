@@ -32,8 +32,12 @@
 #define ISIDIALOG_H
 
 #include <QDialog>
+
+#include <atomic>
+
 #include "systemstate.h"
 #include "isiplot.h"
+#include "analysisthread.h"
 
 class QLabel;
 class QComboBox;
@@ -41,7 +45,7 @@ class QPushButton;
 class QCheckBox;
 class WaveformFifo;
 
-class ISIDialog : public QDialog
+class ISIDialog : public QDialog, public AnalysisClient
 {
     Q_OBJECT
 public:
@@ -53,7 +57,7 @@ public:
     void updateForStop();
     void updateForChangeHeadstages();
 
-    void updateISI(WaveformFifo *waveformFifo, int numSamples);
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
     void activate();
 
 private slots:
@@ -72,8 +76,13 @@ private slots:
     void configSave();
     void saveData();
 
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
 private:
     SystemState* state;
+    std::atomic<bool> visible;  // Read by analyzeNewData() on AnalysisThread
 
     QLabel *channelName;
 
@@ -35,7 +35,8 @@
 
 PSTHDialog::PSTHDialog(SystemState* state_, QWidget *parent) :
     QDialog(parent),
-    state(state_)
+    state(state_),
+    visible(false)
 {
     connect(state, SIGNAL(stateChanged()), this, SLOT(updateFromState()));
 
@@ -245,10 +246,23 @@ void PSTHDialog::activate()
     activateWindow();
 }
 
-void PSTHDialog::updatePSTH(WaveformFifo *waveformFifo, int numSamples)
+// Called from AnalysisThread.
+void PSTHDialog::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
+{
+    if (!visible) return;
+    psthPlot->updateWaveforms(waveformFifo, reader, numSamples);
+}
+
+void PSTHDialog::showEvent(QShowEvent* event)
+{
+    visible = true;
+    QDialog::showEvent(event);
+}
+
+void PSTHDialog::hideEvent(QHideEvent* event)
 {
-    if (this->isHidden()) return;
-    psthPlot->updateWaveforms(waveformFifo, numSamples);
+    visible = false;
+    QDialog::hideEvent(event);
 }
 
 void PSTHDialog::setToSelected()
@@ -32,8 +32,12 @@
 #define PSTHDIALOG_H
 
 #include <QDialog>
+
+#include <atomic>
+
 #include "systemstate.h"
 #include "psthplot.h"
+#include "analysisthread.h"
 
 class QLabel;
 class QComboBox;
@@ -41,7 +45,7 @@ class QPushButton;
 class QCheckBox;
 class WaveformFifo;
 
-class PSTHDialog : public QDialog
+class PSTHDialog : public QDialog, public AnalysisClient
 {
     Q_OBJECT
 public:
@@ -52,7 +56,7 @@ public:
     void updateForLoad();
     void updateForStop();
     void updateForChangeHeadstages();
-    void updatePSTH(WaveformFifo *waveformFifo, int numSamples);
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
     void activate();
 
 private slots:
@@ -78,8 +82,13 @@ private slots:
     void configSave();
     void saveData();
 
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
 private:
     SystemState* state;
+    std::atomic<bool> visible;  // Read by analyzeNewData() on AnalysisThread
 
     QLabel *channelName;
 
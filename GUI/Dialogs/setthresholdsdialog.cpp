@@ -32,7 +32,7 @@
 #include "setthresholdsdialog.h"
 
 SetThresholdsDialog::SetThresholdsDialog(bool absoluteThreshold_, int threshold_, double rmsMultiple_,
-                                         bool negativeRelativeThreshold_, QWidget *parent) :
+                                         bool negativeRelativeThreshold_, bool thresholdTracking_, QWidget *parent) :
     QDialog(parent)
 {
     absoluteThresholdButton = new QRadioButton(tr("Absolute Threshold"), this);
@@ -66,6 +66,9 @@ SetThresholdsDialog::SetThresholdsDialog(bool absoluteThreshold_, int threshold_
     rmsMultipleSpinBox->setSuffix("x RMS");
     rmsMultipleSpinBox->setValue(rmsMultiple_);
 
+    trackingCheckBox = new QCheckBox(tr("Track noise level continuously while running"), this);
+    trackingCheckBox->setChecked(thresholdTracking_);
+
     buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
 
     connect(buttonBox, SIGNAL(accepted()), this, SLOT(accept()));
@@ -90,6 +93,7 @@ SetThresholdsDialog::SetThresholdsDialog(bool absoluteThreshold_, int threshold_
     relativeLayout->addWidget(new QLabel(tr("Set spike detection thresholds to a multiple of the RMS level on each channel."),
                                          this));
     relativeLayout->addLayout(relativeRow);
+    relativeLayout->addWidget(trackingCheckBox);
 
     QGroupBox *absoluteBox = new QGroupBox();
     absoluteBox->setLayout(absoluteLayout);
@@ -119,6 +123,11 @@ double SetThresholdsDialog::threshold() const
     return thresholdSpinBox->value();
 }
 
+bool SetThresholdsDialog::thresholdTracking() const
+{
+    return trackingCheckBox->isChecked();
+}
+
 double SetThresholdsDialog::rmsMultiple() const
 {
     double rmsSign = 1.0;
@@ -134,4 +143,5 @@ void SetThresholdsDialog::updateThresholdType()
     thresholdSpinBox->setEnabled(absolute);
     rmsSignComboBox->setEnabled(!absolute);
     rmsMultipleSpinBox->setEnabled(!absolute);
+    trackingCheckBox->setEnabled(!absolute);
 }
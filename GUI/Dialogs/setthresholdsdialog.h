@@ -39,10 +39,11 @@ class SetThresholdsDialog : public QDialog
     Q_OBJECT
 public:
     explicit SetThresholdsDialog(bool absoluteThreshold_, int threshold_, double rmsMultiple_, bool negativeRelativeThreshold_,
-                                 QWidget *parent);
+                                 bool thresholdTracking_, QWidget *parent);
     bool absoluteThreshold() const;
     double threshold() const;
     double rmsMultiple() const;
+    bool thresholdTracking() const;
 
 private slots:
     void updateThresholdType();
@@ -51,6 +52,7 @@ private:
     QSpinBox *thresholdSpinBox;
     QComboBox *rmsSignComboBox;
     QDoubleSpinBox *rmsMultipleSpinBox;
+    QCheckBox *trackingCheckBox;
     QDialogButtonBox *buttonBox;
 
     QButtonGroup *buttonGroup;
@@ -35,7 +35,8 @@
 
 SpectrogramDialog::SpectrogramDialog(SystemState* state_, QWidget *parent) :
     QDialog(parent),
-    state(state_)
+    state(state_),
+    visible(false)
 {
     connect(state, SIGNAL(stateChanged()), this, SLOT(updateFromState()));
 
@@ -297,10 +298,23 @@ void SpectrogramDialog::activate()
     activateWindow();
 }
 
-void SpectrogramDialog::updateSpectrogram(WaveformFifo *waveformFifo, int numSamples)
+// Called from AnalysisThread.
+void SpectrogramDialog::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
+{
+    if (!visible) return;
+    specPlot->updateWaveforms(waveformFifo, reader, numSamples);
+}
+
+void SpectrogramDialog::showEvent(QShowEvent* event)
+{
+    visible = true;
+    QDialog::showEvent(event);
+}
+
+void SpectrogramDialog::hideEvent(QHideEvent* event)
 {
-    if (this->isHidden()) return;
-    specPlot->updateWaveforms(waveformFifo, numSamples);
+    visible = false;
+    QDialog::hideEvent(event);
 }
 
 void SpectrogramDialog::changeDisplayMode(int index)
@@ -32,8 +32,12 @@
 #define SPECTROGRAMDIALOG_H
 
 #include <QDialog>
+
+#include <atomic>
+
 #include "systemstate.h"
 #include "spectrogramplot.h"
+#include "analysisthread.h"
 
 class QLabel;
 class QComboBox;
@@ -46,7 +50,7 @@ class QCheckBox;
 class WaveformFifo;
 
 
-class SpectrogramDialog : public QDialog
+class SpectrogramDialog : public QDialog, public AnalysisClient
 {
     Q_OBJECT
 public:
@@ -57,7 +61,7 @@ public:
     void updateForLoad();
     void updateForStop();
     void updateForChangeHeadstages();
-    void updateSpectrogram(WaveformFifo *waveformFifo, int numSamples);
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
     void activate();
 
 private slots:
@@ -83,8 +87,13 @@ private slots:
     void configSave();
     void saveData();
 
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
 private:
     SystemState* state;
+    std::atomic<bool> visible;  // Read by analyzeNewData() on AnalysisThread
 
     QLabel *channelName;
 
@@ -35,6 +35,7 @@
 SpikeSortingDialog:: SpikeSortingDialog(SystemState* state_, ControllerInterface* controllerInterface_, QWidget *parent) :
     QDialog(parent),
     state(state_),
+    visible(false),
     controllerInterface(controllerInterface_)
 {
     setAcceptDrops(true);
@@ -374,10 +375,23 @@ void SpikeSortingDialog::activate()
     activateWindow();
 }
 
-void SpikeSortingDialog::updateSpikeScope(WaveformFifo *waveformFifo, int numSamples)
+// Called from AnalysisThread.
+void SpikeSortingDialog::analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
 {
-    if (this->isHidden()) return;
-    spikePlot->updateWaveforms(waveformFifo, numSamples);
+    if (!visible) return;
+    spikePlot->updateWaveforms(waveformFifo, reader, numSamples);
+}
+
+void SpikeSortingDialog::showEvent(QShowEvent* event)
+{
+    visible = true;
+    QDialog::showEvent(event);
+}
+
+void SpikeSortingDialog::hideEvent(QHideEvent* event)
+{
+    visible = false;
+    QDialog::hideEvent(event);
 }
 
 void SpikeSortingDialog::loadSpikeSortingParameters()
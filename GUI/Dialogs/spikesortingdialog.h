@@ -33,9 +33,12 @@
 
 #include <QDialog>
 
+#include <atomic>
+
 #include "systemstate.h"
 #include "xmlinterface.h"
 #include "spikeplot.h"
+#include "analysisthread.h"
 
 class QLabel;
 class QComboBox;
@@ -46,7 +49,7 @@ class QTabWidget;
 class WaveformFifo;
 class ControllerInterface;
 
-class SpikeSortingDialog : public QDialog
+class SpikeSortingDialog : public QDialog, public AnalysisClient
 {
     Q_OBJECT
 public:
@@ -61,7 +64,7 @@ public:
     void updateForStop();
     void updateForChangeHeadstages();
 
-    void updateSpikeScope(WaveformFifo *waveformFifo, int numSamples);
+    void analyzeNewData(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples) override;
     void activate();
 
 private slots:
@@ -89,8 +92,13 @@ private slots:
     void setSuppressionThreshold()
         { state->suppressionThreshold->setValue(suppressionThresholdSpinBox->value()); }
 
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
 private:   
     SystemState* state;
+    std::atomic<bool> visible;  // Read by analyzeNewData() on AnalysisThread
     ControllerInterface* controllerInterface;
 
     XMLInterface *spikeSettingsInterface;
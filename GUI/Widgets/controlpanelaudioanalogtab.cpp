@@ -43,6 +43,7 @@ ControlPanelAudioAnalogTab::ControlPanelAudioAnalogTab(ControllerInterface* cont
     analogOutConfigDialog(nullptr),
     audioEnabledCheckBox(nullptr),
     audioFilterComboBox(nullptr),
+    audioSourceComboBox(nullptr),
     audioChannelLabel(nullptr),
     audioVolumeLabel(nullptr),
     audioVolumeSlider(nullptr),
@@ -150,6 +151,10 @@ ControlPanelAudioAnalogTab::ControlPanelAudioAnalogTab(ControllerInterface* cont
     state->audioFilter->setupComboBox(audioFilterComboBox);
     connect(audioFilterComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(changeAudioFilter(int)));
 
+    audioSourceComboBox = new QComboBox(this);
+    state->audioSource->setupComboBox(audioSourceComboBox);
+    connect(audioSourceComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(changeAudioSource(int)));
+
     audioChannelLabel = new QLabel(tr(""), this);
 
     audioEnabledCheckBox->setFixedWidth(audioEnabledCheckBox->minimumSizeHint().width());
@@ -290,9 +295,15 @@ ControlPanelAudioAnalogTab::ControlPanelAudioAnalogTab(ControllerInterface* cont
     audioLayout2->addWidget(audioThresholdValueLabel);
     audioLayout2->addStretch(2);
 
+    QHBoxLayout *audioLayout3 = new QHBoxLayout;
+    audioLayout3->addWidget(new QLabel(tr("Source"), this));
+    audioLayout3->addWidget(audioSourceComboBox);
+    audioLayout3->addStretch(1);
+
     QVBoxLayout *audioLayout = new QVBoxLayout;
     audioLayout->addLayout(audioLayout1);
     audioLayout->addLayout(audioLayout2);
+    audioLayout->addLayout(audioLayout3);
     audioLayout->addStretch(1);
 
     QGroupBox *pcAudioGroupBox = new QGroupBox(tr("PC Audio"));
@@ -322,6 +333,7 @@ void ControlPanelAudioAnalogTab::updateFromState()
     }
     audioChannelLabel->setText(controllerInterface->getCurrentAudioChannel());
     audioFilterComboBox->setCurrentIndex(state->audioFilter->getIndex());
+    audioSourceComboBox->setCurrentIndex(state->audioSource->getIndex());
 
     int gainIndex = state->analogOutGainIndex->getValue();
     if (gainIndex != gainIndexOld) {
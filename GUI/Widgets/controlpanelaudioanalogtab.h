@@ -48,6 +48,7 @@ public:
 
 private slots:
     void changeAudioFilter(int filterIndex) { state->audioFilter->setIndex(filterIndex); }
+    void changeAudioSource(int sourceIndex) { state->audioSource->setIndex(sourceIndex); }
     void enableAudio(bool enabled);
     void changeVolume(int volume);
     void changeThreshold(int threshold);
@@ -70,6 +71,7 @@ private:
 
     QCheckBox *audioEnabledCheckBox;
     QComboBox *audioFilterComboBox;
+    QComboBox *audioSourceComboBox;
     QLabel *audioChannelLabel;
 
     QLabel *audioVolumeLabel;
@@ -44,8 +44,12 @@ ControlPanelImpedanceTab::ControlPanelImpedanceTab(ControllerInterface* controll
     impedanceFreqSelectButton(nullptr),
     runImpedanceTestButton(nullptr),
     saveImpedancesButton(nullptr),
+    runImpedanceSpectrumButton(nullptr),
+    saveImpedanceSpectrumButton(nullptr),
     desiredImpedanceFreqLabel(nullptr),
-    actualImpedanceFreqLabel(nullptr)
+    actualImpedanceFreqLabel(nullptr),
+    spectrumFreqsLineEdit(nullptr),
+    actualSpectrumFreqsLabel(nullptr)
 {
     impedanceFreqSelectButton = new QPushButton(tr("Select Impedance Test Frequency"), this);
 
@@ -55,6 +59,14 @@ ControlPanelImpedanceTab::ControlPanelImpedanceTab(ControllerInterface* controll
     runImpedanceTestButton = new QPushButton(tr("Run Impedance Measurement"), this);
     saveImpedancesButton = new QPushButton(tr("Save Impedance Measurements in CSV Format"), this);
 
+    spectrumFreqsLineEdit = new QLineEdit(state->desiredImpedanceSpectrumFreqs->getValueString(), this);
+    spectrumFreqsLineEdit->setValidator(new QRegularExpressionValidator(QRegularExpression("[0-9.,\\s]*"), this));
+    actualSpectrumFreqsLabel = new QLabel(this);
+    actualSpectrumFreqsLabel->setWordWrap(true);
+
+    runImpedanceSpectrumButton = new QPushButton(tr("Run Impedance Spectrum Measurement"), this);
+    saveImpedanceSpectrumButton = new QPushButton(tr("Save Impedance Spectra"), this);
+
     QHBoxLayout* impedanceFreqSelectLayout = new QHBoxLayout;
     impedanceFreqSelectLayout->addWidget(impedanceFreqSelectButton);
     impedanceFreqSelectLayout->addStretch(1);
@@ -67,6 +79,18 @@ ControlPanelImpedanceTab::ControlPanelImpedanceTab(ControllerInterface* controll
     saveImpedancesLayout->addWidget(saveImpedancesButton);
     saveImpedancesLayout->addStretch(1);
 
+    QHBoxLayout* spectrumFreqsLayout = new QHBoxLayout;
+    spectrumFreqsLayout->addWidget(new QLabel(tr("Spectrum Frequencies (Hz):"), this));
+    spectrumFreqsLayout->addWidget(spectrumFreqsLineEdit);
+
+    QHBoxLayout* runImpedanceSpectrumLayout = new QHBoxLayout;
+    runImpedanceSpectrumLayout->addWidget(runImpedanceSpectrumButton);
+    runImpedanceSpectrumLayout->addStretch(1);
+
+    QHBoxLayout* saveImpedanceSpectrumLayout = new QHBoxLayout;
+    saveImpedanceSpectrumLayout->addWidget(saveImpedanceSpectrumButton);
+    saveImpedanceSpectrumLayout->addStretch(1);
+
     QVBoxLayout *mainLayout = new QVBoxLayout;
     mainLayout->addLayout(impedanceFreqSelectLayout);
     mainLayout->addWidget(desiredImpedanceFreqLabel);
@@ -74,6 +98,11 @@ ControlPanelImpedanceTab::ControlPanelImpedanceTab(ControllerInterface* controll
     mainLayout->addLayout(runImpedanceTestLayout);
     mainLayout->addLayout(saveImpedancesLayout);
     mainLayout->addWidget(new QLabel(tr("(Impedance measurements are also saved with data)"), this));
+    mainLayout->addSpacing(10);
+    mainLayout->addLayout(spectrumFreqsLayout);
+    mainLayout->addWidget(actualSpectrumFreqsLabel);
+    mainLayout->addLayout(runImpedanceSpectrumLayout);
+    mainLayout->addLayout(saveImpedanceSpectrumLayout);
     mainLayout->addStretch(1);
 
     connect(this, SIGNAL(sendExecuteCommand(QString)), parser, SLOT(executeCommandSlot(QString)));
@@ -81,6 +110,9 @@ ControlPanelImpedanceTab::ControlPanelImpedanceTab(ControllerInterface* controll
     connect(impedanceFreqSelectButton, SIGNAL(clicked()), this, SLOT(changeImpedanceFrequency()));
     connect(runImpedanceTestButton, SIGNAL(clicked()), this, SLOT(runImpedanceTest()));
     connect(saveImpedancesButton, SIGNAL(clicked()), this, SLOT(saveImpedance()));
+    connect(spectrumFreqsLineEdit, SIGNAL(editingFinished()), this, SLOT(changeSpectrumFrequencies()));
+    connect(runImpedanceSpectrumButton, SIGNAL(clicked()), this, SLOT(runImpedanceSpectrum()));
+    connect(saveImpedanceSpectrumButton, SIGNAL(clicked()), this, SLOT(saveImpedanceSpectrum()));
 
     setLayout(mainLayout);
 
@@ -95,6 +127,18 @@ void ControlPanelImpedanceTab::updateFromState()
     impedanceFreqSelectButton->setEnabled(notRunning && nonPlayback);
     runImpedanceTestButton->setEnabled(notRunning && nonPlayback && state->impedanceFreqValid->getValue());
     saveImpedancesButton->setEnabled(notRunning && state->impedancesHaveBeenMeasured->getValue());
+    spectrumFreqsLineEdit->setEnabled(notRunning && nonPlayback);
+    runImpedanceSpectrumButton->setEnabled(notRunning && nonPlayback);
+    saveImpedanceSpectrumButton->setEnabled(notRunning && state->impedanceSpectraHaveBeenMeasured->getValue());
+
+    if (!spectrumFreqsLineEdit->hasFocus()) {
+        spectrumFreqsLineEdit->setText(state->desiredImpedanceSpectrumFreqs->getValueString());
+    }
+    if (state->impedanceSpectraHaveBeenMeasured->getValue()) {
+        actualSpectrumFreqsLabel->setText(tr("Measured Frequencies (Hz): ") + state->actualImpedanceSpectrumFreqs->getValueString());
+    } else {
+        actualSpectrumFreqsLabel->setText(tr("Measured Frequencies (Hz): -"));
+    }
 
     desiredImpedanceFreqLabel->setText(tr("Desired Impedance Test Frequency: ") +
                                        QString::number(state->desiredImpedanceFreq->getValue(), 'f', 0) + tr(" Hz"));
@@ -136,6 +180,39 @@ void ControlPanelImpedanceTab::saveImpedance()
     }
 }
 
+void ControlPanelImpedanceTab::changeSpectrumFrequencies()
+{
+    emit sendSetCommand("DesiredImpedanceSpectrumFreqsHertz", spectrumFreqsLineEdit->text().simplified().remove(' '));
+}
+
+void ControlPanelImpedanceTab::runImpedanceSpectrum()
+{
+    emit sendExecuteCommand("MeasureImpedanceSpectrum");
+}
+
+void ControlPanelImpedanceTab::saveImpedanceSpectrum()
+{
+    QSettings settings;
+    QString defaultDirectory = settings.value("saveDirectory", ".").toString();
+    QString csvFilter = tr("CSV (Comma delimited) (*.csv)");
+    QString binaryFilter = tr("Binary (*.dat)");
+    QString selectedFilter = (state->impedanceSpectrumFileFormat->getValue() == "Binary") ? binaryFilter : csvFilter;
+    QString impedanceFilename;
+    impedanceFilename = QFileDialog::getSaveFileName(this, tr("Save Impedance Spectra As"), defaultDirectory,
+                                                     csvFilter + ";;" + binaryFilter, &selectedFilter);
+
+    if (impedanceFilename.isEmpty()) {
+        return;
+    } else {
+        QFileInfo fileInfo(impedanceFilename);
+        settings.setValue("saveDirectory", fileInfo.absolutePath());
+        state->impedanceFilename->setBaseFilename(fileInfo.baseName());
+        state->impedanceFilename->setPath(fileInfo.path());
+        emit sendSetCommand("ImpedanceSpectrumFileFormat", (selectedFilter == binaryFilter) ? "Binary" : "CSV");
+        emit sendExecuteCommand("SaveImpedanceSpectrum");
+    }
+}
+
 void ControlPanelImpedanceTab::updateImpedanceFrequency()
 {
     int impedancePeriod;
@@ -53,6 +53,9 @@ private slots:
     void changeImpedanceFrequency();
     void runImpedanceTest();
     void saveImpedance();
+    void changeSpectrumFrequencies();
+    void runImpedanceSpectrum();
+    void saveImpedanceSpectrum();
 
 private:
     SystemState* state;
@@ -62,9 +65,13 @@ private:
     QPushButton *impedanceFreqSelectButton;
     QPushButton *runImpedanceTestButton;
     QPushButton *saveImpedancesButton;
+    QPushButton *runImpedanceSpectrumButton;
+    QPushButton *saveImpedanceSpectrumButton;
 
     QLabel *desiredImpedanceFreqLabel;
     QLabel *actualImpedanceFreqLabel;
+    QLineEdit *spectrumFreqsLineEdit;
+    QLabel *actualSpectrumFreqsLabel;
 
     void updateImpedanceFrequency();
 };
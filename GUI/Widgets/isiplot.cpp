@@ -67,6 +67,7 @@ ISIPlot::ISIPlot(SystemState* state_, QWidget *parent) :
 
 void ISIPlot::setWaveform(const std::string& waveName_)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (waveName == waveName_) return;
 
     waveName = waveName_;
@@ -76,6 +77,7 @@ void ISIPlot::setWaveform(const std::string& waveName_)
 
 void ISIPlot::updateFromState()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (timeSpan != (int) state->tSpanISI->getNumericValue()) {
         timeSpan = (int) state->tSpanISI->getNumericValue();
         calculateHistogram();
@@ -89,6 +91,7 @@ void ISIPlot::updateFromState()
 
 void ISIPlot::resetISI()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     fill(isiCount.begin(), isiCount.end(), 0);
     largestISIrecorded = 0;
     numISIsRecorded = 0;
@@ -186,17 +189,18 @@ void ISIPlot::keyPressEvent(QKeyEvent* event)
     }
 }
 
-bool ISIPlot::updateWaveforms(WaveformFifo *waveformFifo, int numSamples)
+bool ISIPlot::updateWaveforms(WaveformFifo *waveformFifo, WaveformFifo::Reader reader, int numSamples)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!waveformFifo->gpuWaveformPresent(waveName + "|SPK")) return false;
     uint16_t* spikeTrain = waveformFifo->getDigitalWaveformPointer(waveName + "|SPK");
     if (!spikeTrain) return false;
 
     bool foundNewSpikes = false;
     for (int t = 0; t < numSamples; ++t) {
-        if (waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, spikeTrain, t) != 0) {
+        if (waveformFifo->getDigitalData(reader, spikeTrain, t) != 0) {
             foundNewSpikes = true;
-            uint32_t newTimeStamp = waveformFifo->getTimeStamp(WaveformFifo::ReaderDisplay, t);
+            uint32_t newTimeStamp = waveformFifo->getTimeStamp(reader, t);
             if (lastTimeStamp != 0u) {
                 int newISI = (int)((int64_t)newTimeStamp - (int64_t)lastTimeStamp);
                 if ((newISI < (int) isiCount.size()) && (newISI > 0)) {
@@ -211,7 +215,7 @@ bool ISIPlot::updateWaveforms(WaveformFifo *waveformFifo, int numSamples)
     if (foundNewSpikes) {
         calculateHistogram();
         calculateISIStatistics();
-        update();
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);  // Called from AnalysisThread; repaint on GUI thread.
     }
 
     return true;
@@ -231,6 +235,7 @@ void ISIPlot::mouseMoveEvent(QMouseEvent* event)  // Note: Must setMouseTracking
 
 void ISIPlot::paintEvent(QPaintEvent* /* event */)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     QPainter painter(&image);
     QRect imageFrame(rect());
     painter.fillRect(imageFrame, QBrush(Qt::black));
@@ -370,6 +375,7 @@ void ISIPlot::paintEvent(QPaintEvent* /* event */)
 
 bool ISIPlot::saveMatFile(const QString& fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     MatFileWriter matFileWriter;
 
     QString fullName = state->signalSources->getNativeAndCustomNames(waveName);
@@ -389,6 +395,7 @@ bool ISIPlot::saveMatFile(const QString& fileName) const
 
 bool ISIPlot::saveCsvFile(QString fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (fileName.right(4).toLower() != ".csv") fileName.append(".csv");
     QFile csvFile(fileName);
     if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
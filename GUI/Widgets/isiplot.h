@@ -37,6 +37,7 @@
 #include <QtWidgets>
 
 #include <vector>
+#include <mutex>
 
 #include "systemstate.h"
 #include "plotutilities.h"
@@ -51,7 +52,7 @@ public:
 
     void setWaveform(const std::string& waveName_);
     QString getWaveform() const { return QString::fromStdString(waveName); }
-    bool updateWaveforms(WaveformFifo* waveformFifo, int numSamples);
+    bool updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples);
     void resetISI();
 
     bool saveMatFile(const QString& fileName) const;
@@ -74,6 +75,9 @@ private:
     SystemState* state;
     std::string waveName;
 
+    // Guards all ISI data, which is updated by updateWaveforms() on AnalysisThread and read and reset on the GUI thread.
+    mutable std::recursive_mutex analysisMutex;
+
     std::vector<int> isiCount;
     std::vector<float> timeScaleISI;
     int largestISIrecorded;
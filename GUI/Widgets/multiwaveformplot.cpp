@@ -1589,26 +1589,12 @@ void MultiWaveformPlot::loadWaveformData(WaveformFifo* waveformFifo)
             waveformManager->loadNewData(waveformFifo, pinnedList.at(i).waveName);
         }
     }
-    bool loadAllFilters = true;
-    bool dcWaveformsPreset = state->getControllerTypeEnum() == ControllerStimRecord;
+    // Only load the filter bands actually displayed.  A band that becomes visible (after scrolling or changing filter
+    // display) is marked out of date and caught up from the waveform FIFO on its first load, which the FIFO's min/max
+    // pyramid makes proportional to the number of display pixels rather than the number of samples.
     for (int i = 0; i < displayList.size(); ++i) {
         if (displayList.at(i).isCurrentlyVisible && !displayList.at(i).isDivider()) {
-        // Of interest for future improvements to high-efficiency data plotting:
-        // inefficient way to make sure all data is plotted immediately after scrolling
-        //if (!displayList.at(i).isDivider()) {
-            QString waveName = displayList.at(i).waveName;
-            if (!loadAllFilters || !waveName.contains('|')) {
-                waveformManager->loadNewData(waveformFifo, waveName);
-            } else {
-                QString baseName = waveName.section('|', 0, 0);
-                waveformManager->loadNewData(waveformFifo, baseName + "|WIDE");
-                waveformManager->loadNewData(waveformFifo, baseName + "|LOW");
-                waveformManager->loadNewData(waveformFifo, baseName + "|HIGH");
-                waveformManager->loadNewData(waveformFifo, baseName + "|SPK");
-                if (dcWaveformsPreset) {
-                    waveformManager->loadNewData(waveformFifo, baseName + "|DC");
-                }
-            }
+            waveformManager->loadNewData(waveformFifo, displayList.at(i).waveName);
         }
     }
     // Note: repaint() seems to give slightly smoother animation than update(), but may cause "QWidget::repaint.
@@ -57,6 +57,7 @@ PSTHPlot::PSTHPlot(SystemState* state_, QWidget *parent) :
 
 void PSTHPlot::setWaveform(const std::string& waveName_)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (waveName == waveName_) return;
 
     waveName = waveName_;
@@ -66,6 +67,7 @@ void PSTHPlot::setWaveform(const std::string& waveName_)
 
 void PSTHPlot::updateFromState()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     bool psthSizeChanged = false;
 
     if (preTriggerTimeSpan != (int) state->tSpanPreTriggerPSTH->getNumericValue()) {
@@ -94,6 +96,7 @@ void PSTHPlot::updateFromState()
 
 void PSTHPlot::resetPSTH()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     numTrials = 0;
 
     for (int trial = 0; trial < (int) rasters.size(); trial++) {
@@ -221,8 +224,9 @@ void PSTHPlot::keyPressEvent(QKeyEvent* event)
     }
 }
 
-bool PSTHPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
+bool PSTHPlot::updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!waveformFifo->gpuWaveformPresent(waveName + "|SPK")) return false;
     uint16_t* spikeTrain = waveformFifo->getDigitalWaveformPointer(waveName + "|SPK");
     if (!spikeTrain) return false;
@@ -234,20 +238,19 @@ bool PSTHPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
     if (!useAnalogTrigger) {  // Use digital trigger
         uint16_t* digitalInWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
         for (int t = 0; t < numSamples; ++t) {
-            digitalWaveformQueue.push_back(waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, digitalInWaveform, t));
+            digitalWaveformQueue.push_back(waveformFifo->getDigitalData(reader, digitalInWaveform, t));
         }
         triggerMask = 0x01u << (int)state->digitalTriggerPSTH->getNumericValue();
     } else {  // Use analog trigger
         float* analogInWaveform = waveformFifo->getAnalogWaveformPointer(triggerChannelName.toStdString());
         float logicThreshold = (float)state->triggerAnalogVoltageThreshold->getValue();
         for (int t = 0; t < numSamples; ++t) {
-            digitalWaveformQueue.push_back(waveformFifo->getAnalogDataAsDigital(WaveformFifo::ReaderDisplay,
-                                                                                analogInWaveform, t, logicThreshold));
+            digitalWaveformQueue.push_back(waveformFifo->getAnalogDataAsDigital(reader, analogInWaveform, t, logicThreshold));
         }
     }
 
     for (int t = 0; t < numSamples; ++t) {
-        spikeTrainQueue.push_back(waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, spikeTrain, t));
+        spikeTrainQueue.push_back(waveformFifo->getDigitalData(reader, spikeTrain, t));
     }
 
     bool risingEdge = state->triggerPolarityPSTH->getValue() == "Rising";
@@ -272,7 +275,7 @@ bool PSTHPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
         }
     }
 
-    update();
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);  // Called from AnalysisThread; repaint on GUI thread.
     return true;
 }
 
@@ -320,6 +323,7 @@ void PSTHPlot::addNewRaster(int timeIndex)
 
 void PSTHPlot::deleteLastRaster()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (numTrials == 0) return;
     --numTrials;
     fill(rasters[numTrials].begin(), rasters[numTrials].end(), 0u);
@@ -360,6 +364,7 @@ void PSTHPlot::mouseMoveEvent(QMouseEvent* event)  // Note: Must setMouseTrackin
 
 void PSTHPlot::paintEvent(QPaintEvent* /* event */)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     QPainter painter(&image);
     QRect imageFrame(rect());
     painter.fillRect(imageFrame, QBrush(Qt::black));
@@ -585,6 +590,7 @@ void PSTHPlot::paintEvent(QPaintEvent* /* event */)
 
 bool PSTHPlot::saveMatFile(const QString& fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     MatFileWriter matFileWriter;
 
     QString fullName = state->signalSources->getNativeAndCustomNames(waveName);
@@ -632,6 +638,7 @@ bool PSTHPlot::saveMatFile(const QString& fileName) const
 
 bool PSTHPlot::saveCsvFile(QString fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (fileName.right(4).toLower() != ".csv") fileName.append(".csv");
     QFile csvFile(fileName);
     if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
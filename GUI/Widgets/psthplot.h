@@ -38,6 +38,7 @@
 
 #include <vector>
 #include <deque>
+#include <mutex>
 #include <string>
 
 #include "systemstate.h"
@@ -53,7 +54,7 @@ public:
 
     void setWaveform(const std::string& waveName_);
     QString getWaveform() const { return QString::fromStdString(waveName); }
-    bool updateWaveforms(WaveformFifo* waveformFifo, int numSamples);
+    bool updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples);
     void resetPSTH();
     void deleteLastRaster();
 
@@ -77,6 +78,9 @@ private:
     SystemState* state;
     std::string waveName;
 
+    // Guards all PSTH data, which is updated by updateWaveforms() on AnalysisThread and read and reset on the GUI thread.
+    mutable std::recursive_mutex analysisMutex;
+
     std::deque<uint16_t> spikeTrainQueue;
     std::deque<uint16_t> digitalWaveformQueue;
     std::vector<std::vector<uint8_t> > rasters;
@@ -28,6 +28,8 @@
 //
 //------------------------------------------------------------------------------
 
+#include <algorithm>
+
 #include "matfilewriter.h"
 #include "spectrogramplot.h"
 
@@ -67,6 +69,7 @@ SpectrogramPlot::~SpectrogramPlot()
 
 void SpectrogramPlot::setWaveform(const std::string& waveName_)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (waveName == waveName_) return;
 
     waveName = waveName_;
@@ -91,6 +94,7 @@ QSize SpectrogramPlot::sizeHint() const
 
 void SpectrogramPlot::updateFromState()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     bool spectrogramSizeChanged = false;
 
     if (fftSize != (int) state->fftSizeSpectrogram->getNumericValue()) {
@@ -156,6 +160,7 @@ void SpectrogramPlot::setNewTimeScale(double tScale_)
 
 void SpectrogramPlot::resetSpectrogram()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     for (int i = 0; i < (int) psdSpectrogram.size(); ++i) {
         psdSpectrogram[i].clear();
     }
@@ -214,8 +219,9 @@ void SpectrogramPlot::keyPressEvent(QKeyEvent* event)
     }
 }
 
-bool SpectrogramPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
+bool SpectrogramPlot::updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!waveformFifo->gpuWaveformPresent(waveName + "|WIDE")) return false;
     GpuWaveformAddress waveformAddress = waveformFifo->getGpuWaveformAddress(waveName + "|WIDE");
     if (waveformAddress.waveformIndex < 0) return false;
@@ -225,39 +231,35 @@ bool SpectrogramPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples
 
     if (!useAnalogAsDigital) {  // Get digital signal
         uint16_t* digitalInWaveform = waveformFifo->getDigitalWaveformPointer("DIGITAL-IN-WORD");
-        for (int t = 0; t < numSamples; ++t) {
-            digitalWaveformQueue.push_back(waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, digitalInWaveform, t));
-        }
+        std::vector<uint16_t> digitalData(numSamples);
+        waveformFifo->copyDigitalData(reader, digitalData.data(), digitalInWaveform, 0, numSamples);
+        digitalWaveformQueue.insert(digitalWaveformQueue.end(), digitalData.begin(), digitalData.end());
     } else {  // Get thresholded analog signal as digital signal
         float* analogInWaveform = waveformFifo->getAnalogWaveformPointer(digitalChannelName.toStdString());
         float logicThreshold = (float)state->triggerAnalogVoltageThreshold->getValue();
         for (int t = 0; t < numSamples; ++t) {
-            digitalWaveformQueue.push_back(waveformFifo->getAnalogDataAsDigital(WaveformFifo::ReaderDisplay,
-                                                                                analogInWaveform, t, logicThreshold));
+            digitalWaveformQueue.push_back(waveformFifo->getAnalogDataAsDigital(reader, analogInWaveform, t, logicThreshold));
         }
     }
 
-    for (int t = 0; t < numSamples; ++t) {
-        amplifierWaveformQueue.push_back(waveformFifo->getGpuAmplifierData(WaveformFifo::ReaderDisplay, waveformAddress, t));
-        amplifierWaveformRecordQueue.push_back(waveformFifo->getGpuAmplifierData(WaveformFifo::ReaderDisplay, waveformAddress, t));
-        waveformTimeStampQueue.push_back(waveformFifo->getTimeStamp(WaveformFifo::ReaderDisplay, t));
-    }
+    std::vector<float> amplifierData(numSamples);
+    std::vector<uint32_t> timeStamps(numSamples);
+    waveformFifo->copyGpuAmplifierData(reader, amplifierData.data(), waveformAddress, 0, numSamples);
+    waveformFifo->copyTimeStamps(reader, timeStamps.data(), 0, numSamples);
+    amplifierWaveformQueue.insert(amplifierWaveformQueue.end(), amplifierData.begin(), amplifierData.end());
+    amplifierWaveformRecordQueue.insert(amplifierWaveformRecordQueue.end(), amplifierData.begin(), amplifierData.end());
+    waveformTimeStampQueue.insert(waveformTimeStampQueue.end(), timeStamps.begin(), timeStamps.end());
 
     float* fftOut;
     while ((int) amplifierWaveformQueue.size() >= fftSize) {
-        for (int tIndex = 0; tIndex < fftSize; ++tIndex) {
-            fftInputBuffer[tIndex] = amplifierWaveformQueue[tIndex];  // Copy N samples for FFT.
-        }
+        std::copy(amplifierWaveformQueue.begin(), amplifierWaveformQueue.begin() + fftSize, fftInputBuffer);  // Copy N samples for FFT.
 
-        for (int i = 0; i < fftSize / 2; ++i) {    // Advance window by N/2 samples.
-            amplifierWaveformQueue.pop_front();
-        }
+        // Advance window by N/2 samples.
+        amplifierWaveformQueue.erase(amplifierWaveformQueue.begin(), amplifierWaveformQueue.begin() + fftSize / 2);
         if (spectrogramFull) {
-            for (int i = 0; i < fftSize / 2; ++i) {
-                amplifierWaveformRecordQueue.pop_front();
-                waveformTimeStampQueue.pop_front();
-                digitalWaveformQueue.pop_front();
-            }
+            amplifierWaveformRecordQueue.erase(amplifierWaveformRecordQueue.begin(), amplifierWaveformRecordQueue.begin() + fftSize / 2);
+            waveformTimeStampQueue.erase(waveformTimeStampQueue.begin(), waveformTimeStampQueue.begin() + fftSize / 2);
+            digitalWaveformQueue.erase(digitalWaveformQueue.begin(), digitalWaveformQueue.begin() + fftSize / 2);
         }
 
         fftOut = fftEngine->logSqrtPowerSpectralDensity(fftInputBuffer);  // Calculate FFT and PSD.
@@ -282,7 +284,7 @@ bool SpectrogramPlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples
         if (++numValidTStepsInSpectrogram > tSize) numValidTStepsInSpectrogram = tSize;
     }
 
-    update();
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);  // Called from AnalysisThread; repaint on GUI thread.
     return true;
 }
 
@@ -300,6 +302,7 @@ void SpectrogramPlot::mouseMoveEvent(QMouseEvent* event)  // Note: Must setMouse
 
 void SpectrogramPlot::paintEvent(QPaintEvent* /* event */)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     QPainter painter(&image);
     QRect imageFrame(rect());
     painter.fillRect(imageFrame, QBrush(Qt::black));
@@ -566,6 +569,7 @@ void SpectrogramPlot::paintEvent(QPaintEvent* /* event */)
 
 bool SpectrogramPlot::saveMatFile(const QString& fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (numValidTStepsInSpectrogram == 0) return false;
 
     bool spectrogramMode = state->displayModeSpectrogram->getValue() == "Spectrogram";
@@ -660,6 +664,7 @@ bool SpectrogramPlot::saveMatFile(const QString& fileName) const
 
 bool SpectrogramPlot::saveCsvFile(QString fileName) const
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (numValidTStepsInSpectrogram == 0) return false;
 
     if (fileName.right(4).toLower() != ".csv") fileName.append(".csv");
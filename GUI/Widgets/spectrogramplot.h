@@ -38,6 +38,7 @@
 
 #include <vector>
 #include <deque>
+#include <mutex>
 #include <string>
 
 #include "systemstate.h"
@@ -57,7 +58,7 @@ public:
 
     void setWaveform(const std::string& waveName_);
     QString getWaveform() const;
-    bool updateWaveforms(WaveformFifo* waveformFifo, int numSamples);
+    bool updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples);
     void resetSpectrogram();
 
     double getDeltaTimeMsec() const { return 1000.0 * tStep; }
@@ -83,6 +84,10 @@ private:
     SystemState* state;
     std::string waveName;
 
+    // Guards all spectrogram data, which is updated by updateWaveforms() on AnalysisThread and read and reset on the
+    // GUI thread.
+    mutable std::recursive_mutex analysisMutex;
+
     std::deque<float> amplifierWaveformQueue;
     std::deque<float> amplifierWaveformRecordQueue;
     std::deque<uint16_t> digitalWaveformQueue;
@@ -71,19 +71,25 @@ SpikePlot::~SpikePlot()
 
 void SpikePlot::setWaveform(const std::string& waveName)
 {
-    channel = state->signalSources->channelByName(waveName);
-    if (channel) {
+    Channel* newChannel = state->signalSources->channelByName(waveName);
+    {
+        std::lock_guard<std::recursive_mutex> lock(analysisMutex);
+        channel = newChannel;
+
+        std::map<std::string, SpikePlotHistory*>::const_iterator it = spikeHistoryMap.find(waveName);
+        if (it == spikeHistoryMap.end()) {  // If data structure for this waveform does not already exist...
+            spikeHistoryMap[waveName] = new SpikePlotHistory;  // ...add new spike history data structure.
+            it = spikeHistoryMap.find(waveName);
+        }
+        history = it->second;
+    }
+
+    // Set state outside the lock, since this emits stateChanged() to other widgets.
+    if (newChannel) {
         state->spikeScopeChannel->setValue(QString::fromStdString(waveName));
     } else {
         state->spikeScopeChannel->setValue("N/A");
     }
-
-    std::map<std::string, SpikePlotHistory*>::const_iterator it = spikeHistoryMap.find(waveName);
-    if (it == spikeHistoryMap.end()) {  // If data structure for this waveform does not already exist...
-        spikeHistoryMap[waveName] = new SpikePlotHistory;  // ...add new spike history data structure.
-        it = spikeHistoryMap.find(waveName);
-    }
-    history = it->second;
 }
 
 QString SpikePlot::getWaveform()
@@ -112,6 +118,7 @@ void SpikePlot::updateFromState()
 
 void SpikePlot::paintEvent(QPaintEvent * /* event */)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     QPainter painter(&image);
 
     // Clear old display.
@@ -153,7 +160,9 @@ void SpikePlot::paintEvent(QPaintEvent * /* event */)
             }
         }
 
-        // Draw current spike waveforms.
+        // Draw current spike waveforms.  When a hoop or template classifier is running, each unit gets its own hue;
+        // otherwise threshold crossings (all unit 1) are drawn in grey as before.
+        bool colorUnits = state->spikeClassifierMode->getValue() != "Threshold";
         length = (int) history->snippets.size();
         for (int i = 0; i < length; ++i) {
             double time = -samplesPreDetect * tStepMsec;
@@ -170,6 +179,18 @@ void SpikePlot::paintEvent(QPaintEvent * /* event */)
                 if (showArtifacts) {
                     painter.drawPolyline(polyline, snippetLength);
                 }
+            } else if (colorUnits && history->spikeIds[i] == (int) SpikeIdSpikeType1) {
+                painter.setPen(QColor(0, value, 0));
+                painter.drawPolyline(polyline, snippetLength);
+            } else if (colorUnits && history->spikeIds[i] == (int) SpikeIdSpikeType2) {
+                painter.setPen(QColor(value, value, 0));
+                painter.drawPolyline(polyline, snippetLength);
+            } else if (colorUnits && history->spikeIds[i] == (int) SpikeIdSpikeType3) {
+                painter.setPen(QColor(value, 0, value));
+                painter.drawPolyline(polyline, snippetLength);
+            } else if (colorUnits && history->spikeIds[i] == (int) SpikeIdSpikeType4) {
+                painter.setPen(QColor(0, value, value));
+                painter.drawPolyline(polyline, snippetLength);
             } else {
                 painter.setPen(QColor(value, value, value));
                 painter.drawPolyline(polyline, snippetLength);
@@ -235,10 +256,14 @@ void SpikePlot::paintEvent(QPaintEvent * /* event */)
     plotDecorator.drawLabeledTickMarkLeft(vThreshold, ct, vThreshold, 0);
 
     // Write RMS value to display.
-    const int textBoxWidth = 180;
+    const int textBoxWidth = 300;
     const int textBoxHeight = painter.fontMetrics().height();
     QString rmsText = "RMS: " + QString::number(latestRmsCalculation, 'f', (latestRmsCalculation < 9.95) ? 1 : 0) +
             " " + MicroVoltsSymbol;
+    if (channel && channel->getNoiseLevel() >= 0.0F) {  // Continuous (median-based) noise estimate
+        rmsText += "  Noise: " + QString::number(channel->getNoiseLevel(), 'f', (channel->getNoiseLevel() < 9.95F) ? 1 : 0) +
+                " " + MicroVoltsSymbol;
+    }
     if (latestSpikeRateCalculation > 0) {
         rmsText += "  " + QString::number(latestSpikeRateCalculation);
         if (latestSpikeRateCalculation == 1) {
@@ -351,8 +376,9 @@ void SpikePlot::resizeEvent(QResizeEvent*) {
     update();
 }
 
-bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
+bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples)
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!channel || !history)
         return false;
 
@@ -365,7 +391,7 @@ bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
 
     int offset = samplesPostDetect - 1;
     int tStart = -offset;
-    int numWordsInMemory = waveformFifo->numWordsInMemory(WaveformFifo::ReaderDisplay);
+    int numWordsInMemory = waveformFifo->numWordsInMemory(reader);
     if (offset > numWordsInMemory) {
         tStart = 0;
     }
@@ -373,13 +399,13 @@ bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
     int numSpikesDisplayed = (int) state->numSpikesDisplayed->getNumericValue();
     int spikeId;
     for (int t = tStart; t < numSamples - offset; ++t) {
-        spikeId = (int) waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, spikeRaster, t);
+        spikeId = (int) waveformFifo->getDigitalData(reader, spikeRaster, t);
         if (spikeId != SpikeIdNoSpike && (t - samplesPreDetect >= -numWordsInMemory)) {
             if (showArtifacts || spikeId != SpikeIdLikelyArtifact) {
                 std::vector<float> newSnippet(samplesPreDetect + samplesPostDetect);
                 int index = 0;
                 for (int i = t - samplesPreDetect; i < t + samplesPostDetect; ++i) {
-                    newSnippet[index++] = waveformFifo->getGpuAmplifierData(WaveformFifo::ReaderDisplay, waveformAddress, i);
+                    newSnippet[index++] = waveformFifo->getGpuAmplifierData(reader, waveformAddress, i);
                 }
                 history->snippets.push_back(newSnippet);
                 history->spikeIds.push_back(spikeId);
@@ -400,9 +426,9 @@ bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
         int numSpikes = 0;
         double sumOfSquares = 0.0;
         for (int t = -numWordsForRms; t < 0; ++t) {
-            float sample = waveformFifo->getGpuAmplifierData(WaveformFifo::ReaderDisplay, waveformAddress, t);
+            float sample = waveformFifo->getGpuAmplifierData(reader, waveformAddress, t);
             sumOfSquares += sample * sample;
-            int spikeId = waveformFifo->getDigitalData(WaveformFifo::ReaderDisplay, spikeRaster, t);
+            int spikeId = waveformFifo->getDigitalData(reader, spikeRaster, t);
             if (spikeId != SpikeIdNoSpike && spikeId != SpikeIdLikelyArtifact) {
                 ++numSpikes;
             }
@@ -412,12 +438,13 @@ bool SpikePlot::updateWaveforms(WaveformFifo* waveformFifo, int numSamples)
         latestSpikeRateCalculation = numSpikes;
     }
 
-    update();
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);  // Called from AnalysisThread; repaint on GUI thread.
     return true;
 }
 
 void SpikePlot::clearSpikes()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!history) return;
     history->snippets.clear();
     history->spikeIds.clear();
@@ -426,6 +453,7 @@ void SpikePlot::clearSpikes()
 
 void SpikePlot::takeSnapshot()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!history) return;
     history->snapshotSnippets = history->snippets;
     history->snapshotSpikeIds = history->spikeIds;
@@ -434,6 +462,7 @@ void SpikePlot::takeSnapshot()
 
 void SpikePlot::clearSnapshot()
 {
+    std::lock_guard<std::recursive_mutex> lock(analysisMutex);
     if (!history) return;
     history->snapshotSnippets.clear();
     history->snapshotSpikeIds.clear();
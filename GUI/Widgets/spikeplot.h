@@ -37,6 +37,7 @@
 #include <QtWidgets>
 #include <deque>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <string>
 #include "systemstate.h"
@@ -62,7 +63,7 @@ public:
 
     void setWaveform(const std::string& waveName);
     QString getWaveform();
-    bool updateWaveforms(WaveformFifo* waveformFifo, int numSamples);
+    bool updateWaveforms(WaveformFifo* waveformFifo, WaveformFifo::Reader reader, int numSamples);
     void clearSpikes();
 
     void takeSnapshot();
@@ -86,6 +87,10 @@ private:
     SystemState* state;
     Channel* channel;
     SpikePlotHistory* history;
+
+    // Guards channel, history, and the RMS and spike rate calculations, which are updated by updateWaveforms() on
+    // AnalysisThread and read and changed on the GUI thread.
+    mutable std::recursive_mutex analysisMutex;
     int samplesPreDetect;
     int samplesPostDetect;
     double tStepMsec;
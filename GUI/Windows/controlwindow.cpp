@@ -1839,28 +1839,28 @@ void ControlWindow::updateMenus()
             probeMapWindow = nullptr;
         }
         if (isiDialog) {
+            controllerInterface->setISIDialog(nullptr);
             isiDialog->close();
             delete isiDialog;
             isiDialog = nullptr;
-            controllerInterface->setISIDialog(isiDialog);
         }
         if (psthDialog) {
+            controllerInterface->setPSTHDialog(nullptr);
             psthDialog->close();
             delete psthDialog;
             psthDialog = nullptr;
-            controllerInterface->setPSTHDialog(psthDialog);
         }
         if (spectrogramDialog) {
+            controllerInterface->setSpectrogramDialog(nullptr);
             spectrogramDialog->close();
             delete spectrogramDialog;
             spectrogramDialog = nullptr;
-            controllerInterface->setSpectrogramDialog(spectrogramDialog);
         }
         if (spikeSortingDialog) {
+            controllerInterface->setSpikeSortingDialog(nullptr);
             spikeSortingDialog->close();
             delete spikeSortingDialog;
             spikeSortingDialog = nullptr;
-            controllerInterface->setSpikeSortingDialog(spikeSortingDialog);
         }
     }
 
@@ -1955,12 +1955,13 @@ void ControlWindow::setSpikeThresholds()
 {
     SetThresholdsDialog setThresholdsDialog(state->absoluteThresholdsEnabled->getValue(), state->absoluteThreshold->getValue(),
                                             state->rmsMultipleThreshold->getValue(), state->negativeRelativeThreshold->getValue(),
-                                            this);
+                                            state->thresholdTrackingEnabled->getValue(), this);
     if (setThresholdsDialog.exec()) {
         state->absoluteThresholdsEnabled->setValue(setThresholdsDialog.absoluteThreshold());
         state->absoluteThreshold->setValue(setThresholdsDialog.threshold());
         state->rmsMultipleThreshold->setValueWithLimits(abs(setThresholdsDialog.rmsMultiple()));
         state->negativeRelativeThreshold->setValue(setThresholdsDialog.rmsMultiple() < 0);
+        state->thresholdTrackingEnabled->setValue(setThresholdsDialog.thresholdTracking());
 
         controllerInterface->setAllSpikeDetectionThresholds();
     }
@@ -30,6 +30,7 @@
 
 #include <QtXml>
 #include <QSettings>
+#include <algorithm>
 #include "signalsources.h"
 #include "probemapwindow.h"
 
@@ -40,8 +41,6 @@ ProbeMapWindow::ProbeMapWindow(SystemState* state_, ControllerInterface* control
 {
     setAcceptDrops(true);
     connect(state, SIGNAL(stateChanged()), this, SLOT(updateFromState()));
-    connect(state, SIGNAL(spikeReportSignal(QString)), this, SLOT(catchSpikeReport(QString)));
-    connect(state, SIGNAL(spikeTimerTick()), this, SLOT(catchSpikeTimerTick()));
     currentPage = -1;
 
     setWindowTitle(tr("Probe Map"));
@@ -217,7 +216,11 @@ ProbeMapWindow::ProbeMapWindow(SystemState* state_, ControllerInterface* control
     if (state->running) updateForRun();
     else updateForStop();
 
+    spikeSnapshotGeneration = 0;
     spikeTimer.start();
+    spikeActivityTimer = new QTimer(this);
+    connect(spikeActivityTimer, SIGNAL(timeout()), this, SLOT(updateSpikeActivity()));
+    spikeActivityTimer->start(SpikeViewIntervalMs);
 }
 
 ProbeMapWindow::~ProbeMapWindow()
@@ -302,37 +305,31 @@ void ProbeMapWindow::updateForStop()
     loadAction->setEnabled(true);
 }
 
-void ProbeMapWindow::catchSpikeReport(QString names)
+// Called every SpikeViewIntervalMs.  In spike view, mark each site whose channel has spiked since the last call, and
+// age the others.
+void ProbeMapWindow::updateSpikeActivity()
 {
-    // Separate QString out using ','
-    QStringList nameList = names.split(',', Qt::SkipEmptyParts);
-
-    // Insert or assign each name within nameList
-    for (QStringList::const_iterator it = nameList.constBegin(); it != nameList.constEnd(); ++it) {
-        activeChannels[(*it).toStdString()] = 0.0;
+    float elapsed = 0.001F * (float) spikeTimer.restart();
+    if (!state->getReportSpikes()) return;
+
+    state->spikeActivity->snapshot(spikeSnapshot);
+    float decayTime = (float) state->getDecayTime();
+    int numChannels = (int) spikeSnapshot.spikeCounts.size();
+    if (spikeSnapshot.generation != spikeSnapshotGeneration || (int) lastSpikeCounts.size() != numChannels) {
+        // Spike counts have restarted (e.g., at the start of a new run).
+        spikeSnapshotGeneration = spikeSnapshot.generation;
+        lastSpikeCounts.assign(numChannels, 0);
+        timeSinceSpike.assign(numChannels, decayTime);
     }
-}
 
-void ProbeMapWindow::catchSpikeTimerTick()
-{
-    // For now, every 0.1 second (100 milliseconds), advance
-    if (spikeTimer.elapsed() >= 100) {
-        for (ChannelList::const_iterator p = activeChannels.begin(); p != activeChannels.end() ; ) {
-            if (p->second >= state->getDecayTime() - 0.1) {
-                QVector<ElectrodeSite*> sitesWithName = getSitesWithName(QString::fromStdString(p->first));
-                for (int i = 0; i < sitesWithName.size(); i++) {
-                    ElectrodeSite* thisSite = sitesWithName[i];
-                    thisSite->spikeTime = state->getDecayTime();
-                }
-                activeChannels.erase(p++);
-            } else {
-                activeChannels[p->first] = p->second + 0.1;
-                ++p;
-            }
-        }
-        spikeTimer.restart();
+    for (int handle = 0; handle < numChannels; ++handle) {
+        bool spiked = spikeSnapshot.spikeCounts[handle] != lastSpikeCounts[handle];
+        if (!spiked && timeSinceSpike[handle] >= decayTime) continue;  // Site has already faded out.
+
+        lastSpikeCounts[handle] = spikeSnapshot.spikeCounts[handle];
+        timeSinceSpike[handle] = spiked ? 0.0F : std::min(decayTime, timeSinceSpike[handle] + elapsed);
+        setSiteSpikeTime(handle, timeSinceSpike[handle]);
     }
-    updateSpikeTimerSites();
 
     // Guarantee an update to repaint the current page
     for (int page = 0; page < pageTabWidget->count(); ++page) {
@@ -340,24 +337,35 @@ void ProbeMapWindow::catchSpikeTimerTick()
     }
 }
 
-void ProbeMapWindow::changeSpikeDecay()
+// Show time since the last spike on every site of the channel with this handle.
+void ProbeMapWindow::setSiteSpikeTime(int handle, float time)
 {
-    state->setDecayTime(decayOptions[spikeDecayComboBox->currentIndex()]);
-
-    // Update the spikeGradient widget
-    spikeGradient->update();
+    Channel* channel = state->signalSources->channelByHandle(handle);
+    if (!channel) return;
+    QVector<ElectrodeSite*> sitesWithName = getSitesWithName(channel->getNativeName());
+    for (int i = 0; i < sitesWithName.size(); i++) {
+        sitesWithName[i]->spikeTime = time;
+    }
 }
 
-void ProbeMapWindow::updateSpikeTimerSites()
+void ProbeMapWindow::changeSpikeDecay()
 {
-    // Go through all active channels, linking their channel name to all ElectrodeSites.
-    for (ChannelList::const_iterator p = activeChannels.begin(); p != activeChannels.end(); p++) {
-        QVector<ElectrodeSite*> sitesWithName = getSitesWithName(QString::fromStdString(p->first));
-        for (int i = 0; i < sitesWithName.size(); i++) {
-            ElectrodeSite* thisSite = sitesWithName[i];
-            thisSite->spikeTime = p->second;
+    float oldDecayTime = (float) state->getDecayTime();
+    state->setDecayTime(decayOptions[spikeDecayComboBox->currentIndex()]);
+    float newDecayTime = (float) state->getDecayTime();
+
+    // Times since the last spike are capped at the decay time, so move the cap: sites that had faded out under the
+    // old decay time must stay faded out rather than light up again under a longer one.
+    for (int handle = 0; handle < (int) timeSinceSpike.size(); ++handle) {
+        float time = timeSinceSpike[handle] >= oldDecayTime ? newDecayTime : std::min(newDecayTime, timeSinceSpike[handle]);
+        if (time != timeSinceSpike[handle]) {
+            timeSinceSpike[handle] = time;
+            setSiteSpikeTime(handle, time);
         }
     }
+
+    // Update the spikeGradient widget
+    spikeGradient->update();
 }
 
 // Catch signal from PageView signifying that the mouse status should be updated. Update status to reflect (x,y) coordinates and info of any hovered sites.
@@ -35,6 +35,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "rhxglobals.h"
 #include "impedancegradient.h"
@@ -43,7 +44,7 @@
 #include "xmlinterface.h"
 #include "controllerinterface.h"
 
-typedef std::map<std::string, double> ChannelList;
+const int SpikeViewIntervalMs = 100;
 
 class ProbeMapWindow : public QMainWindow
 {
@@ -84,16 +85,21 @@ private slots:
     void highlightSiteFromMap(QString nativeName, bool highlighted);
     void deselectAllSitesFromMap();
     void toggleView();
-    void catchSpikeReport(QString names);
-    void catchSpikeTimerTick();
+    void updateSpikeActivity();
     void changeSpikeDecay();
 
 private:
     SystemState* state;
     ControllerInterface* controllerInterface;
 
-    ChannelList activeChannels;
+    // Spike view: every SpikeViewIntervalMs, a snapshot of SystemState::spikeActivity is compared with the previous one
+    // to find the channels that have spiked since.
+    QTimer *spikeActivityTimer;
     QElapsedTimer spikeTimer;
+    SpikeActivitySnapshot spikeSnapshot;
+    uint64_t spikeSnapshotGeneration;
+    std::vector<uint32_t> lastSpikeCounts;  // By channel handle
+    std::vector<float> timeSinceSpike;      // By channel handle, in seconds; capped at the decay time
 
     XMLInterface *probeMapSettingsInterface;
 
@@ -138,8 +144,7 @@ private:
     void clearTabWidget(); // Delete PageViews and clear the tab widget
 
     void enableActions(bool enable);
-
-    void updateSpikeTimerSites();
+    void setSiteSpikeTime(int handle, float time);
 
     std::map<int, double> decayOptions;
 };
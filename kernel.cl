@@ -28,12 +28,14 @@
 //
 //------------------------------------------------------------------------------
 
+// Hoop geometry precompiled into snippet sample indices (see compileSpikeHoops()).  The hoop line at snippet sample s
+// is y_0 + slope * s.
 typedef struct _hoop_info
 {
-    float t_a;
-    float y_a;
-    float t_b;
-    float y_b;
+    int s_a;      // First sample index of the hoop, or -1 if this hoop is inactive (always passes).
+    int s_b;      // Last sample index of the hoop; equal to s_a for a vertical hoop.
+    float y_0;    // Hoop line at sample index 0; lower bound of a vertical hoop.
+    float slope;  // Hoop line slope per sample; upper bound of a vertical hoop.
 } hoop_info_struct;
 
 typedef struct _unit_hoops
@@ -41,11 +43,17 @@ typedef struct _unit_hoops
     hoop_info_struct hoop_info[4];
 } unit_hoops_struct;
 
+// There's no way for const variables (must be const to create an array of that length) to be communicated as args.
+#define snippet_length 50
+
 typedef struct _channel_hoops
 {
     unit_hoops_struct unit_hoops[4];
+    float templates[4][snippet_length];  // Unit centroids, starting at the threshold crossing.
+    float template_max_distance;  // Largest accepted sum of squared differences from the nearest centroid.
     float threshold;
-    char use_hoops; // Ideally would be bool, but bool can't be passed to OpenCL. 1 = true, 0 = false.
+    char classifier;    // 0 = threshold only, 1 = hoops, 2 = templates.
+    char active_units;  // Bit n is set if unit n has at least one hoop (hoop mode) or a template (template mode).
 } channel_hoops_struct;
 
 typedef struct _gl_params
@@ -81,17 +89,58 @@ typedef struct _filter_params
     filter_iteration_param_struct high_params[4];
 } filter_param_struct;
 
-typedef struct _unit_detection
+// Return 1, 2, 4, or 8 for the first unit whose active hoops the snippet crosses, or 64 if there is none.
+uchar classify_by_hoops(__global const channel_hoops_struct* channel_hoops, const float* snippet)
 {
-    bool hoops[4];
-} hoop_detection_struct;
-
+    for (int unit = 0; unit < 4; ++unit) {
+        if (((channel_hoops->active_units >> unit) & 1) == 0) continue;
+
+        bool pass = true;
+        for (int hoop = 0; hoop < 4 && pass; ++hoop) {
+            hoop_info_struct info = channel_hoops->unit_hoops[unit].hoop_info[hoop];
+            if (info.s_a < 0) continue;  // Inactive hoop always passes.
+
+            bool crossed = false;
+            if (info.s_a == info.s_b) {  // Vertical hoop
+                float y = snippet[info.s_a];
+                crossed = (y > info.y_0 && y < info.slope);
+            } else {
+                // Does the line between adjacent samples s and s + 1 cross the hoop line?
+                for (int s = info.s_a; s < info.s_b && !crossed; ++s) {
+                    float hoop_1 = info.y_0 + info.slope * (float) s;
+                    float hoop_2 = hoop_1 + info.slope;
+                    crossed = ((snippet[s] - hoop_1) * (snippet[s + 1] - hoop_2) <= 0.0f);
+                }
+            }
+            pass = crossed;
+        }
+        if (pass) return (uchar) (1 << unit);
+    }
+    return 64;
+}
 
-typedef struct _channel_detection
+// Return 1, 2, 4, or 8 for the unit whose template is nearest the snippet, or 64 if none is within
+// template_max_distance.
+uchar classify_by_templates(__global const channel_hoops_struct* channel_hoops, const float* snippet)
 {
-    hoop_detection_struct units[4];
-    bool max_surpassed;
-} channel_detection_struct;
+    float best_distance = MAXFLOAT;
+    int best_unit = -1;
+    for (int unit = 0; unit < 4; ++unit) {
+        if (((channel_hoops->active_units >> unit) & 1) == 0) continue;
+
+        float distance = 0.0f;
+        for (int s = 0; s < snippet_length; ++s) {
+            float difference = snippet[s] - channel_hoops->templates[unit][s];
+            distance += difference * difference;
+        }
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_unit = unit;
+        }
+    }
+    if (best_unit >= 0 && best_distance <= channel_hoops->template_max_distance) return (uchar) (1 << best_unit);
+    return 64;
+}
 
 // There's no way for const variables (must be const to create an array of that length) to be communicated as args.
 #define samples_per_block 128
@@ -107,8 +156,6 @@ __kernel void process_block(__global global_param_struct* restrict global_parame
     ushort words_per_frame = global_parameters->words_per_frame;
     char type = global_parameters->type;
     char num_streams = global_parameters->num_streams;
-    float sample_rate = global_parameters->sample_rate;
-    float sample_period = 1.0f / sample_rate;
     char snippet_size = global_parameters->snippet_size;
     bool spike_max_enabled = global_parameters->spike_max_enabled;
     float spike_max = global_parameters->spike_max;
@@ -203,7 +250,7 @@ __kernel void process_block(__global global_param_struct* restrict global_parame
     float wide_last = prev_last_2[wide_last_index];
 
     float threshold = hoops[channel_index].threshold;
-    bool use_hoops = (hoops[channel_index].use_hoops == 1) ? true : false;
+    char classifier = hoops[channel_index].classifier;
 
     for (s = 0; s < snippets_per_block; ++s) {
         spike[s * get_global_size(0) + channel_index] = 0;
@@ -385,150 +432,33 @@ __kernel void process_block(__global global_param_struct* restrict global_parame
                 }
             }
 
-            // Create a struct to hold this channel's hoop info.
-            channel_detection_struct detection;
-            for (int unit = 0; unit < 4; ++unit) {
-                for (int hoop = 0; hoop < 4; ++hoop) {
-                    detection.units[unit].hoops[hoop] = false;
-                }
-            }
-            detection.max_surpassed = false;
-
-            // If spike_max_enabled is true, then see if any samples in this snippet surpass spike_max. If they do,
-            // then mark detection.max_surpassed as true and save which sample.
+            // If spike_max_enabled is true, then see if any samples in this snippet surpass spike_max.
+            bool max_surpassed = false;
             if (spike_max_enabled) {
                 for (int i = 0; i < snippet_size; ++i) {
                     if (spike_max >= 0 && this_snippet[i] >= spike_max) {
-                        detection.max_surpassed = true;
+                        max_surpassed = true;
                         break;
                     }
                     if (spike_max < 0 && this_snippet[i] <= spike_max) {
-                        detection.max_surpassed = true;
+                        max_surpassed = true;
                         break;
                     }
                 }
             }
 
-
-            // If use_hoops is true, then go through all units populating detection.units[unit].hoops[hoop].
-            if (use_hoops) {
-                // Go through all units.
-                for (int unit = 0; unit < 4; ++unit) {
-
-                    // If this unit has no valid hoops (all t_a values are -1.0f), then this is an inactive unit which
-                    // should be treated as having no intersect; just go on to the next unit.
-                    if (hoops[channel_index].unit_hoops[unit].hoop_info[0].t_a == -1.0f &&
-                            hoops[channel_index].unit_hoops[unit].hoop_info[1].t_a == -1.0f &&
-                            hoops[channel_index].unit_hoops[unit].hoop_info[2].t_a == -1.0f &&
-                            hoops[channel_index].unit_hoops[unit].hoop_info[3].t_a == -1.0f) {
-                        continue;
-                    }
-
-                    // Go through all hoops.
-                    for (int hoop = 0; hoop < 4; ++hoop) {
-
-                        hoop_info_struct this_hoop = hoops[channel_index].unit_hoops[unit].hoop_info[hoop];
-
-                        // If this hoop info is invalid (t_a is -1.0f), then this is an inactive hoop, which by default passes.
-                        // Set true and continue. If all hoops are inactive, then we would have already passed on to the next
-                        // unit without flagging an intersect.
-                        if (this_hoop.t_a == -1.0f) {
-                            detection.units[unit].hoops[hoop] = true;
-                            continue;
-                        }
-
-                        float t_a = this_hoop.t_a;
-                        float y_a = this_hoop.y_a;
-                        float t_b = this_hoop.t_b;
-                        float y_b = this_hoop.y_b;
-
-                        // In range [t_a, t_b], does line segment from (t_1, y_1) to (t_2, y_2) intersect user-defined hoop?
-                        // If so, mark hoop as jumped through by setting intersect to true.
-                        bool intersect = false;
-
-                        // Round t_a down and t_b up to the nearest discrete sample.
-                        int s_a = floor(sample_rate * t_a);
-                        int s_b = ceil(sample_rate * t_b);
-
-                        if (s_a == s_b) {  // Special case: vertical hoop
-                            float y_1_data = this_snippet[s_a];
-                            if (y_b > y_a) {
-                                intersect = (y_1_data < y_b && y_1_data > y_a);
-                            } else {
-                                intersect = (y_1_data > y_b && y_1_data < y_a);
-                            }
-                        } else {  // General case: non-vertical hoop
-                            float slope = (y_b - y_a) / (t_b - t_a);
-                            // Examine every two adjacent samples in the range [s_a, s_b] and determine if they intersect the hoop.
-                            for (int s_1 = s_a; s_1 < s_b - 1; ++s_1) {
-                                int s_2 = s_1 + 1;
-                                float y_1_data = this_snippet[s_1];
-                                float y_2_data = this_snippet[s_2];
-
-                                // Convert s_1 and s_2 to the float t_1 and t_2 domain.
-                                float t_1 = ((float) s_1) * sample_period;
-                                float t_2 = ((float) s_2) * sample_period;
-
-                                float y_1_hoop = y_a + slope * (t_1 - t_a);
-                                float y_2_hoop = y_a + slope * (t_2 - t_a);
-
-                                // If the data transitions from below to above the hoop (or vice versa), then an intersection
-                                // occurred. Break the loop for checking this hoop.
-                                if ((y_1_data >= y_1_hoop && y_2_data <= y_2_hoop) ||
-                                        (y_1_data <= y_1_hoop && y_2_data >= y_2_hoop)) {
-                                    intersect = true;
-                                    break;
-                                }
-
-                                // Otherwise, keep looking over the course of this hoop.
-                            }
-
-                        }
-
-                        if (intersect) {
-                            // If intersect occurred, mark this hoop as jumped through.
-                            detection.units[unit].hoops[hoop] = true;
-                        } else {
-                            // If not, exit the hoop loop (default value is false, so effectively setting it false)
-                            // and move on to the next unit.
-                            break;
-                        }
-
-                    } // End loop across all hoops.
-
-                } // End loop across all units.
-
-            } else {
-                // If use_hoops is false, then just populate detection.units[unit].hoops[hoop] with true.
-                for (int unit = 0; unit < 4; ++unit) {
-                    for (int hoop = 0; hoop < 4; ++hoop) {
-                        detection.units[unit].hoops[hoop] = true;
-                    }
-                }
-            }
-
-            uchar ID = 0;
             /* Determine correct ID */
-
-            if (detection.max_surpassed) {
+            uchar ID;
+            if (max_surpassed) {
                 // If max has been detected, ID is 128 for max surpassing.
                 ID = 128;
-            } else if (!use_hoops) {
-                // If use_hoops is false, ID is 1 to signify threshold crossing.
-                ID = 1;
+            } else if (classifier == 1) {
+                ID = classify_by_hoops(&hoops[channel_index], this_snippet);
+            } else if (classifier == 2) {
+                ID = classify_by_templates(&hoops[channel_index], this_snippet);
             } else {
-                // If use_hoops is true, ID is either (a) an active unit or (b) just a threshold crossing.
-                // (a) If a unit is active, ID is either 1, 2, 4, or 8 for the unit.
-                for (ushort unit = 0; unit < 4; ++unit) {
-                    if (detection.units[unit].hoops[0] && detection.units[unit].hoops[1] &&
-                            detection.units[unit].hoops[2] && detection.units[unit].hoops[3]) {
-                        ID = (ushort) pow(2.0f, (float) unit);
-                        break;
-                    }
-                }
-
-                // (b) If no unit is active, ID is 64 to signify threshold crossing.
-                if (ID == 0) ID = 64;
+                // Without hoops or templates, ID is 1 to signify threshold crossing.
+                ID = 1;
             }
 
             /* Populate spike with timestamp */